@@ -41,6 +41,8 @@
 
 #cmakedefine ENABLE_TRAFFIC_MONITOR
 
+#cmakedefine HAVE_ZLIB
+
 #cmakedefine ENABLE_HWLOC
 
 #cmakedefine ENABLE_HOST_CPU_DEVICES
@@ -145,6 +145,18 @@ typedef cl_int (CL_API_CALL *clSetKernelArgDevicePointerEXT_fn) (
 /* cl_ext_buffer_device_address (experimental stage) */
 #endif
 
+/* clGetKernelInfo(): A new cl_kernel_info type
+   CL_KERNEL_GROUPS_INDEPENDENT_POCL (cl_bool):
+
+   CL_TRUE if the work-groups of the kernel are known not to observe the rest
+   of its NDRange: neither the kernel nor the functions it calls query the
+   group ids, the number of groups, the global size or the global offset, use
+   atomics or enqueue kernels. A launch of such a kernel can be run as several
+   NDRanges of its own, each a slab of the work-groups at a global offset.
+   CL_FALSE if the kernel uses any of them or the compiler can't tell.
+*/
+#define CL_KERNEL_GROUPS_INDEPENDENT_POCL 0xff10
+
 /***********************************
 * cl_pocl_svm_rect +
 * cl_pocl_command_buffer_svm +
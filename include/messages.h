@@ -50,6 +50,26 @@ extern "C"
 
 #define STRING_TYPE(x) char x[MAX_PACKED_STRING_LEN]
 
+/* Payload codecs, used as a bit mask in the session setup. */
+#define POCL_REMOTE_CODEC_NONE 0
+#define POCL_REMOTE_CODEC_DEFLATE 1
+
+/* An encoded payload is sent as a sequence of blocks, each holding at most
+   POCL_REMOTE_CODEC_BLOCK_SIZE bytes of the raw data. A block whose wire size
+   equals its raw size is stored uncompressed. */
+#define POCL_REMOTE_CODEC_BLOCK_SIZE (256 * 1024)
+
+/* The payload is not sent over the socket at all, but passed in the shared
+   memory window of a same-host session. */
+#define POCL_REMOTE_PAYLOAD_SHM 0x80
+
+/* The payload is split into chunks sent over the extra data connections of
+   the session (see StripeChunkHeader_t) instead of following the message. */
+#define POCL_REMOTE_PAYLOAD_STRIPED 0x40
+
+/* Upper limit for the number of data connections of a session. */
+#define POCL_REMOTE_MAX_STRIPES 16
+
 #define WRITEV_REQ(num, SIZE) writev_req (data, vecs, num, SIZE)
 
 #define CHECK_REPLY(type)                                                     \
@@ -219,6 +239,17 @@ extern "C"
     uint16_t peer_port;
     uint8_t use_rdma;
     uint8_t fast_socket;
+    /* mask of the payload codecs the client supports */
+    uint8_t payload_codecs;
+    /* payloads smaller than this are never encoded */
+    uint32_t codec_threshold;
+    /* number of data connections the client wants to open */
+    uint8_t num_stripes;
+    /* 1-based index of the data connection this handshake is for, 0 for the
+       command and stream sockets */
+    uint8_t stripe;
+    /* size of the chunks striped payloads are split into */
+    uint32_t stripe_chunk;
   } CreateOrAttachSessionMsg_t;
 
   typedef struct __attribute__ ((packed, aligned (8)))
@@ -228,8 +259,46 @@ extern "C"
     uint8_t authkey[AUTHKEY_LENGTH];
     uint16_t peer_port;
     uint8_t use_rdma;
+    /* the payload codec chosen by the server for this session */
+    uint8_t payload_codec;
+    /* set if the server accepts a shared memory window on its local socket */
+    uint8_t shared_memory;
+    /* number of data connections the server accepts for the session */
+    uint8_t num_stripes;
+    /* pid of the server; a same-host client only passes the session
+       credentials to a local socket owned by this process */
+    uint32_t server_pid;
   } CreateOrAttachSessionReply_t;
 
+  /* Sent on the local socket of the server along with a memfd, which the
+     server maps as the shared memory window of the session. The server
+     answers with an int32_t errno value, 0 on success. */
+  typedef struct __attribute__ ((packed, aligned (8))) SharedMemoryAttachMsg_s
+  {
+    uint64_t session;
+    uint8_t authkey[AUTHKEY_LENGTH];
+    uint64_t size;
+  } SharedMemoryAttachMsg_t;
+
+  /* Precedes each chunk of a POCL_REMOTE_PAYLOAD_STRIPED payload on a data
+     connection. The chunks of one payload may arrive in any order and over
+     any of the connections. */
+  typedef struct __attribute__ ((packed, aligned (8))) StripeChunkHeader_s
+  {
+    /* msg_id of the request the payload belongs to */
+    uint64_t msg_id;
+    uint64_t offset;
+    uint64_t size;
+    /* size of the whole payload */
+    uint64_t total;
+  } StripeChunkHeader_t;
+
+  typedef struct __attribute__ ((packed, aligned (4))) CodecBlockHeader_s
+  {
+    uint32_t wire_size;
+    uint32_t raw_size;
+  } CodecBlockHeader_t;
+
   typedef struct __attribute__ ((packed, aligned (8))) DeviceInfo_s
   {
 
@@ -624,6 +693,12 @@ extern "C"
     uint32_t message_type;
     uint64_t obj_id;
     uint32_t cq_id;
+    /* codec of the extra data payload, POCL_REMOTE_CODEC_NONE if raw */
+    uint32_t payload_codec;
+    uint32_t reserved;
+    /* offset of the payload in the shared memory window, if payload_codec is
+       POCL_REMOTE_PAYLOAD_SHM; used for the reply data of reads */
+    uint64_t shm_offset;
 
     union
     {
@@ -720,6 +795,8 @@ extern "C"
     vec3_t reqd_wg_size;
     uint64_t total_local_size;
     uint32_t num_args;
+    /* CL_KERNEL_GROUPS_INDEPENDENT_POCL of the server's kernel. */
+    uint32_t groups_independent;
   } KernelMetaInfo_t;
 
   typedef struct __attribute__ ((packed, aligned (8))) ReplyMsg_s
@@ -745,6 +822,9 @@ extern "C"
     /* The actual strings will be appended after the object as a sequence
        of 0-terminated strings.*/
     uint64_t strings_size;
+    /* codec of the data_size bytes following the reply */
+    uint32_t payload_codec;
+    uint32_t reserved;
 
     // remote server timing data from libOpenCL
     EventTiming_t timing;
@@ -47,6 +47,9 @@ typedef struct dev_image_t {
   INTTYPE _data_type;
   INTTYPE _num_channels;
   INTTYPE _elem_size;
+  /* The tiled layout of the data on the CPU drivers, 0 if it's stored in
+     rows of _row_pitch bytes. See pocl_driver_image_tiling(). */
+  INTTYPE _tiling;
 } dev_image_t;
 
 #endif
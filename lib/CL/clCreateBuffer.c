@@ -291,7 +291,11 @@ ERROR:
     }
 
     if (((flags & CL_MEM_USE_HOST_PTR) == 0) && mem->mem_host_ptr)
-      POCL_MEM_FREE (mem->mem_host_ptr);
+      {
+        size_t align = max (context->min_buffer_alignment, 16);
+        pocl_mem_pool_free (mem->mem_host_ptr, align, mem->size);
+        mem->mem_host_ptr = NULL;
+      }
 
     POCL_MEM_FREE (mem);
   }
@@ -59,6 +59,8 @@ POname(clGetKernelInfo)(cl_kernel      kernel ,
       POCL_RETURN_GETINFO_STR (kernel->meta->attributes);
     else
       POCL_RETURN_GETINFO_STR ("");
+  case CL_KERNEL_GROUPS_INDEPENDENT_POCL:
+    POCL_RETURN_GETINFO (cl_bool, kernel->meta->groups_independent);
   }
   return CL_INVALID_VALUE;
 }
@@ -24,6 +24,17 @@
 
 #include "pocl_util.h"
 
+/* The sub-group size the kernel compiler picks for a local X size, see
+   privatizeContext() in Workgroup.cc. */
+static size_t
+sub_group_size_for_local_x (cl_device_id device, size_t local_x)
+{
+  size_t simd = device->simd_sub_group_size;
+  if (simd > 1 && local_x % simd == 0)
+    return simd;
+  return local_x;
+}
+
 CL_API_ENTRY cl_int CL_API_ENTRY POname (clGetKernelSubGroupInfo) (
     cl_kernel kernel, cl_device_id device, cl_kernel_sub_group_info param_name,
     size_t input_value_size, const void *input_value, size_t param_value_size,
@@ -64,7 +75,8 @@ CL_API_ENTRY cl_int CL_API_ENTRY POname (clGetKernelSubGroupInfo) (
   POCL_RETURN_ERROR_ON ((dev_i == CL_UINT_MAX), CL_INVALID_KERNEL,
                         "the kernel was not built for this device\n");
 
-  if (param_name == CL_KERNEL_MAX_SUB_GROUP_SIZE_FOR_NDRANGE)
+  if (param_name == CL_KERNEL_MAX_SUB_GROUP_SIZE_FOR_NDRANGE
+      || param_name == CL_KERNEL_SUB_GROUP_COUNT_FOR_NDRANGE)
     {
       POCL_RETURN_ERROR_ON ((input_value == NULL
                              || input_value_size < sizeof (size_t)
@@ -84,33 +96,40 @@ CL_API_ENTRY cl_int CL_API_ENTRY POname (clGetKernelSubGroupInfo) (
     /* TODO: this should be a device ops callback */
     case CL_KERNEL_MAX_SUB_GROUP_SIZE_FOR_NDRANGE:
       {
-        /* For now assume SG == WG_x. */
-        POCL_RETURN_GETINFO (size_t, ((size_t *)input_value)[0]);
+        /* For now assume SG == WG_x, or a SIMD vector of it. */
+        POCL_RETURN_GETINFO (
+            size_t,
+            sub_group_size_for_local_x (realdev, ((size_t *)input_value)[0]));
       }
     case CL_KERNEL_SUB_GROUP_COUNT_FOR_NDRANGE:
       {
-        /* For now assume SG == WG_x and thus we have WG_size_y*WG_size_z of
-           them per WG. */
-        POCL_RETURN_GETINFO (size_t,
-                             min (device->max_num_sub_groups,
-                                  (input_value_size > sizeof (size_t)
-                                       ? ((size_t *)input_value)[1]
-                                       : 1)
-                                      * (input_value_size > sizeof (size_t) * 2
-                                             ? ((size_t *)input_value)[2]
-                                             : 1)));
+        /* For now assume SG == WG_x, or a SIMD vector of it, and thus we
+           have WG_x/SG*WG_size_y*WG_size_z of them per WG. */
+        size_t local_x = ((size_t *)input_value)[0];
+        size_t sg_size = sub_group_size_for_local_x (realdev, local_x);
+        POCL_RETURN_GETINFO (
+            size_t,
+            min (device->max_num_sub_groups,
+                 (sg_size ? local_x / sg_size : 1)
+                     * (input_value_size > sizeof (size_t)
+                            ? ((size_t *)input_value)[1]
+                            : 1)
+                     * (input_value_size > sizeof (size_t) * 2
+                            ? ((size_t *)input_value)[2]
+                            : 1)));
       }
     case CL_KERNEL_LOCAL_SIZE_FOR_SUB_GROUP_COUNT:
       {
         POCL_RETURN_ERROR_ON ((input_value == NULL), CL_INVALID_VALUE,
                               "SG size wish not given.");
         size_t n_wish = *(size_t *)input_value;
-        /* For now assume SG == WG_x and the simplest way of looping only at
-           y dimension. Use magic number 32 as the preferred SG size for now.
-         */
+        /* One sub-group per row in y, so X is the sub-group size: the SIMD
+           width with SIMD sub-groups, otherwise the whole row (SG == WG_x)
+           made as wide as the work-group allows. */
+        size_t simd = realdev->simd_sub_group_size;
         size_t nd[3];
-        if (n_wish > device->max_num_sub_groups ||
-            (n_wish > 1 && param_value_size / sizeof(size_t) == 1))
+        if (n_wish == 0 || n_wish > device->max_num_sub_groups
+            || (n_wish > 1 && param_value_size / sizeof (size_t) == 1))
           {
             nd[0] = nd[1] = nd[2] = 0;
             POCL_RETURN_GETINFO_ARRAY (size_t,
@@ -119,7 +138,7 @@ CL_API_ENTRY cl_int CL_API_ENTRY POname (clGetKernelSubGroupInfo) (
           }
         else
           {
-            nd[0] = device->max_work_group_size / n_wish;
+            nd[0] = simd > 1 ? simd : device->max_work_group_size / n_wish;
             nd[1] = n_wish;
             nd[2] = 1;
             POCL_RETURN_GETINFO_ARRAY (size_t,
@@ -23,6 +23,7 @@
    IN THE SOFTWARE.
 */
 
+#include "devices/common.h"
 #include "devices/devices.h"
 #include "pocl_runtime_config.h"
 
@@ -123,6 +124,13 @@ POname(clReleaseContext)(cl_context context) CL_API_SUFFIX__VERSION_1_0
 
       /* see below on why we don't call uninit_devices here anymore */
       --cl_context_count;
+
+      /* no buffers can be alive anymore, return the pooled memory */
+      if (cl_context_count == 0)
+        {
+          pocl_print_system_memory_stats ();
+          pocl_mem_pool_trim ();
+        }
     }
   else
     {
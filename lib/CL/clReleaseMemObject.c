@@ -22,6 +22,7 @@
    IN THE SOFTWARE.
 */
 
+#include "common.h"
 #include "devices.h"
 #include "pocl_cl.h"
 #include "utlist.h"
@@ -150,7 +151,11 @@ POname(clReleaseMemObject)(cl_mem memobj) CL_API_SUFFIX__VERSION_1_0
                 memobj->mem_host_ptr = NULL;
               else
                 {
-                  POCL_MEM_FREE (memobj->mem_host_ptr);
+                  size_t align
+                      = max (memobj->context->min_buffer_alignment, 16);
+                  pocl_mem_pool_free (memobj->mem_host_ptr, align,
+                                      memobj->size);
+                  memobj->mem_host_ptr = NULL;
                 }
             }
         }
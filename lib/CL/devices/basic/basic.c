@@ -360,12 +360,25 @@ pocl_basic_run (void *data, _cl_command_node *cmd)
   unsigned ftz = pocl_save_ftz ();
   pocl_set_ftz (kernel->program->flush_denorms);
 
+  pocl_perf_sample perf_sample, perf_counts = { { 0 } };
+  if (pocl_perf_counters_enabled)
+    pocl_perf_counters_begin (&perf_sample);
+
   for (z = 0; z < pc->num_groups[2]; ++z)
     for (y = 0; y < pc->num_groups[1]; ++y)
       for (x = 0; x < pc->num_groups[0]; ++x)
         ((pocl_workgroup_func) cmd->command.run.wg)
 	  ((uint8_t *)arguments, (uint8_t *)pc, x, y, z);
 
+  if (pocl_perf_counters_enabled)
+    {
+      pocl_perf_counters_end (&perf_sample, &perf_counts);
+      pocl_perf_counters_record (
+          kernel->name, pc->local_size, cmd->command.run.device_data,
+          pc->num_groups[0] * pc->num_groups[1] * pc->num_groups[2],
+          &perf_counts);
+    }
+
   pocl_restore_rm (rm);
   pocl_restore_ftz (ftz);
 
@@ -617,6 +630,17 @@ cl_int pocl_basic_copy_image_rect( void *data,
       region[0], region[1], region[2],
       px);
 
+  if (src_mem_id->extra != 0 || dst_mem_id->extra != 0)
+    {
+      pocl_driver_copy_image_pixels (
+          dst_image, dst_mem_id->extra, dst_mem_id->mem_ptr,
+          dst_image->image_row_pitch, dst_image->image_slice_pitch,
+          dst_origin, src_image, src_mem_id->extra, src_mem_id->mem_ptr,
+          src_image->image_row_pitch, src_image->image_slice_pitch,
+          src_origin, region);
+      return CL_SUCCESS;
+    }
+
   pocl_driver_copy_rect (
       data, dst_mem_id, NULL, src_mem_id, NULL, adj_dst_origin, adj_src_origin,
       adj_region, dst_image->image_row_pitch, dst_image->image_slice_pitch,
@@ -660,6 +684,15 @@ cl_int pocl_basic_write_image_rect (  void *data,
   if (src_slice_pitch == 0)
     src_slice_pitch = src_row_pitch * region[1];
 
+  if (dst_mem_id->extra != 0)
+    {
+      pocl_driver_copy_image_pixels (
+          dst_image, dst_mem_id->extra, dst_mem_id->mem_ptr, 0, 0, origin,
+          dst_image, 0, (char *)ptr, src_row_pitch, src_slice_pitch,
+          zero_origin, region);
+      return CL_SUCCESS;
+    }
+
   const size_t adj_origin[3] = { origin[0] * px, origin[1], origin[2] };
   const size_t adj_region[3] = { region[0] * px, region[1], region[2] };
 
@@ -703,6 +736,16 @@ cl_int pocl_basic_read_image_rect(  void *data,
     dst_row_pitch = px * region[0];
   if (dst_slice_pitch == 0)
     dst_slice_pitch = dst_row_pitch * region[1];
+
+  if (src_mem_id->extra != 0)
+    {
+      pocl_driver_copy_image_pixels (
+          src_image, 0, ptr, dst_row_pitch, dst_slice_pitch, zero_origin,
+          src_image, src_mem_id->extra, src_mem_id->mem_ptr, 0, 0, origin,
+          region);
+      return CL_SUCCESS;
+    }
+
   const size_t adj_origin[3] = { origin[0] * px, origin[1], origin[2] };
   const size_t adj_region[3] = { region[0] * px, region[1], region[2] };
 
@@ -768,23 +811,43 @@ pocl_basic_fill_image (void *data, cl_mem image,
 
   size_t row_pitch = image->image_row_pitch;
   size_t slice_pitch = image->image_slice_pitch;
+  size_t i, j, k;
+
+  /* The pixel sizes of the supported formats are powers of two up to 16
+   * bytes, so the rows can be filled with the fixed size stores of
+   * pocl_fill_aligned_buf_with_pattern instead of a memcpy per pixel. */
+  uint64_t pattern[2];
+  memcpy (pattern, fill_pixel, pixel_size);
+
+  if (image_data->extra != 0)
+    {
+      size_t run;
+      for (k = 0; k < region[2]; ++k)
+        for (j = 0; j < region[1]; ++j)
+          for (i = 0; i < region[0]; i += run)
+            {
+              char *p = pocl_driver_image_pixel (
+                  image, image_data->extra, image_data->mem_ptr, 0, 0,
+                  origin[0] + i, origin[1] + j, origin[2] + k, &run);
+              if (run > region[0] - i)
+                run = region[0] - i;
+              pocl_fill_aligned_buf_with_pattern (p, 0, run * pixel_size,
+                                                  pattern, pixel_size);
+            }
+      return CL_SUCCESS;
+    }
+
   char *__restrict const adjusted_device_ptr
       = (char *)image_data->mem_ptr
         + origin[0] * pixel_size
         + row_pitch * origin[1]
         + slice_pitch * origin[2];
 
-  size_t i, j, k;
-
   for (k = 0; k < region[2]; ++k)
     for (j = 0; j < region[1]; ++j)
-      for (i = 0; i < region[0]; ++i)
-        memcpy (adjusted_device_ptr
-                  + pixel_size * i
-                  + row_pitch * j
-                  + slice_pitch * k,
-                fill_pixel,
-                pixel_size);
+      pocl_fill_aligned_buf_with_pattern (
+          adjusted_device_ptr + row_pitch * j + slice_pitch * k, 0,
+          region[0] * pixel_size, pattern, pixel_size);
   return CL_SUCCESS;
 }
 
@@ -58,6 +58,10 @@
 #include "pocl_util.h"
 #include "common_driver.h"
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 #ifdef HAVE_GETRLIMIT
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -300,6 +304,9 @@ pocl_fill_dev_image_t (dev_image_t *di, struct pocl_argument *parg,
 
   IMAGE1D_TO_BUFFER (mem);
   di->_data = (mem->device_ptrs[device->global_mem_id].mem_ptr);
+  di->_tiling = device->tiled_images
+                    ? mem->device_ptrs[device->global_mem_id].extra
+                    : 0;
 }
 
 /**
@@ -423,6 +430,10 @@ pocl_exec_command (_cl_command_node *node)
               {
                 size_t region[3] = { mem->image_width, mem->image_height,
                                      mem->image_depth };
+                if (mem->type == CL_MEM_OBJECT_IMAGE2D_ARRAY)
+                  region[2] = mem->image_array_size;
+                if (mem->type == CL_MEM_OBJECT_IMAGE1D_ARRAY)
+                  region[1] = mem->image_array_size;
                 if (region[2] == 0)
                   region[2] = 1;
                 if (region[1] == 0)
@@ -432,7 +443,8 @@ pocl_exec_command (_cl_command_node *node)
                 dev->ops->read_image_rect (
                   dev->data, mem,
                   &node->migr_infos->buffer->device_ptrs[dev->global_mem_id],
-                  mem->mem_host_ptr, NULL, origin, region, 0, 0, 0);
+                  mem->mem_host_ptr, NULL, origin, region,
+                  mem->image_row_pitch, mem->image_slice_pitch, 0);
               }
             else
               {
@@ -450,6 +462,10 @@ pocl_exec_command (_cl_command_node *node)
               {
                 size_t region[3] = { mem->image_width, mem->image_height,
                                      mem->image_depth };
+                if (mem->type == CL_MEM_OBJECT_IMAGE2D_ARRAY)
+                  region[2] = mem->image_array_size;
+                if (mem->type == CL_MEM_OBJECT_IMAGE1D_ARRAY)
+                  region[1] = mem->image_array_size;
                 if (region[2] == 0)
                   region[2] = 1;
                 if (region[1] == 0)
@@ -459,7 +475,8 @@ pocl_exec_command (_cl_command_node *node)
                 dev->ops->write_image_rect (
                   dev->data, mem,
                   &node->migr_infos->buffer->device_ptrs[dev->global_mem_id],
-                  mem->mem_host_ptr, NULL, origin, region, 0, 0, 0);
+                  mem->mem_host_ptr, NULL, origin, region,
+                  mem->image_row_pitch, mem->image_slice_pitch, 0);
               }
             else
               {
@@ -878,6 +895,70 @@ pocl_cmd_max_grid_dim_width (_cl_command_run *cmd)
               cmd->pc.local_size[2] * cmd->pc.local_size[2]);
 }
 
+/* Describes the formats of the images and the states of the samplers passed
+   to the kernel of the given run command, for specializing its work-group
+   function to them. Each image argument is written as
+   "-i<arg>.<order>.<data type>.<channels>.<element size>" and each sampler
+   as "-s<arg>.<dev_sampler_t bits>". SPEC is left empty if there's nothing
+   to specialize for, or if the description wouldn't fit. */
+void
+pocl_cmd_image_specialization (_cl_command_run *cmd, cl_device_id dev,
+                               char *spec)
+{
+  pocl_kernel_metadata_t *meta;
+  size_t len = 0;
+  unsigned i;
+
+  spec[0] = 0;
+  /* Only the CPU drivers pass images as dev_image_t. */
+  if (!(dev->type & CL_DEVICE_TYPE_CPU) || !dev->image_support
+      || cmd->kernel == NULL || cmd->arguments == NULL)
+    return;
+
+  meta = cmd->kernel->meta;
+  for (i = 0; i < meta->num_args; ++i)
+    {
+      struct pocl_argument *al = &cmd->arguments[i];
+      int written;
+
+      if (meta->arg_info[i].type == POCL_ARG_TYPE_IMAGE)
+        {
+          cl_mem mem;
+          int num_channels, elem_size;
+          if (al->value == NULL)
+            goto NONE;
+          mem = *(cl_mem *)al->value;
+          pocl_get_image_information (mem->image_channel_order,
+                                      mem->image_channel_data_type,
+                                      &num_channels, &elem_size);
+          written = snprintf (spec + len, POCL_IMAGE_SPEC_LENGTH - len,
+                              "-i%u.%x.%x.%d.%d", i,
+                              (unsigned)mem->image_channel_order,
+                              (unsigned)mem->image_channel_data_type,
+                              num_channels, elem_size);
+        }
+      else if (meta->arg_info[i].type == POCL_ARG_TYPE_SAMPLER)
+        {
+          dev_sampler_t ds;
+          if (al->value == NULL)
+            goto NONE;
+          pocl_fill_dev_sampler_t (&ds, al);
+          written = snprintf (spec + len, POCL_IMAGE_SPEC_LENGTH - len,
+                              "-s%u.%lx", i, (unsigned long)ds);
+        }
+      else
+        continue;
+
+      if (written < 0 || len + written >= POCL_IMAGE_SPEC_LENGTH)
+        goto NONE;
+      len += written;
+    }
+  return;
+
+NONE:
+  spec[0] = 0;
+}
+
 
 /* CPU driver stuff */
 
@@ -896,6 +977,8 @@ struct pocl_dlhandle_cache_item
   int specialize;
   /* Maximum grid dimension this WG function works with. */
   size_t max_grid_dim_width;
+  /* The image formats and sampler states it was specialized to. */
+  char image_spec[POCL_IMAGE_SPEC_LENGTH];
 
   void *wg;
   void *dlhandle;
@@ -1062,10 +1145,14 @@ pocl_check_kernel_disk_cache (_cl_command_node *command, int specialized)
    and return it. Otherwise return NULL. The caller should hold
    pocl_dlhandle_lock. */
 static pocl_dlhandle_cache_item *
-fetch_dlhandle_cache_item (_cl_command_run *run_cmd, int specialize)
+fetch_dlhandle_cache_item (_cl_command_run *run_cmd, cl_device_id device,
+                           int specialize)
 {
   pocl_dlhandle_cache_item *ci = NULL, *tmp = NULL;
   size_t max_grid_width = pocl_cmd_max_grid_dim_width (run_cmd);
+  char image_spec[POCL_IMAGE_SPEC_LENGTH] = "";
+  if (specialize)
+    pocl_cmd_image_specialization (run_cmd, device, image_spec);
   DL_FOREACH_SAFE (pocl_dlhandle_cache, ci, tmp)
   {
     if ((memcmp (ci->hash, run_cmd->hash, sizeof (pocl_kernel_hash_t)) == 0)
@@ -1076,7 +1163,8 @@ fetch_dlhandle_cache_item (_cl_command_run *run_cmd, int specialize)
         && (ci->specialize == specialize)
         && (ci->goffs_zero == (run_cmd->pc.global_offset[0] == 0
                 && run_cmd->pc.global_offset[1] == 0
-                && run_cmd->pc.global_offset[2] == 0)))
+                && run_cmd->pc.global_offset[2] == 0))
+        && (strcmp (ci->image_spec, image_spec) == 0))
       {
         /* move to the front of the line */
         DL_DELETE (pocl_dlhandle_cache, ci);
@@ -1119,7 +1207,7 @@ pocl_check_kernel_dlhandle_cache (_cl_command_node *command,
     specialize = 0;
 
   POCL_LOCK (pocl_dlhandle_lock);
-  ci = fetch_dlhandle_cache_item (run_cmd, specialize);
+  ci = fetch_dlhandle_cache_item (run_cmd, command->device, specialize);
   if (ci != NULL)
     {
       if (retain) ++ci->ref_count;
@@ -1141,6 +1229,8 @@ pocl_check_kernel_dlhandle_cache (_cl_command_node *command,
 
   size_t max_grid_width = pocl_cmd_max_grid_dim_width (run_cmd);
   ci->max_grid_dim_width = max_grid_width;
+  if (specialize)
+    pocl_cmd_image_specialization (run_cmd, command->device, ci->image_spec);
 
   char *module_fn = pocl_check_kernel_disk_cache (command, specialize);
 
@@ -1355,6 +1445,261 @@ pocl_set_buffer_image_limits(cl_device_id device)
 
 }
 
+/* Size-class pool for the buffer backing memory (mem_host_ptr) which is
+ * also the global memory of the CPU devices. Freed blocks are kept in
+ * per-class free lists (up to a limit) and handed out again, which avoids
+ * the page fault & zeroing cost of fresh mappings for applications that
+ * create and release many temporary buffers. Larger blocks can be backed
+ * by transparent or explicit (hugetlbfs) huge pages. */
+
+/* allocations smaller than this are left to malloc */
+#define MEM_POOL_MIN_SHIFT 16
+/* size classes are spaced by 1/4 of a power of two */
+#define MEM_POOL_CLASSES_PER_DOUBLING 4
+#define MEM_POOL_NUM_CLASSES                                                  \
+  ((sizeof (size_t) * 8 - MEM_POOL_MIN_SHIFT) * MEM_POOL_CLASSES_PER_DOUBLING)
+#define MEM_POOL_HUGEPAGE_SIZE (2 * 1024 * 1024)
+#define MEM_POOL_PAGE_SIZE 4096
+
+enum mem_pool_hugepages
+{
+  MEM_POOL_HUGEPAGES_NONE = 0,
+  MEM_POOL_HUGEPAGES_TRANSPARENT,
+  MEM_POOL_HUGEPAGES_EXPLICIT
+};
+
+typedef struct mem_pool_block mem_pool_block;
+struct mem_pool_block
+{
+  mem_pool_block *next;
+};
+
+typedef struct
+{
+  pocl_lock_t lock;
+  int initialized;
+  int enabled;
+  int hugepages;
+  size_t max_cached;
+  size_t cached;
+  mem_pool_block *free_lists[MEM_POOL_NUM_CLASSES];
+
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t released;
+  uint64_t hugepage_allocs;
+  uint64_t currently_allocated;
+  uint64_t max_ever_allocated;
+} pocl_mem_pool_t;
+
+static pocl_mem_pool_t mem_pool = { POCL_LOCK_INITIALIZER };
+
+/* call with mem_pool.lock held */
+static void
+pocl_mem_pool_init_unlocked ()
+{
+  if (mem_pool.initialized)
+    return;
+
+  mem_pool.enabled = pocl_get_bool_option ("POCL_MEM_POOL", 1);
+  mem_pool.max_cached
+      = (size_t)pocl_get_int_option ("POCL_MEM_POOL_MAX_CACHED", 512) << 20;
+
+  const char *hp
+      = pocl_get_string_option ("POCL_MEM_POOL_HUGEPAGES", "transparent");
+  if (strcmp (hp, "explicit") == 0)
+    mem_pool.hugepages = MEM_POOL_HUGEPAGES_EXPLICIT;
+  else if (strcmp (hp, "transparent") == 0)
+    mem_pool.hugepages = MEM_POOL_HUGEPAGES_TRANSPARENT;
+  else
+    mem_pool.hugepages = MEM_POOL_HUGEPAGES_NONE;
+
+  mem_pool.initialized = 1;
+}
+
+/* Returns the size class index of size, and the rounded-up size
+ * of the class in *class_size. */
+static unsigned
+pocl_mem_pool_size_class (size_t size, size_t *class_size)
+{
+  unsigned shift = MEM_POOL_MIN_SHIFT;
+  while (shift < (sizeof (size_t) * 8 - 1) && (size >> (shift + 1)) != 0)
+    ++shift;
+
+  size_t step = (size_t)1 << (shift - 2);
+  size_t rounded = (size + step - 1) & ~(step - 1);
+  if ((rounded >> (shift + 1)) != 0)
+    {
+      ++shift;
+      step <<= 1;
+    }
+  *class_size = rounded;
+  return (shift - MEM_POOL_MIN_SHIFT) * MEM_POOL_CLASSES_PER_DOUBLING
+         + (unsigned)(rounded >> (shift - 2)) - MEM_POOL_CLASSES_PER_DOUBLING;
+}
+
+/* the length of the mapping backing a block of the given class size */
+static size_t
+pocl_mem_pool_mapping_size (size_t class_size)
+{
+  if (mem_pool.hugepages == MEM_POOL_HUGEPAGES_EXPLICIT
+      && class_size >= MEM_POOL_HUGEPAGE_SIZE)
+    return (class_size + MEM_POOL_HUGEPAGE_SIZE - 1)
+           & ~((size_t)MEM_POOL_HUGEPAGE_SIZE - 1);
+  return class_size;
+}
+
+static void *
+pocl_mem_pool_map (size_t class_size)
+{
+  size_t map_size = pocl_mem_pool_mapping_size (class_size);
+#ifdef __linux__
+  void *ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (mem_pool.hugepages == MEM_POOL_HUGEPAGES_EXPLICIT
+      && class_size >= MEM_POOL_HUGEPAGE_SIZE)
+    {
+      ptr = mmap (NULL, map_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (ptr != MAP_FAILED)
+        ++mem_pool.hugepage_allocs;
+    }
+#endif
+  if (ptr == MAP_FAILED)
+    {
+      ptr = mmap (NULL, map_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (ptr == MAP_FAILED)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+      if (mem_pool.hugepages != MEM_POOL_HUGEPAGES_NONE
+          && map_size >= MEM_POOL_HUGEPAGE_SIZE)
+        {
+          if (madvise (ptr, map_size, MADV_HUGEPAGE) == 0)
+            ++mem_pool.hugepage_allocs;
+        }
+#endif
+    }
+  return ptr;
+#else
+  return pocl_aligned_malloc (MEM_POOL_PAGE_SIZE, map_size);
+#endif
+}
+
+static void
+pocl_mem_pool_unmap (void *ptr, size_t class_size)
+{
+#ifdef __linux__
+  munmap (ptr, pocl_mem_pool_mapping_size (class_size));
+#else
+  pocl_aligned_free (ptr);
+#endif
+}
+
+void *
+pocl_mem_pool_alloc (size_t align, size_t size)
+{
+  POCL_LOCK (mem_pool.lock);
+  pocl_mem_pool_init_unlocked ();
+  if (!mem_pool.enabled || (size >> MEM_POOL_MIN_SHIFT) == 0
+      || align > MEM_POOL_PAGE_SIZE)
+    {
+      POCL_UNLOCK (mem_pool.lock);
+      return pocl_aligned_malloc (align, size);
+    }
+
+  size_t class_size;
+  unsigned c = pocl_mem_pool_size_class (size, &class_size);
+  void *ptr = NULL;
+  if (mem_pool.free_lists[c] != NULL)
+    {
+      mem_pool_block *b = mem_pool.free_lists[c];
+      mem_pool.free_lists[c] = b->next;
+      mem_pool.cached -= class_size;
+      ++mem_pool.hits;
+      ptr = b;
+    }
+  else
+    {
+      ptr = pocl_mem_pool_map (class_size);
+      ++mem_pool.misses;
+    }
+
+  if (ptr)
+    {
+      mem_pool.currently_allocated += class_size;
+      if (mem_pool.max_ever_allocated < mem_pool.currently_allocated)
+        mem_pool.max_ever_allocated = mem_pool.currently_allocated;
+    }
+  POCL_UNLOCK (mem_pool.lock);
+
+  return ptr;
+}
+
+void
+pocl_mem_pool_free (void *ptr, size_t align, size_t size)
+{
+  if (ptr == NULL)
+    return;
+
+  POCL_LOCK (mem_pool.lock);
+  assert (mem_pool.initialized);
+  /* the same test as in pocl_mem_pool_alloc (): these blocks didn't come
+   * from the pool and are smaller than their size class */
+  if (!mem_pool.enabled || (size >> MEM_POOL_MIN_SHIFT) == 0
+      || align > MEM_POOL_PAGE_SIZE)
+    {
+      POCL_UNLOCK (mem_pool.lock);
+      pocl_aligned_free (ptr);
+      return;
+    }
+
+  size_t class_size;
+  unsigned c = pocl_mem_pool_size_class (size, &class_size);
+  assert (mem_pool.currently_allocated >= class_size);
+  mem_pool.currently_allocated -= class_size;
+
+  if (mem_pool.cached + class_size <= mem_pool.max_cached)
+    {
+      mem_pool_block *b = (mem_pool_block *)ptr;
+      b->next = mem_pool.free_lists[c];
+      mem_pool.free_lists[c] = b;
+      mem_pool.cached += class_size;
+      ptr = NULL;
+    }
+  else
+    ++mem_pool.released;
+  POCL_UNLOCK (mem_pool.lock);
+
+  if (ptr)
+    pocl_mem_pool_unmap (ptr, class_size);
+}
+
+void
+pocl_mem_pool_trim ()
+{
+  unsigned c;
+  POCL_LOCK (mem_pool.lock);
+  for (c = 0; c < MEM_POOL_NUM_CLASSES; ++c)
+    {
+      /* reconstruct the class size from the index */
+      unsigned shift = MEM_POOL_MIN_SHIFT + c / MEM_POOL_CLASSES_PER_DOUBLING;
+      size_t class_size = ((size_t)(MEM_POOL_CLASSES_PER_DOUBLING
+                                    + c % MEM_POOL_CLASSES_PER_DOUBLING))
+                          << (shift - 2);
+      while (mem_pool.free_lists[c] != NULL)
+        {
+          mem_pool_block *b = mem_pool.free_lists[c];
+          mem_pool.free_lists[c] = b->next;
+          mem_pool.cached -= class_size;
+          ++mem_pool.released;
+          pocl_mem_pool_unmap (b, class_size);
+        }
+    }
+  assert (mem_pool.cached == 0);
+  POCL_UNLOCK (mem_pool.lock);
+}
+
 void*
 pocl_aligned_malloc_global_mem(cl_device_id device, size_t align, size_t size)
 {
@@ -1365,7 +1710,7 @@ pocl_aligned_malloc_global_mem(cl_device_id device, size_t align, size_t size)
   if ((mem->total_alloc_limit - mem->currently_allocated) < size)
     goto ERROR;
 
-  retval = pocl_aligned_malloc (align, size);
+  retval = pocl_mem_pool_alloc (align, size);
   if (!retval)
     goto ERROR;
 
@@ -1381,7 +1726,8 @@ ERROR:
 }
 
 void
-pocl_free_global_mem(cl_device_id device, void* ptr, size_t size)
+pocl_free_global_mem (cl_device_id device, void *ptr, size_t align,
+                      size_t size)
 {
   pocl_global_mem_t *mem = device->global_memory;
 
@@ -1390,7 +1736,7 @@ pocl_free_global_mem(cl_device_id device, void* ptr, size_t size)
   mem->currently_allocated -= size;
   POCL_UNLOCK (mem->pocl_lock);
 
-  POCL_MEM_FREE(ptr);
+  pocl_mem_pool_free (ptr, align, size);
 }
 
 
@@ -1405,6 +1751,28 @@ pocl_print_system_memory_stats()
                     system_memory.total_alloc_limit >> 10,
                     system_memory.currently_allocated >> 10,
                     system_memory.max_ever_allocated >> 10);
+
+  POCL_LOCK (mem_pool.lock);
+  if (mem_pool.enabled)
+    POCL_MSG_PRINT_F (MEMORY, INFO, "",
+                      "____ Buffer pool currently used     : %10" PRIu64
+                      " KB\n"
+                      " ____ Buffer pool max used           : %10" PRIu64
+                      " KB\n"
+                      " ____ Buffer pool cached free blocks : %10" PRIu64
+                      " KB\n"
+                      " ____ Buffer pool hits / misses      : %10" PRIu64
+                      " / %" PRIu64 "\n"
+                      " ____ Buffer pool blocks released    : %10" PRIu64
+                      "\n"
+                      " ____ Buffer pool hugepage mappings  : %10" PRIu64
+                      "\n",
+                      mem_pool.currently_allocated >> 10,
+                      mem_pool.max_ever_allocated >> 10,
+                      (uint64_t)mem_pool.cached >> 10, mem_pool.hits,
+                      mem_pool.misses, mem_pool.released,
+                      mem_pool.hugepage_allocs);
+  POCL_UNLOCK (mem_pool.lock);
 }
 
 /* default WG size in each dimension & total WG size.
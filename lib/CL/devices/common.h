@@ -87,6 +87,14 @@ char *pocl_check_kernel_disk_cache (_cl_command_node *cmd, int specialized);
 POCL_EXPORT
 size_t pocl_cmd_max_grid_dim_width (_cl_command_run *cmd);
 
+/* The maximum length of the string pocl_cmd_image_specialization()
+   describes the image arguments of a command with. */
+#define POCL_IMAGE_SPEC_LENGTH 128
+
+POCL_EXPORT
+void pocl_cmd_image_specialization (_cl_command_run *cmd, cl_device_id dev,
+                                    char *spec);
+
 POCL_EXPORT
 void *pocl_check_kernel_dlhandle_cache (_cl_command_node *command,
                                         int retain,
@@ -108,10 +116,23 @@ POCL_EXPORT
 void* pocl_aligned_malloc_global_mem(cl_device_id device, size_t align, size_t size);
 
 POCL_EXPORT
-void pocl_free_global_mem(cl_device_id device, void *ptr, size_t size);
+void pocl_free_global_mem (cl_device_id device, void *ptr, size_t align,
+                           size_t size);
 
 void pocl_print_system_memory_stats();
 
+/* Pooled allocation of buffer backing memory. The alignment and size
+ * given to free must be the ones given to alloc. */
+POCL_EXPORT
+void *pocl_mem_pool_alloc (size_t align, size_t size);
+
+POCL_EXPORT
+void pocl_mem_pool_free (void *ptr, size_t align, size_t size);
+
+/* Returns all the cached free blocks to the OS. */
+POCL_EXPORT
+void pocl_mem_pool_trim ();
+
 POCL_EXPORT
 void pocl_init_default_device_infos (cl_device_id dev,
                                      const char *device_extensions);
@@ -464,6 +464,52 @@ pocl_driver_free_mapping_ptr (void *data, pocl_mem_identifier *mem_id,
   return CL_SUCCESS;
 }
 
+/* The tiled layout is encoded as the log2 of the tile width, height and
+ * depth in bits 0-3, 4-7 and 8-11. The tiles are stored one after another
+ * in row-major order, and the pixels in a tile likewise. The layers of 2D
+ * image arrays are one pixel deep tiles, so an array is a stack of tiled
+ * 2D images. */
+#define TILE_SHIFT_X(t) ((t)&0xf)
+#define TILE_SHIFT_Y(t) (((t) >> 4) & 0xf)
+#define TILE_SHIFT_Z(t) (((t) >> 8) & 0xf)
+
+uint64_t
+pocl_driver_image_tiling (cl_device_id device, cl_mem image)
+{
+  if (!device->tiled_images || !image->is_image || image->buffer != NULL
+      || (image->flags & CL_MEM_USE_HOST_PTR))
+    return 0;
+
+  /* An 8x8 tile of even the largest, 16 byte pixels spans 1KiB, so the
+   * 2D neighbourhood of a pixel stays within a few cache lines. 3D images
+   * use 4x4x4 tiles to keep the neighbours in z close as well. */
+  switch (image->type)
+    {
+    case CL_MEM_OBJECT_IMAGE2D:
+    case CL_MEM_OBJECT_IMAGE2D_ARRAY:
+      return 3 | (3 << 4);
+    case CL_MEM_OBJECT_IMAGE3D:
+      return 2 | (2 << 4) | (2 << 8);
+    default:
+      return 0;
+    }
+}
+
+static size_t
+tiled_image_size (cl_mem image, uint64_t tiling)
+{
+  size_t sx = TILE_SHIFT_X (tiling), sy = TILE_SHIFT_Y (tiling),
+         sz = TILE_SHIFT_Z (tiling);
+  size_t layers = image->type == CL_MEM_OBJECT_IMAGE3D
+                      ? image->image_depth
+                      : max (image->image_array_size, 1);
+  size_t tiles_x = (image->image_width + (1 << sx) - 1) >> sx;
+  size_t tiles_y = (image->image_height + (1 << sy) - 1) >> sy;
+  size_t tiles_z = (layers + (1 << sz) - 1) >> sz;
+  size_t px = image->image_elem_size * image->image_channels;
+  return ((tiles_x * tiles_y * tiles_z) << (sx + sy + sz)) * px;
+}
+
 cl_int
 pocl_driver_alloc_mem_obj (cl_device_id device, cl_mem mem, void *host_ptr)
 {
@@ -473,6 +519,19 @@ pocl_driver_alloc_mem_obj (cl_device_id device, cl_mem mem, void *host_ptr)
   if ((mem->flags & CL_MEM_ALLOC_HOST_PTR) && (mem->mem_host_ptr == NULL))
     return CL_MEM_OBJECT_ALLOCATION_FAILURE;
 
+  /* Tiled images get storage of their own, which the implicit migrations
+   * convert to and from the row layout of mem_host_ptr. */
+  uint64_t tiling = pocl_driver_image_tiling (device, mem);
+  void *tiled_ptr = NULL;
+  size_t tiled_size = 0;
+  if (tiling != 0)
+    {
+      tiled_size = tiled_image_size (mem, tiling);
+      tiled_ptr = pocl_aligned_malloc (MAX_EXTENDED_ALIGNMENT, tiled_size);
+      if (tiled_ptr == NULL)
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+
   /* malloc mem_host_ptr then increase refcount */
   pocl_alloc_or_retain_mem_host_ptr (mem);
 
@@ -483,6 +542,17 @@ pocl_driver_alloc_mem_obj (cl_device_id device, cl_mem mem, void *host_ptr)
   if (svm_dev && svm_dev->global_mem_id == 0 && svm_dev->ops->svm_register)
     svm_dev->ops->svm_register (svm_dev, mem->mem_host_ptr, mem->size);
 
+  if (tiled_ptr != NULL)
+    {
+      p->version = 0;
+      p->mem_ptr = tiled_ptr;
+      p->device_addr = p->mem_ptr;
+      p->extra = tiling;
+      POCL_MSG_PRINT_MEMORY ("Basic device ALLOC tiled image %p / size %zu\n",
+                             p->mem_ptr, tiled_size);
+      return CL_SUCCESS;
+    }
+
   p->version = mem->mem_host_ptr_version;
   p->mem_ptr = mem->mem_host_ptr;
   p->device_addr = p->mem_ptr;
@@ -506,11 +576,70 @@ pocl_driver_free (cl_device_id device, cl_mem mem)
     svm_dev->ops->svm_unregister (svm_dev, mem->mem_host_ptr, mem->size);
 
   pocl_mem_identifier *p = &mem->device_ptrs[device->global_mem_id];
+  if (p->extra != 0)
+    {
+      pocl_aligned_free (p->mem_ptr);
+      p->extra = 0;
+    }
   pocl_release_mem_host_ptr (mem);
   p->mem_ptr = NULL;
   p->version = 0;
 }
 
+char *
+pocl_driver_image_pixel (cl_mem image, uint64_t tiling, char *base,
+                         size_t row_pitch, size_t slice_pitch, size_t x,
+                         size_t y, size_t z, size_t *run)
+{
+  size_t px = image->image_elem_size * image->image_channels;
+  if (tiling == 0)
+    {
+      *run = SIZE_MAX;
+      return base + x * px + y * row_pitch + z * slice_pitch;
+    }
+
+  size_t sx = TILE_SHIFT_X (tiling), sy = TILE_SHIFT_Y (tiling),
+         sz = TILE_SHIFT_Z (tiling);
+  size_t mx = (1 << sx) - 1, my = (1 << sy) - 1, mz = (1 << sz) - 1;
+  size_t tiles_x = (image->image_width + mx) >> sx;
+  size_t tiles_y = (image->image_height + my) >> sy;
+  size_t tile = ((z >> sz) * tiles_y + (y >> sy)) * tiles_x + (x >> sx);
+  size_t index = (tile << (sx + sy + sz)) + ((z & mz) << (sx + sy))
+                 + ((y & my) << sx) + (x & mx);
+  *run = (mx + 1) - (x & mx);
+  return base + index * px;
+}
+
+void
+pocl_driver_copy_image_pixels (
+    cl_mem dst_image, uint64_t dst_tiling, char *dst, size_t dst_row_pitch,
+    size_t dst_slice_pitch, const size_t *dst_origin, cl_mem src_image,
+    uint64_t src_tiling, char *src, size_t src_row_pitch,
+    size_t src_slice_pitch, const size_t *src_origin, const size_t *region)
+{
+  size_t px = dst_image->image_elem_size * dst_image->image_channels;
+  size_t i, j, k;
+
+  /* Copy each row in pieces that are contiguous on both sides. */
+  for (k = 0; k < region[2]; ++k)
+    for (j = 0; j < region[1]; ++j)
+      for (i = 0; i < region[0];)
+        {
+          size_t dst_run, src_run;
+          char *d = pocl_driver_image_pixel (
+              dst_image, dst_tiling, dst, dst_row_pitch, dst_slice_pitch,
+              dst_origin[0] + i, dst_origin[1] + j, dst_origin[2] + k,
+              &dst_run);
+          char *s = pocl_driver_image_pixel (
+              src_image, src_tiling, src, src_row_pitch, src_slice_pitch,
+              src_origin[0] + i, src_origin[1] + j, src_origin[2] + k,
+              &src_run);
+          size_t n = min (region[0] - i, min (dst_run, src_run));
+          memmove (d, s, n * px);
+          i += n;
+        }
+}
+
 void
 pocl_driver_svm_fill (cl_device_id dev, void *__restrict__ svm_ptr,
                       size_t size, void *__restrict__ pattern,
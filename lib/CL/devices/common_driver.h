@@ -84,6 +84,29 @@ pocl_driver_alloc_mem_obj (cl_device_id device, cl_mem mem, void *host_ptr);
 POCL_EXPORT
 void pocl_driver_free (cl_device_id device, cl_mem mem);
 
+/* Returns the tiled layout the CPU drivers store the image in on the device,
+ * or 0 if it's stored in rows. The layout is kept in the extra field of the
+ * image's pocl_mem_identifier and in the _tiling field of dev_image_t. */
+POCL_EXPORT
+uint64_t pocl_driver_image_tiling (cl_device_id device, cl_mem image);
+
+/* Returns the address of pixel (x, y, z) of an image stored at base with the
+ * given tiling, or in rows of the given pitches if tiling is 0. Sets *run to
+ * the number of pixels starting from it that are contiguous in memory. */
+POCL_EXPORT
+char *pocl_driver_image_pixel (cl_mem image, uint64_t tiling, char *base,
+                               size_t row_pitch, size_t slice_pitch, size_t x,
+                               size_t y, size_t z, size_t *run);
+
+/* Copies a region of pixels between two images, or an image and host
+ * memory, of which at least one is tiled. */
+POCL_EXPORT
+void pocl_driver_copy_image_pixels (
+    cl_mem dst_image, uint64_t dst_tiling, char *dst, size_t dst_row_pitch,
+    size_t dst_slice_pitch, const size_t *dst_origin, cl_mem src_image,
+    uint64_t src_tiling, char *src, size_t src_row_pitch,
+    size_t src_slice_pitch, const size_t *src_origin, const size_t *region);
+
 POCL_EXPORT
 void pocl_driver_svm_fill (cl_device_id dev,
                            void *__restrict__ svm_ptr,
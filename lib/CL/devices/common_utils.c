@@ -127,11 +127,22 @@ pocl_cpu_init_common (cl_device_id device)
 
       /* Just an arbitrary number here based on assumption of SG size 32. */
       device->max_num_sub_groups = device->max_work_group_size / 32;
+
+      /* Map the sub-groups to the 32-bit lanes of the SIMD unit. */
+      if (pocl_get_bool_option ("POCL_CPU_SIMD_SUB_GROUPS", 0)
+          && device->native_vector_width_int > 1)
+        {
+          device->simd_sub_group_size = device->native_vector_width_int;
+          device->max_num_sub_groups
+              = device->max_work_group_size / device->simd_sub_group_size;
+        }
     }
 
   /* 0 is the host memory shared with all drivers that use it */
   device->global_mem_id = 0;
 
+  device->tiled_images = pocl_get_bool_option ("POCL_CPU_TILED_IMAGES", 0);
+
   device->version_of_latest_passed_cts = HOST_DEVICE_LATEST_CTS_PASS;
   device->extensions = HOST_DEVICE_EXTENSIONS;
 
@@ -29,6 +29,7 @@
 #include "pocl_cl.h"
 #include "pocl_util.h"
 #include "pocl_context.h"
+#include "pocl_perf_counters.h"
 #include "pocl_workgroup_func.h"
 
 /* Generic struct for CPU device drivers.
@@ -58,6 +59,9 @@ struct kernel_run_command
 
   struct pocl_context pc __attribute__ ((aligned (HOST_CPU_CACHELINE_SIZE)));
 
+  /* hardware counts of all the threads, if POCL_TRACING=perf */
+  pocl_perf_sample perf_counts;
+
 } __attribute__ ((aligned (HOST_CPU_CACHELINE_SIZE)));
 
 #ifdef __cplusplus
@@ -0,0 +1,534 @@
+/* printf_deferred.c - host-side formatting of deferred kernel printf records
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "printf_deferred.h"
+
+/* The format string parsing and its error codes follow
+ * __pocl_printf_format_full() in lib/kernel/printf.c, so that both paths
+ * accept the same formats and report the same errors. The conversions
+ * themselves are done with the C library's snprintf. */
+
+#define RECORD_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+#define ERROR_STRING " printf format string error: 0x"
+
+#define ERROR_NULL_AFTER_FORMAT_SIGN 0x11
+#define ERROR_REPEATED_FLAG_MINUS 0x12
+#define ERROR_REPEATED_FLAG_PLUS 0x13
+#define ERROR_REPEATED_FLAG_SPACE 0x14
+#define ERROR_REPEATED_FLAG_SHARP 0x15
+#define ERROR_REPEATED_FLAG_ZERO 0x16
+#define ERROR_FIELD_WIDTH_ZERO 0x17
+#define ERROR_FIELD_WIDTH_OVERFLOW 0x18
+#define ERROR_PRECISION_OVERFLOW 0x19
+#define ERROR_VECTOR_LENGTH_ZERO 0x20
+#define ERROR_VECTOR_LENGTH_OVERFLOW 0x21
+#define ERROR_VECTOR_LENGTH_UNKNOWN 0x22
+#define ERROR_VECTOR_LENGTH_WITHOUT_ELEMENT_SIZE 0x23
+#define ERROR_HL_MODIFIER_USED_WITHOUT_VECTOR_LENGTH 0x24
+#define ERROR_C_CONVERSION_SPECIFIER 0x25
+#define ERROR_FLAGS_WITH_S_CONVERSION_SPECIFIER 0x26
+#define ERROR_VECTOR_LENGTH_WITH_S_CONVERSION_SPECIFIER 0x27
+#define ERROR_LENGTH_MODIFIER_WITH_S_CONVERSION_SPECIFIER 0x28
+#define ERROR_FLAGS_WITH_P_CONVERSION_SPECIFIER 0x29
+#define ERROR_PRECISION_WITH_P_CONVERSION_SPECIFIER 0x30
+#define ERROR_VECTOR_LENGTH_WITH_P_CONVERSION_SPECIFIER 0x31
+#define ERROR_LENGTH_MODIFIER_WITH_P_CONVERSION_SPECIFIER 0x32
+#define ERROR_UNKNOWN_CONVERSION_SPECIFIER 0x33
+/* the device side doesn't support half floats either */
+#define ERROR_HALF_FLOAT 0x00
+
+typedef struct
+{
+  /* the not yet consumed argument bytes of the record */
+  const char *args;
+  size_t left;
+  pocl_printf_emit_fn emit;
+  void *user_data;
+} format_state_t;
+
+static int
+take_arg (format_state_t *st, void *dst, size_t size)
+{
+  size_t padded = RECORD_ALIGN (size);
+  if (padded > st->left)
+    return 0;
+  memcpy (dst, st->args, size);
+  st->args += padded;
+  st->left -= padded;
+  return 1;
+}
+
+static void
+emit_formatted (format_state_t *st, const char *spec, ...)
+{
+  char small[256];
+  va_list ap, ap2;
+
+  va_start (ap, spec);
+  va_copy (ap2, ap);
+  int n = vsnprintf (small, sizeof (small), spec, ap);
+  if (n >= 0 && (size_t)n < sizeof (small))
+    st->emit (small, (size_t)n, st->user_data);
+  else if (n > 0)
+    {
+      char *big = malloc ((size_t)n + 1);
+      if (big != NULL)
+        {
+          vsnprintf (big, (size_t)n + 1, spec, ap2);
+          st->emit (big, (size_t)n, st->user_data);
+          free (big);
+        }
+    }
+  va_end (ap2);
+  va_end (ap);
+}
+
+/* Formats one record. Returns early, without output for the rest of the
+ * format, if the record runs out of arguments. */
+static void
+format_record (format_state_t *st, const char *format)
+{
+  unsigned errcode = 0;
+
+  while (*format)
+    {
+      const char *pct = strchr (format, '%');
+      size_t literal = pct ? (size_t)(pct - format) : strlen (format);
+      if (literal > 0)
+        st->emit (format, literal, st->user_data);
+      if (pct == NULL)
+        return;
+      format = pct + 1;
+
+      char ch = *format++;
+      if (ch == 0)
+        {
+          errcode = ERROR_NULL_AFTER_FORMAT_SIGN;
+          goto error;
+        }
+      if (ch == '%')
+        {
+          st->emit ("%", 1, st->user_data);
+          continue;
+        }
+
+      int align_left = 0, always_sign = 0, space = 0, alt = 0, zero = 0;
+      for (;;)
+        {
+          switch (ch)
+            {
+            case '-':
+              if (align_left)
+                {
+                  errcode = ERROR_REPEATED_FLAG_MINUS;
+                  goto error;
+                }
+              align_left = 1;
+              break;
+            case '+':
+              if (always_sign)
+                {
+                  errcode = ERROR_REPEATED_FLAG_PLUS;
+                  goto error;
+                }
+              always_sign = 1;
+              break;
+            case ' ':
+              if (space)
+                {
+                  errcode = ERROR_REPEATED_FLAG_SPACE;
+                  goto error;
+                }
+              space = 1;
+              break;
+            case '#':
+              if (alt)
+                {
+                  errcode = ERROR_REPEATED_FLAG_SHARP;
+                  goto error;
+                }
+              alt = 1;
+              break;
+            case '0':
+              if (zero)
+                {
+                  errcode = ERROR_REPEATED_FLAG_ZERO;
+                  goto error;
+                }
+              if (!align_left)
+                zero = 1;
+              break;
+            default:
+              goto flags_done;
+            }
+          ch = *format++;
+        }
+    flags_done:;
+
+      int field_width = 0;
+      while (ch >= '0' && ch <= '9')
+        {
+          if (ch == '0' && field_width == 0)
+            {
+              errcode = ERROR_FIELD_WIDTH_ZERO;
+              goto error;
+            }
+          if (field_width > (INT_MAX - 9) / 10)
+            {
+              errcode = ERROR_FIELD_WIDTH_OVERFLOW;
+              goto error;
+            }
+          field_width = 10 * field_width + (ch - '0');
+          ch = *format++;
+        }
+
+      int precision = -1;
+      if (ch == '.')
+        {
+          precision = 0;
+          ch = *format++;
+          while (ch >= '0' && ch <= '9')
+            {
+              if (precision > (INT_MAX - 9) / 10)
+                {
+                  errcode = ERROR_PRECISION_OVERFLOW;
+                  goto error;
+                }
+              precision = 10 * precision + (ch - '0');
+              ch = *format++;
+            }
+        }
+
+      unsigned vector_length = 0;
+      if (ch == 'v')
+        {
+          ch = *format++;
+          while (ch >= '0' && ch <= '9')
+            {
+              if (ch == '0' && vector_length == 0)
+                {
+                  errcode = ERROR_VECTOR_LENGTH_ZERO;
+                  goto error;
+                }
+              if (vector_length > (INT_MAX - 9) / 10)
+                {
+                  errcode = ERROR_VECTOR_LENGTH_OVERFLOW;
+                  goto error;
+                }
+              vector_length = 10 * vector_length + (unsigned)(ch - '0');
+              ch = *format++;
+            }
+          if (!(vector_length == 2 || vector_length == 3
+                || vector_length == 4 || vector_length == 8
+                || vector_length == 16))
+            {
+              errcode = ERROR_VECTOR_LENGTH_UNKNOWN;
+              goto error;
+            }
+        }
+
+      unsigned length = 0;
+      if (ch == 'h')
+        {
+          ch = *format++;
+          if (ch == 'h')
+            {
+              ch = *format++;
+              length = 1;
+            }
+          else if (ch == 'l')
+            {
+              ch = *format++;
+              length = 4;
+            }
+          else
+            length = 2;
+        }
+      else if (ch == 'l')
+        {
+          ch = *format++;
+          length = 8;
+        }
+      if (vector_length > 0 && length == 0)
+        {
+          errcode = ERROR_VECTOR_LENGTH_WITHOUT_ELEMENT_SIZE;
+          goto error;
+        }
+      if (vector_length == 0 && length == 4)
+        {
+          errcode = ERROR_HL_MODIFIER_USED_WITHOUT_VECTOR_LENGTH;
+          goto error;
+        }
+      if (vector_length == 0)
+        vector_length = 1;
+      unsigned lanes = vector_length == 3 ? 4 : vector_length;
+
+      /* The C conversion spec without the length modifier and the
+       * conversion character. */
+      char spec[48];
+      char *s = spec;
+      *s++ = '%';
+      if (align_left)
+        *s++ = '-';
+      if (always_sign)
+        *s++ = '+';
+      if (space)
+        *s++ = ' ';
+      if (alt)
+        *s++ = '#';
+      if (zero)
+        *s++ = '0';
+      if (field_width > 0)
+        s += sprintf (s, "%d", field_width);
+
+      switch (ch)
+        {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+          {
+            size_t elem_size = length == 0 ? 4 : length;
+            int is_signed = (ch == 'd' || ch == 'i');
+            uint64_t vals[16];
+            if (!take_arg (st, vals, elem_size * lanes))
+              return;
+            if (precision >= 0)
+              s += sprintf (s, ".%d", precision);
+            sprintf (s, "ll%c", ch);
+
+            for (unsigned d = 0; d < vector_length; ++d)
+              {
+                const char *v = (const char *)vals + d * elem_size;
+                long long sval = 0;
+                unsigned long long uval = 0;
+                switch (elem_size)
+                  {
+                  case 1:
+                    sval = *(const int8_t *)v;
+                    uval = *(const uint8_t *)v;
+                    break;
+                  case 2:
+                    sval = *(const int16_t *)v;
+                    uval = *(const uint16_t *)v;
+                    break;
+                  case 4:
+                    sval = *(const int32_t *)v;
+                    uval = *(const uint32_t *)v;
+                    break;
+                  default:
+                    sval = *(const int64_t *)v;
+                    uval = *(const uint64_t *)v;
+                    break;
+                  }
+                if (d != 0)
+                  st->emit (",", 1, st->user_data);
+                if (is_signed)
+                  emit_formatted (st, spec, sval);
+                else
+                  emit_formatted (st, spec, uval);
+              }
+            break;
+          }
+
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+          {
+            if (length == 2)
+              {
+                errcode = ERROR_HALF_FLOAT;
+                goto error;
+              }
+            size_t elem_size = length == 8 ? 8 : 4;
+            uint64_t vals[16];
+            if (!take_arg (st, vals, elem_size * lanes))
+              return;
+            if (precision >= 0)
+              s += sprintf (s, ".%d", precision);
+            sprintf (s, "%c", ch);
+
+            for (unsigned d = 0; d < vector_length; ++d)
+              {
+                double val;
+                if (elem_size == 8)
+                  val = ((const double *)vals)[d];
+                else
+                  val = ((const float *)vals)[d];
+                /* NaNs are printed always positive, like the device
+                 * side printf does. */
+                if (isnan (val))
+                  val = fabs (val);
+                if (d != 0)
+                  st->emit (",", 1, st->user_data);
+                emit_formatted (st, spec, val);
+              }
+            break;
+          }
+
+        case 'c':
+          {
+            if (always_sign || space || alt || zero || precision >= 0
+                || vector_length != 1 || length != 0)
+              {
+                errcode = ERROR_C_CONVERSION_SPECIFIER;
+                goto error;
+              }
+            int32_t val;
+            if (!take_arg (st, &val, sizeof (val)))
+              return;
+            sprintf (s, "c");
+            emit_formatted (st, spec, (unsigned char)val);
+            break;
+          }
+
+        case 's':
+          {
+            if (always_sign || space || alt || zero)
+              {
+                errcode = ERROR_FLAGS_WITH_S_CONVERSION_SPECIFIER;
+                goto error;
+              }
+            if (vector_length != 1)
+              {
+                errcode = ERROR_VECTOR_LENGTH_WITH_S_CONVERSION_SPECIFIER;
+                goto error;
+              }
+            if (length != 0)
+              {
+                errcode = ERROR_LENGTH_MODIFIER_WITH_S_CONVERSION_SPECIFIER;
+                goto error;
+              }
+            uint32_t len;
+            if (!take_arg (st, &len, sizeof (len)) || len == 0
+                || RECORD_ALIGN (len) > st->left)
+              return;
+            const char *str = st->args;
+            if (str[len - 1] != 0)
+              return;
+            st->args += RECORD_ALIGN (len);
+            st->left -= RECORD_ALIGN (len);
+            if (precision >= 0)
+              s += sprintf (s, ".%d", precision);
+            sprintf (s, "s");
+            emit_formatted (st, spec, str);
+            break;
+          }
+
+        case 'p':
+          {
+            if (always_sign || space || alt || zero)
+              {
+                errcode = ERROR_FLAGS_WITH_P_CONVERSION_SPECIFIER;
+                goto error;
+              }
+            if (precision >= 0)
+              {
+                errcode = ERROR_PRECISION_WITH_P_CONVERSION_SPECIFIER;
+                goto error;
+              }
+            if (vector_length != 1)
+              {
+                errcode = ERROR_VECTOR_LENGTH_WITH_P_CONVERSION_SPECIFIER;
+                goto error;
+              }
+            if (length != 0)
+              {
+                errcode = ERROR_LENGTH_MODIFIER_WITH_P_CONVERSION_SPECIFIER;
+                goto error;
+              }
+            uint64_t val;
+            if (!take_arg (st, &val, sizeof (val)))
+              return;
+            /* the device prints pointers as 0x-prefixed hex, also NULL */
+            char hex[24];
+            snprintf (hex, sizeof (hex), "0x%" PRIx64, val);
+            sprintf (s, "s");
+            emit_formatted (st, spec, hex);
+            break;
+          }
+
+        default:
+          errcode = ERROR_UNKNOWN_CONVERSION_SPECIFIER;
+          goto error;
+        }
+    }
+  return;
+
+error:;
+  char tail[4] = { (char)('0' + (errcode >> 4)), (char)('0' + (errcode & 7)),
+                   '\n', 0 };
+  st->emit (ERROR_STRING, strlen (ERROR_STRING), st->user_data);
+  st->emit (tail, 3, st->user_data);
+}
+
+size_t
+pocl_printf_record_size (const char *data, size_t avail)
+{
+  pocl_printf_record_t hdr;
+  if (avail < sizeof (hdr))
+    return 0;
+  memcpy (&hdr, data, sizeof (hdr));
+  if (hdr.format == 0 || hdr.size < sizeof (hdr) || hdr.size > avail
+      || (hdr.size & 7) != 0)
+    return 0;
+  return hdr.size;
+}
+
+size_t
+pocl_printf_format_records (const char *data, size_t size,
+                            pocl_printf_emit_fn emit, void *user_data)
+{
+  size_t consumed = 0;
+  while (consumed < size)
+    {
+      size_t rec_size
+          = pocl_printf_record_size (data + consumed, size - consumed);
+      if (rec_size == 0)
+        break;
+
+      pocl_printf_record_t hdr;
+      memcpy (&hdr, data + consumed, sizeof (hdr));
+      format_state_t st = { data + consumed + sizeof (hdr),
+                            rec_size - sizeof (hdr), emit, user_data };
+      format_record (&st, (const char *)(uintptr_t)hdr.format);
+      consumed += rec_size;
+    }
+  return consumed;
+}
@@ -0,0 +1,79 @@
+/* printf_deferred.h - host-side formatting of deferred kernel printf records
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+/**
+ * Deferred printf records of the CPU drivers.
+ *
+ * With deferred printf, kernels don't format their printf output. The
+ * kernel library's __pocl_printf_deferred() appends one record per call to
+ * the printf buffer instead, holding the address of the format string and
+ * the raw argument values, and the host formats the records when it drains
+ * the printf ring. The format strings live in the kernel's shared library,
+ * which stays loaded until the command's printf output has been flushed.
+ *
+ * @file printf_deferred.h
+ */
+
+#ifndef POCL_PRINTF_DEFERRED_H
+#define POCL_PRINTF_DEFERRED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pocl_export.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* The record header; must match lib/kernel/printf.c. The arguments
+ * follow, each padded to 8 bytes. */
+typedef struct
+{
+  uint64_t format;
+  /* of the whole record including the header, a multiple of 8 */
+  uint32_t size;
+  uint32_t unused;
+} pocl_printf_record_t;
+
+typedef void (*pocl_printf_emit_fn) (const char *data, size_t size,
+                                     void *user_data);
+
+/* Formats the records in data[0..size) and passes the output to emit in
+ * pieces. Returns the number of bytes consumed, which is less than size
+ * if the data ends with a truncated or corrupt record. */
+POCL_EXPORT
+size_t pocl_printf_format_records (const char *data, size_t size,
+                                   pocl_printf_emit_fn emit, void *user_data);
+
+/* Returns the size of the record at data, or 0 if the avail bytes at data
+ * don't hold a complete, well-formed record. */
+POCL_EXPORT
+size_t pocl_printf_record_size (const char *data, size_t avail);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POCL_PRINTF_DEFERRED_H */
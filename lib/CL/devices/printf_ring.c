@@ -0,0 +1,494 @@
+/* printf_ring.c - lock-free ring for kernel printf output of CPU drivers
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "pocl_cl.h"
+#include "pocl_debug.h"
+#include "pocl_threads.h"
+#include "pocl_util.h"
+#include "printf_deferred.h"
+#include "printf_ring.h"
+
+/* The ring is a power-of-two byte array indexed with free-running 64bit
+ * positions. Each record is an 8-byte header followed by the payload,
+ * padded to 8 bytes, so that a header never wraps around the end.
+ *
+ * A producer reserves space by CAS'ing 'head' forward, copies the payload
+ * and then publishes the record by storing a non-zero header. The flusher
+ * consumes committed records in order from 'tail', zeroes the consumed
+ * bytes (so that stale payload is never mistaken for a header) and then
+ * advances 'tail', which releases the space to the producers.
+ *
+ * The header holds the payload size shifted left by two, bit 1 set if the
+ * payload consists of deferred printf records that the flusher formats
+ * before writing them to the sink, and bit 0 always set. */
+
+#define RING_HDR_SIZE 8
+#define RING_HDR_COMMITTED 1
+#define RING_HDR_DEFERRED 2
+#define RING_HDR_SHIFT 2
+#define RING_ALIGN_UP(x) (((x) + 7) & ~(uint64_t)7)
+#define RING_DEFAULT_SIZE (1 << 20)
+#define RING_MIN_SIZE 4096
+
+typedef struct pocl_printf_ring_s
+{
+  uint64_t head __attribute__ ((aligned (HOST_CPU_CACHELINE_SIZE)));
+  uint64_t tail __attribute__ ((aligned (HOST_CPU_CACHELINE_SIZE)));
+  /* position up to which the data has been written to the sink */
+  uint64_t flushed;
+  int flusher_waiting;
+
+  pocl_lock_t lock __attribute__ ((aligned (HOST_CPU_CACHELINE_SIZE)));
+  pocl_cond_t wake_flusher;
+  pocl_cond_t drained;
+  pocl_thread_t flusher;
+  int refcount;
+  int shutdown;
+
+  char *buf;
+  /* staging buffer for coalescing the drained records into a single
+   * sink write */
+  char *stage;
+  /* contiguous copy of a deferred record payload for the formatter */
+  char *scratch;
+  uint64_t capacity;
+  uint64_t mask;
+
+  int fd;
+  int own_fd;
+  pocl_printf_sink_fn sink_fn;
+  void *sink_data;
+} pocl_printf_ring_t;
+
+static pocl_printf_ring_t ring = { .lock = POCL_LOCK_INITIALIZER };
+
+static void
+ring_sink_write (const char *data, size_t size)
+{
+  pocl_printf_sink_fn fn = __atomic_load_n (&ring.sink_fn, __ATOMIC_ACQUIRE);
+  if (fn != NULL)
+    {
+      fn (data, size, ring.sink_data);
+      return;
+    }
+
+  while (size > 0)
+    {
+      ssize_t written = write (ring.fd, data, size);
+      if (written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return;
+        }
+      data += written;
+      size -= (size_t)written;
+    }
+}
+
+/* copies size bytes from the ring starting at pos, handling the wrap */
+static void
+ring_copy_out (char *dst, uint64_t pos, size_t size)
+{
+  size_t off = pos & ring.mask;
+  size_t first = ring.capacity - off;
+  if (first >= size)
+    memcpy (dst, ring.buf + off, size);
+  else
+    {
+      memcpy (dst, ring.buf + off, first);
+      memcpy (dst + first, ring.buf, size - first);
+    }
+}
+
+static void
+ring_copy_in (uint64_t pos, const char *src, size_t size)
+{
+  size_t off = pos & ring.mask;
+  size_t first = ring.capacity - off;
+  if (first >= size)
+    memcpy (ring.buf + off, src, size);
+  else
+    {
+      memcpy (ring.buf + off, src, first);
+      memcpy (ring.buf, src + first, size - first);
+    }
+}
+
+static void
+ring_clear (uint64_t pos, size_t size)
+{
+  size_t off = pos & ring.mask;
+  size_t first = ring.capacity - off;
+  if (first >= size)
+    memset (ring.buf + off, 0, size);
+  else
+    {
+      memset (ring.buf + off, 0, first);
+      memset (ring.buf, 0, size - first);
+    }
+}
+
+/* Appends formatted deferred printf output to the staging buffer, writing
+ * the staged data out first when it would not fit. */
+static void
+ring_stage_formatted (const char *data, size_t size, void *user_data)
+{
+  size_t *staged = (size_t *)user_data;
+  if (*staged + size > ring.capacity)
+    {
+      ring_sink_write (ring.stage, *staged);
+      *staged = 0;
+    }
+  if (size > ring.capacity)
+    ring_sink_write (data, size);
+  else
+    {
+      memcpy (ring.stage + *staged, data, size);
+      *staged += size;
+    }
+}
+
+/* Consumes all the committed records. Returns the number of bytes
+ * written to the sink. Only called by the flusher thread. */
+static size_t
+ring_drain (void)
+{
+  uint64_t tail = ring.tail;
+  size_t staged = 0;
+
+  for (;;)
+    {
+      uint64_t *hdr_p = (uint64_t *)(ring.buf + (tail & ring.mask));
+      uint64_t hdr = __atomic_load_n (hdr_p, __ATOMIC_ACQUIRE);
+      if (hdr == 0)
+        break;
+
+      size_t len = (size_t)(hdr >> RING_HDR_SHIFT);
+      uint64_t rec_size = RING_HDR_SIZE + RING_ALIGN_UP (len);
+
+      if (hdr & RING_HDR_DEFERRED)
+        {
+          ring_copy_out (ring.scratch, tail + RING_HDR_SIZE, len);
+          pocl_printf_format_records (ring.scratch, len, ring_stage_formatted,
+                                      &staged);
+        }
+      else
+        {
+          /* the staging buffer has the ring's capacity, and a record is
+           * at most half of it */
+          if (staged + len > ring.capacity)
+            break;
+          ring_copy_out (ring.stage + staged, tail + RING_HDR_SIZE, len);
+          staged += len;
+        }
+      ring_clear (tail, rec_size);
+      tail += rec_size;
+    }
+
+  if (tail == ring.tail)
+    return 0;
+
+  /* give the space back before the (possibly slow) sink write */
+  __atomic_store_n (&ring.tail, tail, __ATOMIC_RELEASE);
+
+  if (staged > 0)
+    ring_sink_write (ring.stage, staged);
+
+  return staged > 0 ? staged : 1;
+}
+
+static int
+ring_has_committed (void)
+{
+  uint64_t *hdr_p = (uint64_t *)(ring.buf + (ring.tail & ring.mask));
+  return __atomic_load_n (hdr_p, __ATOMIC_ACQUIRE) != 0;
+}
+
+static void *
+ring_flusher_thread (void *arg)
+{
+  (void)arg;
+  for (;;)
+    {
+      if (ring_drain () > 0)
+        {
+          POCL_LOCK (ring.lock);
+          ring.flushed = ring.tail;
+          POCL_BROADCAST_COND (ring.drained);
+          POCL_UNLOCK (ring.lock);
+          continue;
+        }
+
+      POCL_LOCK (ring.lock);
+      if (ring.shutdown)
+        {
+          POCL_UNLOCK (ring.lock);
+          break;
+        }
+      __atomic_store_n (&ring.flusher_waiting, 1, __ATOMIC_SEQ_CST);
+      /* A producer committing after the check sees flusher_waiting and
+       * signals under the lock, so the wakeup can't be missed. flush()
+       * and shutdown signal too. */
+      if (!ring_has_committed ())
+        POCL_WAIT_COND (ring.wake_flusher, ring.lock);
+      __atomic_store_n (&ring.flusher_waiting, 0, __ATOMIC_SEQ_CST);
+      POCL_UNLOCK (ring.lock);
+    }
+
+  while (ring_drain () > 0)
+    ;
+  POCL_LOCK (ring.lock);
+  ring.flushed = ring.tail;
+  POCL_BROADCAST_COND (ring.drained);
+  POCL_UNLOCK (ring.lock);
+  return NULL;
+}
+
+static void
+ring_wake_flusher (void)
+{
+  POCL_LOCK (ring.lock);
+  POCL_SIGNAL_COND (ring.wake_flusher);
+  POCL_UNLOCK (ring.lock);
+}
+
+static void
+ring_setup_sink (void)
+{
+  const char *sink = pocl_get_string_option ("POCL_PRINTF_SINK", "stdout");
+
+  ring.fd = STDOUT_FILENO;
+  ring.own_fd = 0;
+  if (strcmp (sink, "stdout") == 0)
+    return;
+  if (strcmp (sink, "stderr") == 0)
+    {
+      ring.fd = STDERR_FILENO;
+      return;
+    }
+  if (strncmp (sink, "fd:", 3) == 0)
+    {
+      ring.fd = atoi (sink + 3);
+      return;
+    }
+
+  int fd = open (sink, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0)
+    {
+      POCL_MSG_WARN ("Cannot open POCL_PRINTF_SINK file '%s', "
+                     "printing to stdout\n",
+                     sink);
+      return;
+    }
+  ring.fd = fd;
+  ring.own_fd = 1;
+}
+
+int
+pocl_printf_ring_init (void)
+{
+  POCL_LOCK (ring.lock);
+  if (ring.refcount++ > 0)
+    {
+      POCL_UNLOCK (ring.lock);
+      return CL_SUCCESS;
+    }
+
+  int size = pocl_get_int_option ("POCL_PRINTF_RING_SIZE", RING_DEFAULT_SIZE);
+  uint64_t capacity = RING_MIN_SIZE;
+  while (capacity < (uint64_t)size)
+    capacity <<= 1;
+
+  ring.buf = pocl_aligned_malloc (HOST_CPU_CACHELINE_SIZE, capacity);
+  ring.stage = malloc (capacity);
+  ring.scratch = malloc (capacity / 2);
+  if (ring.buf == NULL || ring.stage == NULL || ring.scratch == NULL)
+    {
+      pocl_aligned_free (ring.buf);
+      free (ring.stage);
+      free (ring.scratch);
+      ring.buf = ring.stage = ring.scratch = NULL;
+      ring.refcount = 0;
+      POCL_UNLOCK (ring.lock);
+      return CL_OUT_OF_HOST_MEMORY;
+    }
+  memset (ring.buf, 0, capacity);
+  ring.capacity = capacity;
+  ring.mask = capacity - 1;
+  ring.head = ring.tail = ring.flushed = 0;
+  ring.shutdown = 0;
+  ring_setup_sink ();
+
+  POCL_INIT_COND (ring.wake_flusher);
+  POCL_INIT_COND (ring.drained);
+  POCL_CREATE_THREAD (ring.flusher, ring_flusher_thread, NULL);
+  POCL_UNLOCK (ring.lock);
+
+  POCL_MSG_PRINT_INFO ("printf ring: %" PRIu64 " bytes\n", capacity);
+  return CL_SUCCESS;
+}
+
+void
+pocl_printf_ring_uninit (void)
+{
+  POCL_LOCK (ring.lock);
+  assert (ring.refcount > 0);
+  if (--ring.refcount > 0)
+    {
+      POCL_UNLOCK (ring.lock);
+      return;
+    }
+  ring.shutdown = 1;
+  POCL_SIGNAL_COND (ring.wake_flusher);
+  POCL_UNLOCK (ring.lock);
+
+  POCL_JOIN_THREAD (ring.flusher);
+
+  POCL_DESTROY_COND (ring.wake_flusher);
+  POCL_DESTROY_COND (ring.drained);
+  if (ring.own_fd)
+    close (ring.fd);
+  pocl_aligned_free (ring.buf);
+  free (ring.stage);
+  free (ring.scratch);
+  ring.buf = ring.stage = ring.scratch = NULL;
+}
+
+static void
+ring_publish_record (const char *data, size_t size, uint64_t flags)
+{
+  uint64_t rec_size = RING_HDR_SIZE + RING_ALIGN_UP (size);
+  uint64_t head = __atomic_load_n (&ring.head, __ATOMIC_RELAXED);
+
+  for (;;)
+    {
+      uint64_t tail = __atomic_load_n (&ring.tail, __ATOMIC_ACQUIRE);
+      if (head + rec_size - tail > ring.capacity)
+        {
+          /* full: the only case where a producer waits */
+          ring_wake_flusher ();
+          sched_yield ();
+          head = __atomic_load_n (&ring.head, __ATOMIC_RELAXED);
+          continue;
+        }
+      if (__atomic_compare_exchange_n (&ring.head, &head, head + rec_size, 1,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        break;
+    }
+
+  ring_copy_in (head + RING_HDR_SIZE, data, size);
+  uint64_t *hdr_p = (uint64_t *)(ring.buf + (head & ring.mask));
+  __atomic_store_n (hdr_p,
+                    ((uint64_t)size << RING_HDR_SHIFT) | flags
+                        | RING_HDR_COMMITTED,
+                    __ATOMIC_RELEASE);
+
+  /* pairs with the flusher's store of flusher_waiting + header re-check */
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&ring.flusher_waiting, __ATOMIC_RELAXED))
+    ring_wake_flusher ();
+}
+
+void
+pocl_printf_ring_publish (const char *data, size_t size)
+{
+  assert (ring.buf != NULL);
+  /* Oversized outputs are split so that a single record never takes
+   * more than half of the ring. */
+  size_t max_record = ring.capacity / 2 - RING_HDR_SIZE;
+  while (size > 0)
+    {
+      size_t chunk = size < max_record ? size : max_record;
+      ring_publish_record (data, chunk, 0);
+      data += chunk;
+      size -= chunk;
+    }
+}
+
+void
+pocl_printf_ring_publish_deferred (const char *data, size_t size)
+{
+  assert (ring.buf != NULL);
+  /* Like above, but split only between the records. */
+  size_t max_record = ring.capacity / 2 - RING_HDR_SIZE;
+  while (size > 0)
+    {
+      size_t chunk = 0;
+      size_t rec_size;
+      while ((rec_size = pocl_printf_record_size (data + chunk, size - chunk))
+                 > 0
+             && chunk + rec_size <= max_record)
+        chunk += rec_size;
+
+      if (chunk == 0)
+        {
+          if (rec_size == 0)
+            {
+              POCL_MSG_WARN ("Dropping a malformed deferred printf record\n");
+              return;
+            }
+          POCL_MSG_WARN ("Dropping a deferred printf record of %zu bytes, "
+                         "larger than half of POCL_PRINTF_RING_SIZE\n",
+                         rec_size);
+          data += rec_size;
+          size -= rec_size;
+          continue;
+        }
+      ring_publish_record (data, chunk, RING_HDR_DEFERRED);
+      data += chunk;
+      size -= chunk;
+    }
+}
+
+void
+pocl_printf_ring_flush (void)
+{
+  uint64_t target = __atomic_load_n (&ring.head, __ATOMIC_ACQUIRE);
+
+  POCL_LOCK (ring.lock);
+  while (ring.flushed < target)
+    {
+      POCL_SIGNAL_COND (ring.wake_flusher);
+      POCL_WAIT_COND (ring.drained, ring.lock);
+    }
+  POCL_UNLOCK (ring.lock);
+}
+
+void
+pocl_printf_ring_set_sink (pocl_printf_sink_fn fn, void *user_data)
+{
+  if (ring.buf != NULL)
+    pocl_printf_ring_flush ();
+  ring.sink_data = user_data;
+  __atomic_store_n (&ring.sink_fn, fn, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,85 @@
+/* printf_ring.h - lock-free ring for kernel printf output of CPU drivers
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+/**
+ * A multi-producer, single-consumer byte ring for kernel printf output.
+ *
+ * Compute threads publish their formatted printf buffers into the ring
+ * without taking locks; a background flusher thread drains it into the
+ * configured sink (a file descriptor, a file, or a user callback), so the
+ * compute threads never block on the sink.
+ *
+ * @file printf_ring.h
+ */
+
+#ifndef POCL_PRINTF_RING_H
+#define POCL_PRINTF_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pocl_export.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Callback sink: called from the flusher thread with each drained record. */
+typedef void (*pocl_printf_sink_fn) (const char *data, size_t size,
+                                     void *user_data);
+
+/* Starts the ring and its flusher thread. Reference counted, so that each
+ * device instance can init/uninit it independently. The sink is chosen
+ * with POCL_PRINTF_SINK, the ring size with POCL_PRINTF_RING_SIZE. */
+POCL_EXPORT
+int pocl_printf_ring_init (void);
+
+/* Drains the ring and stops the flusher when the last user is gone. */
+POCL_EXPORT
+void pocl_printf_ring_uninit (void);
+
+/* Publishes size bytes into the ring. Only waits if the ring is full. */
+POCL_EXPORT
+void pocl_printf_ring_publish (const char *data, size_t size);
+
+/* Publishes deferred printf records (see printf_deferred.h), which the
+ * flusher formats before writing them to the sink. */
+POCL_EXPORT
+void pocl_printf_ring_publish_deferred (const char *data, size_t size);
+
+/* Blocks until everything published before the call has reached the
+ * sink. Used to keep printf output ordered with command completion. */
+POCL_EXPORT
+void pocl_printf_ring_flush (void);
+
+/* Replaces the sink with an in-memory callback; NULL restores the
+ * POCL_PRINTF_SINK default. */
+POCL_EXPORT
+void pocl_printf_ring_set_sink (pocl_printf_sink_fn fn, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POCL_PRINTF_RING_H */
@@ -130,6 +130,12 @@ pocl_pthread_init (unsigned j, cl_device_id device, const char* parameters)
   pocl_init_dlhandle_cache ();
   pocl_init_kernel_run_command_manager ();
 
+#ifndef ENABLE_PRINTF_IMMEDIATE_FLUSH
+  /* The printf ring formats the records when it drains them. */
+  device->deferred_printf
+      = pocl_get_bool_option ("POCL_CPU_DEFERRED_PRINTF", 0);
+#endif
+
   /* pthread has elementary partitioning support,
    * but only if OpenMP is disabled */
 #ifdef ENABLE_HOST_CPU_DEVICES_OPENMP
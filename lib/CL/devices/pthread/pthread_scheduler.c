@@ -32,6 +32,10 @@
 #include <time.h>
 #include <unistd.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "builtin_kernels.hh"
 #include "common.h"
 #include "common_driver.h"
@@ -40,6 +44,7 @@
 #include "pocl_cl.h"
 #include "pocl_mem_management.h"
 #include "pocl_util.h"
+#include "printf_ring.h"
 #include "utlist.h"
 
 #ifdef __APPLE__
@@ -52,6 +57,46 @@
 
 static void* pocl_pthread_driver_thread (void *p);
 
+#ifndef ENABLE_HOST_CPU_DEVICES_OPENMP
+/* A large buffer transfer or fill command, split into chunks which the
+ * pool threads execute in parallel, the same way as the WGs of a kernel.
+ * The transfer is described as a 3D strided region; contiguous regions
+ * are collapsed into a single row which is then chunked by bytes. */
+typedef struct mem_run_command mem_run_command;
+struct mem_run_command
+{
+  _cl_command_node *cmd;
+  cl_device_id device;
+  const char *msg;
+  mem_run_command *prev;
+  mem_run_command *next;
+  unsigned long ref_count;
+
+  char *dst;
+  /* NULL for fills */
+  const char *src;
+  const void *pattern;
+  size_t pattern_size;
+
+  size_t row_size;
+  size_t rows;
+  size_t slices;
+  size_t dst_row_pitch;
+  size_t dst_slice_pitch;
+  size_t src_row_pitch;
+  size_t src_slice_pitch;
+
+  /* bytes per chunk if rows*slices == 1, otherwise rows per chunk */
+  size_t chunk_units;
+  /* use non-temporal stores (the whole transfer doesn't fit the LLC) */
+  int streaming;
+
+  POCL_FAST_LOCK_T lock __attribute__ ((aligned (HOST_CPU_CACHELINE_SIZE)));
+  size_t remaining_chunks;
+  size_t chunks_dealt;
+} __attribute__ ((aligned (HOST_CPU_CACHELINE_SIZE)));
+#endif
+
 struct pool_thread_data
 {
   pthread_t thread __attribute__ ((aligned (HOST_CPU_CACHELINE_SIZE)));
@@ -88,6 +133,11 @@ typedef struct scheduler_data_
   struct pool_thread_data *thread_pool;
 #ifndef ENABLE_HOST_CPU_DEVICES_OPENMP
   kernel_run_command *kernel_queue;
+  mem_run_command *mem_queue;
+  /* transfers larger than this are split into chunks of this size */
+  size_t transfer_chunk_size;
+  /* transfers larger than this bypass the caches */
+  size_t streaming_threshold;
 #endif
 
   pthread_barrier_t init_barrier
@@ -131,6 +181,23 @@ pthread_scheduler_init (cl_device_id device)
    * TODO fix this */
   scheduler.local_mem_size = device->local_mem_size + device->max_parameter_size * MAX_EXTENDED_ALIGNMENT;
 
+#ifndef ENABLE_HOST_CPU_DEVICES_OPENMP
+  /* keep the chunks a multiple of the largest fill pattern size (128) */
+  int chunk_size
+      = pocl_get_int_option ("POCL_CPU_TRANSFER_CHUNK_SIZE", 2 * 1024 * 1024);
+  if (chunk_size < 4096)
+    chunk_size = 4096;
+  scheduler.transfer_chunk_size = (size_t)chunk_size & ~(size_t)4095;
+  scheduler.streaming_threshold = device->global_mem_cache_size
+                                      ? device->global_mem_cache_size
+                                      : (size_t)8 * 1024 * 1024;
+#endif
+
+#ifndef ENABLE_PRINTF_IMMEDIATE_FLUSH
+  if (pocl_printf_ring_init () != CL_SUCCESS)
+    return CL_OUT_OF_HOST_MEMORY;
+#endif
+
   PTHREAD_CHECK (pthread_barrier_init (&scheduler.init_barrier, NULL,
                                        num_worker_threads + 1));
 
@@ -179,6 +246,10 @@ pthread_scheduler_uninit (cl_device_id device)
   POCL_FAST_DESTROY (scheduler.wq_lock_fast);
   POCL_DESTROY_COND (scheduler.wake_pool);
   PTHREAD_CHECK (pthread_barrier_destroy (&scheduler.init_barrier));
+
+#ifndef ENABLE_PRINTF_IMMEDIATE_FLUSH
+  pocl_printf_ring_uninit ();
+#endif
 }
 
 /* push_command and push_kernel MUST use broadcast and wake up all threads,
@@ -309,6 +380,10 @@ work_group_scheduler (kernel_run_command *k,
   unsigned slice_size = k->pc.num_groups[0] * k->pc.num_groups[1];
   unsigned row_size = k->pc.num_groups[0];
 
+  pocl_perf_sample perf_sample;
+  if (pocl_perf_counters_enabled)
+    pocl_perf_counters_begin (&perf_sample);
+
   do
     {
       if (last_wgs)
@@ -331,15 +406,26 @@ work_group_scheduler (kernel_run_command *k,
           pocl_set_default_rm ();
           k->workgroup ((uint8_t*)arguments, (uint8_t*)&pc,
 			gids[0], gids[1], gids[2]);
+#ifndef ENABLE_PRINTF_IMMEDIATE_FLUSH
+          /* Hand the output over to the flusher after every WG, so the
+           * printf buffer only needs to fit the output of a single WG. */
+          if (position > 0)
+            {
+              if (k->device->deferred_printf)
+                pocl_printf_ring_publish_deferred (pc.printf_buffer,
+                                                   position);
+              else
+                pocl_printf_ring_publish (pc.printf_buffer, position);
+              position = 0;
+            }
+#endif
         }
     }
   while (get_wg_index_range (k, &start_index, &end_index, &last_wgs,
                              thread_data->num_threads));
 
-  if (position > 0)
-    {
-      write (STDOUT_FILENO, pc.printf_buffer, position);
-    }
+  if (pocl_perf_counters_enabled)
+    pocl_perf_counters_end (&perf_sample, &k->perf_counts);
 
   pocl_free_kernel_arg_array_with_locals ((void **)&arguments, (void **)&arguments2,
                                      k);
@@ -347,6 +433,408 @@ work_group_scheduler (kernel_run_command *k,
   return 1;
 }
 
+/* Copies/fills the given range with non-temporal stores where possible,
+ * so a transfer larger than the LLC doesn't evict everything else. */
+static void
+stream_copy (char *__restrict__ dst, const char *__restrict__ src, size_t size)
+{
+#ifdef __SSE2__
+  size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+  if (head > size)
+    head = size;
+  memcpy (dst, src, head);
+  dst += head;
+  src += head;
+  size -= head;
+
+  size_t i;
+  size_t vec_bytes = size & ~(size_t)63;
+  for (i = 0; i < vec_bytes; i += 64)
+    {
+      __m128i a = _mm_loadu_si128 ((const __m128i *)(src + i));
+      __m128i b = _mm_loadu_si128 ((const __m128i *)(src + i + 16));
+      __m128i c = _mm_loadu_si128 ((const __m128i *)(src + i + 32));
+      __m128i d = _mm_loadu_si128 ((const __m128i *)(src + i + 48));
+      _mm_stream_si128 ((__m128i *)(dst + i), a);
+      _mm_stream_si128 ((__m128i *)(dst + i + 16), b);
+      _mm_stream_si128 ((__m128i *)(dst + i + 32), c);
+      _mm_stream_si128 ((__m128i *)(dst + i + 48), d);
+    }
+  _mm_sfence ();
+  memcpy (dst + vec_bytes, src + vec_bytes, size - vec_bytes);
+#else
+  memcpy (dst, src, size);
+#endif
+}
+
+static void
+stream_fill (char *__restrict__ dst, size_t size,
+             const void *__restrict__ pattern, size_t pattern_size)
+{
+#ifdef __SSE2__
+  size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+  /* the vector stores can only be used if the pattern repeats within
+   * 16 bytes and the aligned part starts at a pattern boundary */
+  if (pattern_size > 16 || (head % pattern_size) != 0 || size < head + 64)
+    {
+      pocl_fill_aligned_buf_with_pattern (dst, 0, size, pattern,
+                                          pattern_size);
+      return;
+    }
+  pocl_fill_aligned_buf_with_pattern (dst, 0, head, pattern, pattern_size);
+  dst += head;
+  size -= head;
+
+  char vec_pattern[16] __attribute__ ((aligned (16)));
+  pocl_fill_aligned_buf_with_pattern (vec_pattern, 0, 16, pattern,
+                                      pattern_size);
+  __m128i v = _mm_load_si128 ((const __m128i *)vec_pattern);
+
+  size_t i;
+  size_t vec_bytes = size & ~(size_t)63;
+  for (i = 0; i < vec_bytes; i += 64)
+    {
+      _mm_stream_si128 ((__m128i *)(dst + i), v);
+      _mm_stream_si128 ((__m128i *)(dst + i + 16), v);
+      _mm_stream_si128 ((__m128i *)(dst + i + 32), v);
+      _mm_stream_si128 ((__m128i *)(dst + i + 48), v);
+    }
+  _mm_sfence ();
+  pocl_fill_aligned_buf_with_pattern (dst + vec_bytes, 0, size - vec_bytes,
+                                      pattern, pattern_size);
+#else
+  pocl_fill_aligned_buf_with_pattern (dst, 0, size, pattern, pattern_size);
+#endif
+}
+
+static void
+exec_mem_range (mem_run_command *m, char *dst, const char *src, size_t size)
+{
+  if (m->src)
+    {
+      if (m->streaming)
+        stream_copy (dst, src, size);
+      else
+        memcpy (dst, src, size);
+    }
+  else
+    {
+      if (m->streaming)
+        stream_fill (dst, size, m->pattern, m->pattern_size);
+      else
+        pocl_fill_aligned_buf_with_pattern (dst, 0, size, m->pattern,
+                                            m->pattern_size);
+    }
+}
+
+static void
+exec_mem_chunk (mem_run_command *m, size_t chunk)
+{
+  size_t total_rows = m->rows * m->slices;
+
+  if (total_rows == 1)
+    {
+      size_t offset = chunk * m->chunk_units;
+      size_t size = min (m->chunk_units, m->row_size - offset);
+      exec_mem_range (m, m->dst + offset, m->src ? m->src + offset : NULL,
+                      size);
+      return;
+    }
+
+  size_t r;
+  size_t end = min ((chunk + 1) * m->chunk_units, total_rows);
+  for (r = chunk * m->chunk_units; r < end; ++r)
+    {
+      size_t j = r % m->rows;
+      size_t k = r / m->rows;
+      exec_mem_range (
+          m, m->dst + m->dst_row_pitch * j + m->dst_slice_pitch * k,
+          m->src ? m->src + m->src_row_pitch * j + m->src_slice_pitch * k
+                 : NULL,
+          m->row_size);
+    }
+}
+
+static int
+get_mem_chunk (mem_run_command *m, size_t *chunk, int *last_chunk)
+{
+  POCL_FAST_LOCK (m->lock);
+  if (m->remaining_chunks == 0)
+    {
+      POCL_FAST_UNLOCK (m->lock);
+      return 0;
+    }
+  *chunk = m->chunks_dealt++;
+  if (--m->remaining_chunks == 0)
+    *last_chunk = 1;
+  POCL_FAST_UNLOCK (m->lock);
+  return 1;
+}
+
+static void
+mem_chunk_scheduler (mem_run_command *m)
+{
+  size_t chunk;
+  int last_chunk = 0;
+
+  while (get_mem_chunk (m, &chunk, &last_chunk))
+    {
+      if (last_chunk)
+        {
+          POCL_FAST_LOCK (scheduler.wq_lock_fast);
+          DL_DELETE (scheduler.mem_queue, m);
+          POCL_FAST_UNLOCK (scheduler.wq_lock_fast);
+          last_chunk = 0;
+        }
+      exec_mem_chunk (m, chunk);
+    }
+}
+
+static void
+finalize_mem_command (mem_run_command *m)
+{
+  POCL_UPDATE_EVENT_COMPLETE_MSG (m->cmd->sync.event.event, m->msg);
+
+  POCL_FAST_DESTROY (m->lock);
+  pocl_aligned_free (m);
+}
+
+/* Sets up a strided 3D transfer description. The region is collapsed
+ * into one contiguous row when both sides are densely packed. */
+static void
+setup_mem_region (mem_run_command *m, const size_t *region,
+                  size_t dst_row_pitch, size_t dst_slice_pitch,
+                  size_t src_row_pitch, size_t src_slice_pitch)
+{
+  int dst_dense = (dst_row_pitch == region[0]
+                   && dst_slice_pitch == region[0] * region[1]);
+  int src_dense = (m->src == NULL)
+                  || (src_row_pitch == region[0]
+                      && src_slice_pitch == region[0] * region[1]);
+  if (dst_dense && src_dense)
+    {
+      m->row_size = region[0] * region[1] * region[2];
+      m->rows = m->slices = 1;
+    }
+  else
+    {
+      m->row_size = region[0];
+      m->rows = region[1];
+      m->slices = region[2];
+    }
+  m->dst_row_pitch = dst_row_pitch;
+  m->dst_slice_pitch = dst_slice_pitch;
+  m->src_row_pitch = src_row_pitch;
+  m->src_slice_pitch = src_slice_pitch;
+}
+
+/* Splits a large buffer transfer or fill into chunks and queues them for
+ * the worker threads. The chunks copy the memory directly, so only the
+ * commands the device runs with the generic driver ops of common_driver.c
+ * are split. Returns 1 if the command was queued, 0 if it should be
+ * executed as usual by the calling thread. */
+static int
+pocl_pthread_split_mem_command (_cl_command_node *node)
+{
+  cl_device_id dev = node->device;
+  _cl_command_t *cmd = &node->command;
+  mem_run_command m;
+  size_t linear[3] = { 0, 1, 1 };
+
+  if (scheduler.num_threads < 2)
+    return 0;
+
+  memset (&m, 0, sizeof (m));
+  switch (node->type)
+    {
+    case CL_COMMAND_READ_BUFFER:
+      if (dev->ops->read != pocl_driver_read)
+        return 0;
+      m.msg = "Event Read Buffer           ";
+      m.dst = (char *)cmd->read.dst_host_ptr;
+      m.src = (char *)POCL_MEM_BS (cmd->read.src)
+                  ->device_ptrs[dev->global_mem_id]
+                  .mem_ptr
+              + cmd->read.offset;
+      linear[0] = cmd->read.size;
+      setup_mem_region (&m, linear, 0, 0, 0, 0);
+      break;
+    case CL_COMMAND_WRITE_BUFFER:
+      if (dev->ops->write != pocl_driver_write)
+        return 0;
+      m.msg = "Event Write Buffer          ";
+      m.dst = (char *)POCL_MEM_BS (cmd->write.dst)
+                  ->device_ptrs[dev->global_mem_id]
+                  .mem_ptr
+              + cmd->write.offset;
+      m.src = (const char *)cmd->write.src_host_ptr;
+      linear[0] = cmd->write.size;
+      setup_mem_region (&m, linear, 0, 0, 0, 0);
+      break;
+    case CL_COMMAND_COPY_BUFFER:
+      if (dev->ops->copy != pocl_driver_copy)
+        return 0;
+      if (cmd->copy.src_content_size != NULL)
+        return 0;
+      m.msg = "Event Copy Buffer           ";
+      m.dst = (char *)POCL_MEM_BS (cmd->copy.dst)
+                  ->device_ptrs[dev->global_mem_id]
+                  .mem_ptr
+              + cmd->copy.dst_offset;
+      m.src = (char *)POCL_MEM_BS (cmd->copy.src)
+                  ->device_ptrs[dev->global_mem_id]
+                  .mem_ptr
+              + cmd->copy.src_offset;
+      linear[0] = cmd->copy.size;
+      setup_mem_region (&m, linear, 0, 0, 0, 0);
+      break;
+    case CL_COMMAND_FILL_BUFFER:
+      if (dev->ops->memfill != pocl_driver_memfill)
+        return 0;
+      m.msg = "Event Fill Buffer           ";
+      m.dst = (char *)cmd->memfill.dst->device_ptrs[dev->global_mem_id].mem_ptr
+              + cmd->memfill.offset;
+      m.pattern = cmd->memfill.pattern;
+      m.pattern_size = cmd->memfill.pattern_size;
+      linear[0] = cmd->memfill.size;
+      setup_mem_region (&m, linear, 0, 0, 0, 0);
+      break;
+    case CL_COMMAND_SVM_MEMCPY:
+    case CL_COMMAND_MEMCPY_INTEL:
+      if (dev->ops->svm_copy != pocl_driver_svm_copy)
+        return 0;
+      m.msg = "Event SVM Memcpy            ";
+      m.dst = (char *)cmd->svm_memcpy.dst;
+      m.src = (const char *)cmd->svm_memcpy.src;
+      linear[0] = cmd->svm_memcpy.size;
+      setup_mem_region (&m, linear, 0, 0, 0, 0);
+      break;
+    case CL_COMMAND_SVM_MEMFILL:
+    case CL_COMMAND_MEMFILL_INTEL:
+      if (dev->ops->svm_fill != pocl_driver_svm_fill)
+        return 0;
+      m.msg = "Event SVM MemFill           ";
+      m.dst = (char *)cmd->svm_fill.svm_ptr;
+      m.pattern = cmd->svm_fill.pattern;
+      m.pattern_size = cmd->svm_fill.pattern_size;
+      linear[0] = cmd->svm_fill.size;
+      setup_mem_region (&m, linear, 0, 0, 0, 0);
+      break;
+    case CL_COMMAND_READ_BUFFER_RECT:
+      if (dev->ops->read_rect != pocl_driver_read_rect)
+        return 0;
+      m.msg = "Event Read Buffer Rect      ";
+      m.dst = (char *)cmd->read_rect.dst_host_ptr
+              + cmd->read_rect.host_origin[0]
+              + cmd->read_rect.host_row_pitch * cmd->read_rect.host_origin[1]
+              + cmd->read_rect.host_slice_pitch
+                    * cmd->read_rect.host_origin[2];
+      m.src = (char *)cmd->read_rect.src->device_ptrs[dev->global_mem_id]
+                  .mem_ptr
+              + cmd->read_rect.buffer_origin[0]
+              + cmd->read_rect.buffer_row_pitch
+                    * cmd->read_rect.buffer_origin[1]
+              + cmd->read_rect.buffer_slice_pitch
+                    * cmd->read_rect.buffer_origin[2];
+      setup_mem_region (&m, cmd->read_rect.region,
+                        cmd->read_rect.host_row_pitch,
+                        cmd->read_rect.host_slice_pitch,
+                        cmd->read_rect.buffer_row_pitch,
+                        cmd->read_rect.buffer_slice_pitch);
+      break;
+    case CL_COMMAND_WRITE_BUFFER_RECT:
+      if (dev->ops->write_rect != pocl_driver_write_rect)
+        return 0;
+      m.msg = "Event Write Buffer Rect     ";
+      m.dst = (char *)cmd->write_rect.dst->device_ptrs[dev->global_mem_id]
+                  .mem_ptr
+              + cmd->write_rect.buffer_origin[0]
+              + cmd->write_rect.buffer_row_pitch
+                    * cmd->write_rect.buffer_origin[1]
+              + cmd->write_rect.buffer_slice_pitch
+                    * cmd->write_rect.buffer_origin[2];
+      m.src = (const char *)cmd->write_rect.src_host_ptr
+              + cmd->write_rect.host_origin[0]
+              + cmd->write_rect.host_row_pitch
+                    * cmd->write_rect.host_origin[1]
+              + cmd->write_rect.host_slice_pitch
+                    * cmd->write_rect.host_origin[2];
+      setup_mem_region (&m, cmd->write_rect.region,
+                        cmd->write_rect.buffer_row_pitch,
+                        cmd->write_rect.buffer_slice_pitch,
+                        cmd->write_rect.host_row_pitch,
+                        cmd->write_rect.host_slice_pitch);
+      break;
+    case CL_COMMAND_COPY_BUFFER_RECT:
+      if (dev->ops->copy_rect != pocl_driver_copy_rect)
+        return 0;
+      m.msg = "Event Copy Buffer Rect      ";
+      m.dst = (char *)cmd->copy_rect.dst->device_ptrs[dev->global_mem_id]
+                  .mem_ptr
+              + cmd->copy_rect.dst_origin[0]
+              + cmd->copy_rect.dst_row_pitch * cmd->copy_rect.dst_origin[1]
+              + cmd->copy_rect.dst_slice_pitch * cmd->copy_rect.dst_origin[2];
+      m.src = (char *)cmd->copy_rect.src->device_ptrs[dev->global_mem_id]
+                  .mem_ptr
+              + cmd->copy_rect.src_origin[0]
+              + cmd->copy_rect.src_row_pitch * cmd->copy_rect.src_origin[1]
+              + cmd->copy_rect.src_slice_pitch * cmd->copy_rect.src_origin[2];
+      setup_mem_region (&m, cmd->copy_rect.region,
+                        cmd->copy_rect.dst_row_pitch,
+                        cmd->copy_rect.dst_slice_pitch,
+                        cmd->copy_rect.src_row_pitch,
+                        cmd->copy_rect.src_slice_pitch);
+      break;
+    default:
+      return 0;
+    }
+
+  /* in-place transfers (e.g. mapped host pointers) are no-ops */
+  if (m.dst == m.src)
+    return 0;
+
+  size_t total_size = m.row_size * m.rows * m.slices;
+  size_t chunk_size = scheduler.transfer_chunk_size;
+  if (total_size <= chunk_size)
+    return 0;
+
+  size_t num_chunks;
+  if (m.rows * m.slices == 1)
+    {
+      m.chunk_units = chunk_size;
+      num_chunks = (m.row_size + chunk_size - 1) / chunk_size;
+    }
+  else
+    {
+      m.chunk_units = max (chunk_size / m.row_size, (size_t)1);
+      num_chunks = (m.rows * m.slices + m.chunk_units - 1) / m.chunk_units;
+    }
+  if (num_chunks < 2)
+    return 0;
+
+  mem_run_command *run_cmd = pocl_aligned_malloc (HOST_CPU_CACHELINE_SIZE,
+                                                  sizeof (mem_run_command));
+  if (run_cmd == NULL)
+    return 0;
+  memcpy (run_cmd, &m, sizeof (mem_run_command));
+  run_cmd->cmd = node;
+  run_cmd->device = dev;
+  run_cmd->streaming = (total_size > scheduler.streaming_threshold);
+  run_cmd->remaining_chunks = num_chunks;
+  run_cmd->chunks_dealt = 0;
+  run_cmd->ref_count = 0;
+  POCL_FAST_INIT (run_cmd->lock);
+
+  pocl_update_event_running (node->sync.event.event);
+
+  POCL_FAST_LOCK (scheduler.wq_lock_fast);
+  DL_APPEND (scheduler.mem_queue, run_cmd);
+  PTHREAD_CHECK (pthread_cond_broadcast (&scheduler.wake_pool));
+  POCL_FAST_UNLOCK (scheduler.wq_lock_fast);
+
+  return 1;
+}
+
 #else /* OPENMP enabled scheduler */
 
 static int
@@ -385,6 +873,10 @@ work_group_scheduler (kernel_run_command *k,
     unsigned ftz = pocl_save_ftz ();
     pocl_set_ftz (program->flush_denorms);
 
+    pocl_perf_sample perf_sample;
+    if (pocl_perf_counters_enabled)
+      pocl_perf_counters_begin (&perf_sample);
+
     size_t x, y, z;
     /* runtime = set scheduling according to environment variable OMP_SCHEDULE
      */
@@ -395,13 +887,19 @@ work_group_scheduler (kernel_run_command *k,
           ((pocl_workgroup_func)k->workgroup) ((uint8_t *)arguments,
                                                (uint8_t *)&pc, x, y, z);
 
+    if (pocl_perf_counters_enabled)
+      pocl_perf_counters_end (&perf_sample, &k->perf_counts);
+
     pocl_restore_rm (rm);
     pocl_restore_ftz (ftz);
 
 #ifndef ENABLE_PRINTF_IMMEDIATE_FLUSH
     if (position > 0)
       {
-        write (STDOUT_FILENO, pc.printf_buffer, position);
+        if (k->device->deferred_printf)
+          pocl_printf_ring_publish_deferred (pc.printf_buffer, position);
+        else
+          pocl_printf_ring_publish (pc.printf_buffer, position);
         position = 0;
       }
 #endif
@@ -430,6 +928,19 @@ finalize_kernel_command (struct pool_thread_data *thread_data,
 
   pocl_free_kernel_arg_array (k);
 
+  if (pocl_perf_counters_enabled)
+    pocl_perf_counters_record (
+        k->kernel->name, k->pc.local_size, k->cmd->command.run.device_data,
+        k->pc.num_groups[0] * k->pc.num_groups[1] * k->pc.num_groups[2],
+        &k->perf_counts);
+
+#ifndef ENABLE_PRINTF_IMMEDIATE_FLUSH
+  /* the kernel's printf output must reach the sink before its event
+   * completes, and deferred printf records point to format strings in
+   * the kernel library, so before the dlhandle is released */
+  pocl_printf_ring_flush ();
+#endif
+
   pocl_release_dlhandle_cache (k->cmd->command.run.device_data);
 
   POCL_UPDATE_EVENT_COMPLETE_MSG (k->cmd->sync.event.event,
@@ -486,6 +997,7 @@ pocl_pthread_prepare_kernel (void *data, _cl_command_node *cmd)
   run_cmd->kernel_args = cmd->command.run.arguments;
   run_cmd->next = NULL;
   run_cmd->ref_count = 0;
+  memset (&run_cmd->perf_counts, 0, sizeof (pocl_perf_sample));
   POCL_FAST_INIT (run_cmd->lock);
 
   pocl_setup_kernel_arg_array (run_cmd);
@@ -593,6 +1105,20 @@ check_kernel_queue_for_device (thread_data *td)
 
   return NULL;
 }
+
+static mem_run_command *
+check_mem_queue_for_device (thread_data *td)
+{
+  mem_run_command *cmd = NULL;
+  DL_FOREACH (scheduler.mem_queue, cmd)
+  {
+    cl_device_id subd = cmd->device;
+    if (shall_we_run_this (td, subd))
+      return cmd;
+  }
+
+  return NULL;
+}
 #endif
 
 static int
@@ -600,6 +1126,9 @@ pthread_scheduler_get_work (thread_data *td)
 {
   _cl_command_node *cmd = NULL;
   kernel_run_command *run_cmd = NULL;
+#ifndef ENABLE_HOST_CPU_DEVICES_OPENMP
+  mem_run_command *mem_cmd = NULL;
+#endif
 
   /* execute kernel if available */
   POCL_FAST_LOCK (scheduler.wq_lock_fast);
@@ -626,6 +1155,24 @@ RETRY:
           POCL_FAST_LOCK (scheduler.wq_lock_fast);
         }
     }
+
+  /* help with a chunked buffer transfer if available */
+  mem_cmd = check_mem_queue_for_device (td);
+  if (mem_cmd)
+    {
+      ++mem_cmd->ref_count;
+      POCL_FAST_UNLOCK (scheduler.wq_lock_fast);
+
+      mem_chunk_scheduler (mem_cmd);
+
+      POCL_FAST_LOCK (scheduler.wq_lock_fast);
+      if ((--mem_cmd->ref_count) == 0)
+        {
+          POCL_FAST_UNLOCK (scheduler.wq_lock_fast);
+          finalize_mem_command (mem_cmd);
+          POCL_FAST_LOCK (scheduler.wq_lock_fast);
+        }
+    }
 #endif
 
   /* execute a command if available */
@@ -649,7 +1196,15 @@ RETRY:
         }
       else
         {
-          pocl_exec_command (cmd);
+#ifndef ENABLE_HOST_CPU_DEVICES_OPENMP
+          /* Large transfers and fills are executed in chunks by all the
+             workers, which pick them up from the mem queue. */
+          int split = pocl_pthread_split_mem_command (cmd);
+#else
+          int split = 0;
+#endif
+          if (!split)
+            pocl_exec_command (cmd);
         }
 
       POCL_FAST_LOCK (scheduler.wq_lock_fast);
@@ -657,7 +1212,11 @@ RETRY:
     }
 
   /* if neither a command nor a kernel was available, sleep */
-  if ((cmd == NULL) && (run_cmd == NULL) && (do_exit == 0))
+  if ((cmd == NULL) && (run_cmd == NULL)
+#ifndef ENABLE_HOST_CPU_DEVICES_OPENMP
+      && (mem_cmd == NULL)
+#endif
+      && (do_exit == 0))
     {
       PTHREAD_CHECK (
           pthread_cond_wait (&scheduler.wake_pool, &scheduler.wq_lock_fast));
@@ -0,0 +1,950 @@
+/* aggregate.c - remote devices of several servers presented as one device
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+/* An aggregate device is one cl_device_id backed by the same device type on
+ * several servers ("members"). The first member is the primary: it is the
+ * device's own remote_device_data_t and holds the authoritative copy of
+ * every buffer, so all commands other than kernel launches run on it
+ * unchanged. Programs, kernels, queues and buffers are mirrored on the other
+ * members under the same ids.
+ *
+ * A kernel launch is divided only when a partition policy other than the
+ * default "primary" is selected and the kernel is known to give the same
+ * results that way: the partition policy hands each member a contiguous
+ * slab of work-groups along the outermost dimension, which the member runs
+ * as an NDRange of its own at a global offset. Its global ids are the real
+ * ones, but its group ids, group count and global size are those of the
+ * slab, so the kernel must not use them, nor atomics, which could combine
+ * updates of work-groups on different members. The server's compiler
+ * reports this as CL_KERNEL_GROUPS_INDEPENDENT_POCL.
+ * The buffers the members read are first copied to them from the primary
+ * with peer-to-peer migrations, unless the members already have the current
+ * contents. A written buffer is seen as one row per index of the outermost
+ * dimension, and the work-items of a slab must write only the rows of their
+ * own global ids, as in out[get_global_id (0)] or, in two dimensions,
+ * out[y * width + x] with rows as wide as the NDRange. Afterwards only each
+ * member's slab of rows is read back and written to the primary, which ran
+ * its own slab on its authoritative copy. */
+
+#include "aggregate.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pocl_debug.h"
+#include "pocl_timing.h"
+#include "pocl_util.h"
+#include "utlist.h"
+
+typedef struct remote_aggregate_member_s
+{
+  remote_device_data_t *ddata;
+  /* Work-groups per nanosecond measured in the previous divided launches,
+     0 until the first one. */
+  double rate;
+} remote_aggregate_member_t;
+
+struct remote_aggregate_s
+{
+  unsigned num_members;
+  /* members[0] is the primary. */
+  remote_aggregate_member_t *members;
+  const remote_partition_policy_t *policy;
+  /* Protects the rates. */
+  pocl_lock_t lock;
+};
+
+/*****************************************************************************/
+
+static int
+partition_even (remote_aggregate_t *agg, size_t num_groups, size_t *counts)
+{
+  unsigned i, n = agg->num_members;
+  if (num_groups < 2)
+    return 0;
+  for (i = 0; i < n; ++i)
+    counts[i] = num_groups / n + (i < num_groups % n ? 1 : 0);
+  return 1;
+}
+
+/* Weighs the members by their throughput in the previous launches, which
+   balances members of unequal speed or load. */
+static int
+partition_adaptive (remote_aggregate_t *agg, size_t num_groups,
+                    size_t *counts)
+{
+  unsigned i, n = agg->num_members;
+  double total = 0.0;
+  double rates[n];
+
+  if (num_groups < 2)
+    return 0;
+
+  POCL_LOCK (agg->lock);
+  for (i = 0; i < n; ++i)
+    {
+      rates[i] = agg->members[i].rate;
+      total += rates[i];
+    }
+  POCL_UNLOCK (agg->lock);
+
+  for (i = 0; i < n; ++i)
+    if (rates[i] <= 0.0)
+      return partition_even (agg, num_groups, counts);
+
+  size_t assigned = 0;
+  for (i = 0; i < n; ++i)
+    {
+      counts[i] = (size_t)((double)num_groups * rates[i] / total);
+      assigned += counts[i];
+    }
+  for (i = 0; assigned < num_groups; i = (i + 1) % n, ++assigned)
+    ++counts[i];
+  return 1;
+}
+
+static int
+partition_primary (remote_aggregate_t *agg, size_t num_groups, size_t *counts)
+{
+  return 0;
+}
+
+static const remote_partition_policy_t partition_policies[]
+    = { { "primary", partition_primary },
+        { "even", partition_even },
+        { "adaptive", partition_adaptive } };
+
+#define NUM_PARTITION_POLICIES                                                \
+  (sizeof (partition_policies) / sizeof (partition_policies[0]))
+
+/*****************************************************************************/
+
+/* Releases the strings pocl_network_setup_devinfo() duplicated into a
+   scratch device used only to query a member. */
+static void
+free_scratch_device (cl_device_id dev)
+{
+  unsigned i;
+  free ((void *)dev->long_name);
+  free ((void *)dev->version);
+  free ((void *)dev->driver_version);
+  free ((void *)dev->vendor);
+  free ((void *)dev->extensions);
+  free ((void *)dev->supported_spir_v_versions);
+  free (dev->builtin_kernel_list);
+  for (i = 0; i < NUM_OPENCL_IMAGE_TYPES; ++i)
+    free ((void *)dev->image_formats[i]);
+  free (dev);
+}
+
+int
+pocl_remote_aggregate_init (cl_device_id device, remote_device_data_t *d,
+                            unsigned j, const char *members)
+{
+  unsigned i, k;
+  const char *p;
+  unsigned n = 2;
+  for (p = members; *p; ++p)
+    n += (*p == REMOTE_AGGREGATE_SEPARATOR);
+
+  remote_aggregate_t *agg = calloc (1, sizeof (remote_aggregate_t));
+  if (agg == NULL)
+    return CL_OUT_OF_HOST_MEMORY;
+  agg->members = calloc (n, sizeof (remote_aggregate_member_t));
+  if (agg->members == NULL)
+    {
+      free (agg);
+      return CL_OUT_OF_HOST_MEMORY;
+    }
+  agg->members[0].ddata = d;
+  agg->num_members = 1;
+  POCL_INIT_LOCK (agg->lock);
+  d->aggregate = agg;
+
+  const char *policy_name
+      = pocl_get_string_option ("POCL_REMOTE_AGGREGATE_POLICY", "primary");
+  agg->policy = &partition_policies[0];
+  for (i = 0; i < NUM_PARTITION_POLICIES; ++i)
+    if (strcmp (policy_name, partition_policies[i].name) == 0)
+      agg->policy = &partition_policies[i];
+  if (strcmp (policy_name, agg->policy->name) != 0)
+    POCL_MSG_ERR ("Unknown POCL_REMOTE_AGGREGATE_POLICY '%s', using '%s'\n",
+                  policy_name, agg->policy->name);
+
+  /* pocl_network_init_device() points the device's availability to the
+     server it connects, but it's the primary's that counts. */
+  cl_bool *available = device->available;
+  char *list = strdup (members);
+  char *save = NULL;
+  char separator[2] = { REMOTE_AGGREGATE_SEPARATOR, 0 };
+  int err = CL_SUCCESS;
+  if (list == NULL)
+    return CL_OUT_OF_HOST_MEMORY;
+
+  for (char *param = strtok_r (list, separator, &save); param != NULL;
+       param = strtok_r (NULL, separator, &save))
+    {
+      remote_device_data_t *m = calloc (1, sizeof (remote_device_data_t));
+      if (m == NULL)
+        {
+          err = CL_OUT_OF_HOST_MEMORY;
+          break;
+        }
+      agg->members[agg->num_members].ddata = m;
+      ++agg->num_members;
+
+      if (pocl_network_init_device (device, m, j, param))
+        {
+          err = CL_INVALID_DEVICE;
+          break;
+        }
+      device->available = available;
+
+      /* The members of one server share its buffers and programs, so the
+         mirrored objects would collide. */
+      for (k = 0; k + 1 < agg->num_members; ++k)
+        if (agg->members[k].ddata->server == m->server)
+          {
+            POCL_MSG_ERR ("Aggregate device #%u: member '%s' is on the same "
+                          "server as another member\n",
+                          j, param);
+            err = CL_INVALID_DEVICE;
+          }
+      if (err)
+        break;
+
+      struct _cl_device_id *scratch = calloc (1, sizeof (struct _cl_device_id));
+      if (scratch == NULL)
+        {
+          err = CL_OUT_OF_HOST_MEMORY;
+          break;
+        }
+      if (pocl_network_setup_devinfo (scratch, m, m->server,
+                                      m->remote_platform_index,
+                                      m->remote_device_index))
+        {
+          free_scratch_device (scratch);
+          err = CL_INVALID_DEVICE;
+          break;
+        }
+
+      if (strcmp (scratch->short_name, device->short_name) != 0)
+        POCL_MSG_WARN ("Aggregate device #%u: member '%s' is a '%s' while the "
+                       "primary is a '%s', binaries might not work on both\n",
+                       j, param, scratch->short_name, device->short_name);
+
+      device->max_compute_units += scratch->max_compute_units;
+      if (scratch->global_mem_size < device->global_mem_size)
+        device->global_mem_size = scratch->global_mem_size;
+      if (scratch->max_mem_alloc_size < device->max_mem_alloc_size)
+        device->max_mem_alloc_size = scratch->max_mem_alloc_size;
+      free_scratch_device (scratch);
+
+      if ((device->svm_caps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER)
+          && pocl_remote_join_svm_pool (m) != 0)
+        {
+          POCL_MSG_ERR ("Aggregate device #%u: member '%s' has no SVM pool "
+                        "but the primary does\n",
+                        j, param);
+          err = CL_INVALID_DEVICE;
+          break;
+        }
+    }
+  device->available = available;
+  free (list);
+
+  if (err)
+    return err;
+
+  POCL_MSG_PRINT_REMOTE ("Aggregate device #%u: %u members, %u compute units, "
+                         "partition policy '%s'\n",
+                         j, agg->num_members, device->max_compute_units,
+                         agg->policy->name);
+  return CL_SUCCESS;
+}
+
+void
+pocl_remote_aggregate_uninit (remote_device_data_t *d)
+{
+  remote_aggregate_t *agg = d->aggregate;
+  unsigned i;
+  if (agg == NULL)
+    return;
+  for (i = 1; i < agg->num_members; ++i)
+    {
+      remote_device_data_t *m = agg->members[i].ddata;
+      if (m->server)
+        pocl_network_free_device_data (m);
+      free (m);
+    }
+  POCL_DESTROY_LOCK (agg->lock);
+  free (agg->members);
+  free (agg);
+  d->aggregate = NULL;
+}
+
+/*****************************************************************************/
+
+#define FOR_EACH_MEMBER(agg, m)                                               \
+  for (unsigned mi_ = 1;                                                      \
+       mi_ < (agg)->num_members && ((m) = (agg)->members[mi_].ddata, 1);      \
+       ++mi_)
+
+int
+pocl_remote_aggregate_build (remote_device_data_t *d, const void *payload,
+                             size_t payload_size, int is_binary,
+                             int is_builtin, int is_spirv, uint32_t prog_id,
+                             const char *options, int compile_only,
+                             int link_only)
+{
+  remote_device_data_t *m;
+  char *buffer = NULL;
+  int err = CL_SUCCESS;
+
+  /* Binary builds take a list of per-device binaries. */
+  if (is_binary)
+    {
+      uint32_t num = 1;
+      uint32_t size = (uint32_t)payload_size;
+      buffer = malloc (2 * sizeof (uint32_t) + payload_size);
+      if (buffer == NULL)
+        return CL_OUT_OF_HOST_MEMORY;
+      memcpy (buffer, &num, sizeof (uint32_t));
+      memcpy (buffer + sizeof (uint32_t), &size, sizeof (uint32_t));
+      memcpy (buffer + 2 * sizeof (uint32_t), payload, payload_size);
+      payload = buffer;
+      payload_size += 2 * sizeof (uint32_t);
+    }
+
+  FOR_EACH_MEMBER (d->aggregate, m)
+  {
+    char *build_log = NULL;
+    char *kernel_meta = NULL;
+    size_t kernel_meta_size = 0;
+    char *binary = NULL;
+    size_t binary_size = 0;
+
+    err = pocl_network_build_or_link_program (
+        m, payload, payload_size, is_binary, is_builtin, is_spirv, prog_id,
+        options, &kernel_meta, &kernel_meta_size, &m->remote_device_index,
+        &m->remote_platform_index, 1, &build_log, &binary, &binary_size,
+        m->svm_region_offset, compile_only, link_only);
+
+    if (err != CL_SUCCESS)
+      POCL_MSG_ERR ("Aggregate member at %s failed to build program %u:\n%s\n",
+                    m->server->address_with_port, prog_id,
+                    build_log ? build_log : "");
+    POCL_MEM_FREE (build_log);
+    POCL_MEM_FREE (kernel_meta);
+    POCL_MEM_FREE (binary);
+    if (err != CL_SUCCESS)
+      break;
+  }
+
+  free (buffer);
+  return err;
+}
+
+void
+pocl_remote_aggregate_free_program (remote_device_data_t *d, uint32_t prog_id)
+{
+  remote_device_data_t *m;
+  FOR_EACH_MEMBER (d->aggregate, m)
+  {
+    pocl_network_free_program (m, prog_id);
+  }
+}
+
+int
+pocl_remote_aggregate_create_kernel (remote_device_data_t *d,
+                                     const char *name, uint32_t prog_id,
+                                     uint32_t kernel_id, kernel_data_t *kd)
+{
+  remote_device_data_t *m;
+  FOR_EACH_MEMBER (d->aggregate, m)
+  {
+    int err = pocl_network_create_kernel (m, name, prog_id, kernel_id, kd);
+    if (err != CL_SUCCESS)
+      return err;
+  }
+  return CL_SUCCESS;
+}
+
+void
+pocl_remote_aggregate_free_kernel (remote_device_data_t *d, kernel_data_t *kd,
+                                   uint32_t kernel_id, uint32_t prog_id)
+{
+  remote_device_data_t *m;
+  FOR_EACH_MEMBER (d->aggregate, m)
+  {
+    pocl_network_free_kernel (m, kd, kernel_id, prog_id);
+  }
+}
+
+int
+pocl_remote_aggregate_create_queue (remote_device_data_t *d,
+                                    uint32_t queue_id)
+{
+  remote_device_data_t *m;
+  FOR_EACH_MEMBER (d->aggregate, m)
+  {
+    int err = pocl_network_create_queue (m, queue_id);
+    if (err != CL_SUCCESS)
+      return err;
+  }
+  return CL_SUCCESS;
+}
+
+void
+pocl_remote_aggregate_free_queue (remote_device_data_t *d, uint32_t queue_id)
+{
+  remote_device_data_t *m;
+  FOR_EACH_MEMBER (d->aggregate, m)
+  {
+    pocl_network_free_queue (m, queue_id);
+  }
+}
+
+int
+pocl_remote_aggregate_create_buffer (remote_device_data_t *d, cl_mem mem,
+                                     int is_svm)
+{
+  remote_device_data_t *m;
+  void *device_addr = NULL;
+  FOR_EACH_MEMBER (d->aggregate, m)
+  {
+    /* Each member's SVM pool sits at its own offset from the host's. */
+    if (is_svm)
+      mem->mem_host_ptr += m->svm_region_offset;
+    int err = pocl_network_create_buffer (m, mem, &device_addr);
+    if (is_svm)
+      mem->mem_host_ptr -= m->svm_region_offset;
+    if (err != CL_SUCCESS)
+      return err;
+  }
+  return CL_SUCCESS;
+}
+
+void
+pocl_remote_aggregate_free_buffer (remote_device_data_t *d, cl_mem mem)
+{
+  remote_device_data_t *m;
+  FOR_EACH_MEMBER (d->aggregate, m)
+  {
+    pocl_network_free_buffer (m, mem->id, 0);
+  }
+}
+
+/*****************************************************************************/
+
+/* The members' copy of a buffer is current when the extra field of the
+   aggregate device's mem identifier is set. Writes to a sub-buffer change
+   its parent too. */
+static void
+forget_member_copies (cl_mem mem, unsigned global_mem_id)
+{
+  mem->device_ptrs[global_mem_id].extra = 0;
+  if (mem->parent)
+    mem->parent->device_ptrs[global_mem_id].extra = 0;
+}
+
+void
+pocl_remote_aggregate_note_command (remote_device_data_t *d,
+                                    _cl_command_node *node)
+{
+  pocl_buffer_migration_info *mi;
+  unsigned gmem = node->device->global_mem_id;
+  /* Migrations to this device and unmaps write the primary's copy even
+     though they list the buffer as read-only. */
+  int writes_all
+      = (node->type == CL_COMMAND_UNMAP_MEM_OBJECT)
+        || (node->type == CL_COMMAND_MIGRATE_MEM_OBJECTS
+            && node->command.migrate.type != ENQUEUE_MIGRATE_TYPE_D2H);
+
+  LL_FOREACH (node->migr_infos, mi)
+  {
+    if (writes_all || !mi->read_only)
+      forget_member_copies (mi->buffer, gmem);
+  }
+}
+
+typedef struct aggregate_launch_s aggregate_launch_t;
+
+typedef struct aggregate_part_s
+{
+  aggregate_launch_t *launch;
+  unsigned member;
+} aggregate_part_t;
+
+/* A buffer the launch may write, seen as one row per index of the outermost
+   dimension. Each member's slab of rows is read back from it and written to
+   the primary. */
+typedef struct aggregate_written_s
+{
+  cl_mem mem;
+  size_t row_size;
+  /* Each member's slab of the contents after the launch, NULL for the
+     primary and the idle members. */
+  char **slabs;
+} aggregate_written_t;
+
+struct aggregate_launch_s
+{
+  remote_device_data_t *d;
+  _cl_command_node *node;
+  kernel_data_t *kd;
+  vec3_t local;
+  vec3_t global;
+  vec3_t offset;
+  /* The local size and the global offset in the outermost dimension, and
+     the index the NDRange ends at in it. */
+  size_t split_local;
+  size_t split_offset;
+  size_t split_end;
+  aggregate_written_t *written;
+  unsigned num_written;
+  /* First work-group and number of work-groups of each member's slab. */
+  size_t *first;
+  size_t *counts;
+  uint64_t start_ns;
+  /* Sub-commands left in the current stage. */
+  uint64_t pending;
+  aggregate_part_t *parts;
+};
+
+static void launch_run (aggregate_launch_t *l);
+static void launch_gather (aggregate_launch_t *l);
+static void launch_merge (aggregate_launch_t *l);
+
+static uint32_t
+launch_queue_id (aggregate_launch_t *l)
+{
+  return (uint32_t)l->node->sync.event.event->queue->id;
+}
+
+static cl_mem
+arg_buffer (_cl_command_node *cmd, unsigned i)
+{
+  struct pocl_argument *al = &cmd->command.run.arguments[i];
+  if (al->value == NULL)
+    return NULL;
+  return *(cl_mem *)al->value;
+}
+
+/* The bytes of W that member MI's slab of work-groups writes. */
+static void
+slab_range (aggregate_launch_t *l, aggregate_written_t *w, unsigned mi,
+            size_t *offset, size_t *size)
+{
+  size_t first_row = l->split_offset + l->first[mi] * l->split_local;
+  *offset = first_row * w->row_size;
+  *size = l->counts[mi] * l->split_local * w->row_size;
+}
+
+/* Checks that the kernel and the arguments of CMD allow dividing it and
+   lists the buffers it may write. */
+static int
+launch_is_divisible (aggregate_launch_t *l, _cl_command_node *cmd)
+{
+  cl_kernel kernel = cmd->command.run.kernel;
+  pocl_kernel_metadata_t *meta = kernel->meta;
+  unsigned i, j;
+
+  /* The primary's compiler knows whether the work-groups can tell a
+     member's slab from the whole NDRange. */
+  if (!meta->groups_independent || kernel->indirect_raw_ptrs != NULL
+      || kernel->can_access_all_raw_buffers_indirectly)
+    return 0;
+
+  for (i = 0; i < meta->num_args; ++i)
+    {
+      struct pocl_argument *al = &cmd->command.run.arguments[i];
+      pocl_argument_info *ai = &meta->arg_info[i];
+      if (ARGP_IS_LOCAL (ai) || ai->type == POCL_ARG_TYPE_NONE)
+        continue;
+      if (al->is_raw_ptr || ai->type != POCL_ARG_TYPE_POINTER)
+        return 0;
+
+      cl_mem mem = arg_buffer (cmd, i);
+      if (mem == NULL)
+        continue;
+      if (mem->parent != NULL || mem->is_image)
+        return 0;
+      if (al->is_readonly || (mem->flags & CL_MEM_READ_ONLY)
+          || ai->address_qualifier == CL_KERNEL_ARG_ADDRESS_CONSTANT
+          || (ai->type_qualifier & CL_KERNEL_ARG_TYPE_CONST))
+        continue;
+
+      /* A written buffer must split into whole rows. */
+      if (mem->size % l->split_end != 0)
+        return 0;
+
+      for (j = 0; j < l->num_written; ++j)
+        if (l->written[j].mem == mem)
+          break;
+      if (j == l->num_written)
+        {
+          l->written[j].mem = mem;
+          l->written[j].row_size = mem->size / l->split_end;
+          ++l->num_written;
+        }
+    }
+  return 1;
+}
+
+static void
+launch_free (aggregate_launch_t *l)
+{
+  unsigned i, mi;
+  if (l == NULL)
+    return;
+  for (i = 0; i < l->num_written; ++i)
+    {
+      if (l->written[i].slabs == NULL)
+        continue;
+      for (mi = 0; mi < l->d->aggregate->num_members; ++mi)
+        free (l->written[i].slabs[mi]);
+      free (l->written[i].slabs);
+    }
+  free (l->written);
+  free (l->first);
+  free (l->counts);
+  free (l->parts);
+  free (l);
+}
+
+/* Allocates the per-member state of a launch of CMD. */
+static int
+launch_alloc (aggregate_launch_t *l, _cl_command_node *cmd)
+{
+  remote_aggregate_t *agg = l->d->aggregate;
+  l->written = calloc (cmd->command.run.kernel->meta->num_args + 1,
+                       sizeof (aggregate_written_t));
+  l->first = calloc (agg->num_members, sizeof (size_t));
+  l->counts = calloc (agg->num_members, sizeof (size_t));
+  l->parts = calloc (agg->num_members, sizeof (aggregate_part_t));
+  if (l->written == NULL || l->first == NULL || l->counts == NULL
+      || l->parts == NULL)
+    return CL_OUT_OF_HOST_MEMORY;
+  return CL_SUCCESS;
+}
+
+/* Allocates the space each member's slabs of the written buffers are read
+   back to. */
+static int
+launch_alloc_slabs (aggregate_launch_t *l)
+{
+  remote_aggregate_t *agg = l->d->aggregate;
+  unsigned i, mi;
+  size_t offset, size;
+
+  for (i = 0; i < l->num_written; ++i)
+    {
+      aggregate_written_t *w = &l->written[i];
+      w->slabs = calloc (agg->num_members, sizeof (char *));
+      if (w->slabs == NULL)
+        return CL_OUT_OF_HOST_MEMORY;
+      for (mi = 1; mi < agg->num_members; ++mi)
+        {
+          if (l->counts[mi] == 0)
+            continue;
+          slab_range (l, w, mi, &offset, &size);
+          w->slabs[mi] = malloc (size);
+          if (w->slabs[mi] == NULL)
+            return CL_OUT_OF_HOST_MEMORY;
+        }
+    }
+  return CL_SUCCESS;
+}
+
+/* Gives up dividing the launch of CMD for lack of host memory. Returns 0,
+   so that the caller runs it on the primary. */
+static int
+launch_out_of_memory (aggregate_launch_t *l, _cl_command_node *cmd)
+{
+  POCL_MSG_WARN ("Out of host memory for dividing kernel %s, running it on "
+                 "the primary\n",
+                 cmd->command.run.kernel->name);
+  launch_free (l);
+  return 0;
+}
+
+static void
+launch_finish (aggregate_launch_t *l)
+{
+  remote_device_data_t *d = l->d;
+  _cl_command_node *node = l->node;
+  launch_free (l);
+  pocl_remote_finish_command (d, node, 0);
+}
+
+/* The stages count their sub-commands in PENDING, holding one extra
+   reference while issuing them so a fast reply can't advance early. */
+static int
+stage_done (aggregate_launch_t *l)
+{
+  return POCL_ATOMIC_DEC (l->pending) == 0;
+}
+
+static void
+sync_done (void *arg, _cl_command_node *node, size_t extra_rep_bytes)
+{
+  aggregate_launch_t *l = arg;
+  if (stage_done (l))
+    launch_run (l);
+}
+
+/* Brings the members' copies of the buffers up to date. */
+static void
+launch_sync (aggregate_launch_t *l)
+{
+  _cl_command_node *cmd = l->node;
+  remote_aggregate_t *agg = l->d->aggregate;
+  unsigned gmem = cmd->device->global_mem_id;
+  unsigned i, mi;
+
+  l->pending = 1;
+  for (i = 0; i < cmd->command.run.kernel->meta->num_args; ++i)
+    {
+      if (cmd->command.run.kernel->meta->arg_info[i].type
+          != POCL_ARG_TYPE_POINTER)
+        continue;
+      cl_mem mem = arg_buffer (cmd, i);
+      if (mem == NULL || mem->device_ptrs[gmem].extra)
+        continue;
+
+      /* Also to the members idle this time, the copy is kept for the
+         launches after. The written buffers too, as the work-items may read
+         the rows they write. */
+      for (mi = 1; mi < agg->num_members; ++mi)
+        {
+          POCL_ATOMIC_INC (l->pending);
+          pocl_network_migrate_d2d_with_id (
+              pocl_network_sub_event_id (), launch_queue_id (l),
+              (uint32_t)mem->id, 0, 0, 0, 0, 0, mem->size,
+              agg->members[mi].ddata, l->d, sync_done, l, cmd);
+        }
+      /* Writes of this launch forget it again in launch_gather(). */
+      mem->device_ptrs[gmem].extra = 1;
+    }
+
+  if (stage_done (l))
+    launch_run (l);
+}
+
+static void
+run_done (void *arg, _cl_command_node *node, size_t extra_rep_bytes)
+{
+  aggregate_part_t *part = arg;
+  aggregate_launch_t *l = part->launch;
+  remote_aggregate_t *agg = l->d->aggregate;
+  uint64_t elapsed = pocl_gettimemono_ns () - l->start_ns;
+
+  if (elapsed > 0)
+    {
+      /* Smooth the throughput over launches. */
+      double rate = (double)l->counts[part->member] / (double)elapsed;
+      remote_aggregate_member_t *m = &agg->members[part->member];
+      POCL_LOCK (agg->lock);
+      m->rate = (m->rate > 0.0) ? 0.75 * m->rate + 0.25 * rate : rate;
+      POCL_UNLOCK (agg->lock);
+    }
+
+  if (stage_done (l))
+    launch_gather (l);
+}
+
+static void
+launch_run (aggregate_launch_t *l)
+{
+  _cl_command_node *cmd = l->node;
+  remote_aggregate_t *agg = l->d->aggregate;
+  cl_kernel kernel = cmd->command.run.kernel;
+  unsigned dim = cmd->command.run.pc.work_dim;
+  unsigned mi;
+
+  l->pending = 1;
+  l->start_ns = pocl_gettimemono_ns ();
+  for (mi = 0; mi < agg->num_members; ++mi)
+    {
+      if (l->counts[mi] == 0)
+        continue;
+      vec3_t global = l->global;
+      vec3_t offset = l->offset;
+      size_t slab_size = l->counts[mi] * l->split_local;
+      size_t slab_offset = l->first[mi] * l->split_local;
+      if (dim == 3)
+        global.z = slab_size, offset.z += slab_offset;
+      else if (dim == 2)
+        global.y = slab_size, offset.y += slab_offset;
+      else
+        global.x = slab_size, offset.x += slab_offset;
+
+      l->parts[mi].launch = l;
+      l->parts[mi].member = mi;
+      POCL_ATOMIC_INC (l->pending);
+      /* The primary's slab carries the node's own event, so the servers
+         learn about its completion as usual. */
+      pocl_network_run_kernel_with_id (
+          mi == 0 ? 0 : pocl_network_sub_event_id (), launch_queue_id (l),
+          agg->members[mi].ddata, kernel, l->kd, 1, dim, l->local, global,
+          offset, run_done, &l->parts[mi], cmd);
+    }
+  if (stage_done (l))
+    launch_gather (l);
+}
+
+static void
+gather_read (void *arg, _cl_command_node *node, size_t extra_rep_bytes)
+{
+  aggregate_launch_t *l = arg;
+  if (stage_done (l))
+    launch_merge (l);
+}
+
+/* Reads each member's slab of the written buffers back. The primary's slab
+   is already in place. */
+static void
+launch_gather (aggregate_launch_t *l)
+{
+  _cl_command_node *cmd = l->node;
+  remote_aggregate_t *agg = l->d->aggregate;
+  unsigned gmem = cmd->device->global_mem_id;
+  unsigned i, mi;
+  size_t offset, size;
+
+  l->pending = 1;
+  for (i = 0; i < l->num_written; ++i)
+    {
+      aggregate_written_t *w = &l->written[i];
+      w->mem->device_ptrs[gmem].extra = 0;
+
+      for (mi = 1; mi < agg->num_members; ++mi)
+        {
+          if (w->slabs[mi] == NULL)
+            continue;
+          slab_range (l, w, mi, &offset, &size);
+          POCL_ATOMIC_INC (l->pending);
+          pocl_network_read_with_id (
+              pocl_network_sub_event_id (), launch_queue_id (l),
+              agg->members[mi].ddata, (uint32_t)w->mem->id, 0, 0,
+              w->slabs[mi], offset, size, gather_read, l, cmd);
+        }
+    }
+  if (stage_done (l))
+    launch_merge (l);
+}
+
+static void
+merge_written (void *arg, _cl_command_node *node, size_t extra_rep_bytes)
+{
+  aggregate_launch_t *l = arg;
+  if (stage_done (l))
+    launch_finish (l);
+}
+
+/* Writes each member's slab of the written buffers to the primary. */
+static void
+launch_merge (aggregate_launch_t *l)
+{
+  remote_aggregate_t *agg = l->d->aggregate;
+  unsigned i, mi;
+  size_t offset, size;
+
+  l->pending = 1;
+  for (i = 0; i < l->num_written; ++i)
+    {
+      aggregate_written_t *w = &l->written[i];
+      for (mi = 1; mi < agg->num_members; ++mi)
+        {
+          if (w->slabs[mi] == NULL)
+            continue;
+          slab_range (l, w, mi, &offset, &size);
+          POCL_ATOMIC_INC (l->pending);
+          pocl_network_write_with_id (pocl_network_sub_event_id (),
+                                      launch_queue_id (l), l->d,
+                                      (uint32_t)w->mem->id, 0, w->slabs[mi],
+                                      offset, size, merge_written, l,
+                                      l->node);
+        }
+    }
+  if (stage_done (l))
+    launch_finish (l);
+}
+
+int
+pocl_remote_aggregate_run (remote_device_data_t *d, _cl_command_node *cmd)
+{
+  remote_aggregate_t *agg = d->aggregate;
+  unsigned dim = cmd->command.run.pc.work_dim;
+  size_t *num_groups = cmd->command.run.pc.num_groups;
+  size_t *local = cmd->command.run.pc.local_size;
+  size_t *global_offset = cmd->command.run.pc.global_offset;
+  unsigned split = (dim == 0 ? 0 : dim - 1);
+  unsigned mi;
+
+  aggregate_launch_t *l = calloc (1, sizeof (aggregate_launch_t));
+  if (l == NULL)
+    return launch_out_of_memory (l, cmd);
+  l->d = d;
+  if (launch_alloc (l, cmd) != CL_SUCCESS)
+    return launch_out_of_memory (l, cmd);
+  l->split_local = local[split];
+  l->split_offset = global_offset[split];
+  l->split_end = global_offset[split] + num_groups[split] * local[split];
+
+  if (!agg->policy->partition (agg, num_groups[split], l->counts))
+    {
+      launch_free (l);
+      return 0;
+    }
+  for (mi = 1; mi < agg->num_members; ++mi)
+    l->first[mi] = l->first[mi - 1] + l->counts[mi - 1];
+  assert (l->first[agg->num_members - 1] + l->counts[agg->num_members - 1]
+          == num_groups[split]);
+
+  if (!launch_is_divisible (l, cmd))
+    {
+      launch_free (l);
+      return 0;
+    }
+  if (launch_alloc_slabs (l) != CL_SUCCESS)
+    return launch_out_of_memory (l, cmd);
+
+  POCL_MSG_PRINT_REMOTE ("Dividing kernel %s (%zu groups) among %u members\n",
+                         cmd->command.run.kernel->name, num_groups[split],
+                         agg->num_members);
+
+  l->node = cmd;
+  l->kd = cmd->command.run.kernel->data[cmd->program_device_i];
+  l->local = (vec3_t){ local[0], local[1], local[2] };
+  l->global = (vec3_t){ num_groups[0] * local[0], num_groups[1] * local[1],
+                        num_groups[2] * local[2] };
+  l->offset
+      = (vec3_t){ global_offset[0], global_offset[1], global_offset[2] };
+
+  pocl_remote_setup_kernel_args (d, cmd);
+  launch_sync (l);
+  return 1;
+}
@@ -0,0 +1,106 @@
+/* aggregate.h - remote devices of several servers presented as one device
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#ifndef POCL_REMOTE_AGGREGATE_H
+#define POCL_REMOTE_AGGREGATE_H
+
+#include "pocl_cl.h"
+#include "pocl_util.h"
+
+#include "communication.h"
+#include "remote.h"
+
+#ifdef __GNUC__
+#pragma GCC visibility push(hidden)
+#endif
+
+/* Separates the members in the POCL_REMOTEn_PARAMETERS of an aggregate
+   device, e.g. "node1:10998/0+node2:10998/0". */
+#define REMOTE_AGGREGATE_SEPARATOR '+'
+
+/* A strategy for dividing an NDRange among the members of an aggregate
+   device. Splitting is always along the outermost dimension, so each member
+   gets a contiguous slab of work-groups. */
+typedef struct remote_partition_policy_s
+{
+  const char *name;
+  /* Distributes NUM_GROUPS work-groups among the members in member order,
+     writing the number each one gets to COUNTS. Returns 0 to run the launch
+     undivided on the primary member instead. */
+  int (*partition) (remote_aggregate_t *agg, size_t num_groups,
+                    size_t *counts);
+} remote_partition_policy_t;
+
+int pocl_remote_aggregate_init (cl_device_id device, remote_device_data_t *d,
+                                unsigned j, const char *members);
+
+void pocl_remote_aggregate_uninit (remote_device_data_t *d);
+
+/* The object lifecycle is mirrored on every member with the same ids. For
+   binary and SPIR-V builds PAYLOAD is the plain binary of the aggregate
+   device. */
+int pocl_remote_aggregate_build (remote_device_data_t *d, const void *payload,
+                                 size_t payload_size, int is_binary,
+                                 int is_builtin, int is_spirv,
+                                 uint32_t prog_id, const char *options,
+                                 int compile_only, int link_only);
+
+void pocl_remote_aggregate_free_program (remote_device_data_t *d,
+                                         uint32_t prog_id);
+
+int pocl_remote_aggregate_create_kernel (remote_device_data_t *d,
+                                         const char *name, uint32_t prog_id,
+                                         uint32_t kernel_id,
+                                         kernel_data_t *kd);
+
+void pocl_remote_aggregate_free_kernel (remote_device_data_t *d,
+                                        kernel_data_t *kd, uint32_t kernel_id,
+                                        uint32_t prog_id);
+
+int pocl_remote_aggregate_create_queue (remote_device_data_t *d,
+                                        uint32_t queue_id);
+
+void pocl_remote_aggregate_free_queue (remote_device_data_t *d,
+                                       uint32_t queue_id);
+
+int pocl_remote_aggregate_create_buffer (remote_device_data_t *d, cl_mem mem,
+                                         int is_svm);
+
+void pocl_remote_aggregate_free_buffer (remote_device_data_t *d, cl_mem mem);
+
+/* Called for every command before it starts on the primary member, to
+   forget the member copies of the buffers it may write. */
+void pocl_remote_aggregate_note_command (remote_device_data_t *d,
+                                         _cl_command_node *node);
+
+/* Starts the kernel command CMD divided among the members. Returns 0 if the
+   launch can't be divided, in which case the caller runs it on the primary
+   member as usual. */
+int pocl_remote_aggregate_run (remote_device_data_t *d,
+                               _cl_command_node *cmd);
+
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
+#endif /* POCL_REMOTE_AGGREGATE_H */
@@ -111,6 +111,9 @@
 
 static uint64_t last_message_id = 1992;
 static uint64_t last_peer_id = 42;
+/* pocld ignores commands with an event id it has seen before, so the ones
+ * of sub-commands start far above those of the application's events. */
+static uint64_t last_sub_event_id = (uint64_t)1 << 62;
 
 // TODO these are copypaste from C++
 
@@ -375,8 +378,339 @@ writev_full (int fd, size_t num, void **arys, size_t *sizes,
   return res;
 }
 
+/* Commands are collected into a batch while more of them are queued, so a
+ * stream of small commands is written with one writev() instead of a
+ * syscall (and a TCP segment) each. The batch only points to the command
+ * data, which stays alive until the reply to the command has been read. */
+#define REMOTE_BATCH_MAX_IOV 64
+#define REMOTE_BATCH_MAX_CMDS 16
+
+typedef struct write_batch_s
+{
+  struct iovec iov[REMOTE_BATCH_MAX_IOV];
+  unsigned num_iov;
+  size_t bytes;
+  /* commands whose data is all in the batch, timestamped once it's sent */
+  network_command *cmds[REMOTE_BATCH_MAX_CMDS];
+  unsigned num_cmds;
+} write_batch_t;
+
+static void
+batch_reset (write_batch_t *b)
+{
+  b->num_iov = 0;
+  b->bytes = 0;
+  b->num_cmds = 0;
+}
+
+static int
+batch_flush (int fd, write_batch_t *b, remote_server_data_t *sinfo)
+{
+  struct iovec *iov = b->iov;
+  unsigned num = b->num_iov;
+#ifdef ENABLE_TRAFFIC_MONITOR
+  POCL_ATOMIC_ADD (sinfo->tx_bytes_submitted, b->bytes);
+#endif
+  while (num > 0)
+    {
+      ssize_t res = writev (fd, iov, num);
+      if (res < 0)
+        {
+          if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            continue;
+          return -1;
+        }
+#ifdef ENABLE_TRAFFIC_MONITOR
+      POCL_ATOMIC_ADD (sinfo->tx_bytes_confirmed, (uint64_t)res);
+#endif
+      /* skip what got written, possibly ending in the middle of an iovec */
+      size_t written = (size_t)res;
+      while (num > 0 && written >= iov->iov_len)
+        {
+          written -= iov->iov_len;
+          ++iov;
+          --num;
+        }
+      if (num > 0)
+        {
+          iov->iov_base = (char *)iov->iov_base + written;
+          iov->iov_len -= written;
+        }
+    }
+
+  uint64_t now = pocl_gettimemono_ns ();
+  POCL_LOCK (sinfo->write_done.mutex);
+  for (unsigned i = 0; i < b->num_cmds; ++i)
+    {
+      network_command *cmd = b->cmds[i];
+      TP_MSG_SENT (cmd->request.msg_id, cmd->event_id,
+                   cmd->request.client_did, cmd->request.did,
+                   cmd->request.message_type, 1);
+      /* the reader may finish the command after this, don't touch it */
+      POCL_ATOMIC_STORE (cmd->client_write_end_timestamp_ns, now);
+    }
+  if (b->num_cmds > 0)
+    POCL_BROADCAST_COND (sinfo->write_done.cond);
+  POCL_UNLOCK (sinfo->write_done.mutex);
+  batch_reset (b);
+  return 0;
+}
+
+/* Adds num buffers to the batch, sending it first if they don't fit. */
+static int
+batch_append (int fd, write_batch_t *b, size_t num, void **arys,
+              size_t *sizes, remote_server_data_t *sinfo)
+{
+  if (b->num_iov + num > REMOTE_BATCH_MAX_IOV
+      && batch_flush (fd, b, sinfo) < 0)
+    return -1;
+  for (size_t i = 0; i < num; ++i)
+    {
+      if (sizes[i] == 0)
+        continue;
+      b->iov[b->num_iov].iov_base = arys[i];
+      b->iov[b->num_iov].iov_len = sizes[i];
+      ++b->num_iov;
+      b->bytes += sizes[i];
+    }
+  return 0;
+}
+
+/* Buffer and image contents sent to the server; the only payloads large
+ * enough to be worth encoding. */
+static int
+is_bulk_write (uint32_t message_type)
+{
+  return message_type == MessageType_WriteBuffer
+         || message_type == MessageType_WriteBufferRect
+         || message_type == MessageType_WriteImageRect;
+}
+
+/* Sends size bytes of src as encoded blocks. */
+static int
+write_encoded_payload (int fd, const char *src, uint64_t size,
+                       pocl_remote_codec_t *codec, void *scratch,
+                       remote_server_data_t *sinfo)
+{
+  uint64_t done = 0;
+  uint64_t headers = 0;
+  while (done < size)
+    {
+      uint64_t remain = size - done;
+      uint32_t n = remain < POCL_REMOTE_CODEC_BLOCK_SIZE
+                       ? (uint32_t)remain
+                       : POCL_REMOTE_CODEC_BLOCK_SIZE;
+      CodecBlockHeader_t hdr;
+      const void *out = pocl_remote_codec_encode_block (codec, src + done, n,
+                                                        scratch, &hdr);
+      void *ptrs[2] = { &hdr, (void *)out };
+      size_t sizes[2] = { sizeof (hdr), hdr.wire_size };
+      if (writev_full (fd, 2, ptrs, sizes, sinfo) < 0)
+        return -1;
+      done += n;
+      headers += sizeof (hdr);
+    }
+  pocl_remote_codec_end (codec);
+
+  POCL_MSG_PRINT_REMOTE ("WRITER THR: payload %" PRIu64 " -> %" PRIu64
+                         " bytes\n",
+                         codec->raw_bytes, codec->wire_bytes + headers);
+#ifdef ENABLE_TRAFFIC_MONITOR
+  POCL_ATOMIC_ADD (sinfo->tx_payload_raw, codec->raw_bytes);
+  POCL_ATOMIC_ADD (sinfo->tx_payload_wire, codec->wire_bytes + headers);
+#endif
+  return 0;
+}
+
+/* Reads an encoded payload of size raw bytes into dst. Returns like
+ * read_full(). */
+static ssize_t
+read_encoded_payload (int fd, char *dst, uint64_t size, uint32_t codec_id,
+                      pocl_remote_codec_t *codec, void *scratch,
+                      remote_server_data_t *sinfo)
+{
+  uint64_t done = 0;
+  uint64_t wire = 0;
+  while (done < size)
+    {
+      CodecBlockHeader_t hdr;
+      ssize_t readb = read_full (fd, &hdr, sizeof (hdr), sinfo);
+      if (readb <= 0)
+        return readb;
+      if (hdr.raw_size == 0 || hdr.wire_size == 0
+          || hdr.raw_size > size - done || hdr.wire_size > hdr.raw_size
+          || hdr.raw_size > POCL_REMOTE_CODEC_BLOCK_SIZE)
+        {
+          errno = EPROTO;
+          return -1;
+        }
+      /* stored blocks are read in place */
+      void *src
+          = (hdr.wire_size == hdr.raw_size) ? (void *)(dst + done) : scratch;
+      readb = read_full (fd, src, hdr.wire_size, sinfo);
+      if (readb <= 0)
+        return readb;
+      if (pocl_remote_codec_decode_block (codec, codec_id, &hdr, src,
+                                          dst + done))
+        {
+          errno = EPROTO;
+          return -1;
+        }
+      done += hdr.raw_size;
+      wire += sizeof (hdr) + hdr.wire_size;
+    }
+
+#ifdef ENABLE_TRAFFIC_MONITOR
+  POCL_ATOMIC_ADD (sinfo->rx_payload_raw, size);
+  POCL_ATOMIC_ADD (sinfo->rx_payload_wire, wire);
+#endif
+  return (ssize_t)size;
+}
+
+/* Buffer and image contents read from the server. */
+static int
+is_bulk_read (uint32_t message_type)
+{
+  return message_type == MessageType_ReadBuffer
+         || message_type == MessageType_ReadBufferRect
+         || message_type == MessageType_ReadImageRect;
+}
+
+/* Allocation granularity of the shared memory window. */
+#define REMOTE_SHM_CHUNK (64 * 1024)
+
+/* Returns the first run of n free chunks in [from, to), or SIZE_MAX. */
+static size_t
+shm_find_free (const uint64_t *map, size_t from, size_t to, size_t n)
+{
+  size_t run = 0;
+  for (size_t i = from; i < to; ++i)
+    {
+      if (map[i / 64] & (1ULL << (i % 64)))
+        run = 0;
+      else if (++run == n)
+        return i + 1 - n;
+    }
+  return SIZE_MAX;
+}
+
+static void
+shm_mark (uint64_t *map, size_t first, size_t n, int used)
+{
+  for (size_t i = first; i < first + n; ++i)
+    {
+      if (used)
+        map[i / 64] |= 1ULL << (i % 64);
+      else
+        map[i / 64] &= ~(1ULL << (i % 64));
+    }
+}
+
+/* Reserves a slot for a payload of size bytes in the shared memory window.
+ * Next fit, so that slots released roughly in the order they were taken
+ * behave like a ring. Returns 0 on success; when the window is full the
+ * payload goes through the socket instead. */
+static int
+shm_alloc (remote_server_data_t *d, network_command *cmd, uint64_t size)
+{
+  size_t n = (size + REMOTE_SHM_CHUNK - 1) / REMOTE_SHM_CHUNK;
+  if (n == 0 || n > d->shm_chunks)
+    return -1;
+
+  POCL_LOCK (d->shm_lock);
+  size_t first = shm_find_free (d->shm_map, d->shm_next, d->shm_chunks, n);
+  if (first == SIZE_MAX)
+    first = shm_find_free (d->shm_map, 0, d->shm_chunks, n);
+  if (first != SIZE_MAX)
+    {
+      shm_mark (d->shm_map, first, n, 1);
+      d->shm_next = first + n;
+    }
+  POCL_UNLOCK (d->shm_lock);
+
+  if (first == SIZE_MAX)
+    return -1;
+  cmd->shm_offset = (uint64_t)first * REMOTE_SHM_CHUNK;
+  cmd->shm_size = size;
+  return 0;
+}
+
+static void
+shm_release (remote_server_data_t *d, network_command *cmd)
+{
+  size_t n = (cmd->shm_size + REMOTE_SHM_CHUNK - 1) / REMOTE_SHM_CHUNK;
+  POCL_LOCK (d->shm_lock);
+  shm_mark (d->shm_map, cmd->shm_offset / REMOTE_SHM_CHUNK, n, 0);
+  POCL_UNLOCK (d->shm_lock);
+  cmd->shm_size = 0;
+}
+
+/* Passes a new shared memory window to a server running on this host. Any
+ * failure just leaves the session on the sockets. */
+static void
+attach_shared_memory (remote_server_data_t *d, uint32_t server_pid)
+{
+  size_t size = (size_t)pocl_get_int_option ("POCL_REMOTE_SHM_SIZE", 64)
+                << 20;
+  size = size / (64 * REMOTE_SHM_CHUNK) * (64 * REMOTE_SHM_CHUNK);
+  if (size == 0)
+    return;
+
+  int sock = pocl_remote_shm_connect (d->fast_port, server_pid);
+  if (sock < 0)
+    {
+      if (errno == EACCES)
+        POCL_MSG_WARN ("The local socket for %s is not owned by the server, "
+                       "not using shared memory\n",
+                       d->address_with_port);
+      else
+        POCL_MSG_PRINT_REMOTE ("%s is not on this host, not using shared "
+                               "memory\n",
+                               d->address_with_port);
+      return;
+    }
+
+  void *base = NULL;
+  int fd = pocl_remote_shm_create (size, &base);
+  int32_t status = errno;
+  if (fd >= 0)
+    {
+      SharedMemoryAttachMsg_t msg;
+      memset (&msg, 0, sizeof (msg));
+      msg.session = d->session;
+      memcpy (msg.authkey, d->authkey, AUTHKEY_LENGTH);
+      msg.size = size;
+      status = EPIPE;
+      if (pocl_remote_send_fd (sock, &msg, sizeof (msg), fd) == 0
+          && read_full (sock, &status, sizeof (status), d)
+                 != sizeof (status))
+        status = EPIPE;
+      close (fd);
+    }
+  close (sock);
+
+  if (status != 0)
+    {
+      POCL_MSG_WARN ("Could not set up shared memory with %s: %s\n",
+                     d->address_with_port, strerror (status));
+      if (base)
+        munmap (base, size);
+      return;
+    }
+
+  d->shm_base = base;
+  d->shm_size = size;
+  d->shm_chunks = size / REMOTE_SHM_CHUNK;
+  d->shm_map = calloc (d->shm_chunks / 64, sizeof (uint64_t));
+  POCL_INIT_LOCK (d->shm_lock);
+  POCL_MSG_PRINT_REMOTE ("Passing payloads to %s through %zu MiB of shared "
+                         "memory\n",
+                         d->address_with_port, size >> 20);
+}
+
 static void
-finish_running_cmd (network_command *running_cmd)
+finish_running_cmd (remote_server_data_t *remote,
+                    network_command *running_cmd)
 {
 
   running_cmd->client_read_end_timestamp_ns = pocl_gettimemono_ns ();
@@ -385,11 +719,28 @@ finish_running_cmd (network_command *running_cmd)
                    running_cmd->reply.client_did, running_cmd->reply.did,
                    running_cmd->reply.message_type, 1);
 
-  running_cmd->status = NETCMD_FINISHED;
+  /* Wait until the writer has timestamped the end of the write. The writer
+   * may still touch the command after the reply has arrived, which for
+   * synchronous commands must not happen once the caller has been woken
+   * up. */
+  uint64_t start, end;
+  POCL_LOCK (remote->write_done.mutex);
+  for (;;)
+    {
+      end = POCL_ATOMIC_LOAD (running_cmd->client_write_end_timestamp_ns);
+      start = POCL_ATOMIC_LOAD (running_cmd->client_write_start_timestamp_ns);
+      if (end > start)
+        break;
+      POCL_WAIT_COND (remote->write_done.cond, remote->write_done.mutex);
+    }
+  POCL_UNLOCK (remote->write_done.mutex);
 
   if (running_cmd->synchronous)
     {
       POCL_LOCK (running_cmd->data.sync.mutex);
+      /* under the mutex, or the waiter could see it and return before the
+       * signal below */
+      running_cmd->status = NETCMD_FINISHED;
       POCL_SIGNAL_COND (running_cmd->data.sync.cond);
       TP_MSG_RECEIVED (running_cmd->reply.msg_id, running_cmd->event_id,
                        running_cmd->reply.client_did, running_cmd->reply.did,
@@ -406,6 +757,8 @@ finish_running_cmd (network_command *running_cmd)
     }
   else
     {
+      running_cmd->status = NETCMD_FINISHED;
+
       // setup event timestamps
       cl_event e = running_cmd->data.async.node->sync.event.event;
       cl_command_type type = running_cmd->data.async.node->type;
@@ -424,16 +777,6 @@ finish_running_cmd (network_command *running_cmd)
         ocl_on_dev = running_cmd->reply.timing.completed
                      - running_cmd->reply.timing.started;
 
-      /* No-op until writer has finished writing timestamps
-       * If we get stuck here something has gone wrong */
-      uint64_t start, end;
-      do
-        {
-          end = POCL_ATOMIC_LOAD (running_cmd->client_write_end_timestamp_ns);
-          start = POCL_ATOMIC_LOAD (
-              running_cmd->client_write_start_timestamp_ns);
-        }
-      while (end <= start);
       // TODO this compares times of write() syscalls, but that may not be
       // equal to transfer times
       uint64_t local_writing_ns = end - start;
@@ -469,6 +812,11 @@ finish_running_cmd (network_command *running_cmd)
                                       ? local_reading_ns
                                       : remote_writing_ns;
 
+      /* Sub-commands issued under their own event id (aggregate devices)
+       * must not clobber the timestamps of the node's event. */
+      if (running_cmd->event_id != e->id)
+        type = CL_COMMAND_MARKER;
+
       switch (type)
         {
 
@@ -519,19 +867,16 @@ finish_running_cmd (network_command *running_cmd)
                        running_cmd->reply.client_did, running_cmd->reply.did,
                        running_cmd->reply.message_type, 2);
 
+      /* The kernel arguments are copied to the netcmd. Go by the request
+       * rather than the node type, an aggregate device sends transfers on
+       * behalf of kernel nodes as well. */
       void *p = NULL;
-      switch (type)
+      if (running_cmd->request.message_type == MessageType_RunKernel)
         {
-        case CL_COMMAND_NDRANGE_KERNEL:
-        case CL_COMMAND_TASK:
-        case CL_COMMAND_NATIVE_KERNEL:
           p = (void *)running_cmd->req_extra_data;
           POCL_MEM_FREE (p);
           p = (void *)running_cmd->req_extra_data2;
           POCL_MEM_FREE (p);
-          break;
-        default:
-          break;
         }
 
       POCL_MEM_FREE (running_cmd->req_wait_list);
@@ -541,7 +886,8 @@ finish_running_cmd (network_command *running_cmd)
 
 static cl_int
 pocl_network_connect (remote_server_data_t *data, int *fd, unsigned port,
-                      int bufsize, int is_fast, ReplyMsg_t *reply_out)
+                      int bufsize, int is_fast, unsigned stripe,
+                      ReplyMsg_t *reply_out)
 {
   const int32_t one = 1;
   const int32_t zero = 0;
@@ -620,6 +966,11 @@ pocl_network_connect (remote_server_data_t *data, int *fd, unsigned port,
   hs.m.get_session.peer_id = data->peer_id;
   hs.session = data->session;
   hs.m.get_session.fast_socket = is_fast;
+  hs.m.get_session.payload_codecs = data->payload_codec;
+  hs.m.get_session.codec_threshold = data->codec_threshold;
+  hs.m.get_session.num_stripes = data->num_stripes;
+  hs.m.get_session.stripe = stripe;
+  hs.m.get_session.stripe_chunk = data->stripe_chunk;
   memcpy (hs.authkey, data->authkey, AUTHKEY_LENGTH);
   ssize_t readb, writeb;
   uint32_t req_len = request_size (hs.message_type);
@@ -629,6 +980,11 @@ pocl_network_connect (remote_server_data_t *data, int *fd, unsigned port,
   assert ((size_t)(writeb) == 0);
   readb = read_full (socket_fd, &hsr, sizeof (hsr), data);
   assert ((size_t)(readb) == sizeof (hsr));
+  if (hsr.failed)
+    {
+      close (socket_fd);
+      return CL_INVALID_DEVICE;
+    }
   if (reply_out)
     memcpy (reply_out, &hsr, sizeof (ReplyMsg_t));
 
@@ -679,10 +1035,10 @@ pocl_remote_reconnect_sockets (remote_server_data_t *remote)
   int status = 0;
   status |= pocl_network_connect (remote, &remote->fast_socket_fd,
                                   remote->fast_port, NETWORK_BUF_SIZE_FAST, 1,
-                                  NULL);
+                                  0, NULL);
   status |= pocl_network_connect (remote, &remote->slow_socket_fd,
                                   remote->slow_port, NETWORK_BUF_SIZE_SLOW, 0,
-                                  NULL);
+                                  0, NULL);
   // TODO: reconnect RDMA somehow?
 
   if (status == CL_SUCCESS)
@@ -703,6 +1059,235 @@ pocl_remote_reconnect_sockets (remote_server_data_t *remote)
     }
 }
 
+/* Striped transfers: payloads larger than a chunk go over the extra data
+ * connections of the session, each chunk preceded by a StripeChunkHeader_t.
+ * The writer threads of the connections take the chunks of a payload in
+ * turn, so a slow connection doesn't hold up the others; the reader threads
+ * copy incoming chunks straight into the reply buffer of their command.
+ * The data connections are not re-established when the command sockets
+ * reconnect; striping is given up instead. */
+
+typedef struct stripe_job_s
+{
+  uint64_t msg_id;
+  const char *data;
+  uint64_t size;
+  /* offset of the next chunk to send */
+  uint64_t next;
+  /* writer threads still working on the job */
+  unsigned busy;
+  int failed;
+} stripe_job_t;
+
+struct remote_stripe_s
+{
+  remote_server_data_t *remote;
+  int fd;
+  pocl_thread_t reader;
+  pocl_thread_t writer;
+  /* the payload being sent, NULL if none */
+  stripe_job_t *job;
+};
+
+static int
+stripes_usable (remote_server_data_t *d)
+{
+  return d->num_stripes > 0 && !POCL_ATOMIC_LOAD (d->stripes_broken);
+}
+
+static void
+stripes_fail (remote_server_data_t *d)
+{
+  if (POCL_ATOMIC_CAS (&d->stripes_broken, 0, 1) == 0)
+    POCL_MSG_WARN ("Lost a data connection to %s, large transfers go "
+                   "through the command sockets from now on\n",
+                   d->address_with_port);
+}
+
+/* Subtracts the n bytes that just arrived from the payload of a striped
+ * reply; whoever completes it, the reader of the reply or the one of its
+ * last chunk, finishes the command. */
+static void
+stripe_reply_progress (remote_server_data_t *d, network_command *cmd,
+                       uint64_t n)
+{
+  uint64_t left = POCL_ATOMIC_ADD (cmd->stripe_pending, (uint64_t)0 - n);
+  if (left != 0)
+    return;
+  POCL_LOCK (d->inflight_queue->mutex);
+  DL_DELETE (d->inflight_queue->queue, cmd);
+  POCL_UNLOCK (d->inflight_queue->mutex);
+  finish_running_cmd (d, cmd);
+}
+
+static void *
+pocl_remote_stripe_reader_pthread (void *aa)
+{
+  remote_stripe_t *s = aa;
+  remote_server_data_t *d = s->remote;
+  char *discard = NULL;
+
+  StripeChunkHeader_t hdr;
+  while (read_full (s->fd, &hdr, sizeof (hdr), d) == sizeof (hdr))
+    {
+      network_command *cmd = NULL;
+      POCL_LOCK (d->inflight_queue->mutex);
+      DL_FOREACH (d->inflight_queue->queue, cmd)
+      {
+        if (cmd->request.msg_id == hdr.msg_id)
+          break;
+      }
+      POCL_UNLOCK (d->inflight_queue->mutex);
+
+      char *dst;
+      if (cmd != NULL && hdr.offset <= cmd->rep_extra_size
+          && hdr.size <= cmd->rep_extra_size - hdr.offset)
+        dst = cmd->rep_extra_data + hdr.offset;
+      else
+        {
+          /* a reply resent after a reconnect, or garbage */
+          POCL_MSG_WARN ("STRIPE READER: dropping a chunk of message ID %" PRIu64
+                         "\n",
+                         (uint64_t)hdr.msg_id);
+          if (hdr.size > d->stripe_chunk)
+            break;
+          if (discard == NULL)
+            discard = malloc (d->stripe_chunk);
+          dst = discard;
+          cmd = NULL;
+        }
+      if (read_full (s->fd, dst, hdr.size, d) != (ssize_t)hdr.size)
+        break;
+      if (cmd != NULL)
+        stripe_reply_progress (d, cmd, hdr.size);
+    }
+
+  if (!POCL_ATOMIC_LOAD (d->stripe_exit))
+    stripes_fail (d);
+  POCL_MEM_FREE (discard);
+  POCL_EXIT_THREAD (NULL);
+}
+
+static void *
+pocl_remote_stripe_writer_pthread (void *aa)
+{
+  remote_stripe_t *s = aa;
+  remote_server_data_t *d = s->remote;
+
+  POCL_LOCK (d->stripe_lock);
+  while (1)
+    {
+      while (!d->stripe_exit && s->job == NULL)
+        POCL_WAIT_COND (d->stripe_cond, d->stripe_lock);
+      stripe_job_t *job = s->job;
+      if (d->stripe_exit)
+        {
+          /* the sender waits for every writer it gave the job to */
+          if (job != NULL)
+            {
+              job->failed = 1;
+              s->job = NULL;
+              if (--job->busy == 0)
+                POCL_BROADCAST_COND (d->stripe_cond);
+            }
+          break;
+        }
+      POCL_UNLOCK (d->stripe_lock);
+
+      int ok = 1;
+      while (ok)
+        {
+          uint64_t end = POCL_ATOMIC_ADD (job->next, d->stripe_chunk);
+          uint64_t offset = end - d->stripe_chunk;
+          if (offset >= job->size)
+            break;
+          StripeChunkHeader_t hdr;
+          hdr.msg_id = job->msg_id;
+          hdr.offset = offset;
+          hdr.size = end < job->size ? d->stripe_chunk : job->size - offset;
+          hdr.total = job->size;
+          ok = write_full (s->fd, &hdr, sizeof (hdr), d) == 0
+               && write_full (s->fd, (void *)(job->data + offset), hdr.size, d)
+                      == 0;
+        }
+
+      POCL_LOCK (d->stripe_lock);
+      if (!ok)
+        job->failed = 1;
+      s->job = NULL;
+      if (--job->busy == 0)
+        POCL_BROADCAST_COND (d->stripe_cond);
+    }
+  POCL_UNLOCK (d->stripe_lock);
+  POCL_EXIT_THREAD (NULL);
+}
+
+/* Sends the payload of request msg_id over all of the data connections and
+ * returns once it has been written; -1 on an error. */
+static int
+stripe_send (remote_server_data_t *d, uint64_t msg_id, const char *data,
+             uint64_t size)
+{
+  stripe_job_t job;
+  memset (&job, 0, sizeof (job));
+  job.msg_id = msg_id;
+  job.data = data;
+  job.size = size;
+
+  /* one payload at a time, each over all of the connections */
+  POCL_LOCK (d->stripe_send_lock);
+  POCL_LOCK (d->stripe_lock);
+  if (!d->stripe_exit)
+    {
+      for (unsigned i = 0; i < d->num_stripes; ++i)
+        {
+          d->stripes[i].job = &job;
+          ++job.busy;
+        }
+      POCL_BROADCAST_COND (d->stripe_cond);
+      while (job.busy > 0)
+        POCL_WAIT_COND (d->stripe_cond, d->stripe_lock);
+    }
+  else
+    job.failed = 1;
+  POCL_UNLOCK (d->stripe_lock);
+  POCL_UNLOCK (d->stripe_send_lock);
+
+  if (job.failed)
+    stripes_fail (d);
+  return job.failed ? -1 : 0;
+}
+
+/* Opens the data connections the server agreed to in the handshake. Without
+ * all of them the session goes on without striping. */
+static void
+connect_stripes (remote_server_data_t *d)
+{
+  d->stripes = calloc (d->num_stripes, sizeof (remote_stripe_t));
+  for (unsigned i = 0; i < d->num_stripes; ++i)
+    {
+      d->stripes[i].remote = d;
+      if (pocl_network_connect (d, &d->stripes[i].fd, d->slow_port,
+                                NETWORK_BUF_SIZE_SLOW, 0, i + 1, NULL))
+        {
+          POCL_MSG_WARN ("Could not open data connection %u to %s, not "
+                         "striping transfers\n",
+                         i + 1, d->address_with_port);
+          while (i-- > 0)
+            pocl_network_disconnect (d, d->stripes[i].fd);
+          POCL_MEM_FREE (d->stripes);
+          d->num_stripes = 0;
+          return;
+        }
+    }
+  POCL_INIT_LOCK (d->stripe_lock);
+  POCL_INIT_COND (d->stripe_cond);
+  POCL_INIT_LOCK (d->stripe_send_lock);
+  POCL_MSG_PRINT_REMOTE ("Striping transfers larger than %" PRIu32
+                         " bytes over %u data connections\n",
+                         d->stripe_chunk, d->num_stripes);
+}
+
 static void *
 pocl_remote_reader_pthread (void *aa)
 {
@@ -717,6 +1302,13 @@ pocl_remote_reader_pthread (void *aa)
   pfd.events = POLLIN;
   int nevs;
 
+  pocl_remote_codec_t codec;
+  pocl_remote_codec_init (&codec, remote->payload_codec,
+                          remote->codec_threshold);
+  void *codec_scratch = NULL;
+  if (remote->payload_codec != POCL_REMOTE_CODEC_NONE)
+    codec_scratch = malloc (pocl_remote_codec_scratch_size ());
+
   while (!this->exit_requested)
     {
       POCL_LOCK (remote->setup_lock.mutex);
@@ -789,7 +1381,38 @@ pocl_remote_reader_pthread (void *aa)
       running_cmd->status = NETCMD_READ;
 
       // READ EXTRA DATA
-      if (running_cmd->reply.data_size > 0)
+      if (running_cmd->reply.payload_codec == POCL_REMOTE_PAYLOAD_SHM)
+        {
+          if (running_cmd->reply.data_size <= running_cmd->shm_size)
+            memcpy (running_cmd->rep_extra_data,
+                    remote->shm_base + running_cmd->shm_offset,
+                    running_cmd->reply.data_size);
+          else
+            {
+              POCL_MSG_ERR ("READER THR: reply data outside of its shared "
+                            "memory slot\n");
+              running_cmd->reply.failed = 1;
+            }
+          running_cmd->rep_extra_size = running_cmd->reply.data_size;
+        }
+      else if (running_cmd->reply.payload_codec
+               == POCL_REMOTE_PAYLOAD_STRIPED)
+        {
+          /* the payload comes over the data connections, possibly before
+           * the reply */
+          if (running_cmd->reply.data_size > running_cmd->rep_extra_size)
+            {
+              POCL_MSG_ERR ("READER THR: striped reply larger than its "
+                            "buffer\n");
+              running_cmd->reply.failed = 1;
+              running_cmd->reply.data_size = running_cmd->rep_extra_size;
+            }
+          running_cmd->rep_extra_size = running_cmd->reply.data_size;
+          stripe_reply_progress (remote, running_cmd,
+                                 (uint64_t)0 - running_cmd->reply.data_size);
+          continue;
+        }
+      else if (running_cmd->reply.data_size > 0)
         {
           if (running_cmd->reply.strings_size > 0)
             {
@@ -802,15 +1425,26 @@ pocl_remote_reader_pthread (void *aa)
                   = running_cmd->rep_extra_data + running_cmd->rep_extra_size;
             }
           running_cmd->rep_extra_size = running_cmd->reply.data_size;
-          readb = read_full (fd, running_cmd->rep_extra_data,
-                             running_cmd->reply.data_size, remote);
+          if (running_cmd->reply.payload_codec != POCL_REMOTE_CODEC_NONE)
+            readb = read_encoded_payload (
+                fd, running_cmd->rep_extra_data, running_cmd->reply.data_size,
+                running_cmd->reply.payload_codec, &codec, codec_scratch,
+                remote);
+          else
+            readb = read_full (fd, running_cmd->rep_extra_data,
+                               running_cmd->reply.data_size, remote);
           CHECK_READ (readb);
         }
+      /* the server is done with the payload once it has replied */
+      if (running_cmd->shm_size > 0)
+        shm_release (remote, running_cmd);
       POCL_LOCK (inflight->mutex);
       DL_DELETE (inflight->queue, running_cmd);
       POCL_UNLOCK (inflight->mutex);
-      finish_running_cmd (running_cmd);
+      finish_running_cmd (remote, running_cmd);
     }
+  pocl_remote_codec_free (&codec);
+  POCL_MEM_FREE (codec_scratch);
   POCL_EXIT_THREAD (NULL);
 }
 
@@ -902,7 +1536,7 @@ pocl_remote_rdma_reader_pthread (void *aa)
       DL_DELETE (this->queue, cmd);
       POCL_UNLOCK (this->mutex);
 
-      finish_running_cmd (cmd);
+      finish_running_cmd (remote, cmd);
 
       POCL_LOCK (this->mutex);
     }
@@ -1031,8 +1665,11 @@ pocl_remote_rdma_writer_pthread (void *aa)
                   // TODO: Some other failures here could also be recoverable
                 }
 
+              POCL_LOCK (remote->write_done.mutex);
               POCL_ATOMIC_STORE (cmd->client_write_end_timestamp_ns,
                                  pocl_gettimemono_ns ());
+              POCL_BROADCAST_COND (remote->write_done.cond);
+              POCL_UNLOCK (remote->write_done.mutex);
             }
 
           if (attempts == 0)
@@ -1069,8 +1706,18 @@ pocl_remote_writer_pthread (void *aa)
   remote_server_data_t *remote = a->remote;
   POCL_MEM_FREE (a);
   int resending = 0;
-  network_command *backup[5] = { NULL };
+  /* large enough to resend a whole batch that failed to go out */
+  network_command *backup[REMOTE_BATCH_MAX_CMDS] = { NULL };
   int backup_idx = 0;
+  write_batch_t batch;
+  batch_reset (&batch);
+
+  pocl_remote_codec_t codec;
+  pocl_remote_codec_init (&codec, remote->payload_codec,
+                          remote->codec_threshold);
+  void *codec_scratch = NULL;
+  if (remote->payload_codec != POCL_REMOTE_CODEC_NONE)
+    codec_scratch = malloc (pocl_remote_codec_scratch_size ());
 
   network_command *cmd;
   POCL_LOCK (this->mutex);
@@ -1100,6 +1747,8 @@ pocl_remote_writer_pthread (void *aa)
               pocl_remote_reconnect_sockets (remote);
               fd = *this->fd;
               POCL_UNLOCK (remote->setup_lock.mutex);
+              /* the batched commands are in the backups */
+              batch_reset (&batch);
               resending = 1;
               backup_idx = 0;
             }
@@ -1125,6 +1774,7 @@ pocl_remote_writer_pthread (void *aa)
             }
 
           uint32_t msg_size = request_size (cmd->request.message_type);
+          cmd->request_size = msg_size;
 
           POCL_MSG_PRINT_REMOTE ("WRITER THR: WRITING MSG, TYPE: %u  ID: %zu  "
                                  "EVENT: %zu  SIZE: msg_size: %u + waitlist: "
@@ -1159,53 +1809,105 @@ pocl_remote_writer_pthread (void *aa)
             }
 
           // WRITE DATA
+          /* Payloads to and from a same-host server go through the shared
+           * memory window when there's room. A resent command keeps its
+           * slot. */
+          if (remote->shm_base != NULL && cmd->shm_size == 0)
+            {
+              if (cmd->req_extra_data != NULL
+                  && is_bulk_write (cmd->request.message_type)
+                  && shm_alloc (remote, cmd, cmd->req_extra_size) == 0)
+                memcpy (remote->shm_base + cmd->shm_offset,
+                        cmd->req_extra_data, cmd->req_extra_size);
+              else if (cmd->rep_extra_data != NULL
+                       && is_bulk_read (cmd->request.message_type))
+                shm_alloc (remote, cmd, cmd->rep_extra_size);
+            }
+
+          cmd->request.payload_codec = POCL_REMOTE_CODEC_NONE;
+          if (cmd->shm_size > 0)
+            {
+              cmd->request.payload_codec = POCL_REMOTE_PAYLOAD_SHM;
+              cmd->request.shm_offset = cmd->shm_offset;
+            }
+          /* Large transfers are split over the data connections; the
+           * chunks are not compressed. */
+          else if (stripes_usable (remote) && cmd->req_extra_data != NULL
+                   && cmd->req_extra_data2 == NULL
+                   && is_bulk_write (cmd->request.message_type)
+                   && cmd->req_extra_size > remote->stripe_chunk)
+            cmd->request.payload_codec = POCL_REMOTE_PAYLOAD_STRIPED;
+          else if (stripes_usable (remote) && cmd->rep_extra_data != NULL
+                   && is_bulk_read (cmd->request.message_type)
+                   && cmd->rep_extra_size > remote->stripe_chunk)
+            cmd->request.payload_codec = POCL_REMOTE_PAYLOAD_STRIPED;
+          else if (codec_scratch != NULL && cmd->req_extra_data != NULL
+                   && is_bulk_write (cmd->request.message_type))
+            cmd->request.payload_codec
+                = pocl_remote_codec_begin (&codec, cmd->req_extra_size);
+
           if (cmd->req_extra_data2)
             {
               void *ptrs[5]
-                  = { &msg_size, &cmd->request, (void *)cmd->req_wait_list,
-                      (void *)cmd->req_extra_data,
+                  = { &cmd->request_size, &cmd->request,
+                      (void *)cmd->req_wait_list, (void *)cmd->req_extra_data,
                       (void *)cmd->req_extra_data2 };
               size_t sizes[5] = { sizeof (uint32_t), msg_size,
                                   cmd->req_waitlist_size * sizeof (uint64_t),
                                   cmd->req_extra_size, cmd->req_extra_size2 };
-              CHECK_WRITE (writev_full (fd, 5, ptrs, sizes, remote));
-            }
-          else if (cmd->req_extra_data)
-            {
-
-              void *ed = (void *)cmd->req_extra_data;
-              size_t eds = cmd->req_extra_size;
-
-              void *ptrs[4] = { &msg_size, &cmd->request,
-                                (void *)cmd->req_wait_list, ed };
-              size_t sizes[4]
-                  = { sizeof (uint32_t), msg_size,
-                      cmd->req_waitlist_size * sizeof (uint64_t), eds };
-              CHECK_WRITE (writev_full (fd, 4, ptrs, sizes, remote));
+              CHECK_WRITE (batch_append (fd, &batch, 5, ptrs, sizes, remote));
             }
-          else if (cmd->req_waitlist_size > 0)
+          else if (cmd->request.payload_codec != POCL_REMOTE_CODEC_NONE)
             {
-              void *ptrs[3]
-                  = { &msg_size, &cmd->request, (void *)cmd->req_wait_list };
+              void *ptrs[3] = { &cmd->request_size, &cmd->request,
+                                (void *)cmd->req_wait_list };
               size_t sizes[3] = { sizeof (uint32_t), msg_size,
                                   cmd->req_waitlist_size * sizeof (uint64_t) };
-              CHECK_WRITE (writev_full (fd, 3, ptrs, sizes, remote));
+              CHECK_WRITE (batch_append (fd, &batch, 3, ptrs, sizes, remote));
+              if (cmd->request.payload_codec == POCL_REMOTE_PAYLOAD_STRIPED)
+                {
+                  if (cmd->req_extra_data != NULL)
+                    {
+                      CHECK_WRITE (batch_flush (fd, &batch, remote));
+                      CHECK_WRITE (stripe_send (remote, cmd->request.msg_id,
+                                                cmd->req_extra_data,
+                                                cmd->req_extra_size));
+                    }
+                }
+              else if (cmd->request.payload_codec != POCL_REMOTE_PAYLOAD_SHM)
+                {
+                  CHECK_WRITE (batch_flush (fd, &batch, remote));
+                  CHECK_WRITE (write_encoded_payload (
+                      fd, cmd->req_extra_data, cmd->req_extra_size, &codec,
+                      codec_scratch, remote));
+                }
             }
           else
             {
-              assert (cmd->req_waitlist_size == 0);
-              assert (cmd->req_wait_list == NULL);
-              CHECK_WRITE (
-                  write_full (fd, &msg_size, sizeof (uint32_t), remote));
-              CHECK_WRITE (write_full (fd, &cmd->request, msg_size, remote));
+              /* any of the waitlist and the extra data may be empty */
+              void *ptrs[4] = { &cmd->request_size, &cmd->request,
+                                (void *)cmd->req_wait_list,
+                                (void *)cmd->req_extra_data };
+              size_t sizes[4] = { sizeof (uint32_t), msg_size,
+                                  cmd->req_waitlist_size * sizeof (uint64_t),
+                                  cmd->req_extra_data ? cmd->req_extra_size
+                                                      : 0 };
+              CHECK_WRITE (batch_append (fd, &batch, 4, ptrs, sizes, remote));
             }
+          batch.cmds[batch.num_cmds++] = cmd;
 
-          POCL_ATOMIC_STORE (cmd->client_write_end_timestamp_ns,
-                             pocl_gettimemono_ns ());
-
-          TP_MSG_SENT (cmd->request.msg_id, cmd->event_id,
-                       cmd->request.client_did, cmd->request.did,
-                       cmd->request.message_type, 1);
+          /* Send the batch unless more commands are already waiting and
+           * there's room for them. Resent commands go out one by one. */
+          int more = 0;
+          if (!resending && batch.num_cmds < REMOTE_BATCH_MAX_CMDS
+              && batch.bytes < remote->write_batch_size)
+            {
+              POCL_LOCK (this->mutex);
+              more = this->queue != NULL;
+              POCL_UNLOCK (this->mutex);
+            }
+          if (!more)
+            CHECK_WRITE (batch_flush (fd, &batch, remote));
 
           if (resending)
             {
@@ -1242,6 +1944,8 @@ pocl_remote_writer_pthread (void *aa)
 
   POCL_UNLOCK (this->mutex);
 
+  pocl_remote_codec_free (&codec);
+  POCL_MEM_FREE (codec_scratch);
   POCL_EXIT_THREAD (NULL);
 }
 
@@ -1302,9 +2006,15 @@ traffic_monitor_pthread (void *arg)
       rx_bytes_confirmed = POCL_ATOMIC_LOAD (server->rx_bytes_confirmed);
       tx_bytes_submitted = POCL_ATOMIC_LOAD (server->tx_bytes_submitted);
       tx_bytes_confirmed = POCL_ATOMIC_LOAD (server->tx_bytes_confirmed);
-      fprintf (f, "%jd,%ld,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+      fprintf (f,
+               "%jd,%ld,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+               ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
                now.tv_sec, now.tv_nsec, rx_bytes_requested, rx_bytes_confirmed,
-               tx_bytes_submitted, tx_bytes_confirmed);
+               tx_bytes_submitted, tx_bytes_confirmed,
+               POCL_ATOMIC_LOAD (server->rx_payload_raw),
+               POCL_ATOMIC_LOAD (server->rx_payload_wire),
+               POCL_ATOMIC_LOAD (server->tx_payload_raw),
+               POCL_ATOMIC_LOAD (server->tx_payload_wire));
       fflush (f);
 
       now.tv_nsec += 10000000; /* 10ms */
@@ -1375,6 +2085,14 @@ start_engines (remote_server_data_t *d, remote_device_data_t *devd,
   POCL_CREATE_THREAD (d->fast_write_queue->thread_id,
                       pocl_remote_writer_pthread, a);
 
+  for (unsigned i = 0; i < d->num_stripes; ++i)
+    {
+      POCL_CREATE_THREAD (d->stripes[i].reader,
+                          pocl_remote_stripe_reader_pthread, &d->stripes[i]);
+      POCL_CREATE_THREAD (d->stripes[i].writer,
+                          pocl_remote_stripe_writer_pthread, &d->stripes[i]);
+    }
+
 #ifdef ENABLE_RDMA
   if (d->use_rdma)
     {
@@ -1429,6 +2147,22 @@ stop_engines (remote_server_data_t *d)
   POCL_JOIN_THREAD (d->fast_read_queue->thread_id);
   POCL_JOIN_THREAD (d->slow_read_queue->thread_id);
 
+  if (d->num_stripes > 0)
+    {
+      POCL_LOCK (d->stripe_lock);
+      POCL_ATOMIC_STORE (d->stripe_exit, 1);
+      POCL_BROADCAST_COND (d->stripe_cond);
+      /* wakes up the readers blocked in read() */
+      for (unsigned i = 0; i < d->num_stripes; ++i)
+        shutdown (d->stripes[i].fd, SHUT_RDWR);
+      POCL_UNLOCK (d->stripe_lock);
+      for (unsigned i = 0; i < d->num_stripes; ++i)
+        {
+          POCL_JOIN_THREAD (d->stripes[i].writer);
+          POCL_JOIN_THREAD (d->stripes[i].reader);
+        }
+    }
+
 #ifdef ENABLE_RDMA
   POCL_JOIN_THREAD (d->rdma_read_queue->thread_id);
   POCL_JOIN_THREAD (d->rdma_write_queue->thread_id);
@@ -1475,6 +2209,8 @@ find_or_create_server (const char *address_with_port, unsigned port,
              strchr (address_with_port, ':') - address_with_port);
   POCL_INIT_LOCK (d->setup_lock.mutex);
   POCL_INIT_COND (d->setup_lock.cond);
+  POCL_INIT_LOCK (d->write_done.mutex);
+  POCL_INIT_COND (d->write_done.cond);
 
   // TODO: delet this
   // In RealWorldUse(tm) peers should not need a separate interface for
@@ -1514,9 +2250,30 @@ find_or_create_server (const char *address_with_port, unsigned port,
     }
 #endif
 
+  if (pocl_get_bool_option ("POCL_REMOTE_COMPRESSION", 0))
+    {
+      d->payload_codec = pocl_remote_supported_codecs ();
+      if (d->payload_codec == POCL_REMOTE_CODEC_NONE)
+        POCL_MSG_WARN ("POCL_REMOTE_COMPRESSION is set, but this build has "
+                       "no compression support\n");
+    }
+  d->codec_threshold = (uint32_t)pocl_get_int_option (
+      "POCL_REMOTE_COMPRESSION_THRESHOLD", 64 * 1024);
+  d->write_batch_size
+      = (uint32_t)pocl_get_int_option ("POCL_REMOTE_WRITE_BATCH", 64 * 1024);
+  int num_stripes = pocl_get_int_option ("POCL_REMOTE_STRIPES", 0);
+  d->num_stripes = num_stripes < 0 ? 0
+                   : num_stripes > POCL_REMOTE_MAX_STRIPES
+                       ? POCL_REMOTE_MAX_STRIPES
+                       : (unsigned)num_stripes;
+  d->stripe_chunk = (uint32_t)pocl_get_int_option ("POCL_REMOTE_STRIPE_CHUNK",
+                                                   1024 * 1024);
+  if (d->stripe_chunk == 0)
+    d->stripe_chunk = 1024 * 1024;
+
   ReplyMsg_t hsr;
   if (pocl_network_connect (d, &d->fast_socket_fd, d->fast_port,
-                            NETWORK_BUF_SIZE_FAST, 1, &hsr))
+                            NETWORK_BUF_SIZE_FAST, 1, 0, &hsr))
     {
       POCL_MSG_ERR ("Could not connect to server\n");
       POCL_MEM_FREE (d);
@@ -1535,15 +2292,33 @@ find_or_create_server (const char *address_with_port, unsigned port,
   }
 
   d->peer_port = hsr.m.get_session.peer_port;
+  d->payload_codec = hsr.m.get_session.payload_codec;
+  if (d->payload_codec != POCL_REMOTE_CODEC_NONE)
+    POCL_MSG_PRINT_REMOTE ("Payloads of %" PRIu32
+                           " bytes and more will be compressed\n",
+                           d->codec_threshold);
 
   if (pocl_network_connect (d, &d->slow_socket_fd, d->slow_port,
-                            NETWORK_BUF_SIZE_SLOW, 0, NULL))
+                            NETWORK_BUF_SIZE_SLOW, 0, 0, NULL))
     {
       POCL_MSG_ERR ("Could not connect to server\n");
       POCL_MEM_FREE (d);
       return NULL;
     }
 
+  /* Only after both connections are up: the server has registered the
+   * session by the time it answers the second handshake. */
+  if (hsr.m.get_session.shared_memory
+      && pocl_get_bool_option ("POCL_REMOTE_SHM", 1))
+    attach_shared_memory (d, hsr.m.get_session.server_pid);
+
+  /* the server may support fewer data connections than asked for */
+  d->num_stripes = hsr.m.get_session.num_stripes < d->num_stripes
+                       ? hsr.m.get_session.num_stripes
+                       : d->num_stripes;
+  if (d->num_stripes > 0)
+    connect_stripes (d);
+
   DL_APPEND (servers, d);
 
 #ifdef ENABLE_RDMA
@@ -1740,10 +2515,29 @@ release_server (remote_server_data_t *d)
   // disconnect sockets.
   pocl_network_disconnect (d, d->fast_socket_fd);
   pocl_network_disconnect (d, d->slow_socket_fd);
+  if (d->num_stripes > 0)
+    {
+      for (unsigned i = 0; i < d->num_stripes; ++i)
+        close (d->stripes[i].fd);
+      POCL_MEM_FREE (d->stripes);
+      POCL_DESTROY_LOCK (d->stripe_lock);
+      POCL_DESTROY_COND (d->stripe_cond);
+      POCL_DESTROY_LOCK (d->stripe_send_lock);
+    }
+
+  POCL_DESTROY_LOCK (d->write_done.mutex);
+  POCL_DESTROY_COND (d->write_done.cond);
 
 #ifdef ENABLE_RDMA
   rdma_uninitialize (&d->rdma_data);
 #endif
+
+  if (d->shm_base)
+    {
+      munmap (d->shm_base, d->shm_size);
+      POCL_MEM_FREE (d->shm_map);
+      POCL_DESTROY_LOCK (d->shm_lock);
+    }
 }
 
 cl_int
@@ -2050,7 +2844,13 @@ pocl_network_setup_devinfo (cl_device_id device, remote_device_data_t *ddata,
 cl_int
 pocl_network_free_device (cl_device_id device)
 {
-  REMOTE_SERV_DATA;
+  return pocl_network_free_device_data (device->data);
+}
+
+cl_int
+pocl_network_free_device_data (remote_device_data_t *ddata)
+{
+  REMOTE_SERV_DATA2;
 
   release_server (data);
 
@@ -2233,6 +3033,7 @@ pocl_network_setup_metadata (char *buffer, size_t total_size,
         p[i].reqd_wg_size[0] = temp_kernel.reqd_wg_size.x;
         p[i].reqd_wg_size[1] = temp_kernel.reqd_wg_size.y;
         p[i].reqd_wg_size[2] = temp_kernel.reqd_wg_size.z;
+        p[i].groups_independent = temp_kernel.groups_independent;
 
         p[i].arg_info = calloc (p[i].num_args, sizeof (pocl_argument_info));
       }
@@ -2720,6 +3521,12 @@ pocl_network_free_image (remote_device_data_t *ddata, uint32_t image_id)
 // ##################################################################################
 // ##################################################################################
 
+uint64_t
+pocl_network_sub_event_id (void)
+{
+  return POCL_ATOMIC_INC (last_sub_event_id);
+}
+
 cl_int
 pocl_network_migrate_d2d (uint32_t cq_id, uint32_t mem_id, uint32_t size_id,
                           unsigned mem_is_image, uint32_t height,
@@ -2728,12 +3535,24 @@ pocl_network_migrate_d2d (uint32_t cq_id, uint32_t mem_id, uint32_t size_id,
                           remote_device_data_t *source,
                           network_command_callback cb, void *arg,
                           _cl_command_node *node)
+{
+  return pocl_network_migrate_d2d_with_id (0, cq_id, mem_id, size_id,
+                                           mem_is_image, height, width, depth,
+                                           size, dest, source, cb, arg, node);
+}
+
+cl_int
+pocl_network_migrate_d2d_with_id (
+    uint64_t event_id, uint32_t cq_id, uint32_t mem_id, uint32_t size_id,
+    unsigned mem_is_image, uint32_t height, uint32_t width, uint32_t depth,
+    size_t size, remote_device_data_t *dest, remote_device_data_t *source,
+    network_command_callback cb, void *arg, _cl_command_node *node)
 {
   remote_device_data_t *ddata = dest;
   remote_server_data_t *data = dest->server;
 
   // request
-  CREATE_ASYNC_NETCMD;
+  CREATE_ASYNC_NETCMD_AS (event_id);
 
   ID_REQUEST (MigrateD2D, mem_id);
   req->cq_id = cq_id;
@@ -2762,12 +3581,24 @@ pocl_network_read (uint32_t cq_id, remote_device_data_t *ddata,
                    void *host_ptr, size_t offset, size_t size,
                    network_command_callback cb, void *arg,
                    _cl_command_node *node)
+{
+  return pocl_network_read_with_id (0, cq_id, ddata, mem_id, is_svm, size_id,
+                                    host_ptr, offset, size, cb, arg, node);
+}
+
+cl_int
+pocl_network_read_with_id (uint64_t event_id, uint32_t cq_id,
+                           remote_device_data_t *ddata, uint32_t mem_id,
+                           int is_svm, uint32_t size_id, void *host_ptr,
+                           size_t offset, size_t size,
+                           network_command_callback cb, void *arg,
+                           _cl_command_node *node)
 {
   REMOTE_SERV_DATA2;
   assert (size > 0);
 
   // request
-  CREATE_ASYNC_NETCMD;
+  CREATE_ASYNC_NETCMD_AS (event_id);
 
   ID_REQUEST (ReadBuffer, mem_id);
   req->cq_id = cq_id;
@@ -2795,10 +3626,21 @@ pocl_network_write (uint32_t cq_id, remote_device_data_t *ddata,
                     uint32_t mem_id, int is_svm, const void *host_ptr,
                     size_t offset, size_t size, network_command_callback cb,
                     void *arg, _cl_command_node *node)
+{
+  return pocl_network_write_with_id (0, cq_id, ddata, mem_id, is_svm,
+                                     host_ptr, offset, size, cb, arg, node);
+}
+
+cl_int
+pocl_network_write_with_id (uint64_t event_id, uint32_t cq_id,
+                            remote_device_data_t *ddata, uint32_t mem_id,
+                            int is_svm, const void *host_ptr, size_t offset,
+                            size_t size, network_command_callback cb,
+                            void *arg, _cl_command_node *node)
 {
   REMOTE_SERV_DATA2;
 
-  CREATE_ASYNC_NETCMD;
+  CREATE_ASYNC_NETCMD_AS (event_id);
 
   ID_REQUEST (WriteBuffer, mem_id);
   req->cq_id = cq_id;
@@ -3032,6 +3874,18 @@ pocl_network_run_kernel (uint32_t cq_id, remote_device_data_t *ddata,
                          vec3_t local, vec3_t global, vec3_t offset,
                          network_command_callback cb, void *arg,
                          _cl_command_node *node)
+{
+  return pocl_network_run_kernel_with_id (0, cq_id, ddata, kernel, kd,
+                                          requires_kernarg_update, dim, local,
+                                          global, offset, cb, arg, node);
+}
+
+cl_int
+pocl_network_run_kernel_with_id (
+    uint64_t event_id, uint32_t cq_id, remote_device_data_t *ddata,
+    cl_kernel kernel, kernel_data_t *kd, int requires_kernarg_update,
+    unsigned dim, vec3_t local, vec3_t global, vec3_t offset,
+    network_command_callback cb, void *arg, _cl_command_node *node)
 {
   REMOTE_SERV_DATA2;
   assert (kd != NULL);
@@ -3039,7 +3893,7 @@ pocl_network_run_kernel (uint32_t cq_id, remote_device_data_t *ddata,
   pocl_kernel_metadata_t *kernel_md = kernel->meta;
   uint32_t kernel_id = (uint32_t)kernel->id;
 
-  CREATE_ASYNC_NETCMD;
+  CREATE_ASYNC_NETCMD_AS (event_id);
 
   ID_REQUEST (RunKernel, kernel_id);
   req->cq_id = cq_id;
@@ -94,31 +94,40 @@ typedef struct async_t
   nc.status = NETCMD_STARTED;                                                 \
   nc.synchronous = 1;
 
-#define CREATE_ASYNC_NETCMD                                                   \
+/* Creates an asynchronous netcmd for NODE. A nonzero EV_ID is used as the
+ * remote event id instead of the node's own, without a wait list; this is
+ * for the sub-commands an aggregate device issues on behalf of one node,
+ * which the driver orders itself. */
+#define CREATE_ASYNC_NETCMD_AS(ev_id)                                         \
   network_command *netcmd = calloc (1, sizeof (network_command));             \
   netcmd->status = NETCMD_STARTED;                                            \
-  POCL_LOCK_OBJ (node->sync.event.event);                                     \
-  netcmd->event_id = node->sync.event.event->id;                              \
-  struct event_node *n;                                                       \
-  LL_COMPUTE_LENGTH (node->sync.event.event->wait_list, n,                    \
-                     netcmd->req_waitlist_size);                              \
-  if (netcmd->req_waitlist_size > 0)                                          \
-    netcmd->req_wait_list                                                     \
-        = calloc (netcmd->req_waitlist_size, sizeof (uint64_t));              \
-  {                                                                           \
-    uint64_t *dst = netcmd->req_wait_list;                                    \
-    LL_FOREACH (node->sync.event.event->wait_list, n)                         \
+  if (ev_id)                                                                  \
+    netcmd->event_id = (ev_id);                                               \
+  else                                                                        \
     {                                                                         \
-      *(dst++) = n->event->id;                                                \
+      POCL_LOCK_OBJ (node->sync.event.event);                                 \
+      netcmd->event_id = node->sync.event.event->id;                          \
+      struct event_node *n;                                                   \
+      LL_COMPUTE_LENGTH (node->sync.event.event->wait_list, n,                \
+                         netcmd->req_waitlist_size);                          \
+      if (netcmd->req_waitlist_size > 0)                                      \
+        netcmd->req_wait_list                                                 \
+            = calloc (netcmd->req_waitlist_size, sizeof (uint64_t));          \
+      uint64_t *dst = netcmd->req_wait_list;                                  \
+      LL_FOREACH (node->sync.event.event->wait_list, n)                       \
+      {                                                                       \
+        *(dst++) = n->event->id;                                              \
+      }                                                                       \
+      POCL_UNLOCK_OBJ (node->sync.event.event);                               \
     }                                                                         \
-  }                                                                           \
-  POCL_UNLOCK_OBJ (node->sync.event.event);                                   \
   netcmd->receiver = data->inflight_queue;                                    \
   netcmd->synchronous = 0;                                                    \
   netcmd->data.async.cb = cb;                                                 \
   netcmd->data.async.arg = arg;                                               \
   netcmd->data.async.node = node;
 
+#define CREATE_ASYNC_NETCMD CREATE_ASYNC_NETCMD_AS (0)
+
 typedef struct network_queue network_queue;
 
 #ifdef ENABLE_RDMA
@@ -157,6 +166,15 @@ struct network_command
   uint64_t client_read_end_timestamp_ns;
   int synchronous;
   network_queue *receiver;
+  /* size of the request body on the wire, written before it */
+  uint32_t request_size;
+  /* slot of the payload in the shared memory window, shm_size is 0 if the
+   * payload goes through the socket */
+  uint64_t shm_offset;
+  uint64_t shm_size;
+  /* bytes of a striped reply payload still to be read from the data
+   * connections, plus one for the reply itself */
+  uint64_t stripe_pending;
 #ifdef ENABLE_RDMA
   struct ibv_mr *rdma_region;
 #endif
@@ -173,6 +191,8 @@ struct network_command
 // in nanoseconds
 #define POCL_REMOTE_RECONNECT_TIMEOUT_NS 60 * 1000000000L
 
+typedef struct remote_stripe_s remote_stripe_t;
+
 typedef struct remote_server_data_s
 {
   char address[MAX_ADDRESS_SIZE];
@@ -192,6 +212,9 @@ typedef struct remote_server_data_s
   uint8_t authkey[AUTHKEY_LENGTH];
   uint32_t available;
   sync_t setup_lock;
+  /* signalled by the writer threads once they have timestamped the end of
+   * a write; replies can be read before that */
+  sync_t write_done;
   int threads_awaiting_reconnect;
   int slow_socket_fd;
   int fast_socket_fd;
@@ -200,6 +223,38 @@ typedef struct remote_server_data_s
   uint32_t num_devices;
   uint32_t *platform_devices;
 
+  /* payload codec negotiated for the session and the smallest payload it
+   * is applied to */
+  uint32_t payload_codec;
+  uint32_t codec_threshold;
+
+  /* bytes the writer threads collect into one writev() while more commands
+   * are queued, 0 to write each command separately */
+  uint32_t write_batch_size;
+
+  /* shared memory window of a same-host server, NULL if not in use */
+  char *shm_base;
+  size_t shm_size;
+  /* allocation map of the window, one bit per REMOTE_SHM_CHUNK bytes */
+  uint64_t *shm_map;
+  size_t shm_chunks;
+  /* where to look for free chunks next */
+  size_t shm_next;
+  pocl_lock_t shm_lock;
+
+  /* extra data connections that large payloads are striped over, and the
+   * size of the chunks they are split into */
+  remote_stripe_t *stripes;
+  unsigned num_stripes;
+  uint32_t stripe_chunk;
+  /* set once striping has failed; the transfers go through the command
+   * sockets from then on */
+  int stripes_broken;
+  int stripe_exit;
+  pocl_lock_t stripe_lock;
+  pocl_cond_t stripe_cond;
+  pocl_lock_t stripe_send_lock;
+
   // network handling threads / ids
   network_queue *slow_read_queue;
   network_queue *fast_read_queue;
@@ -220,6 +275,11 @@ typedef struct remote_server_data_s
   uint64_t rx_bytes_confirmed;
   uint64_t tx_bytes_submitted;
   uint64_t tx_bytes_confirmed;
+  /* payload bytes before and after encoding */
+  uint64_t tx_payload_raw;
+  uint64_t tx_payload_wire;
+  uint64_t rx_payload_raw;
+  uint64_t rx_payload_wire;
 #endif
 
   // ID maps.
@@ -306,6 +366,8 @@ cl_int pocl_network_init_device (cl_device_id device,
 
 cl_int pocl_network_free_device (cl_device_id device);
 
+cl_int pocl_network_free_device_data (remote_device_data_t *ddata);
+
 cl_int pocl_network_setup_peer_mesh ();
 
 cl_int pocl_network_setup_devinfo (cl_device_id device,
@@ -384,6 +446,32 @@ cl_int pocl_network_write (uint32_t cq_id, remote_device_data_t *ddata,
                            network_command_callback cb, void *arg,
                            _cl_command_node *node);
 
+/* Returns a remote event id for a sub-command, apart from the ids
+ * pocl_create_event() gives to the application's events. */
+uint64_t pocl_network_sub_event_id (void);
+
+/* Variants of the above that run under a separate remote event id, see
+ * CREATE_ASYNC_NETCMD_AS. */
+cl_int pocl_network_migrate_d2d_with_id (
+    uint64_t event_id, uint32_t cq_id, uint32_t mem_id, uint32_t size_id,
+    unsigned mem_is_image, uint32_t height, uint32_t width, uint32_t depth,
+    size_t size, remote_device_data_t *dest, remote_device_data_t *source,
+    network_command_callback cb, void *arg, _cl_command_node *node);
+
+cl_int pocl_network_read_with_id (uint64_t event_id, uint32_t cq_id,
+                                  remote_device_data_t *ddata, uint32_t mem,
+                                  int is_svm, uint32_t size_id,
+                                  void *host_ptr, size_t offset, size_t size,
+                                  network_command_callback cb, void *arg,
+                                  _cl_command_node *node);
+
+cl_int pocl_network_write_with_id (uint64_t event_id, uint32_t cq_id,
+                                   remote_device_data_t *ddata, uint32_t mem,
+                                   int is_svm, const void *host_ptr,
+                                   size_t offset, size_t size,
+                                   network_command_callback cb, void *arg,
+                                   _cl_command_node *node);
+
 cl_int pocl_network_copy (uint32_t cq_id, remote_device_data_t *ddata,
                           uint32_t src, uint32_t dst, uint32_t size_buf,
                           size_t src_offset, size_t dst_offset, size_t size,
@@ -429,6 +517,12 @@ cl_int pocl_network_run_kernel (uint32_t cq_id, remote_device_data_t *ddata,
                                 network_command_callback cb, void *arg,
                                 _cl_command_node *node);
 
+cl_int pocl_network_run_kernel_with_id (
+    uint64_t event_id, uint32_t cq_id, remote_device_data_t *ddata,
+    cl_kernel kernel, kernel_data_t *kd, int requires_kernarg_update,
+    unsigned dim, vec3_t local, vec3_t global, vec3_t offset,
+    network_command_callback cb, void *arg, _cl_command_node *node);
+
 /****************************************************************************/
 
 cl_int pocl_network_copy_image_rect (
@@ -0,0 +1,410 @@
+/* dirty_blocks.c - sending only the changed blocks of remote buffers
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+/* The driver keeps a checksum of every fixed-size block of a buffer's device
+ * copy, taken from the data it last wrote to or read from the device. A
+ * buffer write (clEnqueueWriteBuffer, an unmap or a migration from the host)
+ * checksums the blocks it covers and sends only the ones that differ, so
+ * rewriting a mostly unchanged buffer costs little more than the hashing.
+ *
+ * The checksums are only trusted while nothing else can have changed the
+ * device copy: the commands that write a buffer some other way drop its
+ * checksums when they start. Commands using a buffer never overlap, so the
+ * starting order is the order the device copy changes in. Kernels that may
+ * access buffers through raw pointers drop all of them by bumping the
+ * device's epoch.
+ *
+ * Write-protecting the host copy would avoid the hashing, but mem_host_ptr
+ * may be the application's own memory and faulting on it from a driver
+ * isn't an option. */
+
+#include "dirty_blocks.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "communication.h"
+#include "pocl_debug.h"
+#include "utlist.h"
+
+/* A write is sent in at most this many pieces; further changed blocks are
+   merged into the last one. */
+#define REMOTE_DIRTY_MAX_PIECES 32
+
+/* An epoch that never matches the device's, for forgotten checksums. */
+#define REMOTE_DIRTY_STALE ((uint64_t)-1)
+
+typedef struct remote_block_sums_s
+{
+  /* The device epoch the checksums are valid in. */
+  uint64_t epoch;
+  /* The device epoch when the last read started. */
+  uint64_t read_epoch;
+  size_t num_blocks;
+  /* 0 for the blocks whose device contents are unknown. */
+  uint64_t *sums;
+} remote_block_sums_t;
+
+typedef struct dirty_write_s
+{
+  remote_device_data_t *d;
+  uint64_t pending;
+} dirty_write_t;
+
+typedef struct dirty_read_s
+{
+  remote_device_data_t *d;
+  remote_block_sums_t *s;
+  const char *host_ptr;
+  size_t offset;
+  size_t size;
+} dirty_read_t;
+
+/*****************************************************************************/
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+
+static inline uint64_t
+rotl64 (uint64_t x, unsigned r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+mix_word (uint64_t acc, uint64_t w)
+{
+  return rotl64 (acc + w * PRIME2, 31) * PRIME1;
+}
+
+/* A 64-bit checksum of N bytes, a multiple of 32, in four independent lanes
+   to keep the multipliers busy. Never 0. */
+static uint64_t
+block_checksum (const char *p, size_t n)
+{
+  uint64_t a = PRIME1 + PRIME2, b = PRIME2, c = 0, e = (uint64_t)0 - PRIME1;
+  uint64_t w[4];
+  for (size_t i = 0; i < n; i += sizeof (w))
+    {
+      /* the host pointers of the application need not be aligned */
+      memcpy (w, p + i, sizeof (w));
+      a = mix_word (a, w[0]);
+      b = mix_word (b, w[1]);
+      c = mix_word (c, w[2]);
+      e = mix_word (e, w[3]);
+    }
+  uint64_t h = rotl64 (a, 1) + rotl64 (b, 7) + rotl64 (c, 12) + rotl64 (e, 18);
+  h ^= h >> 33;
+  h *= PRIME2;
+  h ^= h >> 29;
+  h *= PRIME3;
+  h ^= h >> 32;
+  return h ? h : 1;
+}
+
+/*****************************************************************************/
+
+void
+pocl_remote_dirty_init (remote_device_data_t *d)
+{
+  int size = pocl_get_int_option ("POCL_REMOTE_DIRTY_BLOCK_SIZE", 0);
+  if (size <= 0)
+    return;
+  /* a power of two, at least one round of the checksum */
+  size_t block = 32;
+  while (block < (size_t)size)
+    block <<= 1;
+  d->dirty_block_size = block;
+  POCL_MSG_PRINT_REMOTE ("Sending only the changed %zu byte blocks of "
+                         "buffer writes\n",
+                         block);
+}
+
+void
+pocl_remote_dirty_free (pocl_mem_identifier *p)
+{
+  POCL_MEM_FREE (p->extra_ptr);
+}
+
+static int
+is_tracked (remote_device_data_t *d, cl_mem mem)
+{
+  return d->dirty_block_size != 0 && !mem->is_image && mem->parent == NULL;
+}
+
+static void
+forget_sums (cl_mem mem, unsigned global_mem_id)
+{
+  /* Writes to a sub-buffer change its parent. */
+  if (mem->parent)
+    mem = mem->parent;
+  remote_block_sums_t *s
+      = (remote_block_sums_t *)mem->device_ptrs[global_mem_id].extra_ptr;
+  if (s)
+    s->epoch = REMOTE_DIRTY_STALE;
+}
+
+/* Returns the checksums of MEM's device copy, all unknown unless they are
+   valid in the current epoch. */
+static remote_block_sums_t *
+current_sums (remote_device_data_t *d, cl_mem mem, unsigned global_mem_id)
+{
+  pocl_mem_identifier *p = &mem->device_ptrs[global_mem_id];
+  remote_block_sums_t *s = (remote_block_sums_t *)p->extra_ptr;
+  uint64_t epoch = POCL_ATOMIC_LOAD (d->dirty_epoch);
+  if (s == NULL)
+    {
+      size_t n = (mem->size + d->dirty_block_size - 1) / d->dirty_block_size;
+      s = (remote_block_sums_t *)malloc (sizeof (remote_block_sums_t)
+                                         + n * sizeof (uint64_t));
+      if (s == NULL)
+        return NULL;
+      s->num_blocks = n;
+      s->sums = (uint64_t *)(s + 1);
+      s->epoch = REMOTE_DIRTY_STALE;
+      p->extra_ptr = s;
+    }
+  if (s->epoch != epoch)
+    {
+      memset (s->sums, 0, s->num_blocks * sizeof (uint64_t));
+      s->epoch = epoch;
+    }
+  return s;
+}
+
+void
+pocl_remote_dirty_note_command (remote_device_data_t *d,
+                                _cl_command_node *node)
+{
+  pocl_buffer_migration_info *mi;
+  unsigned gmem = node->device->global_mem_id;
+
+  if (d->dirty_block_size == 0)
+    return;
+
+  switch (node->type)
+    {
+    /* Reads and maps don't change the device copy. */
+    case CL_COMMAND_READ_BUFFER:
+    case CL_COMMAND_MAP_BUFFER:
+      return;
+    /* Writes to tracked buffers update the checksums themselves. Unmaps and
+       migrations list the buffer they write as read-only. */
+    case CL_COMMAND_WRITE_BUFFER:
+      if (is_tracked (d, node->command.write.dst))
+        return;
+      break;
+    case CL_COMMAND_UNMAP_MEM_OBJECT:
+      if (!is_tracked (d, node->command.unmap.buffer))
+        forget_sums (node->command.unmap.buffer, gmem);
+      return;
+    case CL_COMMAND_MIGRATE_MEM_OBJECTS:
+      if (node->command.migrate.type == ENQUEUE_MIGRATE_TYPE_D2H
+          || node->command.migrate.type == ENQUEUE_MIGRATE_TYPE_NOP)
+        return;
+      LL_FOREACH (node->migr_infos, mi)
+      {
+        if (node->command.migrate.type != ENQUEUE_MIGRATE_TYPE_H2D
+            || !is_tracked (d, mi->buffer))
+          forget_sums (mi->buffer, gmem);
+      }
+      return;
+    case CL_COMMAND_NDRANGE_KERNEL:
+      {
+        cl_kernel kernel = node->command.run.kernel;
+        int raw = kernel->indirect_raw_ptrs != NULL
+                  || kernel->can_access_all_raw_buffers_indirectly;
+        for (unsigned i = 0; !raw && i < kernel->meta->num_args; ++i)
+          raw = node->command.run.arguments[i].is_raw_ptr;
+        if (raw)
+          POCL_ATOMIC_INC (d->dirty_epoch);
+        break;
+      }
+    case CL_COMMAND_SVM_UNMAP:
+      /* The buffers are allocated from the SVM pool when there is one. */
+      POCL_ATOMIC_INC (d->dirty_epoch);
+      break;
+    default:
+      break;
+    }
+
+  LL_FOREACH (node->migr_infos, mi)
+  {
+    if (!mi->read_only)
+      forget_sums (mi->buffer, gmem);
+  }
+}
+
+/*****************************************************************************/
+
+static void
+dirty_write_done (void *arg, _cl_command_node *node, size_t extra_rep_bytes)
+{
+  dirty_write_t *w = (dirty_write_t *)arg;
+  if (POCL_ATOMIC_DEC (w->pending) != 0)
+    return;
+  remote_device_data_t *d = w->d;
+  free (w);
+  pocl_remote_finish_command (d, node, 0);
+}
+
+int
+pocl_remote_dirty_write (remote_device_data_t *d, _cl_command_node *node,
+                         cl_mem mem, const void *host_ptr, size_t offset,
+                         size_t size)
+{
+  if (!is_tracked (d, mem) || size == 0)
+    return 1;
+  unsigned gmem = node->device->global_mem_id;
+  remote_block_sums_t *s = current_sums (d, mem, gmem);
+  if (s == NULL)
+    return 1;
+  /* Without it, the caller writes the whole range as usual. */
+  dirty_write_t *w = (dirty_write_t *)malloc (sizeof (dirty_write_t));
+  if (w == NULL)
+    return 1;
+
+  const char *src = (const char *)host_ptr;
+  size_t block = d->dirty_block_size;
+  size_t end = offset + size;
+  size_t piece_start[REMOTE_DIRTY_MAX_PIECES];
+  size_t piece_end[REMOTE_DIRTY_MAX_PIECES];
+  unsigned num_pieces = 0;
+  size_t sent = 0;
+
+  for (size_t b = offset / block; b * block < end; ++b)
+    {
+      size_t bs = b * block > offset ? b * block : offset;
+      size_t be = (b + 1) * block < end ? (b + 1) * block : end;
+      int changed = 1;
+      if (be - bs == block)
+        {
+          uint64_t sum = block_checksum (src + (bs - offset), block);
+          changed = sum != s->sums[b];
+          s->sums[b] = sum;
+        }
+      else
+        s->sums[b] = 0;
+      if (!changed)
+        continue;
+
+      if (num_pieces > 0
+          && (piece_end[num_pieces - 1] == bs
+              || num_pieces == REMOTE_DIRTY_MAX_PIECES))
+        piece_end[num_pieces - 1] = be;
+      else
+        {
+          piece_start[num_pieces] = bs;
+          piece_end[num_pieces] = be;
+          ++num_pieces;
+        }
+    }
+
+  /* The command's event must still reach the server. */
+  if (num_pieces == 0)
+    {
+      piece_start[0] = offset;
+      piece_end[0] = offset + (size < block ? size : block);
+      num_pieces = 1;
+    }
+
+  w->d = d;
+  w->pending = num_pieces;
+  uint32_t queue_id = (uint32_t)node->sync.event.event->queue->id;
+  uint32_t mem_id = (uint32_t)(uintptr_t)mem->device_ptrs[gmem].mem_ptr;
+
+  for (unsigned i = 0; i < num_pieces; ++i)
+    sent += piece_end[i] - piece_start[i];
+  POCL_MSG_PRINT_MEMORY ("REMOTE: writing %zu of %zu bytes of buf %zu in %u "
+                         "pieces\n",
+                         sent, size, mem->id, num_pieces);
+
+  /* The last piece carries the command's event. */
+  for (unsigned i = 0; i < num_pieces; ++i)
+    pocl_network_write_with_id (
+        i + 1 < num_pieces ? pocl_network_sub_event_id () : 0, queue_id,
+        d, mem_id, 0, src + (piece_start[i] - offset), piece_start[i],
+        piece_end[i] - piece_start[i], dirty_write_done, w, node);
+  return 0;
+}
+
+/*****************************************************************************/
+
+static void
+dirty_read_done (void *arg, _cl_command_node *node, size_t extra_rep_bytes)
+{
+  dirty_read_t *r = (dirty_read_t *)arg;
+  remote_device_data_t *d = r->d;
+  remote_block_sums_t *s = r->s;
+  size_t block = d->dirty_block_size;
+
+  /* The device copy may have changed meanwhile if the epoch did. A short
+     read, of a buffer with a content size, only covers the bytes received. */
+  if (s->read_epoch == POCL_ATOMIC_LOAD (d->dirty_epoch))
+    {
+      size_t end
+          = r->offset + (extra_rep_bytes < r->size ? extra_rep_bytes : r->size);
+      if (s->epoch != s->read_epoch)
+        {
+          memset (s->sums, 0, s->num_blocks * sizeof (uint64_t));
+          s->epoch = s->read_epoch;
+        }
+      for (size_t b = (r->offset + block - 1) / block; (b + 1) * block <= end;
+           ++b)
+        s->sums[b]
+            = block_checksum (r->host_ptr + (b * block - r->offset), block);
+    }
+
+  free (r);
+  pocl_remote_finish_command (d, node, extra_rep_bytes);
+}
+
+int
+pocl_remote_dirty_read (remote_device_data_t *d, _cl_command_node *node,
+                        cl_mem mem, uint32_t size_id, void *host_ptr,
+                        size_t offset, size_t size)
+{
+  if (!is_tracked (d, mem))
+    return 1;
+  unsigned gmem = node->device->global_mem_id;
+  remote_block_sums_t *s = current_sums (d, mem, gmem);
+  if (s == NULL)
+    return 1;
+
+  /* Without it, the caller reads the range as usual. */
+  dirty_read_t *r = (dirty_read_t *)malloc (sizeof (dirty_read_t));
+  if (r == NULL)
+    return 1;
+  r->d = d;
+  r->s = s;
+  r->host_ptr = (const char *)host_ptr;
+  r->offset = offset;
+  r->size = size;
+  s->read_epoch = s->epoch;
+
+  uint32_t queue_id = (uint32_t)node->sync.event.event->queue->id;
+  uint32_t mem_id = (uint32_t)(uintptr_t)mem->device_ptrs[gmem].mem_ptr;
+  return pocl_network_read (queue_id, d, mem_id, 0, size_id, host_ptr, offset,
+                            size, dirty_read_done, r, node);
+}
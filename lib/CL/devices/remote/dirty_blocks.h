@@ -0,0 +1,65 @@
+/* dirty_blocks.h - sending only the changed blocks of remote buffers
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#ifndef POCL_REMOTE_DIRTY_BLOCKS_H
+#define POCL_REMOTE_DIRTY_BLOCKS_H
+
+#include "pocl_cl.h"
+#include "pocl_util.h"
+
+#include "remote.h"
+
+#ifdef __GNUC__
+#pragma GCC visibility push(hidden)
+#endif
+
+/* Reads POCL_REMOTE_DIRTY_BLOCK_SIZE. Tracking stays off when it's 0. */
+void pocl_remote_dirty_init (remote_device_data_t *d);
+
+/* Releases the block checksums of a buffer's device copy. */
+void pocl_remote_dirty_free (pocl_mem_identifier *p);
+
+/* Called for every command before it starts, to forget the checksums of the
+   buffers it may write in ways that aren't tracked. */
+void pocl_remote_dirty_note_command (remote_device_data_t *d,
+                                     _cl_command_node *node);
+
+/* Writes SIZE bytes at HOST_PTR to OFFSET of MEM, skipping the blocks the
+   device already has. Returns nonzero if MEM isn't tracked, in which case
+   the caller writes it as usual. */
+int pocl_remote_dirty_write (remote_device_data_t *d, _cl_command_node *node,
+                             cl_mem mem, const void *host_ptr, size_t offset,
+                             size_t size);
+
+/* Reads SIZE bytes at OFFSET of MEM to HOST_PTR and records the checksums of
+   the blocks received. Returns nonzero if MEM isn't tracked, in which case
+   the caller reads it as usual. */
+int pocl_remote_dirty_read (remote_device_data_t *d, _cl_command_node *node,
+                            cl_mem mem, uint32_t size_id, void *host_ptr,
+                            size_t offset, size_t size);
+
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
+#endif /* POCL_REMOTE_DIRTY_BLOCKS_H */
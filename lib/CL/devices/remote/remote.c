@@ -46,7 +46,9 @@
 #include "utlist.h"
 #include <CL/cl.h>
 
+#include "aggregate.h"
 #include "communication.h"
+#include "dirty_blocks.h"
 #include "messages.h"
 
 /*
@@ -160,6 +162,19 @@ pocl_remote_alloc_mem_obj (cl_device_id device, cl_mem mem, void *host_ptr)
   if (r != 0)
     goto ERROR;
 
+  /* Images only ever live on the primary of an aggregate device, kernels
+     using them are not divided. */
+  if (d->aggregate && !mem->is_image)
+    {
+      r = pocl_remote_aggregate_create_buffer (
+          d, mem, is_svm_ptr (mem->mem_host_ptr));
+      if (r != 0)
+        {
+          pocl_network_free_buffer (d, mem->id, 0);
+          goto ERROR;
+        }
+    }
+
   /* The device-specific "address" is an id reference to the remote buffer,
      which then contains the actual physical address of the controlled
      device. */
@@ -239,11 +254,14 @@ pocl_remote_free (cl_device_id device, cl_mem mem)
   else
     {
       r = pocl_network_free_buffer (d, mem->id, 0);
+      if (d->aggregate)
+        pocl_remote_aggregate_free_buffer (d, mem);
     }
   assert (r == 0);
 
   POCL_MSG_PRINT_MEMORY ("REMOTE DEVICE FREE PTR %p SIZE %zu\n", p->mem_ptr,
                          mem->size);
+  pocl_remote_dirty_free (p);
 
   if (mem->mem_host_ptr != NULL && !(mem->flags & CL_MEM_USE_HOST_PTR)
       && (device->svm_caps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER))
@@ -417,6 +435,39 @@ pocl_remote_update_event (cl_device_id device, cl_event event)
     }
 }
 
+/**
+ * Sets up the SVM pool offset of a remote device whose SVM region is mapped
+ * to the already allocated host SVM region.
+ */
+int
+pocl_remote_join_svm_pool (remote_device_data_t *ddata)
+{
+  if (svm_data == NULL || ddata->device_svm_region_start_addr == 0
+      || ddata->device_svm_region_size == 0)
+    return -1;
+
+  ddata->svm_region_offset = ddata->device_svm_region_start_addr
+                             - svm_data->host_svm_region_start_addr;
+  POCL_MSG_PRINT_REMOTE ("Host SVM region already allocated. "
+                         "SVM pool offset for this device: %zd.\n",
+                         ddata->svm_region_offset);
+
+  /* Shrink the host SVM region to the smallest remote SVM region size. */
+  if (svm_data->host_svm_region_size > ddata->device_svm_region_size)
+    {
+      POCL_MSG_PRINT_REMOTE ("Remote SVM region smaller than the host region."
+                             "Shrinking to %zu MB.\n",
+                             ddata->device_svm_region_size / (1024 * 1024));
+      svm_data->allocations.last_chunk->size = ddata->device_svm_region_size;
+      svm_data->host_svm_region_size = ddata->device_svm_region_size;
+      /* TODO: mremap() to free the unallocatable host VM space */
+    }
+
+  /* TODO: Add the remote SVM region gaps to the memory manager so they
+     won't get allocated. */
+  return 0;
+}
+
 /**
  * \brief Allocates a memory region from the host process to map SVM
  * allocations to and initializes SVM memory management.
@@ -449,29 +500,7 @@ setup_svm_memory_pool (cl_device_id device)
     {
       /* Let the first remote device take care of the SVM allocation. */
       device->svm_allocation_priority = 0;
-
-      ddata->svm_region_offset = ddata->device_svm_region_start_addr
-                                 - svm_data->host_svm_region_start_addr;
-      POCL_MSG_PRINT_REMOTE ("Host SVM region already allocated. "
-                             "SVM pool offset for this device: %zd.\n",
-                             ddata->svm_region_offset);
-
-      /* Shrink the host SVM region to the smallest remote SVM region size. */
-      if (svm_data->host_svm_region_size > ddata->device_svm_region_size)
-        {
-          POCL_MSG_PRINT_REMOTE (
-              "Remote SVM region smaller than the host region."
-              "Shrinking to %zu MB.\n",
-              ddata->device_svm_region_size / (1024 * 1024));
-          svm_data->allocations.last_chunk->size
-              = ddata->device_svm_region_size;
-          svm_data->host_svm_region_size = ddata->device_svm_region_size;
-          /* TODO: mremap() to free the unallocatable host VM space */
-        }
-
-      /* TODO: Add the remote SVM region gaps to the memory manager so they
-         won't get allocated. */
-      return 0;
+      return pocl_remote_join_svm_pool (ddata);
     }
 
   /* This is the first SVM-capable remote device that should handle the
@@ -560,9 +589,19 @@ pocl_remote_init (unsigned j, cl_device_id device, const char *parameters)
 
   device->has_own_timer = CL_TRUE;
 
+  /* An aggregate device lists its members separated by '+', the first one
+     is the primary. */
+  char *primary = strdup (parameters);
+  char *members = strchr (primary, REMOTE_AGGREGATE_SEPARATOR);
+  if (members != NULL)
+    *members++ = 0;
+
   // TODO: add list of all remotes to create_or_find_server from here
-  if (pocl_network_init_device (device, d, j, parameters))
-    return CL_INVALID_DEVICE;
+  if (pocl_network_init_device (device, d, j, primary))
+    {
+      free (primary);
+      return CL_INVALID_DEVICE;
+    }
 
   const char *magic = "pocl";
   device->vendor_id
@@ -586,6 +625,8 @@ pocl_remote_init (unsigned j, cl_device_id device, const char *parameters)
   POCL_INIT_LOCK (d->wq_lock);
   d->work_queue = NULL;
 
+  pocl_remote_dirty_init (d);
+
   POCL_CREATE_THREAD (d->driver_thread_id, pocl_remote_driver_pthread, device);
 
   /* Setup SVM. */
@@ -617,7 +658,12 @@ pocl_remote_init (unsigned j, cl_device_id device, const char *parameters)
       device->extensions = exts_w_pinned;
     }
 
-  return CL_SUCCESS;
+  int err = CL_SUCCESS;
+  if (members != NULL)
+    err = pocl_remote_aggregate_init (device, d, j, members);
+  free (primary);
+
+  return err;
 }
 
 cl_int
@@ -630,6 +676,7 @@ cl_int
 pocl_remote_uninit (unsigned j, cl_device_id device)
 {
   // TODO thread signal
+  pocl_remote_aggregate_uninit (device->data);
   pocl_network_free_device (device);
   return CL_SUCCESS;
 }
@@ -805,6 +852,8 @@ pocl_remote_free_program (cl_device_id device, cl_program program,
     program->data[program_device_i] = NULL;
 
   int err = pocl_network_free_program (d, (uint32_t)program->id);
+  if (d->aggregate)
+    pocl_remote_aggregate_free_program (d, (uint32_t)program->id);
 
   return err;
 }
@@ -874,6 +923,11 @@ pocl_remote_build_source (cl_program program, cl_uint device_i,
 
   setup_build_logs (program, num_relevant_devices, build_indexes, build_logs);
 
+  if (err == CL_SUCCESS && d->aggregate)
+    err = pocl_remote_aggregate_build (
+        d, program->source, strlen (program->source), CL_FALSE, CL_FALSE,
+        CL_FALSE, prog_id, program->compiler_options, !link_program, 0);
+
   if (err)
     return err;
 
@@ -995,6 +1049,20 @@ pocl_remote_build_binary (cl_program program, cl_uint device_i,
 
   setup_build_logs (program, num_relevant_devices, build_indexes, build_logs);
 
+  if (err == CL_SUCCESS && d->aggregate)
+    {
+      if (spirv_build)
+        err = pocl_remote_aggregate_build (
+            d, program->program_il, program->program_il_size, CL_TRUE,
+            CL_FALSE, CL_TRUE, prog_id, program->compiler_options,
+            !link_program, 0);
+      else
+        err = pocl_remote_aggregate_build (
+            d, program->binaries[device_i], program->binary_sizes[device_i],
+            CL_TRUE, CL_FALSE, CL_FALSE, prog_id, program->compiler_options,
+            !link_program, 0);
+    }
+
   if (err)
     return err;
 
@@ -1075,6 +1143,12 @@ pocl_remote_build_builtin (cl_program program, cl_uint device_i)
       &d->remote_platform_index, // relevant_platforms,,
       1, &build_log, NULL, 0, 0, 0, 0);
 
+  if (err == CL_SUCCESS && d->aggregate)
+    err = pocl_remote_aggregate_build (
+        d, program->concated_builtin_names,
+        strlen (program->concated_builtin_names), CL_FALSE, CL_TRUE, CL_FALSE,
+        prog_id, program->compiler_options, 0, 0);
+
   if (err)
     return err;
 
@@ -1158,6 +1232,11 @@ int pocl_remote_link_program (cl_program program, cl_uint device_i,
 
   setup_build_logs (program, num_relevant_devices, build_indexes, build_logs);
 
+  if (err == CL_SUCCESS && d->aggregate)
+    err = pocl_remote_aggregate_build (
+        d, (const void *)&input_prog_ids[0], total_binary_request_size, 0, 0,
+        0, target_prog_id, program->compiler_options, 0, 1);
+
   if (err)
     return err;
 
@@ -1272,8 +1351,12 @@ pocl_remote_create_kernel (cl_device_id device, cl_program program,
   kd->arg_array = calloc ((kernel->meta->num_args), sizeof (uint64_t));
   kd->ptr_is_svm = calloc ((kernel->meta->num_args), sizeof (unsigned char));
 
-  return pocl_network_create_kernel (device->data, kernel->name, prog_id,
-                                     kern_id, kd);
+  remote_device_data_t *d = device->data;
+  int err = pocl_network_create_kernel (d, kernel->name, prog_id, kern_id, kd);
+  if (err == CL_SUCCESS && d->aggregate)
+    err = pocl_remote_aggregate_create_kernel (d, kernel->name, prog_id,
+                                               kern_id, kd);
+  return err;
 }
 
 int
@@ -1291,7 +1374,10 @@ pocl_remote_free_kernel (cl_device_id device, cl_program program,
   uint32_t prog_id = (uint32_t)program->id;
   assert (kern_id);
 
-  int err = pocl_network_free_kernel (device->data, kd, kern_id, prog_id);
+  remote_device_data_t *d = device->data;
+  int err = pocl_network_free_kernel (d, kd, kern_id, prog_id);
+  if (d->aggregate)
+    pocl_remote_aggregate_free_kernel (d, kd, kern_id, prog_id);
 
   POCL_MEM_FREE (kd->arg_array);
   POCL_MEM_FREE (kd->ptr_is_svm);
@@ -1320,7 +1406,10 @@ pocl_remote_init_queue (cl_device_id device, cl_command_queue queue)
   uint32_t queue_id = (uint32_t)queue->id;
   assert (queue_id);
 
-  return pocl_network_create_queue (d, queue_id);
+  int err = pocl_network_create_queue (d, queue_id);
+  if (err == CL_SUCCESS && d->aggregate)
+    err = pocl_remote_aggregate_create_queue (d, queue_id);
+  return err;
 }
 
 int
@@ -1336,6 +1425,8 @@ pocl_remote_free_queue (cl_device_id device, cl_command_queue queue)
   assert (queue_id);
 
   int err = pocl_network_free_queue (d, queue_id);
+  if (d->aggregate)
+    pocl_remote_aggregate_free_queue (d, queue_id);
   if (err != CL_SUCCESS)
     goto ERROR;
 
@@ -1565,6 +1656,13 @@ remote_finish_command (void *arg, _cl_command_node *node,
   POCL_FAST_UNLOCK (d->wq_lock);
 }
 
+void
+pocl_remote_finish_command (void *arg, _cl_command_node *node,
+                            size_t extra_rep_bytes)
+{
+  remote_finish_command (arg, node, extra_rep_bytes);
+}
+
 int
 pocl_remote_async_read (void *data, _cl_command_node *node,
                         void *__restrict__ host_ptr,
@@ -1580,6 +1678,11 @@ pocl_remote_async_read (void *data, _cl_command_node *node,
     content_size_id
         = (uintptr_t)node->command.read.src_content_size_mem_id->mem_ptr;
 
+  if (pocl_remote_dirty_read (data, node, src_buf, content_size_id, host_ptr,
+                              offset, size)
+      == 0)
+    return 0;
+
   return pocl_network_read (queue_id, data, mem_id, 0, content_size_id,
                             host_ptr, offset, size, remote_finish_command,
                             data, node);
@@ -1652,6 +1755,10 @@ pocl_remote_async_write (void *data, _cl_command_node *node,
 
   uint32_t queue_id = (uint32_t)node->sync.event.event->queue->id;
 
+  if (pocl_remote_dirty_write (data, node, dst_buf, host_ptr, offset, size)
+      == 0)
+    return 0;
+
   return pocl_network_write (queue_id, data, mem_id, 0, host_ptr, offset, size,
                              remote_finish_command, data, node);
 }
@@ -1878,6 +1985,11 @@ pocl_remote_async_map_mem (void *data, _cl_command_node *node,
                          "to dst_host_ptr %p\n",
                          mem_id, offset, host_ptr);
 
+  if (pocl_remote_dirty_read (data, node, src_buf, size_id, host_ptr, offset,
+                              size)
+      == 0)
+    return 0;
+
   int r = pocl_network_read (queue_id, data, mem_id, 0, size_id, host_ptr,
                              offset, size, remote_finish_command, data, node);
   assert (r == 0);
@@ -1931,17 +2043,24 @@ pocl_remote_async_unmap_mem (void *data, _cl_command_node *node,
   POCL_MSG_PRINT_MEMORY ("REMOTE: UNMAP memcpy() "
                          "host_ptr %p to mem_id %lu + offset %zu size %zu\n",
                          host_ptr, mem_id, offset, size);
+  if (pocl_remote_dirty_write (data, node, node->command.unmap.buffer,
+                               host_ptr, offset, size)
+      == 0)
+    return 0;
   int r = pocl_network_write (queue_id, data, mem_id, 0, host_ptr, offset,
                               size, remote_finish_command, data, node);
   assert (r == 0);
   return 0;
 }
 
-void
-pocl_remote_async_run (void *data, _cl_command_node *cmd)
+/**
+ * Packs the arguments of the kernel command CMD into its kernel_data_t.
+ * Returns 1 if they differ from the ones last sent to the remote.
+ */
+int
+pocl_remote_setup_kernel_args (remote_device_data_t *ddata,
+                               _cl_command_node *cmd)
 {
-  uint32_t queue_id = (uint32_t)cmd->sync.event.event->queue->id;
-
   struct pocl_argument *al = NULL;
   unsigned i;
   cl_kernel kernel = cmd->command.run.kernel;
@@ -1949,7 +2068,6 @@ pocl_remote_async_run (void *data, _cl_command_node *cmd)
   int requires_kernarg_update = 0;
 
   pocl_kernel_metadata_t *kernel_md = kernel->meta;
-  remote_device_data_t *ddata = (remote_device_data_t *)data;
 
   kernel_data_t *kd = (kernel_data_t *)(kernel->data[dev_i]);
   assert (kd != NULL);
@@ -2051,6 +2169,22 @@ pocl_remote_async_run (void *data, _cl_command_node *cmd)
 
   assert (pod_arg_pointer <= (kd->pod_arg_storage + kd->pod_total_size));
 
+  return requires_kernarg_update;
+}
+
+void
+pocl_remote_async_run (void *data, _cl_command_node *cmd)
+{
+  uint32_t queue_id = (uint32_t)cmd->sync.event.event->queue->id;
+  cl_kernel kernel = cmd->command.run.kernel;
+  remote_device_data_t *ddata = (remote_device_data_t *)data;
+  kernel_data_t *kd = (kernel_data_t *)(kernel->data[cmd->program_device_i]);
+
+  if (ddata->aggregate && pocl_remote_aggregate_run (ddata, cmd))
+    return;
+
+  int requires_kernarg_update = pocl_remote_setup_kernel_args (ddata, cmd);
+
   vec3_t local
       = { cmd->command.run.pc.local_size[0], cmd->command.run.pc.local_size[1],
           cmd->command.run.pc.local_size[2] };
@@ -2291,6 +2425,10 @@ remote_start_command (remote_device_data_t *d, _cl_command_node *node)
     }
   pocl_update_event_running (event);
 
+  if (d->aggregate)
+    pocl_remote_aggregate_note_command (d, node);
+  pocl_remote_dirty_note_command (d, node);
+
   switch (node->type)
     {
     case CL_COMMAND_MIGRATE_MEM_OBJECTS:
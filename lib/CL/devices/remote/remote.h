@@ -33,6 +33,7 @@
 #include "prototypes.inc"
 
 typedef struct remote_server_data_s remote_server_data_t;
+typedef struct remote_aggregate_s remote_aggregate_t;
 typedef struct remote_device_data_s
 {
   remote_server_data_t *server;
@@ -71,6 +72,17 @@ typedef struct remote_device_data_s
   pocl_thread_t driver_thread_id;
   size_t driver_thread_exit_requested;
 
+  /* Non-NULL if this device aggregates devices of several servers into one
+     (see aggregate.c). The fields above then describe the primary member,
+     which holds the authoritative copy of every buffer. */
+  remote_aggregate_t *aggregate;
+
+  /* Block size of the buffer checksums used to skip unchanged blocks in
+     writes, 0 if disabled (see dirty_blocks.c). */
+  size_t dirty_block_size;
+  /* Bumped when a command may have written any buffer. */
+  uint64_t dirty_epoch;
+
 } remote_device_data_t;
 
 GEN_PROTOTYPES (remote)
@@ -81,4 +93,13 @@ peer_list_t *pocl_remote_get_peer_list (int base_id, unsigned device_count);
 
 cl_int pocl_remote_setup_peer_mesh ();
 
+/* Driver internals shared with aggregate.c. */
+void pocl_remote_finish_command (void *arg, _cl_command_node *node,
+                                 size_t extra_rep_bytes);
+
+int pocl_remote_setup_kernel_args (remote_device_data_t *ddata,
+                                   _cl_command_node *cmd);
+
+int pocl_remote_join_svm_pool (remote_device_data_t *ddata);
+
 #endif /* POCL_REMOTE_H */
@@ -164,6 +164,8 @@ pocl_hash_clipped_name (const char *str, size_t max_length, char *new_str)
    - if the global offset is zero (in all dimensions) or not
    - if the grid size in any dimension is smaller than a device
    specified limit ("smallgrid" specialization)
+   - the formats of the image arguments and the states of the sampler
+   arguments, on the CPU devices (see pocl_cmd_image_specialization)
 */
 void
 pocl_cache_kernel_cachedir_path (char *kernel_cachedir_path,
@@ -176,13 +178,16 @@ pocl_cache_kernel_cachedir_path (char *kernel_cachedir_path,
   char tempstring[POCL_MAX_PATHNAME_LENGTH];
   cl_device_id dev = command->device;
   size_t max_grid_width = pocl_cmd_max_grid_dim_width (run_cmd);
+  char image_spec[POCL_IMAGE_SPEC_LENGTH] = "";
+  if (specialized)
+    pocl_cmd_image_specialization (run_cmd, dev, image_spec);
 
   char kernel_dir_name[POCL_MAX_DIRNAME_LENGTH + 1];
   pocl_hash_clipped_name (kernel->name, POCL_MAX_DIRNAME_LENGTH,
                           &kernel_dir_name[0]);
 
   bytes_written = snprintf (
-      tempstring, POCL_MAX_PATHNAME_LENGTH, "/%s/%zu-%zu-%zu%s%s%s",
+      tempstring, POCL_MAX_PATHNAME_LENGTH, "/%s/%zu-%zu-%zu%s%s%s%s",
       kernel_dir_name, !specialized ? 0 : run_cmd->pc.local_size[0],
       !specialized ? 0 : run_cmd->pc.local_size[1],
       !specialized ? 0 : run_cmd->pc.local_size[2],
@@ -195,7 +200,7 @@ pocl_cache_kernel_cachedir_path (char *kernel_cachedir_path,
               && max_grid_width < dev->grid_width_specialization_limit
           ? "-smallgrid"
           : "",
-      append_str);
+      image_spec, append_str);
   assert (bytes_written > 0 && bytes_written < POCL_MAX_PATHNAME_LENGTH);
 
   program_device_dir (kernel_cachedir_path, program, program_device_i,
@@ -477,6 +482,12 @@ build_program_compute_hash (cl_program program, unsigned device_i,
         if (wg_method)
           pocl_SHA1_Update (&hash_ctx, (uint8_t *)wg_method,
                             strlen (wg_method));
+        if (device->deferred_printf)
+          pocl_SHA1_Update (&hash_ctx, (uint8_t *)"deferred_printf", 15);
+        if (device->simd_sub_group_size)
+          pocl_SHA1_Update (&hash_ctx,
+                            (uint8_t *)&device->simd_sub_group_size,
+                            sizeof (cl_uint));
       }
 #endif
 
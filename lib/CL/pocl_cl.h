@@ -983,6 +983,11 @@ struct _cl_device_id {
    * Currently the pthread/basic devices require this; other devices
    * implement printf their own way. */
   int device_side_printf;
+  /* when enabled together with device_side_printf, printf() calls are
+   * replaced with __pocl_printf_deferred instead, which only stores the
+   * format string address and the argument values; the driver formats
+   * the output on the host. */
+  int deferred_printf;
   size_t max_work_item_sizes[3];
   size_t max_work_group_size;
   size_t preferred_wg_size_multiple;
@@ -1204,10 +1209,18 @@ struct _cl_device_id {
 
   cl_uint max_num_sub_groups;
   cl_bool sub_group_independent_forward_progress;
+  /* If nonzero, the kernel compiler makes sub-groups this many work-items
+     wide, i.e. one vector of the vectorized work-item loop, when the local
+     X size is a multiple of it. Otherwise a sub-group spans the local X
+     dimension. */
+  cl_uint simd_sub_group_size;
 
   /* image formats supported by the device, per image type */
   const cl_image_format *image_formats[NUM_OPENCL_IMAGE_TYPES];
   cl_uint num_image_formats[NUM_OPENCL_IMAGE_TYPES];
+  /* If nonzero, the CPU drivers store 2D, 2D array and 3D images in
+     square (cubic) tiles instead of rows, see pocl_driver_image_tiling(). */
+  int tiled_images;
 
   /* Device operations, shared among devices of the same type */
   struct pocl_device_ops *ops;
@@ -1718,6 +1731,9 @@ typedef struct pocl_kernel_metadata_s
   size_t reqd_wg_size[OPENCL_MAX_DIMENSION];
   size_t wg_size_hint[OPENCL_MAX_DIMENSION];
   char vectypehint[16];
+  /* value for CL_KERNEL_GROUPS_INDEPENDENT_POCL, CL_FALSE unless the
+   * compiler has checked the kernel */
+  cl_bool groups_independent;
 
   /* if we know the size of _every_ kernel argument, we store
    * the total size here. see struct _cl_kernel on why */
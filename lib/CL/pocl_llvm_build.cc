@@ -187,8 +187,14 @@ static bool generateProgramBC(PoclLLVMContextData *Context, llvm::Module *Mod,
     Program->global_var_total_size[device_i] = TotalGVarBytes;
   }
 
+  const char *Options = Program->compiler_options;
+  bool RelaxedMath =
+      Options != nullptr &&
+      (strstr(Options, "-cl-fast-relaxed-math") != nullptr ||
+       strstr(Options, "-cl-unsafe-math-optimizations") != nullptr);
+
   if (link(Mod, BuiltinLib, Log, Device->device_aux_functions,
-           Device->device_side_printf != CL_FALSE))
+           Device->device_side_printf != CL_FALSE, RelaxedMath))
     return true;
 
   raw_string_ostream OS(Log);
@@ -1009,6 +1015,11 @@ static llvm::Module *getKernelLibrary(cl_device_id device,
         POCL_ABORT("Kernel library file %s doesn't exist.\n", kernellib.c_str());
     }
   assert (lib != NULL);
+
+  // Let the work-item loops of CPU kernels call the SIMD math functions.
+  if (device->type & CL_DEVICE_TYPE_CPU)
+    addVectorVariantMappings(lib);
+
   kernelLibraryMap->insert(std::make_pair(device, lib));
 
   return lib;
@@ -34,6 +34,8 @@ IGNORE_COMPILER_WARNING("-Wunused-parameter")
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/ADT/SmallVector.h>
 
 #include <string>
@@ -510,6 +512,70 @@ static int pocl_get_kernel_arg_function_metadata(llvm::Function *Kernel,
   return 0;
 }
 
+/* The work-item functions whose results differ between an NDRange and a slab
+   of its work-groups run as an NDRange of its own at a global offset. */
+static const char *NDRangeWIFuncNames[] = {
+    "_Z12get_group_idj", "_Z14get_num_groupsj", "_Z15get_global_sizej",
+    "_Z17get_global_offsetj", "_Z20get_global_linear_idv"};
+
+/* The kernel library variables behind them. */
+static const char *NDRangeWIVarPrefixes[] = {"_group_id_", "_num_groups_",
+                                             "_global_offset_"};
+
+/* Returns true if neither Kernel nor the functions it calls use the
+   work-item functions above, atomics or device-side enqueue, see
+   CL_KERNEL_GROUPS_INDEPENDENT_POCL. Indirect calls make it false. */
+static bool areGroupsIndependent(llvm::Function *Kernel) {
+  SmallPtrSet<llvm::Function *, 16> Visited;
+  SmallVector<llvm::Function *, 16> Worklist;
+  Visited.insert(Kernel);
+  Worklist.push_back(Kernel);
+
+  while (!Worklist.empty()) {
+    llvm::Function *F = Worklist.pop_back_val();
+    for (llvm::BasicBlock &BB : *F) {
+      for (llvm::Instruction &I : BB) {
+        if (I.isAtomic() && !isa<FenceInst>(I))
+          return false;
+
+        for (llvm::Value *Op : I.operands()) {
+          auto *GV = dyn_cast<GlobalVariable>(Op->stripPointerCasts());
+          if (GV == nullptr)
+            continue;
+          for (const char *Prefix : NDRangeWIVarPrefixes)
+            if (GV->getName().startswith(Prefix))
+              return false;
+        }
+
+        auto *Call = dyn_cast<CallBase>(&I);
+        if (Call == nullptr)
+          continue;
+        llvm::Function *Callee = Call->getCalledFunction();
+        if (Callee == nullptr)
+          return false;
+        if (Callee->isIntrinsic())
+          continue;
+        StringRef Name = Callee->getName();
+        for (const char *WIFunc : NDRangeWIFuncNames)
+          if (Name == WIFunc)
+            return false;
+        // The other work-item functions read the kernel library variables
+        // too, but only to compute the ids within the slab.
+        bool IsWIFunc = false;
+        for (unsigned i = 0; i < pocl::NumWIFuncNames; ++i)
+          IsWIFunc |= (Name == pocl::WIFuncNameArray[i]);
+        if (IsWIFunc)
+          continue;
+        if (Name.contains("atom") || Name.contains("enqueue_kernel"))
+          return false;
+        if (!Callee->isDeclaration() && Visited.insert(Callee).second)
+          Worklist.push_back(Callee);
+      }
+    }
+  }
+  return true;
+}
+
 /*****************************************************************************/
 
 int pocl_llvm_get_kernels_metadata(cl_program program, unsigned device_i) {
@@ -582,6 +648,9 @@ int pocl_llvm_get_kernels_metadata(cl_program program, unsigned device_i) {
       return CL_INVALID_KERNEL;
     }
 
+    meta->groups_independent =
+        areGroupsIndependent(KernelFunction) ? CL_TRUE : CL_FALSE;
+
 #ifdef DEBUG_POCL_LLVM_API
     printf("### fetching kernel metadata for kernel %s program %p "
            "input llvm::Module %p\n",
@@ -368,9 +368,17 @@ void cpu_setup_vector_widths(cl_device_id dev) {
 
   if (strstr(dev->extensions, "cl_khr_fp16") == NULL) {
     dev->native_vector_width_half = dev->preferred_vector_width_half = 0;
+  } else if (res && (features["avx512fp16"] || features["fullfp16"])) {
+    // The SIMD unit computes in half precision (AVX512-FP16, Armv8.2 FP16),
+    // so a vector register holds twice as many halves as floats.
+    dev->native_vector_width_half = dev->preferred_vector_width_half =
+        VECWIDTH(cl_half);
   } else {
+    // The backend promotes half arithmetic to float, using F16C for the
+    // conversions where available, so the halves go a float vector at a
+    // time.
     dev->native_vector_width_half = dev->preferred_vector_width_half =
-        VECWIDTH(cl_short);
+        VECWIDTH(float);
   }
 }
 
@@ -629,6 +629,7 @@ static bool runKernelCompilerPasses(cl_device_id Device, llvm::Module &Mod) {
   }
 
   PM.run(Mod);
+  inlineUnvectorizedVariantCalls(&Mod);
   return true;
 }
 
@@ -1029,6 +1030,8 @@ static int pocl_llvm_run_pocl_passes(llvm::Module *Bitcode,
   // If set to non-zero, assume each grid dimension is at most this
   // work-items wide.
   size_t WGMaxGridDimWidth;
+  // The image formats and sampler states to specialize for, if any.
+  char WGImageSpec[POCL_IMAGE_SPEC_LENGTH] = "";
 
   // Set the specialization properties.
   if (Specialize) {
@@ -1050,6 +1053,7 @@ static int pocl_llvm_run_pocl_passes(llvm::Module *Bitcode,
       // Limited grid dimension width by the device specific limit.
       WGMaxGridDimWidth = Device->grid_width_specialization_limit;
     }
+    pocl_cmd_image_specialization(RunCommand, Device, WGImageSpec);
   } else {
     WGDynamicLocalSize = true;
     WGLocalSizeX = WGLocalSizeY = WGLocalSizeZ = 0;
@@ -1079,6 +1083,10 @@ static int pocl_llvm_run_pocl_passes(llvm::Module *Bitcode,
     setModuleIntMetadata(Bitcode, "device_native_vec_width",
                          Device->native_vector_width_in_bits);
 
+  if (Device->simd_sub_group_size)
+    setModuleIntMetadata(Bitcode, "device_simd_sub_group_size",
+                         Device->simd_sub_group_size);
+
   if (Kernel != nullptr)
     setModuleStringMetadata(Bitcode, "KernelName", Kernel->name);
 
@@ -1089,6 +1097,7 @@ static int pocl_llvm_run_pocl_passes(llvm::Module *Bitcode,
   setModuleBoolMetadata(Bitcode, "WGDynamicLocalSize", WGDynamicLocalSize);
   setModuleBoolMetadata(Bitcode, "WGAssumeZeroGlobalOffset",
                         WGAssumeZeroGlobalOffset);
+  setModuleStringMetadata(Bitcode, "WGImageSpecialization", WGImageSpec);
 
   setModuleIntMetadata(Bitcode, "device_global_as_id", Device->global_as_id);
   setModuleIntMetadata(Bitcode, "device_local_as_id", Device->local_as_id);
@@ -1099,6 +1108,8 @@ static int pocl_llvm_run_pocl_passes(llvm::Module *Bitcode,
 
   setModuleBoolMetadata(Bitcode, "device_side_printf",
                         Device->device_side_printf);
+  setModuleBoolMetadata(Bitcode, "device_deferred_printf",
+                        Device->deferred_printf);
   setModuleBoolMetadata(Bitcode, "device_alloca_locals",
                         Device->device_alloca_locals);
   setModuleIntMetadata(Bitcode, "device_autolocals_to_args",
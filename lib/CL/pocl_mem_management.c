@@ -23,6 +23,7 @@
 */
 
 #include "pocl_mem_management.h"
+#include "common.h"
 #include "pocl.h"
 #include "pocl_util.h"
 
@@ -568,6 +569,28 @@ update_subbuffer_versioning_data (cl_mem updated_buf)
     }
 }
 
+/**
+ * Returns 1 if the device global memory identified by gmem aliases the
+ * buffer's mem_host_ptr and the device already holds the latest version.
+ *
+ * Sub-buffers, buffers with sub-buffers and content size -tracked buffers
+ * have extra versioning side effects, so they always take the full path.
+ * Must be called with the buffer locked.
+ */
+static int
+pocl_mem_is_host_unified (cl_mem mem, pocl_mem_identifier *gmem)
+{
+  if (gmem->mem_ptr == NULL || gmem->mem_ptr != mem->mem_host_ptr)
+    return 0;
+  if (mem->parent != NULL || mem->sub_buffers != NULL
+      || mem->size_buffer != NULL || mem->content_buffer != NULL)
+    return 0;
+  /* A fresh mem_host_ptr alone is not enough: it might have been marked
+   * fresh by a still pending export from another device, which the full
+   * path orders the user command after. */
+  return gmem->version == mem->latest_version;
+}
+
 /**
  * Creates the necessary implicit migration commands to ensure data is
  * where it's supposed to be according to the semantics of the program
@@ -653,6 +676,26 @@ pocl_create_migration_commands (cl_device_id dev,
   previous_last_event = mem->last_updater;
   mem->last_updater = user_cmd;
 
+  /* Fast path for host-unified memory: the device uses mem_host_ptr
+   * directly as its storage (CPU devices), so the device copy and the host
+   * copy are the same bytes and no migration command is needed. */
+  if (ev_export_p == NULL && pocl_mem_is_host_unified (mem, gmem))
+    {
+      if (!readonly)
+        ++mem->latest_version;
+      gmem->version = mem->latest_version;
+      mem->mem_host_ptr_version = mem->latest_version;
+      POCL_UNLOCK_OBJ (mem);
+
+      POCL_MSG_PRINT_MEMORY ("Buf %zu is host-unified on device %zu, "
+                             "skipping migration (v%zu).\n",
+                             mem->id, dev->id, mem->latest_version);
+
+      if (previous_last_event)
+        POname (clReleaseEvent (previous_last_event));
+      return CL_SUCCESS;
+    }
+
   /* Find the device/gmem with the latest copy of the data and that has the
    * fastest migration route.
    * ex_dev = device with the latest copy _other than dev_
@@ -845,7 +888,7 @@ FINISH_VER_SETUP:
           size_t align = max (mem->context->min_buffer_alignment, 16);
           /* Always allocate mem_host_ptr for the full size of the buffer to
            * guard against applications forgetting to check content size. */
-          mem->mem_host_ptr = pocl_aligned_malloc (align, mem->size);
+          mem->mem_host_ptr = pocl_mem_pool_alloc (align, mem->size);
           assert ((mem->mem_host_ptr != NULL)
                   && "Cannot allocate backing memory for mem_host_ptr!\n");
         }
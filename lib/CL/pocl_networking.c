@@ -23,21 +23,36 @@
    IN THE SOFTWARE.
 */
 
+#define _GNU_SOURCE
+
+#include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
 #include <netinet/in.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <sys/time.h>
 #include <limits.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
 
 #include "pocl_debug.h"
 #include "pocl_networking.h"
 #ifdef ENABLE_VSOCK
 #include <linux/vm_sockets.h>
 #endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #ifdef ENABLE_VSOCK
 /* Allocate an addrinfo for AF_VSOCK.  Free with host_freeaddrinfo(). */
@@ -268,3 +283,400 @@ pocl_remote_client_set_socket_options (int socket_fd, int bufsize, int is_fast,
 
   return 0;
 }
+
+/* A transfer is considered poorly compressible when it shrinks by less than
+   10%. */
+#define CODEC_IS_POOR(raw, wire) ((wire) * 10 > (raw) * 9)
+/* Upper bound of the transfers bypassing the codec in a row. */
+#define CODEC_MAX_BACKOFF 64
+/* Blocks tried before the rest of a poorly compressing transfer is sent
+   stored without trying. */
+#define CODEC_PROBE_BLOCKS 2
+
+uint8_t
+pocl_remote_supported_codecs (void)
+{
+#ifdef HAVE_ZLIB
+  return POCL_REMOTE_CODEC_DEFLATE;
+#else
+  return POCL_REMOTE_CODEC_NONE;
+#endif
+}
+
+void
+pocl_remote_codec_init (pocl_remote_codec_t *c, uint32_t codec,
+                        uint32_t threshold)
+{
+  memset (c, 0, sizeof (pocl_remote_codec_t));
+  c->codec = codec & pocl_remote_supported_codecs ();
+  c->threshold = threshold;
+}
+
+void
+pocl_remote_codec_free (pocl_remote_codec_t *c)
+{
+#ifdef HAVE_ZLIB
+  if (c->deflate_stream)
+    {
+      deflateEnd ((z_stream *)c->deflate_stream);
+      free (c->deflate_stream);
+    }
+  if (c->inflate_stream)
+    {
+      inflateEnd ((z_stream *)c->inflate_stream);
+      free (c->inflate_stream);
+    }
+#endif
+  c->deflate_stream = NULL;
+  c->inflate_stream = NULL;
+}
+
+size_t
+pocl_remote_codec_scratch_size (void)
+{
+  /* the encoder gives up as soon as the output would not be smaller than
+     the input, so a block sized buffer always suffices */
+  return POCL_REMOTE_CODEC_BLOCK_SIZE;
+}
+
+uint32_t
+pocl_remote_codec_begin (pocl_remote_codec_t *c, uint64_t size)
+{
+  c->raw_bytes = 0;
+  c->wire_bytes = 0;
+  if (c->codec == POCL_REMOTE_CODEC_NONE || size < c->threshold)
+    return POCL_REMOTE_CODEC_NONE;
+  if (c->skip > 0)
+    {
+      --c->skip;
+      return POCL_REMOTE_CODEC_NONE;
+    }
+  return c->codec;
+}
+
+#ifdef HAVE_ZLIB
+static int
+codec_deflate (pocl_remote_codec_t *c, const void *src, uint32_t size,
+               void *dst, uint32_t *wire_size)
+{
+  z_stream *zs = (z_stream *)c->deflate_stream;
+  if (zs == NULL)
+    {
+      zs = (z_stream *)calloc (1, sizeof (z_stream));
+      /* raw deflate, the blocks have their own framing */
+      if (zs == NULL
+          || deflateInit2 (zs, Z_BEST_SPEED, Z_DEFLATED, -15, 8,
+                           Z_DEFAULT_STRATEGY)
+                 != Z_OK)
+        {
+          POCL_MSG_WARN ("Could not initialize deflate, disabling payload "
+                         "compression\n");
+          free (zs);
+          c->codec = POCL_REMOTE_CODEC_NONE;
+          return -1;
+        }
+      c->deflate_stream = zs;
+    }
+  else
+    deflateReset (zs);
+
+  zs->next_in = (Bytef *)src;
+  zs->avail_in = size;
+  zs->next_out = (Bytef *)dst;
+  /* leave out one byte so that a block which does not shrink ends
+     the stream early instead of overflowing */
+  zs->avail_out = size - 1;
+  if (deflate (zs, Z_FINISH) != Z_STREAM_END)
+    return -1;
+  *wire_size = (uint32_t)zs->total_out;
+  return 0;
+}
+
+static int
+codec_inflate (pocl_remote_codec_t *c, const void *src, uint32_t wire_size,
+               void *dst, uint32_t raw_size)
+{
+  z_stream *zs = (z_stream *)c->inflate_stream;
+  if (zs == NULL)
+    {
+      zs = (z_stream *)calloc (1, sizeof (z_stream));
+      if (zs == NULL || inflateInit2 (zs, -15) != Z_OK)
+        {
+          free (zs);
+          return -1;
+        }
+      c->inflate_stream = zs;
+    }
+  else
+    inflateReset (zs);
+
+  zs->next_in = (Bytef *)src;
+  zs->avail_in = wire_size;
+  zs->next_out = (Bytef *)dst;
+  zs->avail_out = raw_size;
+  if (inflate (zs, Z_FINISH) != Z_STREAM_END || zs->total_out != raw_size)
+    return -1;
+  return 0;
+}
+#endif
+
+const void *
+pocl_remote_codec_encode_block (pocl_remote_codec_t *c, const void *src,
+                                uint32_t size, void *scratch,
+                                CodecBlockHeader_t *hdr)
+{
+  const void *out = src;
+  uint32_t wire_size = size;
+
+  assert (size <= POCL_REMOTE_CODEC_BLOCK_SIZE);
+  int probe = c->raw_bytes < CODEC_PROBE_BLOCKS * POCL_REMOTE_CODEC_BLOCK_SIZE
+              || !CODEC_IS_POOR (c->raw_bytes, c->wire_bytes);
+
+#ifdef HAVE_ZLIB
+  if (probe && size > 1 && c->codec == POCL_REMOTE_CODEC_DEFLATE
+      && codec_deflate (c, src, size, scratch, &wire_size) == 0)
+    out = scratch;
+#endif
+
+  hdr->raw_size = size;
+  hdr->wire_size = wire_size;
+  c->raw_bytes += size;
+  c->wire_bytes += wire_size;
+  return out;
+}
+
+void
+pocl_remote_codec_end (pocl_remote_codec_t *c)
+{
+  if (c->raw_bytes == 0)
+    return;
+
+  if (CODEC_IS_POOR (c->raw_bytes, c->wire_bytes))
+    {
+      c->backoff = c->backoff ? c->backoff * 2 : 1;
+      if (c->backoff > CODEC_MAX_BACKOFF)
+        c->backoff = CODEC_MAX_BACKOFF;
+      c->skip = c->backoff;
+    }
+  else
+    c->backoff = 0;
+}
+
+int
+pocl_remote_codec_decode_block (pocl_remote_codec_t *c, uint32_t codec,
+                                const CodecBlockHeader_t *hdr,
+                                const void *src, void *dst)
+{
+  if (hdr->raw_size > POCL_REMOTE_CODEC_BLOCK_SIZE
+      || hdr->wire_size > hdr->raw_size)
+    return -1;
+
+  if (hdr->wire_size == hdr->raw_size)
+    {
+      if (src != dst)
+        memcpy (dst, src, hdr->raw_size);
+      return 0;
+    }
+
+#ifdef HAVE_ZLIB
+  if (codec == POCL_REMOTE_CODEC_DEFLATE)
+    return codec_inflate (c, src, hdr->wire_size, dst, hdr->raw_size);
+#endif
+  return -1;
+}
+
+#ifdef __linux__
+
+int
+pocl_remote_shm_create (size_t size, void **ptr)
+{
+  int fd = memfd_create ("pocl-remote-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0)
+    return -1;
+  if (ftruncate (fd, size) < 0
+      || fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+             < 0)
+    {
+      close (fd);
+      return -1;
+    }
+  *ptr = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (*ptr == MAP_FAILED)
+    {
+      *ptr = NULL;
+      close (fd);
+      return -1;
+    }
+  return fd;
+}
+
+void *
+pocl_remote_shm_map (int fd, size_t size)
+{
+  /* Without the seal the client could truncate the file and make accesses
+   * to the mapping fault. */
+  int seals = fcntl (fd, F_GET_SEALS);
+  struct stat st;
+  if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat (fd, &st) < 0
+      || size == 0 || (uint64_t)st.st_size < size)
+    return NULL;
+  void *p = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+/* The local socket lives in the abstract namespace, so there is nothing to
+ * clean up in the filesystem. */
+static socklen_t
+shm_socket_address (uint16_t port, struct sockaddr_un *addr)
+{
+  memset (addr, 0, sizeof (*addr));
+  addr->sun_family = AF_UNIX;
+  int len = snprintf (addr->sun_path + 1, sizeof (addr->sun_path) - 1,
+                      "pocld-%u", (unsigned)port);
+  return offsetof (struct sockaddr_un, sun_path) + 1 + len;
+}
+
+int
+pocl_remote_shm_listen (uint16_t port)
+{
+  struct sockaddr_un addr;
+  socklen_t len = shm_socket_address (port, &addr);
+  int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  if (bind (fd, (struct sockaddr *)&addr, len) < 0 || listen (fd, 16) < 0)
+    {
+      close (fd);
+      return -1;
+    }
+  return fd;
+}
+
+int
+pocl_remote_shm_connect (uint16_t port, uint32_t server_pid)
+{
+  struct sockaddr_un addr;
+  socklen_t len = shm_socket_address (port, &addr);
+  int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  if (connect (fd, (struct sockaddr *)&addr, len) < 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  /* The credentials of a listening socket are those of the process that
+   * called listen(). A server in another pid namespace reports 0 and is
+   * refused too, which just leaves the session on the network sockets. */
+  struct ucred cred;
+  socklen_t cred_len = sizeof (cred);
+  if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0
+      || server_pid == 0 || cred.pid != (pid_t)server_pid)
+    {
+      close (fd);
+      errno = EACCES;
+      return -1;
+    }
+  return fd;
+}
+
+int
+pocl_remote_send_fd (int sock, const void *msg, size_t size, int fd)
+{
+  union
+  {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE (sizeof (int))];
+  } ctrl;
+  struct iovec iov = { (void *)msg, size };
+  struct msghdr mh;
+  memset (&mh, 0, sizeof (mh));
+  memset (&ctrl, 0, sizeof (ctrl));
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = ctrl.buf;
+  mh.msg_controllen = sizeof (ctrl.buf);
+
+  struct cmsghdr *c = CMSG_FIRSTHDR (&mh);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN (sizeof (int));
+  memcpy (CMSG_DATA (c), &fd, sizeof (int));
+
+  return sendmsg (sock, &mh, MSG_NOSIGNAL) == (ssize_t)size ? 0 : -1;
+}
+
+int
+pocl_remote_recv_fd (int sock, void *msg, size_t size, int *fd)
+{
+  union
+  {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE (sizeof (int))];
+  } ctrl;
+  struct iovec iov = { msg, size };
+  struct msghdr mh;
+  memset (&mh, 0, sizeof (mh));
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = ctrl.buf;
+  mh.msg_controllen = sizeof (ctrl.buf);
+
+  *fd = -1;
+  ssize_t n = recvmsg (sock, &mh, MSG_CMSG_CLOEXEC);
+  for (struct cmsghdr *c = CMSG_FIRSTHDR (&mh); n >= 0 && c != NULL;
+       c = CMSG_NXTHDR (&mh, c))
+    {
+      if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS
+          && c->cmsg_len == CMSG_LEN (sizeof (int)))
+        memcpy (fd, CMSG_DATA (c), sizeof (int));
+    }
+
+  if (n == (ssize_t)size && *fd >= 0 && !(mh.msg_flags & MSG_CTRUNC))
+    return 0;
+  if (*fd >= 0)
+    close (*fd);
+  *fd = -1;
+  return -1;
+}
+
+#else
+
+int
+pocl_remote_shm_create (size_t size, void **ptr)
+{
+  return -1;
+}
+
+void *
+pocl_remote_shm_map (int fd, size_t size)
+{
+  return NULL;
+}
+
+int
+pocl_remote_shm_listen (uint16_t port)
+{
+  return -1;
+}
+
+int
+pocl_remote_shm_connect (uint16_t port, uint32_t server_pid)
+{
+  return -1;
+}
+
+int
+pocl_remote_send_fd (int sock, const void *msg, size_t size, int fd)
+{
+  return -1;
+}
+
+int
+pocl_remote_recv_fd (int sock, void *msg, size_t size, int *fd)
+{
+  return -1;
+}
+
+#endif
@@ -22,8 +22,10 @@
    IN THE SOFTWARE.
 */
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "messages.h"
 #include "pocl_export.h"
 
 #ifndef POCL_NETWORKING_H
@@ -94,6 +96,103 @@ extern "C"
    */
   extern struct addrinfo *vsock_hostname_addrinfo (const char *hostname,
                                                    uint16_t port);
+
+  /*
+   * Payload compression of the remote protocol.
+   *
+   * Large buffer and image payloads can be sent through a codec negotiated
+   * at session setup. The payload is split into blocks of at most
+   * POCL_REMOTE_CODEC_BLOCK_SIZE raw bytes which are encoded and sent one at
+   * a time, so the encoding overlaps with the socket writes and needs only a
+   * block sized scratch buffer. Blocks that do not shrink are sent stored.
+   *
+   * Each sending thread keeps its own pocl_remote_codec_t. When a transfer
+   * compresses poorly, the following transfers bypass the codec, with the
+   * number of bypassed transfers doubling on each consecutive poor result.
+   */
+  typedef struct pocl_remote_codec_s
+  {
+    uint32_t codec;
+    uint32_t threshold;
+    /* transfers still to send without encoding */
+    uint32_t skip;
+    uint32_t backoff;
+    /* raw and wire bytes of the current transfer */
+    uint64_t raw_bytes;
+    uint64_t wire_bytes;
+    void *deflate_stream;
+    void *inflate_stream;
+  } pocl_remote_codec_t;
+
+  /* Returns the mask of the codecs available in this build. */
+  extern uint8_t pocl_remote_supported_codecs (void);
+
+  extern void pocl_remote_codec_init (pocl_remote_codec_t *c, uint32_t codec,
+                                      uint32_t threshold);
+
+  extern void pocl_remote_codec_free (pocl_remote_codec_t *c);
+
+  /* Size of the scratch buffer needed by pocl_remote_codec_encode_block(). */
+  extern size_t pocl_remote_codec_scratch_size (void);
+
+  /* Starts a transfer of size raw bytes. Returns the codec to mark the
+   * message with, POCL_REMOTE_CODEC_NONE if the payload is sent raw. */
+  extern uint32_t pocl_remote_codec_begin (pocl_remote_codec_t *c,
+                                           uint64_t size);
+
+  /* Encodes one block of at most POCL_REMOTE_CODEC_BLOCK_SIZE bytes and fills
+   * in its header. Returns the data to send after the header: either the
+   * scratch buffer or src itself for a stored block. */
+  extern const void *pocl_remote_codec_encode_block (pocl_remote_codec_t *c,
+                                                     const void *src,
+                                                     uint32_t size,
+                                                     void *scratch,
+                                                     CodecBlockHeader_t *hdr);
+
+  /* Finishes the transfer started with pocl_remote_codec_begin() and
+   * updates the bypass state from its compression ratio. */
+  extern void pocl_remote_codec_end (pocl_remote_codec_t *c);
+
+  /* Decodes a block received with the given header into dst, which has room
+   * for hdr->raw_size bytes. Returns 0 on success. */
+  extern int pocl_remote_codec_decode_block (pocl_remote_codec_t *c,
+                                             uint32_t codec,
+                                             const CodecBlockHeader_t *hdr,
+                                             const void *src, void *dst);
+
+  /*
+   * Same-host shared memory transport of the remote protocol.
+   *
+   * Besides its TCP ports, the server listens on an abstract unix socket
+   * named after its command port, reachable only from the same host. A
+   * client there can pass the server a sealed memfd over that socket, which
+   * both ends then map as the shared memory window of the session. Bulk
+   * payloads are copied into the window instead of being sent through the
+   * TCP sockets, and the messages only carry their offset in it.
+   *
+   * Only available on Linux; elsewhere these return -1 / NULL.
+   */
+
+  /* Creates a shared memory file of size bytes, sealed against resizing,
+   * and maps it at *ptr. Returns the fd or -1. */
+  extern int pocl_remote_shm_create (size_t size, void **ptr);
+
+  /* Maps size bytes of a shared memory file received from a client, after
+   * checking that it can't be shrunk under the mapping. */
+  extern void *pocl_remote_shm_map (int fd, size_t size);
+
+  /* Returns a listening / connected socket for the local socket of the
+   * server with the given command port, or -1. The socket name can be
+   * bound by any local process, so connect fails with EACCES unless the
+   * peer is the process server_pid. */
+  extern int pocl_remote_shm_listen (uint16_t port);
+  extern int pocl_remote_shm_connect (uint16_t port, uint32_t server_pid);
+
+  /* Sends / receives a small message together with a file descriptor.
+   * Return 0 on success. */
+  extern int pocl_remote_send_fd (int sock, const void *msg, size_t size,
+                                  int fd);
+  extern int pocl_remote_recv_fd (int sock, void *msg, size_t size, int *fd);
 #ifdef __cplusplus
 }
 #endif
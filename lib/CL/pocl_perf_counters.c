@@ -0,0 +1,367 @@
+/* OpenCL runtime library: per-kernel hardware performance counter collection
+   for the CPU drivers
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#include "pocl_perf_counters.h"
+#include "pocl_cl.h"
+#include "pocl_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Maximum number of different kernel/local size/specialization
+   combinations tracked. */
+#define POCL_PERF_MAX_ENTRIES 1000
+
+/* The generic events, in the order of the sample values. */
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_CACHE_REFS 2
+#define PERF_CACHE_MISSES 3
+#define PERF_BRANCH_MISSES 4
+#define PERF_NUM_GENERIC 5
+
+int pocl_perf_counters_enabled = 0;
+
+static unsigned num_counters = PERF_NUM_GENERIC;
+static uint64_t raw_events[POCL_PERF_MAX_COUNTERS - PERF_NUM_GENERIC];
+
+struct kernel_perf_stats
+{
+  char *kernel_name;
+  size_t local_size[3];
+  const void *specialization;
+  unsigned long launches;
+  unsigned long wgs;
+  pocl_perf_sample counts;
+};
+
+static pocl_lock_t perf_stats_lock = POCL_LOCK_INITIALIZER;
+static struct kernel_perf_stats *perf_stats = NULL;
+static unsigned perf_stats_count = 0;
+static int perf_open_failed = 0;
+
+#ifdef __linux__
+
+typedef struct
+{
+  /* The group leader; -1 if opening failed. */
+  int group_fd;
+  int fds[POCL_PERF_MAX_COUNTERS];
+} perf_thread_counters;
+
+/* The counters of the calling thread; NULL if not opened yet. The key's
+   destructor closes them when the thread exits, also for the application
+   threads the basic driver runs kernels on. */
+static __thread perf_thread_counters *thread_counters = NULL;
+static pthread_key_t thread_counters_key;
+static pthread_once_t thread_counters_key_once = PTHREAD_ONCE_INIT;
+
+/* The PERF_FORMAT_GROUP read of a counter group: the number of counters,
+   the times the group was enabled and actually counting, then the
+   values. */
+#define PERF_READ_ENABLED 1
+#define PERF_READ_RUNNING 2
+#define PERF_READ_VALUES 3
+
+static int
+perf_open_counter (uint32_t type, uint64_t config, int group_fd)
+{
+  struct perf_event_attr attr;
+  memset (&attr, 0, sizeof (attr));
+  attr.size = sizeof (attr);
+  attr.type = type;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                     | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.disabled = (group_fd == -1);
+  /* Counting user space only works also with perf_event_paranoid=2. */
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall (SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void
+perf_close_thread_counters (void *arg)
+{
+  perf_thread_counters *c = (perf_thread_counters *)arg;
+  if (c->group_fd >= 0)
+    for (unsigned i = 0; i < num_counters; ++i)
+      close (c->fds[i]);
+  free (c);
+}
+
+static void
+perf_create_thread_counters_key ()
+{
+  pthread_key_create (&thread_counters_key, perf_close_thread_counters);
+}
+
+static void
+perf_open_thread_counters ()
+{
+  pthread_once (&thread_counters_key_once, perf_create_thread_counters_key);
+  perf_thread_counters *c
+      = (perf_thread_counters *)malloc (sizeof (perf_thread_counters));
+  if (c == NULL)
+    return;
+  c->group_fd = -1;
+  thread_counters = c;
+  pthread_setspecific (thread_counters_key, c);
+
+  unsigned i;
+  for (i = 0; i < num_counters; ++i)
+    {
+      uint32_t type = PERF_TYPE_HARDWARE;
+      uint64_t config;
+      switch (i)
+        {
+        case PERF_CYCLES:
+          config = PERF_COUNT_HW_CPU_CYCLES;
+          break;
+        case PERF_INSTRUCTIONS:
+          config = PERF_COUNT_HW_INSTRUCTIONS;
+          break;
+        case PERF_CACHE_REFS:
+          config = PERF_COUNT_HW_CACHE_REFERENCES;
+          break;
+        case PERF_CACHE_MISSES:
+          config = PERF_COUNT_HW_CACHE_MISSES;
+          break;
+        case PERF_BRANCH_MISSES:
+          config = PERF_COUNT_HW_BRANCH_MISSES;
+          break;
+        default:
+          type = PERF_TYPE_RAW;
+          config = raw_events[i - PERF_NUM_GENERIC];
+        }
+      c->fds[i] = perf_open_counter (type, config, i == 0 ? -1 : c->fds[0]);
+      if (c->fds[i] < 0)
+        break;
+    }
+
+  if (i < num_counters)
+    {
+      while (i-- > 0)
+        close (c->fds[i]);
+      if (POCL_ATOMIC_INC (perf_open_failed) == 1)
+        POCL_MSG_WARN ("perf_event_open() failed, no hardware counters will "
+                       "be collected (check "
+                       "/proc/sys/kernel/perf_event_paranoid)\n");
+      return;
+    }
+
+  c->group_fd = c->fds[0];
+  ioctl (c->group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl (c->group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+static int
+perf_read_thread_counters (uint64_t *buf)
+{
+  if (thread_counters == NULL)
+    perf_open_thread_counters ();
+  if (thread_counters == NULL || thread_counters->group_fd < 0)
+    return 0;
+
+  ssize_t size = (num_counters + PERF_READ_VALUES) * sizeof (uint64_t);
+  return read (thread_counters->group_fd, buf, size) == size;
+}
+
+void
+pocl_perf_counters_begin (pocl_perf_sample *sample)
+{
+  memset (sample, 0, sizeof (pocl_perf_sample));
+
+  uint64_t buf[POCL_PERF_MAX_COUNTERS + PERF_READ_VALUES];
+  if (!perf_read_thread_counters (buf))
+    return;
+  sample->time_enabled = buf[PERF_READ_ENABLED];
+  sample->time_running = buf[PERF_READ_RUNNING];
+  memcpy (sample->values, buf + PERF_READ_VALUES,
+          num_counters * sizeof (uint64_t));
+}
+
+void
+pocl_perf_counters_end (const pocl_perf_sample *sample, pocl_perf_sample *acc)
+{
+  uint64_t buf[POCL_PERF_MAX_COUNTERS + PERF_READ_VALUES];
+  if (!perf_read_thread_counters (buf))
+    return;
+
+  /* When there are more events than hardware counters, the kernel
+     multiplexes the group and it counts only part of the time it is
+     enabled. Extrapolate the counts to the whole time. */
+  uint64_t enabled = buf[PERF_READ_ENABLED] - sample->time_enabled;
+  uint64_t running = buf[PERF_READ_RUNNING] - sample->time_running;
+  if (running == 0)
+    return;
+  for (unsigned i = 0; i < num_counters; ++i)
+    {
+      uint64_t count = buf[PERF_READ_VALUES + i] - sample->values[i];
+      if (running < enabled)
+        count = (uint64_t)((double)count * enabled / running);
+      __atomic_add_fetch (&acc->values[i], count, __ATOMIC_RELAXED);
+    }
+}
+
+#else
+
+void
+pocl_perf_counters_begin (pocl_perf_sample *sample)
+{
+  memset (sample, 0, sizeof (pocl_perf_sample));
+}
+
+void
+pocl_perf_counters_end (const pocl_perf_sample *sample, pocl_perf_sample *acc)
+{
+}
+
+#endif
+
+void
+pocl_perf_counters_record (const char *kernel_name, const size_t *local_size,
+                           const void *specialization, size_t num_wgs,
+                           const pocl_perf_sample *acc)
+{
+  POCL_LOCK (perf_stats_lock);
+  unsigned i;
+  for (i = 0; i < perf_stats_count; ++i)
+    {
+      struct kernel_perf_stats *s = &perf_stats[i];
+      if (s->specialization == specialization
+          && memcmp (s->local_size, local_size, sizeof (s->local_size)) == 0
+          && strcmp (s->kernel_name, kernel_name) == 0)
+        break;
+    }
+
+  if (i == perf_stats_count)
+    {
+      if (perf_stats_count >= POCL_PERF_MAX_ENTRIES)
+        {
+          POCL_UNLOCK (perf_stats_lock);
+          return;
+        }
+      struct kernel_perf_stats *s = &perf_stats[perf_stats_count++];
+      s->kernel_name = strdup (kernel_name);
+      memcpy (s->local_size, local_size, sizeof (s->local_size));
+      s->specialization = specialization;
+    }
+
+  struct kernel_perf_stats *s = &perf_stats[i];
+  s->launches++;
+  s->wgs += num_wgs;
+  for (unsigned c = 0; c < num_counters; ++c)
+    s->counts.values[c] += acc->values[c];
+  POCL_UNLOCK (perf_stats_lock);
+}
+
+static int
+order_by_cycles (const void *a, const void *b)
+{
+  uint64_t ca = ((struct kernel_perf_stats *)a)->counts.values[PERF_CYCLES];
+  uint64_t cb = ((struct kernel_perf_stats *)b)->counts.values[PERF_CYCLES];
+  if (ca < cb)
+    return 1;
+  else if (ca > cb)
+    return -1;
+  else
+    return 0;
+}
+
+static void
+pocl_perf_atexit ()
+{
+  POCL_LOCK (perf_stats_lock);
+  qsort (perf_stats, perf_stats_count, sizeof (struct kernel_perf_stats),
+         order_by_cycles);
+
+  printf ("\n");
+  printf ("     %-30s %-16s %8s %10s %12s %6s %7s %12s", "kernel",
+          "local size", "launches", "WGs", "Mcycles", "IPC", "miss %",
+          "br. misses");
+  for (unsigned r = PERF_NUM_GENERIC; r < num_counters; ++r)
+    {
+      char name[32];
+      snprintf (name, sizeof (name), "raw:0x%" PRIx64,
+                raw_events[r - PERF_NUM_GENERIC]);
+      printf (" %14s", name);
+    }
+  printf ("\n");
+
+  for (unsigned i = 0; i < perf_stats_count; ++i)
+    {
+      struct kernel_perf_stats *s = &perf_stats[i];
+      uint64_t *v = s->counts.values;
+      char local[32];
+      snprintf (local, sizeof (local), "%zux%zux%zu", s->local_size[0],
+                s->local_size[1], s->local_size[2]);
+      printf ("%3u) %-30s %-16s %8lu %10lu %12.2f %6.2f %6.2f%% %12" PRIu64,
+              i + 1, s->kernel_name, local, s->launches, s->wgs,
+              v[PERF_CYCLES] / 1e6,
+              v[PERF_CYCLES] ? (double)v[PERF_INSTRUCTIONS] / v[PERF_CYCLES]
+                             : 0.0,
+              v[PERF_CACHE_REFS]
+                  ? 100.0 * v[PERF_CACHE_MISSES] / v[PERF_CACHE_REFS]
+                  : 0.0,
+              v[PERF_BRANCH_MISSES]);
+      for (unsigned r = PERF_NUM_GENERIC; r < num_counters; ++r)
+        printf (" %14" PRIu64, v[r]);
+      printf ("\n");
+    }
+  POCL_UNLOCK (perf_stats_lock);
+}
+
+/* Initialize the collection, if not yet done. */
+
+void
+pocl_perf_counters_init ()
+{
+  const char *raw = pocl_get_string_option ("POCL_PERF_RAW_EVENTS", NULL);
+  if (raw != NULL)
+    {
+      char *end = NULL;
+      while (*raw != 0 && num_counters < POCL_PERF_MAX_COUNTERS)
+        {
+          uint64_t code = strtoull (raw, &end, 0);
+          if (end == raw)
+            break;
+          raw_events[num_counters++ - PERF_NUM_GENERIC] = code;
+          raw = (*end == ',') ? end + 1 : end;
+        }
+    }
+
+  perf_stats = (struct kernel_perf_stats *)calloc (
+      POCL_PERF_MAX_ENTRIES, sizeof (struct kernel_perf_stats));
+  atexit (pocl_perf_atexit);
+  pocl_perf_counters_enabled = 1;
+}
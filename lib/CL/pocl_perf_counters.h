@@ -0,0 +1,93 @@
+/* OpenCL runtime library: per-kernel hardware performance counter collection
+   for the CPU drivers
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+/* The 'perf' tracer (POCL_TRACING=perf) samples hardware performance counters
+   with perf_event_open() around the work-group execution of the CPU drivers.
+   Each executing thread opens its own counter group once and keeps it
+   running; a sample is just two reads of the group around the executed
+   work-groups, so the profiled code itself is not instrumented.
+
+   The counts are accumulated per kernel launch, then aggregated per kernel
+   name, local size and compiled specialization (work-group function), and
+   printed atexit() in the same manner as the 'cq' profiler.
+
+   The generic hardware events (cycles, instructions, cache references and
+   misses, branch misses) are always sampled. Additional raw, model specific
+   events such as the vector FP instruction counters can be added with
+   POCL_PERF_RAW_EVENTS, a comma separated list of raw event codes. */
+
+#ifndef POCL_PERF_COUNTERS_H
+#define POCL_PERF_COUNTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pocl_export.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define POCL_PERF_MAX_COUNTERS 8
+
+typedef struct
+{
+  uint64_t values[POCL_PERF_MAX_COUNTERS];
+  /* The times the counters were enabled and running, for scaling the
+     counts of a multiplexed group. Only used in the begin sample. */
+  uint64_t time_enabled;
+  uint64_t time_running;
+} pocl_perf_sample;
+
+/* This is set to 1 in case the collection was enabled via POCL_TRACING=perf.
+ */
+POCL_EXPORT
+extern int pocl_perf_counters_enabled;
+
+void pocl_perf_counters_init ();
+
+/* Reads the calling thread's counters into the sample. The counters are
+   opened on the first call from each thread and closed when it exits. */
+POCL_EXPORT
+void pocl_perf_counters_begin (pocl_perf_sample *sample);
+
+/* Atomically adds the counts elapsed since pocl_perf_counters_begin() to
+   acc, which can be shared by all the threads executing the same command. */
+POCL_EXPORT
+void pocl_perf_counters_end (const pocl_perf_sample *sample,
+                             pocl_perf_sample *acc);
+
+/* Records the accumulated counts of a finished kernel launch. */
+POCL_EXPORT
+void pocl_perf_counters_record (const char *kernel_name,
+                                const size_t *local_size,
+                                const void *specialization, size_t num_wgs,
+                                const pocl_perf_sample *acc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -37,6 +37,7 @@
 #include <time.h>
 
 #include "pocl_cq_profiling.h"
+#include "pocl_perf_counters.h"
 #include "pocl_util.h"
 #include "pocl_tracing.h"
 #include "pocl_timing.h"
@@ -351,6 +352,12 @@ static const struct pocl_event_tracer cq_profiler
            little impact as possible for later collection/analysis. */
         NULL, NULL };
 
+static const struct pocl_event_tracer perf_profiler
+    = { "perf", pocl_perf_counters_init,
+        /* The counters are sampled by the CPU drivers around the work-group
+           execution, no per-event callbacks needed. */
+        NULL, NULL };
+
 //#################################################################
 
 #ifdef HAVE_LTTNG_UST
@@ -525,7 +532,7 @@ static const struct pocl_event_tracer *pocl_event_tracers[]
 #ifdef HAVE_LTTNG_UST
         &lttng_tracer,
 #endif
-        &cq_profiler };
+        &cq_profiler, &perf_profiler };
 
 #define POCL_TRACER_COUNT                                                     \
   (sizeof (pocl_event_tracers) / sizeof ((pocl_event_tracers)[0]))
@@ -1107,7 +1107,7 @@ pocl_alloc_or_retain_mem_host_ptr (cl_mem mem)
   if (mem->mem_host_ptr == NULL)
     {
       size_t align = max (mem->context->min_buffer_alignment, 16);
-      mem->mem_host_ptr = pocl_aligned_malloc (align, mem->size);
+      mem->mem_host_ptr = pocl_mem_pool_alloc (align, mem->size);
       if (mem->mem_host_ptr == NULL)
         return -1;
       mem->mem_host_ptr_version = 0;
@@ -1124,7 +1124,8 @@ pocl_release_mem_host_ptr (cl_mem mem)
   --mem->mem_host_ptr_refcount;
   if (mem->mem_host_ptr_refcount == 0 && mem->mem_host_ptr != NULL)
     {
-      pocl_aligned_free (mem->mem_host_ptr);
+      size_t align = max (mem->context->min_buffer_alignment, 16);
+      pocl_mem_pool_free (mem->mem_host_ptr, align, mem->size);
       mem->mem_host_ptr = NULL;
       mem->mem_host_ptr_version = 0;
     }
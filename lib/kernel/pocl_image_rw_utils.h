@@ -69,4 +69,43 @@
     dest.w = source.w;                                                        \
   }
 
+/* Returns the x, y and z parts of the pixel index of coord in the image
+ * data; the index is their sum. Keeping them apart lets the linear filters
+ * combine the parts of the neighbouring pixels. The layer of an image array
+ * goes in coord.z, also for 1D image arrays, so that it is scaled by the
+ * slice pitch. With the tiled layout of the CPU drivers, see
+ * pocl_driver_image_tiling(), the tiles and the pixels in them are both
+ * stored in row-major order. */
+_CL_READONLY static ulong4
+pocl_image_index_parts (global dev_image_t *img, int4 coord)
+{
+  ulong4 res;
+  int tiling = img->_tiling;
+  if (tiling == 0)
+    {
+      size_t elem_bytes = img->_num_channels * img->_elem_size;
+      size_t row_pitch = img->_row_pitch / elem_bytes;
+      size_t slice_pitch = img->_slice_pitch / elem_bytes;
+      res.x = coord.x;
+      res.y = coord.y * row_pitch;
+      res.z = coord.z * slice_pitch;
+      res.w = 0;
+      return res;
+    }
+
+  int sx = tiling & 0xf;
+  int sy = (tiling >> 4) & 0xf;
+  int sz = (tiling >> 8) & 0xf;
+  int tshift = sx + sy + sz;
+  ulong tiles_x = (img->_width + (1 << sx) - 1) >> sx;
+  ulong tiles_y = (img->_height + (1 << sy) - 1) >> sy;
+  res.x = ((ulong)(coord.x >> sx) << tshift) + (coord.x & ((1 << sx) - 1));
+  res.y = (((coord.y >> sy) * tiles_x) << tshift)
+          + ((ulong)(coord.y & ((1 << sy) - 1)) << sx);
+  res.z = (((coord.z >> sz) * tiles_x * tiles_y) << tshift)
+          + ((ulong)(coord.z & ((1 << sz) - 1)) << (sx + sy));
+  res.w = 0;
+  return res;
+}
+
 #endif
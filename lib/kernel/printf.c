@@ -748,6 +748,271 @@ __pocl_printf (char *restrict __buffer, uint32_t *__buffer_index,
 
 /**************************************************************************/
 
+/* Deferred printf: instead of formatting on the device, append a record
+ * holding the format string address and the raw argument values to the
+ * printf buffer, and let the host format it after the work-group has
+ * finished. Used by the Workgroup pass instead of __pocl_printf when the
+ * device enables deferred printf. The record layout must match
+ * lib/CL/devices/printf_deferred.h: a 16-byte header (format address,
+ * record size) followed by the arguments, each padded to 8 bytes. Vector
+ * arguments are stored as their elements, 3-vectors as 4 elements, %s as
+ * a 32-bit length followed by the NUL-terminated string. A record that
+ * does not fit in the buffer is dropped as a whole. */
+
+#ifdef cl_khr_int64
+
+#define DEFERRED_HEADER_SIZE 16
+#define DEFERRED_ALIGN(x) (((x) + 7u) & ~7u)
+
+static int
+__pocl_printf_deferred_put (PRINTF_BUFFER_AS char *buf, uint32_t *pos,
+                            uint32_t cap, const char *src, uint32_t size)
+{
+  uint32_t padded = DEFERRED_ALIGN (size);
+  if (padded > cap - *pos)
+    return 0;
+  for (uint32_t i = 0; i < size; ++i)
+    buf[*pos + i] = src[i];
+  for (uint32_t i = size; i < padded; ++i)
+    buf[*pos + i] = 0;
+  *pos += padded;
+  return 1;
+}
+
+int
+__pocl_printf_deferred (char *restrict __buffer, uint32_t *__buffer_index,
+                        uint32_t __buffer_capacity,
+                        const PRINTF_FMT_STR_AS char *restrict fmt, ...)
+{
+  PRINTF_BUFFER_AS char *buf = (PRINTF_BUFFER_AS char *)__buffer;
+  uint32_t start = *(PRINTF_BUFFER_AS uint32_t *)__buffer_index;
+  uint32_t pos = start + DEFERRED_HEADER_SIZE;
+  if (fmt == NULL || start > __buffer_capacity
+      || __buffer_capacity - start < DEFERRED_HEADER_SIZE)
+    return -1;
+
+  va_list ap;
+  va_start (ap, fmt);
+  const PRINTF_FMT_STR_AS char *format = fmt;
+  char ch;
+
+  /* Only the parts of the format that decide which arguments are passed
+   * are parsed here; the host validates the rest. Parsing stops at the
+   * first malformed conversion, where the host stops as well. */
+  while ((ch = *format++))
+    {
+      if (ch != '%')
+        continue;
+      ch = *format++;
+      if (ch == '%')
+        continue;
+
+      /* flags, field width and precision */
+      while (ch == '-' || ch == '+' || ch == ' ' || ch == '#' || ch == '.'
+             || (ch >= '0' && ch <= '9'))
+        ch = *format++;
+
+      size_t vector_length = 0;
+      if (ch == 'v')
+        {
+          ch = *format++;
+          while (ch >= '0' && ch <= '9' && vector_length < 100)
+            {
+              vector_length = 10 * vector_length + (ch - '0');
+              ch = *format++;
+            }
+          if (!(vector_length == 2 || vector_length == 3
+                || vector_length == 4 || vector_length == 8
+                || vector_length == 16))
+            break;
+        }
+
+      size_t length = 0;
+      if (ch == 'h')
+        {
+          ch = *format++;
+          if (ch == 'h')
+            {
+              ch = *format++;
+              length = 1;
+            }
+          else if (ch == 'l')
+            {
+              ch = *format++;
+              length = 4;
+            }
+          else
+            length = 2;
+        }
+      else if (ch == 'l')
+        {
+          ch = *format++;
+          length = 8;
+        }
+      if (vector_length > 0 && length == 0)
+        break;
+      if (vector_length == 0 && length == 4)
+        break;
+      if (vector_length == 0)
+        vector_length = 1;
+#ifdef DISABLE_VECTOR_PRINTF
+      vector_length = 1;
+#endif
+      uint32_t lanes = vector_length == 3 ? 4 : vector_length;
+
+#define PUT_DEFERRED_ARG(WIDTH, PROMOTED_WIDTH)                               \
+  {                                                                           \
+    WIDTH##16 val;                                                            \
+    switch (vector_length)                                                    \
+      {                                                                       \
+      default:                                                                \
+        __builtin_unreachable ();                                             \
+      case 1:                                                                 \
+        val.s0 = va_arg (ap, PROMOTED_WIDTH);                                 \
+        break;                                                                \
+      case 2:                                                                 \
+        val.s01 = va_arg (ap, WIDTH##2);                                      \
+        break;                                                                \
+      case 3:                                                                 \
+      case 4:                                                                 \
+        val.s0123 = va_arg (ap, WIDTH##4);                                    \
+        break;                                                                \
+      case 8:                                                                 \
+        val.lo = va_arg (ap, WIDTH##8);                                       \
+        break;                                                                \
+      case 16:                                                                \
+        val = va_arg (ap, WIDTH##16);                                         \
+        break;                                                                \
+      }                                                                       \
+    if (!__pocl_printf_deferred_put (buf, &pos, __buffer_capacity,           \
+                                     (const char *)&val,                      \
+                                     sizeof (WIDTH) * lanes))                 \
+      goto overflow;                                                          \
+  }
+
+      switch (ch)
+        {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+          switch (length)
+            {
+            case 1:
+              PUT_DEFERRED_ARG (uchar, uint);
+              break;
+            case 2:
+              PUT_DEFERRED_ARG (ushort, uint);
+              break;
+            case 0:
+            case 4:
+              PUT_DEFERRED_ARG (uint, uint);
+              break;
+            case 8:
+              PUT_DEFERRED_ARG (ulong, ulong);
+              break;
+            default:
+              goto done;
+            }
+          continue;
+
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+          switch (length)
+            {
+            case 0:
+            case 4:
+#ifdef cl_khr_fp64
+              PUT_DEFERRED_ARG (float, double);
+              break;
+            case 8:
+              PUT_DEFERRED_ARG (double, double);
+              break;
+#else
+              PUT_DEFERRED_ARG (float, float);
+              break;
+#endif
+            default:
+              goto done;
+            }
+          continue;
+
+        case 'c':
+          {
+            int val = va_arg (ap, int);
+            if (!__pocl_printf_deferred_put (buf, &pos, __buffer_capacity,
+                                             (const char *)&val, sizeof (val)))
+              goto overflow;
+            continue;
+          }
+
+        case 's':
+          {
+            OCL_C_AS const char *val = va_arg (ap, OCL_C_AS const char *);
+            if (val == 0)
+              val = "(null)";
+            uint32_t len = 0;
+            while (val[len])
+              ++len;
+            ++len;
+            if (!__pocl_printf_deferred_put (buf, &pos, __buffer_capacity,
+                                             (const char *)&len, sizeof (len))
+                || !__pocl_printf_deferred_put (buf, &pos, __buffer_capacity,
+                                                val, len))
+              goto overflow;
+            continue;
+          }
+
+        case 'p':
+          {
+            ulong val = (ulong)(uintptr_t)va_arg (ap, OCL_C_AS const void *);
+            if (!__pocl_printf_deferred_put (buf, &pos, __buffer_capacity,
+                                             (const char *)&val, sizeof (val)))
+              goto overflow;
+            continue;
+          }
+
+        default:
+          goto done;
+        }
+#undef PUT_DEFERRED_ARG
+    }
+
+done:;
+  va_end (ap);
+
+  struct
+  {
+    ulong format;
+    uint32_t size;
+    uint32_t unused;
+  } header = { (ulong)(uintptr_t)fmt, pos - start, 0 };
+  uint32_t header_pos = start;
+  __pocl_printf_deferred_put (buf, &header_pos, __buffer_capacity,
+                              (const char *)&header, sizeof (header));
+  *(PRINTF_BUFFER_AS uint32_t *)__buffer_index = pos;
+  return 0;
+
+overflow:
+  va_end (ap);
+  return -1;
+}
+
+#undef DEFERRED_HEADER_SIZE
+#undef DEFERRED_ALIGN
+
+#endif
+
+/**************************************************************************/
+
 extern char *_printf_buffer;
 extern uint32_t *_printf_buffer_position;
 extern uint32_t _printf_buffer_capacity;
@@ -755,7 +1020,8 @@ extern uint32_t _printf_buffer_capacity;
 /* This is a placeholder printf function that will be replaced by calls
  * to __pocl_printf(), after an LLVM pass handles the hidden arguments.
  * both __pocl_printf and __pocl_printf_format_simple must be referenced
- * here, so that the kernel library linker pulls them in. */
+ * here, so that the kernel library linker pulls them in. The same goes
+ * for __pocl_printf_deferred, which returns early for a NULL format. */
 
 int
 printf (const PRINTF_FMT_STR_AS char *restrict fmt, ...)
@@ -774,6 +1040,10 @@ printf (const PRINTF_FMT_STR_AS char *restrict fmt, ...)
 
   __pocl_printf (_printf_buffer, _printf_buffer_position,
                  _printf_buffer_capacity, NULL);
+#ifdef cl_khr_int64
+  __pocl_printf_deferred (_printf_buffer, _printf_buffer_position,
+                          _printf_buffer_capacity, NULL);
+#endif
 
   *(PRINTF_BUFFER_AS uint32_t *)_printf_buffer_position
       = p.printf_buffer_index;
@@ -351,8 +351,8 @@ get_image_array_offset (global dev_image_t *img, int4 uvw_after_rint,
         }
       else
         {
-          res.y = clamp (array_coord.y, 0, (img->_image_array_size - 1));
-          res.z = 0;
+          res.y = 0;
+          res.z = clamp (array_coord.y, 0, (img->_image_array_size - 1));
           res.w = 0;
         }
     }
@@ -375,9 +375,9 @@ get_image_array_offset_float (global dev_image_t *img, int4 uvw_after_rint,
         }
       else
         {
-          res.y = clamp (convert_int (rint (array_coord.y)), 0,
+          res.y = 0;
+          res.z = clamp (convert_int (rint (array_coord.y)), 0,
                          (img->_image_array_size - 1));
-          res.z = 0;
           res.w = 0;
         }
     }
@@ -411,9 +411,6 @@ pocl_read_pixel (global dev_image_t *img, int4 coord)
   int elem_size = img->_elem_size;
   int channel_type = img->_data_type;
   void *data = img->_data;
-  size_t elem_bytes = num_channels * elem_size;
-  size_t row_pitch = img->_row_pitch / elem_bytes;
-  size_t slice_pitch = img->_slice_pitch / elem_bytes;
 
   if ((coord.x >= width || coord.x < 0)
       || ((height != 0) && (coord.y >= height || coord.y < 0))
@@ -433,8 +430,8 @@ pocl_read_pixel (global dev_image_t *img, int4 coord)
         return as_uint4 (BORDER_COLOR_F);
     }
 
-  size_t base_index
-      = coord.x + (coord.y * row_pitch) + (coord.z * slice_pitch);
+  ulong4 parts = pocl_image_index_parts (img, coord);
+  size_t base_index = parts.x + parts.y + parts.z;
 
   if ((channel_type == CLK_SIGNED_INT8) || (channel_type == CLK_SIGNED_INT16)
       || (channel_type == CLK_SIGNED_INT32))
@@ -479,8 +476,7 @@ pocl_address_mode (global dev_image_t *img, int4 input_coord,
 _CL_READONLY static float4
 read_pixel_linear_3d_float (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
                             int width, int height, int depth, int channel_type,
-                            size_t row_pitch, size_t slice_pitch, int order,
-                            void *data)
+                            ulong4 off0, ulong4 off1, int order, void *data)
 {
   size_t base_index = 0;
   int ijk0_y_OK = (ijk0.y >= 0 && ijk0.y < height);
@@ -493,123 +489,123 @@ read_pixel_linear_3d_float (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
 
   if (ijk0.z >= 0 && ijk0.z < depth)
     {
-      base_index += (ijk0.z * slice_pitch);
+      base_index += off0.z;
 
       if (ijk0_y_OK)
         {
-          base_index += (ijk0.y * row_pitch);
+          base_index += off0.y;
 
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * one_m.y * one_m.z
                       * pocl_read_pixel_fast_f (base_index, channel_type,
                                                 order, data));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * (1 – b) * (1 – c) * Ti1j0k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * one_m.y * one_m.z
                       * pocl_read_pixel_fast_f (base_index, channel_type,
                                                 order, data));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk0.y * row_pitch);
+          base_index -= off0.y;
         }
 
       if (ijk1_y_OK)
         {
-          base_index += (ijk1.y * row_pitch);
+          base_index += off1.y;
 
           // + (1 – a) * b * (1 – c) * Ti0j1k0
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * abc.y * one_m.z
                       * pocl_read_pixel_fast_f (base_index, channel_type,
                                                 order, data));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * b * (1 – c) * Ti1j1k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * abc.y * one_m.z
                       * pocl_read_pixel_fast_f (base_index, channel_type,
                                                 order, data));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk1.y * row_pitch);
+          base_index -= off1.y;
         }
 
-      base_index -= (ijk0.z * slice_pitch);
+      base_index -= off0.z;
     }
 
   if (ijk1.z >= 0 && ijk1.z < depth)
     {
-      base_index += (ijk1.z * slice_pitch);
+      base_index += off1.z;
 
       if (ijk0_y_OK)
         {
-          base_index += (ijk0.y * row_pitch);
+          base_index += off0.y;
 
           // + (1 – a) * (1 – b) * c * Ti0j0k1
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * one_m.y * abc.z
                       * pocl_read_pixel_fast_f (base_index, channel_type,
                                                 order, data));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * (1 – b) * (1 – c) * Ti1j0k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * one_m.y * abc.z
                       * pocl_read_pixel_fast_f (base_index, channel_type,
                                                 order, data));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk0.y * row_pitch);
+          base_index -= off0.y;
         }
 
       if (ijk1_y_OK)
         {
-          base_index += (ijk1.y * row_pitch);
+          base_index += off1.y;
 
           // + (1 – a) * b * (1 – c) * Ti0j1k0
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * abc.y * abc.z
                       * pocl_read_pixel_fast_f (base_index, channel_type,
                                                 order, data));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * b * (1 – c) * Ti1j1k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * abc.y * abc.z
                       * pocl_read_pixel_fast_f (base_index, channel_type,
                                                 order, data));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk1.y * row_pitch);
+          base_index -= off1.y;
         }
 
-      base_index -= (ijk1.z * slice_pitch);
+      base_index -= off1.z;
     }
 
   return sum;
@@ -621,9 +617,8 @@ read_pixel_linear_3d_float (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
 
 _CL_READONLY static uint4
 read_pixel_linear_3d_uint (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
-                           int width, int height, int depth, size_t row_pitch,
-                           size_t slice_pitch, int order, int elem_size,
-                           void *data)
+                           int width, int height, int depth, ulong4 off0,
+                           ulong4 off1, int order, int elem_size, void *data)
 {
   size_t base_index = 0;
   int ijk0_y_OK = (ijk0.y >= 0 && ijk0.y < height);
@@ -636,123 +631,123 @@ read_pixel_linear_3d_uint (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
 
   if (ijk0.z >= 0 && ijk0.z < depth)
     {
-      base_index += (ijk0.z * slice_pitch);
+      base_index += off0.z;
 
       if (ijk0_y_OK)
         {
-          base_index += (ijk0.y * row_pitch);
+          base_index += off0.y;
 
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * one_m.y * one_m.z
                       * convert_float4 (pocl_read_pixel_fast_ui (
                             base_index, order, elem_size, data)));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * (1 – b) * (1 – c) * Ti1j0k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * one_m.y * one_m.z
                       * convert_float4 (pocl_read_pixel_fast_ui (
                             base_index, order, elem_size, data)));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk0.y * row_pitch);
+          base_index -= off0.y;
         }
 
       if (ijk1_y_OK)
         {
-          base_index += (ijk1.y * row_pitch);
+          base_index += off1.y;
 
           // + (1 – a) * b * (1 – c) * Ti0j1k0
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * abc.y * one_m.z
                       * convert_float4 (pocl_read_pixel_fast_ui (
                             base_index, order, elem_size, data)));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * b * (1 – c) * Ti1j1k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * abc.y * one_m.z
                       * convert_float4 (pocl_read_pixel_fast_ui (
                             base_index, order, elem_size, data)));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk1.y * row_pitch);
+          base_index -= off1.y;
         }
 
-      base_index -= (ijk0.z * slice_pitch);
+      base_index -= off0.z;
     }
 
   if (ijk1.z >= 0 && ijk1.z < depth)
     {
-      base_index += (ijk1.z * slice_pitch);
+      base_index += off1.z;
 
       if (ijk0_y_OK)
         {
-          base_index += (ijk0.y * row_pitch);
+          base_index += off0.y;
 
           // + (1 – a) * (1 – b) * c * Ti0j0k1
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * one_m.y * abc.z
                       * convert_float4 (pocl_read_pixel_fast_ui (
                             base_index, order, elem_size, data)));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * (1 – b) * (1 – c) * Ti1j0k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * one_m.y * abc.z
                       * convert_float4 (pocl_read_pixel_fast_ui (
                             base_index, order, elem_size, data)));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk0.y * row_pitch);
+          base_index -= off0.y;
         }
 
       if (ijk1_y_OK)
         {
-          base_index += (ijk1.y * row_pitch);
+          base_index += off1.y;
 
           // + (1 – a) * b * (1 – c) * Ti0j1k0
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * abc.y * abc.z
                       * convert_float4 (pocl_read_pixel_fast_ui (
                             base_index, order, elem_size, data)));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * b * (1 – c) * Ti1j1k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * abc.y * abc.z
                       * convert_float4 (pocl_read_pixel_fast_ui (
                             base_index, order, elem_size, data)));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk1.y * row_pitch);
+          base_index -= off1.y;
         }
 
-      base_index -= (ijk1.z * slice_pitch);
+      base_index -= off1.z;
     }
 
   return convert_uint4 (sum);
@@ -760,9 +755,8 @@ read_pixel_linear_3d_uint (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
 
 _CL_READONLY static int4
 read_pixel_linear_3d_int (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
-                          int width, int height, int depth, size_t row_pitch,
-                          size_t slice_pitch, int order, int elem_size,
-                          void *data)
+                          int width, int height, int depth, ulong4 off0,
+                          ulong4 off1, int order, int elem_size, void *data)
 {
   size_t base_index = 0;
   int ijk0_y_OK = (ijk0.y >= 0 && ijk0.y < height);
@@ -775,123 +769,123 @@ read_pixel_linear_3d_int (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
 
   if (ijk0.z >= 0 && ijk0.z < depth)
     {
-      base_index += (ijk0.z * slice_pitch);
+      base_index += off0.z;
 
       if (ijk0_y_OK)
         {
-          base_index += (ijk0.y * row_pitch);
+          base_index += off0.y;
 
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * one_m.y * one_m.z
                       * convert_float4 (pocl_read_pixel_fast_i (
                             base_index, order, elem_size, data)));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * (1 – b) * (1 – c) * Ti1j0k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * one_m.y * one_m.z
                       * convert_float4 (pocl_read_pixel_fast_i (
                             base_index, order, elem_size, data)));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk0.y * row_pitch);
+          base_index -= off0.y;
         }
 
       if (ijk1_y_OK)
         {
-          base_index += (ijk1.y * row_pitch);
+          base_index += off1.y;
 
           // + (1 – a) * b * (1 – c) * Ti0j1k0
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * abc.y * one_m.z
                       * convert_float4 (pocl_read_pixel_fast_i (
                             base_index, order, elem_size, data)));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * b * (1 – c) * Ti1j1k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * abc.y * one_m.z
                       * convert_float4 (pocl_read_pixel_fast_i (
                             base_index, order, elem_size, data)));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk1.y * row_pitch);
+          base_index -= off1.y;
         }
 
-      base_index -= (ijk0.z * slice_pitch);
+      base_index -= off0.z;
     }
 
   if (ijk1.z >= 0 && ijk1.z < depth)
     {
-      base_index += (ijk1.z * slice_pitch);
+      base_index += off1.z;
 
       if (ijk0_y_OK)
         {
-          base_index += (ijk0.y * row_pitch);
+          base_index += off0.y;
 
           // + (1 – a) * (1 – b) * c * Ti0j0k1
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * one_m.y * abc.z
                       * convert_float4 (pocl_read_pixel_fast_i (
                             base_index, order, elem_size, data)));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * (1 – b) * (1 – c) * Ti1j0k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * one_m.y * abc.z
                       * convert_float4 (pocl_read_pixel_fast_i (
                             base_index, order, elem_size, data)));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk0.y * row_pitch);
+          base_index -= off0.y;
         }
 
       if (ijk1_y_OK)
         {
-          base_index += (ijk1.y * row_pitch);
+          base_index += off1.y;
 
           // + (1 – a) * b * (1 – c) * Ti0j1k0
           if (ijk0_x_OK)
             {
-              base_index += ijk0.x;
+              base_index += off0.x;
               sum += (one_m.x * abc.y * abc.z
                       * convert_float4 (pocl_read_pixel_fast_i (
                             base_index, order, elem_size, data)));
-              base_index -= ijk0.x;
+              base_index -= off0.x;
             }
 
           // + a * b * (1 – c) * Ti1j1k0
           if (ijk1_x_OK)
             {
-              base_index += ijk1.x;
+              base_index += off1.x;
               sum += (abc.x * abc.y * abc.z
                       * convert_float4 (pocl_read_pixel_fast_i (
                             base_index, order, elem_size, data)));
-              base_index -= ijk1.x;
+              base_index -= off1.x;
             }
 
-          base_index -= (ijk1.y * row_pitch);
+          base_index -= off1.y;
         }
 
-      base_index -= (ijk1.z * slice_pitch);
+      base_index -= off1.z;
     }
 
   return convert_int4 (sum);
@@ -900,32 +894,31 @@ read_pixel_linear_3d_int (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
 _CL_READONLY static uint4
 read_pixel_linear_3d (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
                       int width, int height, int depth, int channel_type,
-                      size_t row_pitch, size_t slice_pitch, int order,
-                      int elem_size, void *data)
+                      ulong4 off0, ulong4 off1, int order, int elem_size,
+                      void *data)
 {
   // TODO unsupported channel types
   if ((channel_type == CLK_SIGNED_INT8) || (channel_type == CLK_SIGNED_INT16)
       || (channel_type == CLK_SIGNED_INT32))
     return as_uint4 (read_pixel_linear_3d_int (
-        abc, one_m, ijk0, ijk1, width, height, depth, row_pitch, slice_pitch,
-        order, elem_size, data));
+        abc, one_m, ijk0, ijk1, width, height, depth, off0, off1, order,
+        elem_size, data));
   if ((channel_type == CLK_UNSIGNED_INT8) || (channel_type == CLK_UNSIGNED_INT16)
       || (channel_type == CLK_UNSIGNED_INT32))
     return read_pixel_linear_3d_uint (abc, one_m, ijk0, ijk1, width, height,
-                                      depth, row_pitch, slice_pitch, order,
-                                      elem_size, data);
+                                      depth, off0, off1, order, elem_size,
+                                      data);
   return as_uint4 (read_pixel_linear_3d_float (
-      abc, one_m, ijk0, ijk1, width, height, depth, channel_type, row_pitch,
-      slice_pitch, order, data));
+      abc, one_m, ijk0, ijk1, width, height, depth, channel_type, off0,
+      off1, order, data));
 }
 
 /*************************************************************************/
 
 _CL_READONLY static float4
 read_pixel_linear_2d_float (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
-                            int array_coord, int width, int height,
-                            int channel_type, size_t row_pitch,
-                            size_t slice_pitch, int order, void *data)
+                            int width, int height, int channel_type,
+                            ulong4 off0, ulong4 off1, int order, void *data)
 {
   // 2D image
   size_t base_index = 0;
@@ -933,60 +926,60 @@ read_pixel_linear_2d_float (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
   int ijk1_x_OK = (ijk1.x >= 0 && ijk1.x < width);
   float4 sum = (float4) (0.0f);
 
-  if (array_coord > 0)
-    base_index += (array_coord * slice_pitch);
+  // the offset of the array layer
+  base_index += off0.z;
 
   if (ijk0.y >= 0 && ijk0.y < height)
     {
-      base_index += (ijk0.y * row_pitch);
+      base_index += off0.y;
 
       // T = (1 – a) * (1 – b) * Ti0j0
       if (ijk0_x_OK)
         {
-          base_index += ijk0.x;
+          base_index += off0.x;
           sum += (one_m.x * one_m.y * pocl_read_pixel_fast_f (base_index,
                                                               channel_type,
                                                               order, data));
-          base_index -= ijk0.x;
+          base_index -= off0.x;
         }
 
       // + a * (1 – b) * Ti1j0
       if (ijk1_x_OK)
         {
-          base_index += ijk1.x;
+          base_index += off1.x;
           sum += (abc.x * one_m.y * pocl_read_pixel_fast_f (base_index,
                                                             channel_type,
                                                             order, data));
-          base_index -= ijk1.x;
+          base_index -= off1.x;
         }
 
-      base_index -= (ijk0.y * row_pitch);
+      base_index -= off0.y;
     }
 
   if (ijk1.y >= 0 && ijk1.y < height)
     {
-      base_index += (ijk1.y * row_pitch);
+      base_index += off1.y;
 
       // + (1 – a) * b * Ti0j1
       if (ijk0_x_OK)
         {
-          base_index += ijk0.x;
+          base_index += off0.x;
           sum += (one_m.x * abc.y * pocl_read_pixel_fast_f (base_index,
                                                             channel_type,
                                                             order, data));
-          base_index -= ijk0.x;
+          base_index -= off0.x;
         }
 
       // + a * b * Ti1j1
       if (ijk1_x_OK)
         {
-          base_index += ijk1.x;
+          base_index += off1.x;
           sum += (abc.x * abc.y * pocl_read_pixel_fast_f (
                                       base_index, channel_type, order, data));
-          base_index -= ijk1.x;
+          base_index -= off1.x;
         }
 
-      base_index -= (ijk1.y * row_pitch);
+      base_index -= off1.y;
     }
 
   return sum;
@@ -998,9 +991,8 @@ read_pixel_linear_2d_float (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
 
 _CL_READONLY static uint4
 read_pixel_linear_2d_uint (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
-                           int array_coord, int width, int height,
-                           size_t row_pitch, size_t slice_pitch, int order,
-                           int elem_size, void *data)
+                           int width, int height, ulong4 off0, ulong4 off1,
+                           int order, int elem_size, void *data)
 {
   // 2D image
   size_t base_index = 0;
@@ -1008,58 +1000,58 @@ read_pixel_linear_2d_uint (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
   int ijk1_x_OK = (ijk1.x >= 0 && ijk1.x < width);
   float4 sum = (float4) (0.0f);
 
-  if (array_coord > 0)
-    base_index += (array_coord * slice_pitch);
+  // the offset of the array layer
+  base_index += off0.z;
 
   if (ijk0.y >= 0 && ijk0.y < height)
     {
-      base_index += (ijk0.y * row_pitch);
+      base_index += off0.y;
 
       // T = (1 – a) * (1 – b) * Ti0j0
       if (ijk0_x_OK)
         {
-          base_index += ijk0.x;
+          base_index += off0.x;
           sum += (one_m.x * one_m.y
                   * convert_float4 (pocl_read_pixel_fast_ui (
                         base_index, order, elem_size, data)));
-          base_index -= ijk0.x;
+          base_index -= off0.x;
         }
 
       // + a * (1 – b) * Ti1j0
       if (ijk1_x_OK)
         {
-          base_index += ijk1.x;
+          base_index += off1.x;
           sum += (abc.x * one_m.y * convert_float4 (pocl_read_pixel_fast_ui (
                                         base_index, order, elem_size, data)));
-          base_index -= ijk1.x;
+          base_index -= off1.x;
         }
 
-      base_index -= (ijk0.y * row_pitch);
+      base_index -= off0.y;
     }
 
   if (ijk1.y >= 0 && ijk1.y < height)
     {
-      base_index += (ijk1.y * row_pitch);
+      base_index += off1.y;
 
       // + (1 – a) * b * Ti0j1
       if (ijk0_x_OK)
         {
-          base_index += ijk0.x;
+          base_index += off0.x;
           sum += (one_m.x * abc.y * convert_float4 (pocl_read_pixel_fast_ui (
                                         base_index, order, elem_size, data)));
-          base_index -= ijk0.x;
+          base_index -= off0.x;
         }
 
       // + a * b * Ti1j1
       if (ijk1_x_OK)
         {
-          base_index += ijk1.x;
+          base_index += off1.x;
           sum += (abc.x * abc.y * convert_float4 (pocl_read_pixel_fast_ui (
                                       base_index, order, elem_size, data)));
-          base_index -= ijk1.x;
+          base_index -= off1.x;
         }
 
-      base_index -= (ijk1.y * row_pitch);
+      base_index -= off1.y;
     }
 
   return convert_uint4 (sum);
@@ -1067,9 +1059,8 @@ read_pixel_linear_2d_uint (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
 
 _CL_READONLY static int4
 read_pixel_linear_2d_int (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
-                          int array_coord, int width, int height,
-                          size_t row_pitch, size_t slice_pitch, int order,
-                          int elem_size, void *data)
+                          int width, int height, ulong4 off0, ulong4 off1,
+                          int order, int elem_size, void *data)
 {
   // 2D image
   size_t base_index = 0;
@@ -1077,58 +1068,58 @@ read_pixel_linear_2d_int (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
   int ijk1_x_OK = (ijk1.x >= 0 && ijk1.x < width);
   float4 sum = (float4) (0.0f);
 
-  if (array_coord > 0)
-    base_index += (array_coord * slice_pitch);
+  // the offset of the array layer
+  base_index += off0.z;
 
   if (ijk0.y >= 0 && ijk0.y < height)
     {
-      base_index += (ijk0.y * row_pitch);
+      base_index += off0.y;
 
       // T = (1 – a) * (1 – b) * Ti0j0
       if (ijk0_x_OK)
         {
-          base_index += ijk0.x;
+          base_index += off0.x;
           sum += (one_m.x * one_m.y
                   * convert_float4 (pocl_read_pixel_fast_i (base_index, order,
                                                             elem_size, data)));
-          base_index -= ijk0.x;
+          base_index -= off0.x;
         }
 
       // + a * (1 – b) * Ti1j0
       if (ijk1_x_OK)
         {
-          base_index += ijk1.x;
+          base_index += off1.x;
           sum += (abc.x * one_m.y * convert_float4 (pocl_read_pixel_fast_i (
                                         base_index, order, elem_size, data)));
-          base_index -= ijk1.x;
+          base_index -= off1.x;
         }
 
-      base_index -= (ijk0.y * row_pitch);
+      base_index -= off0.y;
     }
 
   if (ijk1.y >= 0 && ijk1.y < height)
     {
-      base_index += (ijk1.y * row_pitch);
+      base_index += off1.y;
 
       // + (1 – a) * b * Ti0j1
       if (ijk0_x_OK)
         {
-          base_index += ijk0.x;
+          base_index += off0.x;
           sum += (one_m.x * abc.y * convert_float4 (pocl_read_pixel_fast_i (
                                         base_index, order, elem_size, data)));
-          base_index -= ijk0.x;
+          base_index -= off0.x;
         }
 
       // + a * b * Ti1j1
       if (ijk1_x_OK)
         {
-          base_index += ijk1.x;
+          base_index += off1.x;
           sum += (abc.x * abc.y * convert_float4 (pocl_read_pixel_fast_i (
                                       base_index, order, elem_size, data)));
-          base_index -= ijk1.x;
+          base_index -= off1.x;
         }
 
-      base_index -= (ijk1.y * row_pitch);
+      base_index -= off1.y;
     }
 
   return convert_int4 (sum);
@@ -1136,24 +1127,23 @@ read_pixel_linear_2d_int (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
 
 _CL_READONLY static uint4
 read_pixel_linear_2d (float4 abc, float4 one_m, int4 ijk0, int4 ijk1,
-                      int array_coord, int width, int height, int channel_type,
-                      size_t row_pitch, size_t slice_pitch, int order,
-                      int elem_size, void *data)
+                      int width, int height, int channel_type,
+                      ulong4 off0, ulong4 off1, int order, int elem_size,
+                      void *data)
 {
   // TODO unsupported channel types
   if ((channel_type == CLK_SIGNED_INT8) || (channel_type == CLK_SIGNED_INT16)
       || (channel_type == CLK_SIGNED_INT32))
     return as_uint4 (read_pixel_linear_2d_int (
-        abc, one_m, ijk0, ijk1, array_coord, width, height, row_pitch,
-        slice_pitch, order, elem_size, data));
+        abc, one_m, ijk0, ijk1, width, height, off0, off1, order, elem_size,
+        data));
   if ((channel_type == CLK_UNSIGNED_INT8) || (channel_type == CLK_UNSIGNED_INT16)
       || (channel_type == CLK_UNSIGNED_INT32))
-    return read_pixel_linear_2d_uint (abc, one_m, ijk0, ijk1, array_coord,
-                                      width, height, row_pitch, slice_pitch,
-                                      order, elem_size, data);
+    return read_pixel_linear_2d_uint (abc, one_m, ijk0, ijk1, width, height,
+                                      off0, off1, order, elem_size, data);
   return as_uint4 (read_pixel_linear_2d_float (
-      abc, one_m, ijk0, ijk1, array_coord, width, height, channel_type,
-      row_pitch, slice_pitch, order, data));
+      abc, one_m, ijk0, ijk1, width, height, channel_type, off0, off1, order,
+      data));
 }
 
 /*************************************************************************/
@@ -1306,7 +1296,6 @@ nonrepeat_filter (global dev_image_t *img, float4 orig_coord,
   int elem_size = img->_elem_size;
   int a_index = 0;
   size_t elem_bytes = num_channels * elem_size;
-  size_t row_pitch = img->_row_pitch / elem_bytes;
   size_t slice_pitch = img->_slice_pitch / elem_bytes;
 
   if (samp & CLK_FILTER_NEAREST)
@@ -1330,7 +1319,8 @@ nonrepeat_filter (global dev_image_t *img, float4 orig_coord,
         {
           res = read_pixel_linear_3d (
               abc, one_m, ijk0, ijk1, img->_width, img->_height, img->_depth,
-              img->_data_type, row_pitch, slice_pitch, img->_order,
+              img->_data_type, pocl_image_index_parts (img, ijk0),
+              pocl_image_index_parts (img, ijk1), img->_order,
               img->_elem_size, img->_data);
         }
       else if (img->_height != 0)
@@ -1338,9 +1328,11 @@ nonrepeat_filter (global dev_image_t *img, float4 orig_coord,
           if (img->_image_array_size > 0)
             a_index = clamp (convert_int (rint (coord.z)), 0,
                              (int)(img->_image_array_size - 1));
+          ijk0.z = ijk1.z = a_index;
           res = read_pixel_linear_2d (
-              abc, one_m, ijk0, ijk1, a_index, img->_width, img->_height,
-              img->_data_type, row_pitch, slice_pitch, img->_order,
+              abc, one_m, ijk0, ijk1, img->_width, img->_height,
+              img->_data_type, pocl_image_index_parts (img, ijk0),
+              pocl_image_index_parts (img, ijk1), img->_order,
               img->_elem_size, img->_data);
         }
       else
@@ -1367,7 +1359,6 @@ repeat_filter (global dev_image_t *img, float4 coord, const dev_sampler_t samp)
   int array_size = img->_image_array_size;
   int num_channels = img->_num_channels;
   size_t elem_bytes = num_channels * img->_elem_size;
-  size_t row_pitch = img->_row_pitch / elem_bytes;
   size_t slice_pitch = img->_slice_pitch / elem_bytes;
 
   if (samp & CLK_FILTER_NEAREST)
@@ -1418,7 +1409,8 @@ repeat_filter (global dev_image_t *img, float4 coord, const dev_sampler_t samp)
         {
           res = read_pixel_linear_3d (
               abc, one_m, ijk0, ijk1, img->_width, img->_height, img->_depth,
-              img->_data_type, row_pitch, slice_pitch, img->_order,
+              img->_data_type, pocl_image_index_parts (img, ijk0),
+              pocl_image_index_parts (img, ijk1), img->_order,
               img->_elem_size, img->_data);
         }
       else if (img->_height != 0)
@@ -1427,9 +1419,11 @@ repeat_filter (global dev_image_t *img, float4 coord, const dev_sampler_t samp)
             a_index
                 = clamp (convert_int (rint (coord.z)),
                          0, (array_size - 1));
+          ijk0.z = ijk1.z = a_index;
           res = read_pixel_linear_2d (
-              abc, one_m, ijk0, ijk1, a_index, img->_width, img->_height,
-              img->_data_type, row_pitch, slice_pitch, img->_order,
+              abc, one_m, ijk0, ijk1, img->_width, img->_height,
+              img->_data_type, pocl_image_index_parts (img, ijk0),
+              pocl_image_index_parts (img, ijk1), img->_order,
               img->_elem_size, img->_data);
         }
       else
@@ -1458,7 +1452,6 @@ mirrored_repeat_filter (global dev_image_t *img, float4 coord,
   int array_size = img->_image_array_size;
   int num_channels = img->_num_channels;
   size_t elem_bytes = num_channels * img->_elem_size;
-  size_t row_pitch = img->_row_pitch / elem_bytes;
   size_t slice_pitch = img->_slice_pitch / elem_bytes;
 
   if (samp & CLK_FILTER_NEAREST)
@@ -1512,7 +1505,8 @@ mirrored_repeat_filter (global dev_image_t *img, float4 coord,
         {
           res = read_pixel_linear_3d (
               abc, one_m, ijk0, ijk1, img->_width, img->_height, img->_depth,
-              img->_data_type, row_pitch, slice_pitch, img->_order,
+              img->_data_type, pocl_image_index_parts (img, ijk0),
+              pocl_image_index_parts (img, ijk1), img->_order,
               img->_elem_size, img->_data);
         }
       else if (img->_height != 0)
@@ -1521,9 +1515,11 @@ mirrored_repeat_filter (global dev_image_t *img, float4 coord,
             a_index
                 = clamp (convert_int (rint (coord.z)),
                          0, (array_size - 1));
+          ijk0.z = ijk1.z = a_index;
           res = read_pixel_linear_2d (
-              abc, one_m, ijk0, ijk1, a_index, img->_width, img->_height,
-              img->_data_type, row_pitch, slice_pitch, img->_order,
+              abc, one_m, ijk0, ijk1, img->_width, img->_height,
+              img->_data_type, pocl_image_index_parts (img, ijk0),
+              pocl_image_index_parts (img, ijk1), img->_order,
               img->_elem_size, img->_data);
         }
       else
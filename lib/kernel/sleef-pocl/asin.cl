@@ -5,11 +5,10 @@ float
 _cl_asin (float x)
 {
 
-#ifdef MAX_PRECISION
-  return Sleef_asinf_u10 (x);
-#else
-  return Sleef_asinf_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_asinf_u35 (x);
+  else
+    return Sleef_asinf_u10 (x);
 }
 
 _CL_OVERLOADABLE
@@ -43,11 +42,10 @@ _cl_asin (float4 x)
 
 #if defined(SLEEF_VEC_128_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_asinf4_u10 (x);
-#else
-  return Sleef_asinf4_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_asinf4_u35 (x);
+  else
+    return Sleef_asinf4_u10 (x);
 
 #else
 
@@ -65,11 +63,10 @@ _cl_asin (float8 x)
 
 #if defined(SLEEF_VEC_256_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_asinf8_u10 (x);
-#else
-  return Sleef_asinf8_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_asinf8_u35 (x);
+  else
+    return Sleef_asinf8_u10 (x);
 
 #else
 
@@ -87,11 +84,10 @@ _cl_asin (float16 x)
 
 #if defined(SLEEF_VEC_512_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_asinf16_u10 (x);
-#else
-  return Sleef_asinf16_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_asinf16_u35 (x);
+  else
+    return Sleef_asinf16_u10 (x);
 
 #else
 
@@ -109,11 +105,10 @@ double
 _cl_asin (double x)
 {
 
-#ifdef MAX_PRECISION
-  return Sleef_asin_u10 (x);
-#else
-  return Sleef_asin_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_asin_u35 (x);
+  else
+    return Sleef_asin_u10 (x);
 }
 
 #endif /* cl_khr_fp64 */
@@ -127,11 +122,10 @@ _cl_asin (double2 x)
 
 #if defined(SLEEF_VEC_128_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_asind2_u10 (x);
-#else
-  return Sleef_asind2_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_asind2_u35 (x);
+  else
+    return Sleef_asind2_u10 (x);
 
 #else
 
@@ -171,11 +165,10 @@ _cl_asin (double4 x)
 
 #if defined(SLEEF_VEC_256_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_asind4_u10 (x);
-#else
-  return Sleef_asind4_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_asind4_u35 (x);
+  else
+    return Sleef_asind4_u10 (x);
 
 #else
 
@@ -197,11 +190,10 @@ _cl_asin (double8 x)
 
 #if defined(SLEEF_VEC_512_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_asind8_u10 (x);
-#else
-  return Sleef_asind8_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_asind8_u35 (x);
+  else
+    return Sleef_asind8_u10 (x);
 
 #else
 
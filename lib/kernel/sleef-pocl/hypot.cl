@@ -5,11 +5,10 @@ float
 _cl_hypot (float x, float y)
 {
 
-#ifdef MAX_PRECISION
-  return Sleef_hypotf_u05 (x, y);
-#else
-  return Sleef_hypotf_u35 (x, y);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_hypotf_u35 (x, y);
+  else
+    return Sleef_hypotf_u05 (x, y);
 }
 
 _CL_OVERLOADABLE
@@ -44,11 +43,10 @@ _cl_hypot (float4 x, float4 y)
 
 #if defined(SLEEF_VEC_128_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_hypotf4_u05 (x, y);
-#else
-  return Sleef_hypotf4_u35 (x, y);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_hypotf4_u35 (x, y);
+  else
+    return Sleef_hypotf4_u05 (x, y);
 
 #else
 
@@ -66,11 +64,10 @@ _cl_hypot (float8 x, float8 y)
 
 #if defined(SLEEF_VEC_256_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_hypotf8_u05 (x, y);
-#else
-  return Sleef_hypotf8_u35 (x, y);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_hypotf8_u35 (x, y);
+  else
+    return Sleef_hypotf8_u05 (x, y);
 
 #else
 
@@ -88,11 +85,10 @@ _cl_hypot (float16 x, float16 y)
 
 #if defined(SLEEF_VEC_512_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_hypotf16_u05 (x, y);
-#else
-  return Sleef_hypotf16_u35 (x, y);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_hypotf16_u35 (x, y);
+  else
+    return Sleef_hypotf16_u05 (x, y);
 
 #else
 
@@ -110,11 +106,10 @@ double
 _cl_hypot (double x, double y)
 {
 
-#ifdef MAX_PRECISION
-  return Sleef_hypot_u05 (x, y);
-#else
-  return Sleef_hypot_u35 (x, y);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_hypot_u35 (x, y);
+  else
+    return Sleef_hypot_u05 (x, y);
 }
 
 #endif /* cl_khr_fp64 */
@@ -128,11 +123,10 @@ _cl_hypot (double2 x, double2 y)
 
 #if defined(SLEEF_VEC_128_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_hypotd2_u05 (x, y);
-#else
-  return Sleef_hypotd2_u35 (x, y);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_hypotd2_u35 (x, y);
+  else
+    return Sleef_hypotd2_u05 (x, y);
 
 #else
 
@@ -173,11 +167,10 @@ _cl_hypot (double4 x, double4 y)
 
 #if defined(SLEEF_VEC_256_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_hypotd4_u05 (x, y);
-#else
-  return Sleef_hypotd4_u35 (x, y);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_hypotd4_u35 (x, y);
+  else
+    return Sleef_hypotd4_u05 (x, y);
 
 #else
 
@@ -199,11 +192,10 @@ _cl_hypot (double8 x, double8 y)
 
 #if defined(SLEEF_VEC_512_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
 
-#ifdef MAX_PRECISION
-  return Sleef_hypotd8_u05 (x, y);
-#else
-  return Sleef_hypotd8_u35 (x, y);
-#endif
+  if (__pocl_relaxed_math ())
+    return Sleef_hypotd8_u35 (x, y);
+  else
+    return Sleef_hypotd8_u05 (x, y);
 
 #else
 
@@ -6,11 +6,10 @@ _cl_sincos (float x, global float *cosval)
 {
   Sleef_float2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf_u10 (x);
-#else
-  temp = Sleef_sincosf_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf_u35 (x);
+  else
+    temp = Sleef_sincosf_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -47,11 +46,10 @@ _cl_sincos (float4 x, global float4 *cosval)
 #if defined(SLEEF_VEC_128_AVAILABLE)
   Sleef_float4_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf4_u10 (x);
-#else
-  temp = Sleef_sincosf4_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf4_u35 (x);
+  else
+    temp = Sleef_sincosf4_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -74,11 +72,10 @@ _cl_sincos (float8 x, global float8 *cosval)
 #if defined(SLEEF_VEC_256_AVAILABLE)
   Sleef_float8_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf8_u10 (x);
-#else
-  temp = Sleef_sincosf8_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf8_u35 (x);
+  else
+    temp = Sleef_sincosf8_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -101,11 +98,10 @@ _cl_sincos (float16 x, global float16 *cosval)
 #if defined(SLEEF_VEC_512_AVAILABLE)
   Sleef_float16_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf16_u10 (x);
-#else
-  temp = Sleef_sincosf16_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf16_u35 (x);
+  else
+    temp = Sleef_sincosf16_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -129,11 +125,10 @@ _cl_sincos (double x, global double *cosval)
 {
   Sleef_double2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincos_u10 (x);
-#else
-  temp = Sleef_sincos_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincos_u35 (x);
+  else
+    temp = Sleef_sincos_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -170,11 +165,10 @@ _cl_sincos (double2 x, global double2 *cosval)
 #if defined(SLEEF_VEC_128_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double2_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd2_u10 (x);
-#else
-  temp = Sleef_sincosd2_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd2_u35 (x);
+  else
+    temp = Sleef_sincosd2_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -197,11 +191,10 @@ _cl_sincos (double4 x, global double4 *cosval)
 #if defined(SLEEF_VEC_256_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double4_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd4_u10 (x);
-#else
-  temp = Sleef_sincosd4_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd4_u35 (x);
+  else
+    temp = Sleef_sincosd4_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -224,11 +217,10 @@ _cl_sincos (double8 x, global double8 *cosval)
 #if defined(SLEEF_VEC_512_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double8_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd8_u10 (x);
-#else
-  temp = Sleef_sincosd8_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd8_u35 (x);
+  else
+    temp = Sleef_sincosd8_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -257,11 +249,10 @@ _cl_sincos (float x, local float *cosval)
 {
   Sleef_float2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf_u10 (x);
-#else
-  temp = Sleef_sincosf_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf_u35 (x);
+  else
+    temp = Sleef_sincosf_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -298,11 +289,10 @@ _cl_sincos (float4 x, local float4 *cosval)
 #if defined(SLEEF_VEC_128_AVAILABLE)
   Sleef_float4_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf4_u10 (x);
-#else
-  temp = Sleef_sincosf4_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf4_u35 (x);
+  else
+    temp = Sleef_sincosf4_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -325,11 +315,10 @@ _cl_sincos (float8 x, local float8 *cosval)
 #if defined(SLEEF_VEC_256_AVAILABLE)
   Sleef_float8_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf8_u10 (x);
-#else
-  temp = Sleef_sincosf8_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf8_u35 (x);
+  else
+    temp = Sleef_sincosf8_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -352,11 +341,10 @@ _cl_sincos (float16 x, local float16 *cosval)
 #if defined(SLEEF_VEC_512_AVAILABLE)
   Sleef_float16_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf16_u10 (x);
-#else
-  temp = Sleef_sincosf16_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf16_u35 (x);
+  else
+    temp = Sleef_sincosf16_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -380,11 +368,10 @@ _cl_sincos (double x, local double *cosval)
 {
   Sleef_double2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincos_u10 (x);
-#else
-  temp = Sleef_sincos_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincos_u35 (x);
+  else
+    temp = Sleef_sincos_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -421,11 +408,10 @@ _cl_sincos (double2 x, local double2 *cosval)
 #if defined(SLEEF_VEC_128_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double2_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd2_u10 (x);
-#else
-  temp = Sleef_sincosd2_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd2_u35 (x);
+  else
+    temp = Sleef_sincosd2_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -448,11 +434,10 @@ _cl_sincos (double4 x, local double4 *cosval)
 #if defined(SLEEF_VEC_256_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double4_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd4_u10 (x);
-#else
-  temp = Sleef_sincosd4_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd4_u35 (x);
+  else
+    temp = Sleef_sincosd4_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -475,11 +460,10 @@ _cl_sincos (double8 x, local double8 *cosval)
 #if defined(SLEEF_VEC_512_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double8_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd8_u10 (x);
-#else
-  temp = Sleef_sincosd8_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd8_u35 (x);
+  else
+    temp = Sleef_sincosd8_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -508,11 +492,10 @@ _cl_sincos (float x, private float *cosval)
 {
   Sleef_float2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf_u10 (x);
-#else
-  temp = Sleef_sincosf_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf_u35 (x);
+  else
+    temp = Sleef_sincosf_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -549,11 +532,10 @@ _cl_sincos (float4 x, private float4 *cosval)
 #if defined(SLEEF_VEC_128_AVAILABLE)
   Sleef_float4_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf4_u10 (x);
-#else
-  temp = Sleef_sincosf4_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf4_u35 (x);
+  else
+    temp = Sleef_sincosf4_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -576,11 +558,10 @@ _cl_sincos (float8 x, private float8 *cosval)
 #if defined(SLEEF_VEC_256_AVAILABLE)
   Sleef_float8_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf8_u10 (x);
-#else
-  temp = Sleef_sincosf8_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf8_u35 (x);
+  else
+    temp = Sleef_sincosf8_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -603,11 +584,10 @@ _cl_sincos (float16 x, private float16 *cosval)
 #if defined(SLEEF_VEC_512_AVAILABLE)
   Sleef_float16_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf16_u10 (x);
-#else
-  temp = Sleef_sincosf16_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf16_u35 (x);
+  else
+    temp = Sleef_sincosf16_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -631,11 +611,10 @@ _cl_sincos (double x, private double *cosval)
 {
   Sleef_double2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincos_u10 (x);
-#else
-  temp = Sleef_sincos_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincos_u35 (x);
+  else
+    temp = Sleef_sincos_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -672,11 +651,10 @@ _cl_sincos (double2 x, private double2 *cosval)
 #if defined(SLEEF_VEC_128_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double2_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd2_u10 (x);
-#else
-  temp = Sleef_sincosd2_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd2_u35 (x);
+  else
+    temp = Sleef_sincosd2_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -699,11 +677,10 @@ _cl_sincos (double4 x, private double4 *cosval)
 #if defined(SLEEF_VEC_256_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double4_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd4_u10 (x);
-#else
-  temp = Sleef_sincosd4_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd4_u35 (x);
+  else
+    temp = Sleef_sincosd4_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -726,11 +703,10 @@ _cl_sincos (double8 x, private double8 *cosval)
 #if defined(SLEEF_VEC_512_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double8_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd8_u10 (x);
-#else
-  temp = Sleef_sincosd8_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd8_u35 (x);
+  else
+    temp = Sleef_sincosd8_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -761,11 +737,10 @@ _cl_sincos (float x, generic float *cosval)
 {
   Sleef_float2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf_u10 (x);
-#else
-  temp = Sleef_sincosf_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf_u35 (x);
+  else
+    temp = Sleef_sincosf_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -802,11 +777,10 @@ _cl_sincos (float4 x, generic float4 *cosval)
 #if defined(SLEEF_VEC_128_AVAILABLE)
   Sleef_float4_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf4_u10 (x);
-#else
-  temp = Sleef_sincosf4_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf4_u35 (x);
+  else
+    temp = Sleef_sincosf4_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -829,11 +803,10 @@ _cl_sincos (float8 x, generic float8 *cosval)
 #if defined(SLEEF_VEC_256_AVAILABLE)
   Sleef_float8_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf8_u10 (x);
-#else
-  temp = Sleef_sincosf8_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf8_u35 (x);
+  else
+    temp = Sleef_sincosf8_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -856,11 +829,10 @@ _cl_sincos (float16 x, generic float16 *cosval)
 #if defined(SLEEF_VEC_512_AVAILABLE)
   Sleef_float16_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosf16_u10 (x);
-#else
-  temp = Sleef_sincosf16_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosf16_u35 (x);
+  else
+    temp = Sleef_sincosf16_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -884,11 +856,10 @@ _cl_sincos (double x, generic double *cosval)
 {
   Sleef_double2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincos_u10 (x);
-#else
-  temp = Sleef_sincos_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincos_u35 (x);
+  else
+    temp = Sleef_sincos_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -925,11 +896,10 @@ _cl_sincos (double2 x, generic double2 *cosval)
 #if defined(SLEEF_VEC_128_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double2_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd2_u10 (x);
-#else
-  temp = Sleef_sincosd2_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd2_u35 (x);
+  else
+    temp = Sleef_sincosd2_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -952,11 +922,10 @@ _cl_sincos (double4 x, generic double4 *cosval)
 #if defined(SLEEF_VEC_256_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double4_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd4_u10 (x);
-#else
-  temp = Sleef_sincosd4_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd4_u35 (x);
+  else
+    temp = Sleef_sincosd4_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -979,11 +948,10 @@ _cl_sincos (double8 x, generic double8 *cosval)
 #if defined(SLEEF_VEC_512_AVAILABLE) && defined(SLEEF_DOUBLE_VEC_AVAILABLE)
   Sleef_double8_2 temp;
 
-#ifdef MAX_PRECISION
-  temp = Sleef_sincosd8_u10 (x);
-#else
-  temp = Sleef_sincosd8_u35 (x);
-#endif
+  if (__pocl_relaxed_math ())
+    temp = Sleef_sincosd8_u35 (x);
+  else
+    temp = Sleef_sincosd8_u10 (x);
 
   *cosval = temp.y;
   return temp.x;
@@ -72,6 +72,12 @@ typedef double double16 __attribute__ ((__ext_vector_type__ (16)));
 
 #endif
 
+/* Nonzero if the program was built with -cl-fast-relaxed-math or
+   -cl-unsafe-math-optimizations, in which case the builtins switch to the
+   3.5 ULP variants of the functions that have one. The library leaves this
+   undefined; the kernel compiler defines it as a constant when linking. */
+int __pocl_relaxed_math (void) __attribute__ ((const));
+
 #ifdef cl_khr_fp64
 
 #ifndef Sleef_double2_DEFINED
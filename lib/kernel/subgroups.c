@@ -174,7 +174,25 @@ _Z19sub_group_broadcastDhj (half val, uint mask)
 
 #endif
 
-#define SUB_GROUP_REDUCE_OT(OPNAME, OPERATION, TYPE)                          \
+/* The serial folds of work_group.c. WorkitemLoops expands them to vector
+   code, which with SIMD sub-groups is a single vector per sub-group. */
+#define SUB_GROUP_FOLD_DECL_OT(OPNAME, TYPE, CODE)                            \
+  TYPE __pocl_work_group_reduce_##OPNAME##_##CODE (TYPE *data, size_t n);     \
+  void __pocl_work_group_scan_##OPNAME##_##CODE (TYPE *data, size_t n);
+
+#define SUB_GROUP_FOLD_DECL_T(OPNAME)                                         \
+  SUB_GROUP_FOLD_DECL_OT (OPNAME, int, i)                                     \
+  SUB_GROUP_FOLD_DECL_OT (OPNAME, uint, j)                                    \
+  SUB_GROUP_FOLD_DECL_OT (OPNAME, long, l)                                    \
+  SUB_GROUP_FOLD_DECL_OT (OPNAME, ulong, m)                                   \
+  SUB_GROUP_FOLD_DECL_OT (OPNAME, float, f)                                   \
+  SUB_GROUP_FOLD_DECL_OT (OPNAME, double, d)
+
+SUB_GROUP_FOLD_DECL_T (add)
+SUB_GROUP_FOLD_DECL_T (min)
+SUB_GROUP_FOLD_DECL_T (max)
+
+#define SUB_GROUP_REDUCE_OT(OPNAME, TYPE, CODE)                               \
   __attribute__ ((always_inline))                                             \
   TYPE _CL_OVERLOADABLE sub_group_reduce_##OPNAME (TYPE val)                  \
   {                                                                           \
@@ -183,33 +201,31 @@ _Z19sub_group_broadcastDhj (half val, uint mask)
     temp_storage[get_local_linear_id ()] = val;                               \
     sub_group_barrier (CLK_LOCAL_MEM_FENCE);                                  \
     if (get_sub_group_local_id () == 0)                                       \
-      {                                                                       \
-        for (uint i = 1; i < get_sub_group_size (); ++i)                      \
-          {                                                                   \
-            TYPE a = temp_storage[get_first_llid ()],                         \
-                 b = temp_storage[get_first_llid () + i];                     \
-            temp_storage[get_first_llid ()] = OPERATION;                      \
-          }                                                                   \
-      }                                                                       \
+      temp_storage[get_first_llid ()]                                         \
+          = __pocl_work_group_reduce_##OPNAME##_##CODE (                      \
+              (TYPE *)temp_storage + get_first_llid (),                       \
+              get_sub_group_size ());                                         \
     sub_group_barrier (CLK_LOCAL_MEM_FENCE);                                  \
     return temp_storage[get_first_llid ()];                                   \
   }
 
-#define SUB_GROUP_REDUCE_T(OPNAME, OPERATION)                                 \
-  SUB_GROUP_REDUCE_OT (OPNAME, OPERATION, int)                                \
-  SUB_GROUP_REDUCE_OT (OPNAME, OPERATION, uint)                               \
-  SUB_GROUP_REDUCE_OT (OPNAME, OPERATION, long)                               \
-  SUB_GROUP_REDUCE_OT (OPNAME, OPERATION, ulong)                              \
-  SUB_GROUP_REDUCE_OT (OPNAME, OPERATION, float)                              \
-  SUB_GROUP_REDUCE_OT (OPNAME, OPERATION, double)
+#define SUB_GROUP_REDUCE_T(OPNAME)                                            \
+  SUB_GROUP_REDUCE_OT (OPNAME, int, i)                                        \
+  SUB_GROUP_REDUCE_OT (OPNAME, uint, j)                                       \
+  SUB_GROUP_REDUCE_OT (OPNAME, long, l)                                       \
+  SUB_GROUP_REDUCE_OT (OPNAME, ulong, m)                                      \
+  SUB_GROUP_REDUCE_OT (OPNAME, float, f)                                      \
+  SUB_GROUP_REDUCE_OT (OPNAME, double, d)
 
-SUB_GROUP_REDUCE_T (add, a + b)
-SUB_GROUP_REDUCE_T (min, a > b ? b : a)
-SUB_GROUP_REDUCE_T (max, a > b ? a : b)
+SUB_GROUP_REDUCE_T (add)
+SUB_GROUP_REDUCE_T (min)
+SUB_GROUP_REDUCE_T (max)
 
 #ifdef cl_khr_fp16
-SUB_GROUP_REDUCE_OT (add, a + b, half)
-SUB_GROUP_REDUCE_OT (max, a > b ? a : b, half)
+SUB_GROUP_FOLD_DECL_OT (add, half, Dh)
+SUB_GROUP_FOLD_DECL_OT (max, half, Dh)
+SUB_GROUP_REDUCE_OT (add, half, Dh)
+SUB_GROUP_REDUCE_OT (max, half, Dh)
 
 half
 _Z20sub_group_reduce_maxDh (half val)
@@ -224,7 +240,7 @@ _Z20sub_group_reduce_addDh (half val)
 }
 #endif
 
-#define SUB_GROUP_SCAN_INCLUSIVE_OT(OPNAME, OPERATION, TYPE)                  \
+#define SUB_GROUP_SCAN_INCLUSIVE_OT(OPNAME, TYPE, CODE)                       \
   __attribute__ ((always_inline))                                             \
   TYPE _CL_OVERLOADABLE sub_group_scan_inclusive_##OPNAME (TYPE val)          \
   {                                                                           \
@@ -233,31 +249,25 @@ _Z20sub_group_reduce_addDh (half val)
     data[get_local_linear_id ()] = val;                                       \
     sub_group_barrier (CLK_LOCAL_MEM_FENCE);                                  \
     if (get_sub_group_local_id () == 0)                                       \
-      {                                                                       \
-        for (uint i = 1; i < get_sub_group_size (); ++i)                      \
-          {                                                                   \
-            TYPE a = data[get_first_llid () + i - 1],                         \
-                 b = data[get_first_llid () + i];                             \
-            data[get_first_llid () + i] = OPERATION;                          \
-          }                                                                   \
-      }                                                                       \
+      __pocl_work_group_scan_##OPNAME##_##CODE (                              \
+          (TYPE *)data + get_first_llid (), get_sub_group_size ());           \
     sub_group_barrier (CLK_LOCAL_MEM_FENCE);                                  \
     return data[get_local_linear_id ()];                                      \
   }
 
-#define SUB_GROUP_SCAN_INCLUSIVE_T(OPNAME, OPERATION)                         \
-  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, int)                        \
-  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, uint)                       \
-  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, long)                       \
-  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, ulong)                      \
-  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, float)                      \
-  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, double)
+#define SUB_GROUP_SCAN_INCLUSIVE_T(OPNAME)                                    \
+  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, int, i)                                \
+  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, uint, j)                               \
+  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, long, l)                               \
+  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, ulong, m)                              \
+  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, float, f)                              \
+  SUB_GROUP_SCAN_INCLUSIVE_OT (OPNAME, double, d)
 
-SUB_GROUP_SCAN_INCLUSIVE_T (add, a + b)
-SUB_GROUP_SCAN_INCLUSIVE_T (min, a > b ? b : a)
-SUB_GROUP_SCAN_INCLUSIVE_T (max, a > b ? a : b)
+SUB_GROUP_SCAN_INCLUSIVE_T (add)
+SUB_GROUP_SCAN_INCLUSIVE_T (min)
+SUB_GROUP_SCAN_INCLUSIVE_T (max)
 
-#define SUB_GROUP_SCAN_EXCLUSIVE_OT(OPNAME, OPERATION, TYPE, ID)              \
+#define SUB_GROUP_SCAN_EXCLUSIVE_OT(OPNAME, TYPE, CODE, ID)                   \
   __attribute__ ((always_inline))                                             \
   TYPE _CL_OVERLOADABLE sub_group_scan_exclusive_##OPNAME (TYPE val)          \
   {                                                                           \
@@ -267,38 +277,32 @@ SUB_GROUP_SCAN_INCLUSIVE_T (max, a > b ? a : b)
     data[get_first_llid ()] = ID;                                             \
     sub_group_barrier (CLK_LOCAL_MEM_FENCE);                                  \
     if (get_sub_group_local_id () == 0)                                       \
-      {                                                                       \
-        for (uint i = 1; i < get_sub_group_size (); ++i)                      \
-          {                                                                   \
-            TYPE a = data[get_first_llid () + i - 1],                         \
-                 b = data[get_first_llid () + i];                             \
-            data[get_first_llid () + i] = OPERATION;                          \
-          }                                                                   \
-      }                                                                       \
+      __pocl_work_group_scan_##OPNAME##_##CODE (                              \
+          (TYPE *)data + get_first_llid (), get_sub_group_size ());           \
     sub_group_barrier (CLK_LOCAL_MEM_FENCE);                                  \
     return data[get_local_linear_id ()];                                      \
   }
 
-SUB_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, int, 0)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, uint, 0)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, long, 0)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, ulong, 0)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, float, 0.0f)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, double, 0.0)
-
-SUB_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, int, INT_MAX)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, uint, UINT_MAX)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, long, LONG_MAX)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, ulong, ULONG_MAX)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, float, +INFINITY)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, double, +INFINITY)
-
-SUB_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, int, INT_MIN)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, uint, 0)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, long, LONG_MIN)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, ulong, 0)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, float, -INFINITY)
-SUB_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, double, -INFINITY)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (add, int, i, 0)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (add, uint, j, 0)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (add, long, l, 0)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (add, ulong, m, 0)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (add, float, f, 0.0f)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (add, double, d, 0.0)
+
+SUB_GROUP_SCAN_EXCLUSIVE_OT (min, int, i, INT_MAX)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (min, uint, j, UINT_MAX)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (min, long, l, LONG_MAX)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (min, ulong, m, ULONG_MAX)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (min, float, f, +INFINITY)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (min, double, d, +INFINITY)
+
+SUB_GROUP_SCAN_EXCLUSIVE_OT (max, int, i, INT_MIN)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (max, uint, j, 0)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (max, long, l, LONG_MIN)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (max, ulong, m, 0)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (max, float, f, -INFINITY)
+SUB_GROUP_SCAN_EXCLUSIVE_OT (max, double, d, -INFINITY)
 
 __attribute__ ((always_inline)) uint4 _CL_OVERLOADABLE
 sub_group_ballot (int predicate)
@@ -94,7 +94,51 @@ WORK_GROUP_BROADCAST_T (ulong)
 WORK_GROUP_BROADCAST_T (float)
 WORK_GROUP_BROADCAST_T (double)
 
-#define WORK_GROUP_REDUCE_OT(OPNAME, OPERATION, TYPE)                         \
+/* The serial folds the reductions and scans below run in a single work-item.
+   They are kept out of line so WorkitemLoops can recognize the calls and
+   expand them to vector code; these definitions are used when it doesn't.
+   The name ends with the Itanium mangling code of the element type. */
+#define WORK_GROUP_FOLD_OT(OPNAME, OPERATION, TYPE, CODE)                     \
+  __attribute__ ((noinline)) TYPE                                             \
+      __pocl_work_group_reduce_##OPNAME##_##CODE (TYPE *data, size_t n)       \
+  {                                                                           \
+    TYPE a = data[0];                                                         \
+    for (size_t i = 1; i < n; ++i)                                            \
+      {                                                                       \
+        TYPE b = data[i];                                                     \
+        a = OPERATION;                                                        \
+      }                                                                       \
+    return a;                                                                 \
+  }                                                                           \
+  __attribute__ ((noinline)) void                                             \
+      __pocl_work_group_scan_##OPNAME##_##CODE (TYPE *data, size_t n)         \
+  {                                                                           \
+    for (size_t i = 1; i < n; ++i)                                            \
+      {                                                                       \
+        TYPE a = data[i - 1], b = data[i];                                    \
+        data[i] = OPERATION;                                                  \
+      }                                                                       \
+  }
+
+#define WORK_GROUP_FOLD_T(OPNAME, OPERATION)                                  \
+  WORK_GROUP_FOLD_OT (OPNAME, OPERATION, int, i)                              \
+  WORK_GROUP_FOLD_OT (OPNAME, OPERATION, uint, j)                             \
+  WORK_GROUP_FOLD_OT (OPNAME, OPERATION, long, l)                             \
+  WORK_GROUP_FOLD_OT (OPNAME, OPERATION, ulong, m)                            \
+  WORK_GROUP_FOLD_OT (OPNAME, OPERATION, float, f)                            \
+  WORK_GROUP_FOLD_OT (OPNAME, OPERATION, double, d)
+
+WORK_GROUP_FOLD_T (add, a + b)
+WORK_GROUP_FOLD_T (min, a > b ? b : a)
+WORK_GROUP_FOLD_T (max, a > b ? a : b)
+
+#ifdef cl_khr_fp16
+WORK_GROUP_FOLD_OT (add, a + b, half, Dh)
+WORK_GROUP_FOLD_OT (min, a > b ? b : a, half, Dh)
+WORK_GROUP_FOLD_OT (max, a > b ? a : b, half, Dh)
+#endif
+
+#define WORK_GROUP_REDUCE_OT(OPNAME, TYPE, CODE)                              \
   __attribute__ ((always_inline))                                             \
   TYPE _CL_OVERLOADABLE work_group_reduce_##OPNAME (TYPE val)                 \
   {                                                                           \
@@ -103,30 +147,25 @@ WORK_GROUP_BROADCAST_T (double)
     temp_storage[get_local_linear_id ()] = val;                               \
     work_group_barrier (CLK_LOCAL_MEM_FENCE);                                 \
     if (get_local_linear_id () == 0)                                          \
-      {                                                                       \
-        for (uint i = 1; i < get_total_local_size (); ++i)                    \
-          {                                                                   \
-            TYPE a = temp_storage[0], b = temp_storage[i];                    \
-            temp_storage[0] = OPERATION;                                      \
-          }                                                                   \
-      }                                                                       \
+      temp_storage[0] = __pocl_work_group_reduce_##OPNAME##_##CODE (          \
+          (TYPE *)temp_storage, get_total_local_size ());                     \
     work_group_barrier (CLK_LOCAL_MEM_FENCE);                                 \
     return temp_storage[0];                                                   \
   }
 
-#define WORK_GROUP_REDUCE_T(OPNAME, OPERATION)                                \
-  WORK_GROUP_REDUCE_OT (OPNAME, OPERATION, int)                               \
-  WORK_GROUP_REDUCE_OT (OPNAME, OPERATION, uint)                              \
-  WORK_GROUP_REDUCE_OT (OPNAME, OPERATION, long)                              \
-  WORK_GROUP_REDUCE_OT (OPNAME, OPERATION, ulong)                             \
-  WORK_GROUP_REDUCE_OT (OPNAME, OPERATION, float)                             \
-  WORK_GROUP_REDUCE_OT (OPNAME, OPERATION, double)
+#define WORK_GROUP_REDUCE_T(OPNAME)                                           \
+  WORK_GROUP_REDUCE_OT (OPNAME, int, i)                                       \
+  WORK_GROUP_REDUCE_OT (OPNAME, uint, j)                                      \
+  WORK_GROUP_REDUCE_OT (OPNAME, long, l)                                      \
+  WORK_GROUP_REDUCE_OT (OPNAME, ulong, m)                                     \
+  WORK_GROUP_REDUCE_OT (OPNAME, float, f)                                     \
+  WORK_GROUP_REDUCE_OT (OPNAME, double, d)
 
-WORK_GROUP_REDUCE_T (add, a + b)
-WORK_GROUP_REDUCE_T (min, a > b ? b : a)
-WORK_GROUP_REDUCE_T (max, a > b ? a : b)
+WORK_GROUP_REDUCE_T (add)
+WORK_GROUP_REDUCE_T (min)
+WORK_GROUP_REDUCE_T (max)
 
-#define WORK_GROUP_SCAN_INCLUSIVE_OT(OPNAME, OPERATION, TYPE)                 \
+#define WORK_GROUP_SCAN_INCLUSIVE_OT(OPNAME, TYPE, CODE)                      \
   __attribute__ ((always_inline))                                             \
   TYPE _CL_OVERLOADABLE work_group_scan_inclusive_##OPNAME (TYPE val)         \
   {                                                                           \
@@ -135,30 +174,25 @@ WORK_GROUP_REDUCE_T (max, a > b ? a : b)
     data[get_local_linear_id ()] = val;                                       \
     work_group_barrier (CLK_LOCAL_MEM_FENCE);                                 \
     if (get_local_linear_id () == 0)                                          \
-      {                                                                       \
-        for (uint i = 1; i < get_total_local_size (); ++i)                    \
-          {                                                                   \
-            TYPE a = data[i - 1], b = data[i];                                \
-            data[i] = OPERATION;                                              \
-          }                                                                   \
-      }                                                                       \
+      __pocl_work_group_scan_##OPNAME##_##CODE ((TYPE *)data,                 \
+                                                get_total_local_size ());     \
     work_group_barrier (CLK_LOCAL_MEM_FENCE);                                 \
     return data[get_local_linear_id ()];                                      \
   }
 
-#define WORK_GROUP_SCAN_INCLUSIVE_T(OPNAME, OPERATION)                        \
-  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, int)                       \
-  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, uint)                      \
-  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, long)                      \
-  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, ulong)                     \
-  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, float)                     \
-  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, OPERATION, double)
+#define WORK_GROUP_SCAN_INCLUSIVE_T(OPNAME)                                   \
+  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, int, i)                               \
+  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, uint, j)                              \
+  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, long, l)                              \
+  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, ulong, m)                             \
+  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, float, f)                             \
+  WORK_GROUP_SCAN_INCLUSIVE_OT (OPNAME, double, d)
 
-WORK_GROUP_SCAN_INCLUSIVE_T (add, a + b)
-WORK_GROUP_SCAN_INCLUSIVE_T (min, a > b ? b : a)
-WORK_GROUP_SCAN_INCLUSIVE_T (max, a > b ? a : b)
+WORK_GROUP_SCAN_INCLUSIVE_T (add)
+WORK_GROUP_SCAN_INCLUSIVE_T (min)
+WORK_GROUP_SCAN_INCLUSIVE_T (max)
 
-#define WORK_GROUP_SCAN_EXCLUSIVE_OT(OPNAME, OPERATION, TYPE, ID)             \
+#define WORK_GROUP_SCAN_EXCLUSIVE_OT(OPNAME, TYPE, CODE, ID)                  \
   __attribute__ ((always_inline))                                             \
   TYPE _CL_OVERLOADABLE work_group_scan_exclusive_##OPNAME (TYPE val)         \
   {                                                                           \
@@ -169,37 +203,32 @@ WORK_GROUP_SCAN_INCLUSIVE_T (max, a > b ? a : b)
     data[0] = ID;                                                             \
     work_group_barrier (CLK_LOCAL_MEM_FENCE);                                 \
     if (get_local_linear_id () == 0)                                          \
-      {                                                                       \
-        for (uint i = 1; i < get_total_local_size (); ++i)                    \
-          {                                                                   \
-            TYPE a = data[i - 1], b = data[i];                                \
-            data[i] = OPERATION;                                              \
-          }                                                                   \
-      }                                                                       \
+      __pocl_work_group_scan_##OPNAME##_##CODE ((TYPE *)data,                 \
+                                                get_total_local_size ());     \
     work_group_barrier (CLK_LOCAL_MEM_FENCE);                                 \
     return data[get_local_linear_id ()];                                      \
   }
 
-WORK_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, int, 0)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, uint, 0)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, long, 0)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, ulong, 0)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, float, 0.0f)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (add, a + b, double, 0.0)
-
-WORK_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, int, INT_MAX)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, uint, UINT_MAX)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, long, LONG_MAX)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, ulong, ULONG_MAX)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, float, +INFINITY)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (min, a > b ? b : a, double, +INFINITY)
-
-WORK_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, int, INT_MIN)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, uint, 0)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, long, LONG_MIN)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, ulong, 0)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, float, -INFINITY)
-WORK_GROUP_SCAN_EXCLUSIVE_OT (max, a > b ? a : b, double, -INFINITY)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (add, int, i, 0)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (add, uint, j, 0)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (add, long, l, 0)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (add, ulong, m, 0)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (add, float, f, 0.0f)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (add, double, d, 0.0)
+
+WORK_GROUP_SCAN_EXCLUSIVE_OT (min, int, i, INT_MAX)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (min, uint, j, UINT_MAX)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (min, long, l, LONG_MAX)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (min, ulong, m, ULONG_MAX)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (min, float, f, +INFINITY)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (min, double, d, +INFINITY)
+
+WORK_GROUP_SCAN_EXCLUSIVE_OT (max, int, i, INT_MIN)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (max, uint, j, 0)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (max, long, l, LONG_MIN)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (max, ulong, m, 0)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (max, float, f, -INFINITY)
+WORK_GROUP_SCAN_EXCLUSIVE_OT (max, double, d, -INFINITY)
 
 __attribute__ ((always_inline)) int _CL_OVERLOADABLE
 work_group_any (int predicate)
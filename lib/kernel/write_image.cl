@@ -348,9 +348,7 @@ pocl_write_pixel_fast_i (int4 color, size_t base_index, int order,
  * Writes a four element pixel to an image pixel pointed by integer coords.
  */
 static void
-pocl_write_pixel (uint4 color, global dev_image_t *img, int4 coord,
-                  size_t array_offset_pixels, size_t row_pitch,
-                  size_t slice_pitch)
+pocl_write_pixel (uint4 color, global dev_image_t *img, int4 coord)
 {
   int width = img->_width;
   int height = img->_height;
@@ -367,8 +365,8 @@ pocl_write_pixel (uint4 color, global dev_image_t *img, int4 coord,
       return;
     }
 
-  size_t base_index = array_offset_pixels + coord.x + (coord.y * row_pitch)
-                      + (coord.z * slice_pitch);
+  ulong4 parts = pocl_image_index_parts (img, coord);
+  size_t base_index = parts.x + parts.y + parts.z;
 
   color = map_channels (color, order);
 
@@ -412,13 +410,7 @@ CLK_UNSIGNED_INT8, CLK_UNSIGNED_INT16, or CLK_UNSIGNED_INT32.
     INITCOORD##__COORD__ (coord4, coord);                                     \
     global dev_image_t *i_ptr                                                 \
         = __builtin_astype (image, global dev_image_t *);                     \
-    int elem_size = i_ptr->_elem_size;                                        \
-    int num_channels = i_ptr->_num_channels;                                  \
-    size_t elem_bytes = num_channels * elem_size;                             \
-    size_t row_pitch = i_ptr->_row_pitch / elem_bytes;                        \
-    size_t slice_pitch = i_ptr->_slice_pitch / elem_bytes;                    \
-    pocl_write_pixel (as_uint4 (color), i_ptr, coord4, 0, row_pitch,          \
-                      slice_pitch);                                           \
+    pocl_write_pixel (as_uint4 (color), i_ptr, coord4);                       \
   }
 
 #define IMPLEMENT_WRITE_ARRAY_INT_COORD(__IMGTYPE__, __POSTFIX__, __COORD__,  \
@@ -431,26 +423,14 @@ CLK_UNSIGNED_INT8, CLK_UNSIGNED_INT16, or CLK_UNSIGNED_INT32.
     global dev_image_t *i_ptr                                                 \
         = __builtin_astype (image, global dev_image_t *);                     \
     int asize = i_ptr->_image_array_size - 1;                                 \
-    int elem_size = i_ptr->_elem_size;                                        \
-    int num_channels = i_ptr->_num_channels;                                  \
-    size_t elem_bytes = num_channels * elem_size;                             \
-    size_t row_pitch = i_ptr->_row_pitch / elem_bytes;                        \
-    size_t slice_pitch = i_ptr->_slice_pitch / elem_bytes;                    \
-    size_t array_offset_pixels = 0;                                           \
     if (i_ptr->_height > 0)                                                   \
-      {                                                                       \
-        array_offset_pixels = clamp (coord4.z, 0, asize);                     \
-        coord4.z = 0;                                                         \
-      }                                                                       \
+      coord4.z = clamp (coord4.z, 0, asize);                                  \
     else                                                                      \
       {                                                                       \
-        array_offset_pixels = clamp (coord4.y, 0, asize);                     \
+        coord4.z = clamp (coord4.y, 0, asize);                                \
         coord4.y = 0;                                                         \
-        coord4.z = 0;                                                         \
       }                                                                       \
-    array_offset_pixels *= slice_pitch;                                       \
-    pocl_write_pixel (as_uint4 (color), i_ptr, coord4, array_offset_pixels,   \
-                      row_pitch, slice_pitch);                                \
+    pocl_write_pixel (as_uint4 (color), i_ptr, coord4);                       \
   }
 
 IMPLEMENT_WRITE_IMAGE_INT_COORD (IMG_WO_AQ image1d_t, ui, int, uint4)
@@ -29,12 +29,16 @@ IGNORE_COMPILER_WARNING("-Wmaybe-uninitialized")
 POP_COMPILER_DIAGS
 IGNORE_COMPILER_WARNING("-Wunused-parameter")
 #include <llvm/Analysis/ConstantFolding.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Dominators.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/Verifier.h>
@@ -42,6 +46,7 @@ IGNORE_COMPILER_WARNING("-Wunused-parameter")
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 #include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
 #include <llvm-c/Core.h>
 #include <llvm-c/Target.h>
 POP_COMPILER_DIAGS
@@ -60,6 +65,7 @@ POP_COMPILER_DIAGS
 
 #include <iostream>
 #include <map>
+#include <set>
 #include <sstream>
 
 #if _MSC_VER
@@ -178,11 +184,190 @@ private:
   unsigned long DeviceContextASid;
   unsigned long DeviceArgsASid;
   bool DeviceSidePrintf;
+  bool DeviceDeferredPrintf;
   bool DeviceAllocaLocals;
   unsigned long DeviceMaxWItemDim;
   unsigned long DeviceMaxWItemSizes[3];
+  unsigned long DeviceSIMDSubGroupSize;
+  std::string WGImageSpecialization;
 };
 
+// Returns true if BB is inside one of the parallel work-item loops the
+// work-item handlers generate.
+static bool isInWorkItemLoop(LoopInfo &LI, BasicBlock *BB) {
+  for (Loop *L = LI.getLoopFor(BB); L != nullptr; L = L->getParentLoop()) {
+    if (findOptionMDForLoop(L, "llvm.loop.parallel_accesses") != nullptr)
+      return true;
+  }
+  return false;
+}
+
+// The kernel library maps some of its scalar builtins to their vector
+// overloads (see addVectorVariantMappings), but the loop vectorizer only
+// looks for the mappings on the call sites. Copy them to the calls inside
+// the work-item loops and keep just those calls out of line until the
+// vectorizer has seen them; the builtins themselves become inlinable
+// again everywhere else. The vector variants, which have no users yet, are
+// kept from being dropped once they are internalized.
+static void exposeVectorVariants(Module &M) {
+  std::map<Function *, std::pair<std::string, SmallVector<GlobalValue *, 4>>>
+      Mapped;
+
+  for (Function &F : M) {
+    Attribute Attr = F.getFnAttribute("vector-function-abi-variant");
+    if (F.isDeclaration() || !Attr.isStringAttribute())
+      continue;
+    F.removeFnAttr(Attribute::NoInline);
+
+    SmallVector<StringRef, 4> Mappings;
+    std::string Available;
+    SmallVector<GlobalValue *, 4> Variants;
+    Attr.getValueAsString().split(Mappings, ',');
+    for (StringRef Mapping : Mappings) {
+      size_t Open = Mapping.find('(');
+      if (Open == StringRef::npos || !Mapping.endswith(")"))
+        continue;
+      Function *VecF =
+          M.getFunction(Mapping.slice(Open + 1, Mapping.size() - 1));
+      if (VecF == nullptr || VecF->isDeclaration())
+        continue;
+      Variants.push_back(VecF);
+      if (!Available.empty())
+        Available += ",";
+      Available += Mapping.str();
+    }
+    if (!Available.empty())
+      Mapped[&F] = std::make_pair(Available, Variants);
+  }
+
+  std::map<Function *, SmallVector<CallInst *, 8>> CallsByCaller;
+  for (auto &Entry : Mapped) {
+    for (User *U : Entry.first->users()) {
+      CallInst *Call = dyn_cast<CallInst>(U);
+      if (Call != nullptr && Call->getCalledFunction() == Entry.first)
+        CallsByCaller[Call->getFunction()].push_back(Call);
+    }
+  }
+
+  SmallVector<GlobalValue *, 8> Used;
+  std::set<Function *> Exposed;
+  for (auto &C : CallsByCaller) {
+    DominatorTree DT(*C.first);
+    LoopInfo LI(DT);
+    for (CallInst *Call : C.second) {
+      if (!isInWorkItemLoop(LI, Call->getParent()))
+        continue;
+      Function *F = Call->getCalledFunction();
+      Call->addFnAttr(Attribute::get(M.getContext(),
+                                     "vector-function-abi-variant",
+                                     Mapped[F].first));
+      Call->addFnAttr(Attribute::NoInline);
+      if (Exposed.insert(F).second)
+        Used.append(Mapped[F].second.begin(), Mapped[F].second.end());
+    }
+  }
+
+  if (!Used.empty())
+    appendToCompilerUsed(M, Used);
+}
+
+// Replaces the loads of the format fields of the dev_image_t Img points to
+// with the given values. The image builtins reading them are inlined first,
+// as long as they take Img, so that the loads become visible.
+static void specializeImageArg(Function &F, Argument *Img,
+                               ArrayRef<uint64_t> FormatFields) {
+  for (unsigned Depth = 0; Depth < 8; ++Depth) {
+    SmallVector<CallInst *, 8> Calls;
+    for (Instruction &I : instructions(F)) {
+      CallInst *Call = dyn_cast<CallInst>(&I);
+      Function *Callee = Call ? Call->getCalledFunction() : nullptr;
+      if (Callee == nullptr || Callee->isDeclaration() ||
+          Callee->isIntrinsic())
+        continue;
+      for (Value *Op : Call->args()) {
+        if (getUnderlyingObject(Op) == Img) {
+          Calls.push_back(Call);
+          break;
+        }
+      }
+    }
+    if (Calls.empty())
+      break;
+    for (CallInst *Call : Calls) {
+      InlineFunctionInfo IFI;
+      InlineFunction(*Call, IFI);
+    }
+  }
+
+  // dev_image_t is the data pointer followed by ints, of which _order,
+  // _data_type, _num_channels and _elem_size are the 9th to the 12th.
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  unsigned AS = Img->getType()->getPointerAddressSpace();
+  uint64_t FirstOffset = DL.getPointerSize(AS) + 8 * sizeof(int32_t);
+
+  SmallVector<LoadInst *, 8> Loads;
+  for (Instruction &I : instructions(F)) {
+    LoadInst *Load = dyn_cast<LoadInst>(&I);
+    if (Load != nullptr && !Load->isVolatile() &&
+        Load->getType()->isIntegerTy(32))
+      Loads.push_back(Load);
+  }
+  for (LoadInst *Load : Loads) {
+    APInt Offset(DL.getIndexSizeInBits(AS), 0);
+    Value *Base = Load->getPointerOperand()->stripAndAccumulateConstantOffsets(
+        DL, Offset, true);
+    if (Base != Img || Offset.getZExtValue() < FirstOffset)
+      continue;
+    uint64_t Field = (Offset.getZExtValue() - FirstOffset) / sizeof(int32_t);
+    if ((Offset.getZExtValue() - FirstOffset) % sizeof(int32_t) != 0 ||
+        Field >= FormatFields.size())
+      continue;
+    Load->replaceAllUsesWith(
+        ConstantInt::get(Load->getType(), FormatFields[Field]));
+    Load->eraseFromParent();
+  }
+}
+
+// Specializes the kernel to the image formats and sampler states of the
+// command it's compiled for, as described by pocl_cmd_image_specialization().
+static void specializeImageArgs(Function &F, StringRef Spec) {
+  SmallVector<StringRef, 8> Args;
+  Spec.split(Args, '-', -1, false);
+
+  for (StringRef Arg : Args) {
+    char Kind = Arg.front();
+    SmallVector<StringRef, 5> Fields;
+    Arg.drop_front().split(Fields, '.');
+
+    unsigned ArgIndex;
+    if (Fields[0].getAsInteger(10, ArgIndex) || ArgIndex >= F.arg_size())
+      continue;
+    Argument *A = F.getArg(ArgIndex);
+    if (!A->getType()->isPointerTy())
+      continue;
+
+    if (Kind == 'i' && Fields.size() == 5) {
+      uint64_t Order, DataType, NumChannels, ElemSize;
+      if (Fields[1].getAsInteger(16, Order) ||
+          Fields[2].getAsInteger(16, DataType) ||
+          Fields[3].getAsInteger(10, NumChannels) ||
+          Fields[4].getAsInteger(10, ElemSize))
+        continue;
+      specializeImageArg(F, A, {Order, DataType, NumChannels, ElemSize});
+    } else if (Kind == 's' && Fields.size() == 2) {
+      // The sampler is passed as its dev_sampler_t bits in a pointer.
+      uint64_t Bits;
+      if (Fields[1].getAsInteger(16, Bits))
+        continue;
+      const DataLayout &DL = F.getParent()->getDataLayout();
+      Constant *Sampler = ConstantExpr::getIntToPtr(
+          ConstantInt::get(DL.getIntPtrType(A->getType()), Bits),
+          A->getType());
+      A->replaceAllUsesWith(Sampler);
+    }
+  }
+}
+
 bool WorkgroupImpl::runOnModule(Module &M, FunctionVec &OldKernels) {
 
   this->M = &M;
@@ -201,6 +386,9 @@ bool WorkgroupImpl::runOnModule(Module &M, FunctionVec &OldKernels) {
   getModuleIntMetadata(M, "WGLocalSizeY", WGLocalSizeY);
   getModuleIntMetadata(M, "WGLocalSizeZ", WGLocalSizeZ);
   getModuleBoolMetadata(M, "WGDynamicLocalSize", WGDynamicLocalSize);
+  if (!getModuleStringMetadata(M, "WGImageSpecialization",
+                               WGImageSpecialization))
+    WGImageSpecialization.clear();
   getModuleBoolMetadata(M, "WGAssumeZeroGlobalOffset",
                         WGAssumeZeroGlobalOffset);
 
@@ -211,12 +399,17 @@ bool WorkgroupImpl::runOnModule(Module &M, FunctionVec &OldKernels) {
   getModuleIntMetadata(M, "device_context_as_id", DeviceContextASid);
 
   getModuleBoolMetadata(M, "device_side_printf", DeviceSidePrintf);
+  DeviceDeferredPrintf = false;
+  getModuleBoolMetadata(M, "device_deferred_printf", DeviceDeferredPrintf);
   getModuleBoolMetadata(M, "device_alloca_locals", DeviceAllocaLocals);
 
   getModuleIntMetadata(M, "device_max_witem_dim", DeviceMaxWItemDim);
   getModuleIntMetadata(M, "device_max_witem_sizes_0", DeviceMaxWItemSizes[0]);
   getModuleIntMetadata(M, "device_max_witem_sizes_1", DeviceMaxWItemSizes[1]);
   getModuleIntMetadata(M, "device_max_witem_sizes_2", DeviceMaxWItemSizes[2]);
+  DeviceSIMDSubGroupSize = 0;
+  getModuleIntMetadata(M, "device_simd_sub_group_size",
+                       DeviceSIMDSubGroupSize);
 
   HiddenArgs = 0;
   SizeTWidth = AddressBits;
@@ -244,6 +437,8 @@ bool WorkgroupImpl::runOnModule(Module &M, FunctionVec &OldKernels) {
   assert ((SizeTWidth == 64 || SizeTWidth == 32) &&
           "Target has an unsupported pointer width.");
 
+  exposeVectorVariants(M);
+
   for (Module::iterator i = M.begin(), e = M.end(); i != e; ++i) {
     // Don't internalize functions starting with "__wrap_" for the use of GNU
     // linker's switch --wrap=symbol, where calls to the "symbol" are replaced
@@ -265,6 +460,8 @@ bool WorkgroupImpl::runOnModule(Module &M, FunctionVec &OldKernels) {
   for (Module::iterator i = M.begin(), e = M.end(); i != e; ++i) {
     Function &OrigKernel = *i;
     if (!isKernelToProcess(OrigKernel)) continue;
+    if (!WGImageSpecialization.empty())
+      specializeImageArgs(OrigKernel, WGImageSpecialization);
     Function *L = createWrapper(&OrigKernel, PrintfCache);
     KernelsMap[&OrigKernel] = L;
 
@@ -772,7 +969,8 @@ Function *WorkgroupImpl::createWrapper(Function *F,
   InlineFunction(*CI, IFI);
 
   if (DeviceSidePrintf) {
-    Function *FoclPrintfFun = M->getFunction("__pocl_printf");
+    Function *FoclPrintfFun = M->getFunction(
+        DeviceDeferredPrintf ? "__pocl_printf_deferred" : "__pocl_printf");
     replacePrintfCalls(PrintfBuf, PrintfBufPos, PrintfBufCapa,
                        true, FoclPrintfFun, *M, L, PrintfCache);
   }
@@ -973,6 +1171,16 @@ void WorkgroupImpl::privatizeContext(Function *F) {
     if (SGSize == nullptr) {
       SGSize = Builder.CreateLoad(LocalSizeAllocas[0]->getAllocatedType(),
                                   LocalSizeAllocas[0]);
+      // With SIMD sub-groups, a sub-group is the work-items of one vector
+      // of the x loop if the local X size is a multiple of the vector.
+      if (DeviceSIMDSubGroupSize > 1) {
+        Value *SIMDSize =
+            ConstantInt::get(SGSize->getType(), DeviceSIMDSubGroupSize);
+        Value *WholeVectors = Builder.CreateICmpEQ(
+            Builder.CreateURem(SGSize, SIMDSize),
+            ConstantInt::get(SGSize->getType(), 0));
+        SGSize = Builder.CreateSelect(WholeVectors, SIMDSize, SGSize);
+      }
     }
     assert(SGSize != nullptr);
     privatizeGlobals(F, Builder, {"_pocl_sub_group_size"}, {SGSize});
@@ -1629,8 +1837,9 @@ void WorkgroupImpl::createFastWorkgroupLauncher(llvm::Function *F) {
 }
 
 // The subgroup size is currently defined for the CPU implementations
-// via the intel_reqd_subgroup_size metadata or the local dimension
-// x size (the default).
+// via the intel_reqd_subgroup_size metadata, the SIMD width if the device
+// maps sub-groups to vector lanes, or the local dimension x size (the
+// default).
 llvm::Value *WorkgroupImpl::getRequiredSubgroupSize(llvm::Function &F) {
 
   if (MDNode *SGSizeMD = F.getMetadata("intel_reqd_sub_group_size")) {
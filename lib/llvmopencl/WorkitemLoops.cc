@@ -31,6 +31,7 @@ IGNORE_COMPILER_WARNING("-Wunused-parameter")
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DebugInfoMetadata.h"
@@ -57,6 +58,7 @@ POP_COMPILER_DIAGS
 #include <iostream>
 #include <map>
 #include <sstream>
+#include <tuple>
 #include <vector>
 
 #define DEBUG_TYPE "workitem-loops"
@@ -82,6 +84,20 @@ static const char *POCL_LOCAL_MEM_ALLOCA_FUNC_NAME = "__pocl_local_mem_alloca";
 static const char *POCL_WORK_GROUP_ALLOCA_FUNC_NAME =
     "__pocl_work_group_alloca";
 
+// Prefixes of the serial folds the work-group reductions and scans of
+// work_group.c call from a single work-item. They are followed by the
+// operation and the Itanium code of the element type, e.g.
+// "__pocl_work_group_scan_max_j". The library definitions are the fallback
+// for the calls not expanded here.
+static const char *POCL_WORK_GROUP_REDUCE_FUNC_PREFIX =
+    "__pocl_work_group_reduce_";
+static const char *POCL_WORK_GROUP_SCAN_FUNC_PREFIX =
+    "__pocl_work_group_scan_";
+
+// The number of elements the expanded folds handle at a time. The backend
+// splits the vectors if they are wider than the target's.
+static const unsigned WORK_GROUP_FOLD_WIDTH = 8;
+
 class WorkitemLoopsImpl : public pocl::WorkitemHandler {
 public:
   WorkitemLoopsImpl(llvm::DominatorTree &DT, llvm::LoopInfo &LI,
@@ -95,6 +111,7 @@ private:
   using InstructionIndex = std::set<llvm::Instruction *>;
   using InstructionVec = std::vector<llvm::Instruction *>;
   using StrInstructionMap = std::map<std::string, llvm::AllocaInst *>;
+  using AtomicRMWVec = std::vector<llvm::AtomicRMWInst *>;
 
   llvm::DominatorTree &DT;
   llvm::LoopInfo &LI;
@@ -121,6 +138,12 @@ private:
 
   void fixMultiRegionVariables(ParallelRegion *region);
   bool handleLocalMemAllocas(Kernel &K);
+  bool handleWorkGroupFolds(Kernel &K);
+  bool expandWorkGroupFold(llvm::CallInst *Call);
+  AtomicRMWVec findUniformAtomics(ParallelRegion &Region);
+  void aggregateUniformAtomics(const AtomicRMWVec &Atomics,
+                               llvm::BasicBlock *LoopInitBB,
+                               llvm::BasicBlock *LoopEndBB);
   void addContextSaveRestore(llvm::Instruction *instruction);
   void releaseParallelRegions();
 
@@ -182,6 +205,8 @@ bool WorkitemLoopsImpl::runOnFunction(Function &F) {
 
   Changed |= handleLocalMemAllocas(cast<Kernel>(F));
 
+  Changed |= handleWorkGroupFolds(cast<Kernel>(F));
+
 #ifdef DUMP_CFGS
   dumpCFG(F, F.getName().str() + "_after_wiloops.dot", nullptr,
           &OriginalParallelRegions);
@@ -514,6 +539,12 @@ bool WorkitemLoopsImpl::processFunction(Function &F) {
     
     peeledRegion[original] = peelFirst;
 
+    // Look for the atomic updates to combine before the region is
+    // replicated or wrapped in loops.
+    AtomicRMWVec UniformAtomics;
+    if (!peelFirst)
+      UniformAtomics = findUniformAtomics(*original);
+
     std::pair<llvm::BasicBlock *, llvm::BasicBlock *> l;
     // the original predecessor nodes of which successor
     // should be fixed if not peeling
@@ -637,6 +668,9 @@ bool WorkitemLoopsImpl::processFunction(Function &F) {
       }
     }
 
+    if (!unrolled && !UniformAtomics.empty())
+      aggregateUniformAtomics(UniformAtomics, l.first, l.second);
+
     /* Loop edges coming from another region mean B-loops which means 
        we have to fix the loop edge to jump to the beginning of the wi-loop 
        structure, not its body. This has to be done only for non-peeled
@@ -792,6 +826,465 @@ bool WorkitemLoopsImpl::handleLocalMemAllocas(Kernel &K) {
   return Changed;
 }
 
+// Replace the calls to the serial __pocl_work_group_{reduce,scan}_* folds
+// with loops that combine WORK_GROUP_FOLD_WIDTH elements at a time.
+bool WorkitemLoopsImpl::handleWorkGroupFolds(Kernel &K) {
+
+  std::vector<CallInst *> InstructionsToFix;
+
+  for (BasicBlock &BB : K) {
+    for (Instruction &I : BB) {
+      CallInst *Call = dyn_cast<CallInst>(&I);
+      if (Call == nullptr || Call->getCalledFunction() == nullptr)
+        continue;
+      StringRef Name = Call->getCalledFunction()->getName();
+      if (Name.startswith(POCL_WORK_GROUP_REDUCE_FUNC_PREFIX) ||
+          Name.startswith(POCL_WORK_GROUP_SCAN_FUNC_PREFIX))
+        InstructionsToFix.push_back(Call);
+    }
+  }
+
+  bool Changed = false;
+  for (CallInst *Call : InstructionsToFix)
+    Changed |= expandWorkGroupFold(Call);
+  return Changed;
+}
+
+// Expands a call to a serial fold over the first N elements of DATA:
+//
+//  T __pocl_work_group_reduce_OP_T (T *data, size_t n)
+//    returns data[0] OP data[1] OP ... OP data[n - 1]
+//
+//  void __pocl_work_group_scan_OP_T (T *data, size_t n)
+//    replaces data[i] with data[0] OP ... OP data[i] for all i < n
+//
+// The reduction keeps a vector of partial results which is combined
+// horizontally at the end. The scan computes the prefixes of a vector in
+// log2(width) shift-and-combine steps and adds the carry from the previous
+// vector. The leftover elements are handled one at a time. The work-group
+// collectives don't define the order of the operations, so the result of a
+// floating point addition may differ from the serial one in rounding.
+//
+// Returns false, leaving the call to the library definition, for names and
+// signatures it doesn't recognize.
+bool WorkitemLoopsImpl::expandWorkGroupFold(llvm::CallInst *Call) {
+
+  StringRef Name = Call->getCalledFunction()->getName();
+  bool IsScan = Name.consume_front(POCL_WORK_GROUP_SCAN_FUNC_PREFIX);
+  if (!IsScan)
+    Name.consume_front(POCL_WORK_GROUP_REDUCE_FUNC_PREFIX);
+
+  std::pair<StringRef, StringRef> OpAndType = Name.split('_');
+  StringRef OpName = OpAndType.first;
+  StringRef TypeCode = OpAndType.second;
+  // The code is one letter, or two for half (Dh). IPO passes may have
+  // suffixed a copy of the function with '.N'.
+  size_t CodeLen = TypeCode.startswith("Dh") ? 2 : 1;
+  if (TypeCode.size() < CodeLen ||
+      (TypeCode.size() > CodeLen && TypeCode[CodeLen] != '.'))
+    return false;
+  if (OpName != "add" && OpName != "min" && OpName != "max")
+    return false;
+
+  LLVMContext &C = Call->getContext();
+  llvm::Type *ElemTy = nullptr;
+  bool IsSigned = TypeCode[0] == 'i' || TypeCode[0] == 'l';
+  switch (TypeCode[0]) {
+  case 'i':
+  case 'j':
+    ElemTy = llvm::Type::getInt32Ty(C);
+    break;
+  case 'l':
+  case 'm':
+    ElemTy = llvm::Type::getInt64Ty(C);
+    break;
+  case 'f':
+    ElemTy = llvm::Type::getFloatTy(C);
+    break;
+  case 'd':
+    ElemTy = llvm::Type::getDoubleTy(C);
+    break;
+  case 'D':
+    ElemTy = llvm::Type::getHalfTy(C);
+    break;
+  default:
+    return false;
+  }
+  bool IsFP = ElemTy->isFloatingPointTy();
+
+  if (Call->arg_size() != 2 ||
+      !Call->getArgOperand(0)->getType()->isPointerTy() ||
+      !Call->getArgOperand(1)->getType()->isIntegerTy() ||
+      Call->getType() != (IsScan ? llvm::Type::getVoidTy(C) : ElemTy))
+    return false;
+
+  // The identity of the operation, the carry into the first element.
+  Constant *Identity = nullptr;
+  unsigned Bits = ElemTy->getScalarSizeInBits();
+  if (OpName == "add")
+    Identity = IsFP ? ConstantFP::getNegativeZero(ElemTy)
+                    : Constant::getNullValue(ElemTy);
+  else if (OpName == "min")
+    Identity = IsFP     ? ConstantFP::getInfinity(ElemTy, false)
+               : IsSigned ? ConstantInt::get(ElemTy,
+                                             APInt::getSignedMaxValue(Bits))
+                          : Constant::getAllOnesValue(ElemTy);
+  else
+    Identity = IsFP     ? ConstantFP::getInfinity(ElemTy, true)
+               : IsSigned ? ConstantInt::get(ElemTy,
+                                             APInt::getSignedMinValue(Bits))
+                          : Constant::getNullValue(ElemTy);
+
+  // Combines an earlier value A with a later one B the same way as the
+  // OPERATION of work_group.c. Works for both scalars and vectors.
+  auto Combine = [&](IRBuilder<> &Builder, Value *A, Value *B) -> Value * {
+    if (OpName == "add")
+      return IsFP ? Builder.CreateFAdd(A, B) : Builder.CreateAdd(A, B);
+    Value *AGreater = IsFP       ? Builder.CreateFCmpOGT(A, B)
+                      : IsSigned ? Builder.CreateICmpSGT(A, B)
+                                 : Builder.CreateICmpUGT(A, B);
+    return OpName == "min" ? Builder.CreateSelect(AGreater, B, A)
+                           : Builder.CreateSelect(AGreater, A, B);
+  };
+
+  const unsigned Width = WORK_GROUP_FOLD_WIDTH;
+  llvm::Type *VecTy = FixedVectorType::get(ElemTy, Width);
+  const DataLayout &DL = Call->getModule()->getDataLayout();
+  Align ElemAlign = DL.getABITypeAlign(ElemTy);
+
+  Value *Data = Call->getArgOperand(0);
+  unsigned AS = Data->getType()->getPointerAddressSpace();
+
+  BasicBlock *EntryBB = Call->getParent();
+  Function *F = EntryBB->getParent();
+  BasicBlock *ExitBB = EntryBB->splitBasicBlock(Call, "wg_fold_exit");
+  BasicBlock *VecCondBB =
+      BasicBlock::Create(C, "wg_fold_vec_cond", F, ExitBB);
+  BasicBlock *VecBodyBB =
+      BasicBlock::Create(C, "wg_fold_vec_body", F, ExitBB);
+  BasicBlock *TailBB = BasicBlock::Create(C, "wg_fold_tail", F, ExitBB);
+  BasicBlock *ScalarCondBB =
+      BasicBlock::Create(C, "wg_fold_scalar_cond", F, ExitBB);
+  BasicBlock *ScalarBodyBB =
+      BasicBlock::Create(C, "wg_fold_scalar_body", F, ExitBB);
+
+  IRBuilder<> Builder(EntryBB->getTerminator());
+  Value *N = Builder.CreateZExtOrTrunc(Call->getArgOperand(1), SizeT);
+  EntryBB->getTerminator()->setSuccessor(0, VecCondBB);
+
+  // The vector loop. ACC is the vector of partial results of a reduction,
+  // or the last prefix of a scan broadcast to all lanes.
+  Builder.SetInsertPoint(VecCondBB);
+  PHINode *VecIndex = Builder.CreatePHI(SizeT, 2, "wg_fold_i");
+  PHINode *Acc =
+      Builder.CreatePHI(IsScan ? ElemTy : VecTy, 2, "wg_fold_acc");
+  Value *VecEnd = Builder.CreateAdd(VecIndex, ConstantInt::get(SizeT, Width));
+  Builder.CreateCondBr(Builder.CreateICmpULE(VecEnd, N), VecBodyBB, TailBB);
+
+  Builder.SetInsertPoint(VecBodyBB);
+  Value *VecPtr = Builder.CreateBitCast(
+      Builder.CreateInBoundsGEP(ElemTy, Data, VecIndex),
+      VecTy->getPointerTo(AS));
+  Value *Vec = Builder.CreateAlignedLoad(VecTy, VecPtr, ElemAlign);
+  Value *NextAcc = nullptr;
+  if (IsScan) {
+    Value *IdentityVec =
+        ConstantVector::getSplat(ElementCount::getFixed(Width), Identity);
+    for (unsigned Shift = 1; Shift < Width; Shift *= 2) {
+      // Lane L gets the lane L - Shift, or the identity for the first lanes.
+      SmallVector<int, WORK_GROUP_FOLD_WIDTH> Mask;
+      for (unsigned L = 0; L < Width; ++L)
+        Mask.push_back(L < Shift ? Width + L : L - Shift);
+      Value *Shifted = Builder.CreateShuffleVector(Vec, IdentityVec, Mask);
+      Vec = Combine(Builder, Shifted, Vec);
+    }
+    Vec = Combine(Builder, Builder.CreateVectorSplat(Width, Acc), Vec);
+    Builder.CreateAlignedStore(Vec, VecPtr, ElemAlign);
+    NextAcc = Builder.CreateExtractElement(Vec, (uint64_t)Width - 1);
+  } else {
+    NextAcc = Combine(Builder, Acc, Vec);
+  }
+  Builder.CreateBr(VecCondBB);
+
+  VecIndex->addIncoming(ConstantInt::get(SizeT, 0), EntryBB);
+  VecIndex->addIncoming(VecEnd, VecBodyBB);
+  Acc->addIncoming(IsScan ? Identity
+                          : ConstantVector::getSplat(
+                                ElementCount::getFixed(Width), Identity),
+                   EntryBB);
+  Acc->addIncoming(NextAcc, VecBodyBB);
+
+  // Reduce the partial results by combining the upper half of the remaining
+  // lanes to the lower half until lane 0 has them all.
+  Builder.SetInsertPoint(TailBB);
+  Value *TailAcc = Acc;
+  if (!IsScan) {
+    for (unsigned Half = Width / 2; Half > 0; Half /= 2) {
+      SmallVector<int, WORK_GROUP_FOLD_WIDTH> Mask;
+      for (unsigned L = 0; L < Width; ++L)
+        Mask.push_back(L < Half ? L + Half : L);
+      TailAcc = Combine(Builder, TailAcc,
+                        Builder.CreateShuffleVector(TailAcc, Mask));
+    }
+    TailAcc = Builder.CreateExtractElement(TailAcc, (uint64_t)0);
+  }
+  Builder.CreateBr(ScalarCondBB);
+
+  // The leftover elements.
+  Builder.SetInsertPoint(ScalarCondBB);
+  PHINode *ScalarIndex = Builder.CreatePHI(SizeT, 2, "wg_fold_j");
+  PHINode *ScalarAcc = Builder.CreatePHI(ElemTy, 2, "wg_fold_sacc");
+  Builder.CreateCondBr(Builder.CreateICmpULT(ScalarIndex, N), ScalarBodyBB,
+                       ExitBB);
+
+  Builder.SetInsertPoint(ScalarBodyBB);
+  Value *ElemPtr = Builder.CreateInBoundsGEP(ElemTy, Data, ScalarIndex);
+  Value *Elem = Builder.CreateAlignedLoad(ElemTy, ElemPtr, ElemAlign);
+  Value *NextScalarAcc = Combine(Builder, ScalarAcc, Elem);
+  if (IsScan)
+    Builder.CreateAlignedStore(NextScalarAcc, ElemPtr, ElemAlign);
+  Value *NextScalarIndex =
+      Builder.CreateAdd(ScalarIndex, ConstantInt::get(SizeT, 1));
+  Builder.CreateBr(ScalarCondBB);
+
+  ScalarIndex->addIncoming(VecIndex, TailBB);
+  ScalarIndex->addIncoming(NextScalarIndex, ScalarBodyBB);
+  ScalarAcc->addIncoming(TailAcc, TailBB);
+  ScalarAcc->addIncoming(NextScalarAcc, ScalarBodyBB);
+
+#ifdef DEBUG_WORK_ITEM_LOOPS
+  std::cerr << "### expanded a work-group fold of " << Width << " lanes for"
+            << std::endl;
+  Call->dump();
+#endif
+  if (!IsScan)
+    Call->replaceAllUsesWith(ScalarAcc);
+  Call->eraseFromParent();
+  return true;
+}
+
+// Returns the value of an operand of the atomic update OP which leaves the
+// other operand unchanged.
+static Constant *atomicIdentity(AtomicRMWInst::BinOp Op, llvm::Type *Ty) {
+  unsigned Bits = Ty->getIntegerBitWidth();
+  switch (Op) {
+  case AtomicRMWInst::And:
+  case AtomicRMWInst::UMin:
+    return Constant::getAllOnesValue(Ty);
+  case AtomicRMWInst::Max:
+    return ConstantInt::get(Ty, APInt::getSignedMinValue(Bits));
+  case AtomicRMWInst::Min:
+    return ConstantInt::get(Ty, APInt::getSignedMaxValue(Bits));
+  default:
+    return Constant::getNullValue(Ty);
+  }
+}
+
+// Combines the operands A and B of two atomic updates OP of the same address
+// to the operand of a single one. Subtractions are combined by adding the
+// amounts.
+static Value *combineAtomicOperands(IRBuilder<> &Builder,
+                                    AtomicRMWInst::BinOp Op, Value *A,
+                                    Value *B) {
+  switch (Op) {
+  case AtomicRMWInst::Add:
+  case AtomicRMWInst::Sub:
+    return Builder.CreateAdd(A, B);
+  case AtomicRMWInst::And:
+    return Builder.CreateAnd(A, B);
+  case AtomicRMWInst::Or:
+    return Builder.CreateOr(A, B);
+  case AtomicRMWInst::Xor:
+    return Builder.CreateXor(A, B);
+  case AtomicRMWInst::Max:
+    return Builder.CreateSelect(Builder.CreateICmpSGT(A, B), A, B);
+  case AtomicRMWInst::Min:
+    return Builder.CreateSelect(Builder.CreateICmpSLT(A, B), A, B);
+  case AtomicRMWInst::UMax:
+    return Builder.CreateSelect(Builder.CreateICmpUGT(A, B), A, B);
+  case AtomicRMWInst::UMin:
+    return Builder.CreateSelect(Builder.CreateICmpULT(A, B), A, B);
+  default:
+    llvm_unreachable("Unexpected atomic operation.");
+  }
+}
+
+// Returns the atomic updates in the region that can be combined over the
+// work-items and applied once after the work-item loop, e.g. a counter or
+// a flag every work-item updates without looking at the old value. They must
+//
+//  - be integer operations that can be reordered (add, sub, and, or, xor,
+//    min, max),
+//  - have their result unused,
+//  - not be sequentially consistent,
+//  - update an address computed outside the region, which is the same for
+//    all the work-items, and
+//  - not be followed in the region by other accesses of the work-item to
+//    memory the update could alias, except updates with the same operation,
+//    type, ordering, scope and volatility.
+//
+// Deferring the updates of the work-items to the end of the loop is then
+// one of the orders in which they could have run concurrently, and the
+// release part of the update still follows their earlier accesses. The
+// pre-2.0 atomic builtins take volatile pointers by their signature, so
+// volatile updates are accepted too.
+WorkitemLoopsImpl::AtomicRMWVec
+WorkitemLoopsImpl::findUniformAtomics(ParallelRegion &Region) {
+
+  std::set<llvm::BasicBlock *> RegionBlocks(Region.begin(), Region.end());
+  Function *F = Region.entryBB()->getParent();
+
+  std::set<AtomicRMWInst *> Candidates;
+  for (BasicBlock *BB : Region) {
+    for (Instruction &I : *BB) {
+      AtomicRMWInst *RMW = dyn_cast<AtomicRMWInst>(&I);
+      if (RMW == nullptr || !RMW->use_empty() ||
+          RMW->getOrdering() == AtomicOrdering::SequentiallyConsistent)
+        continue;
+      switch (RMW->getOperation()) {
+      case AtomicRMWInst::Add:
+      case AtomicRMWInst::Sub:
+      case AtomicRMWInst::And:
+      case AtomicRMWInst::Or:
+      case AtomicRMWInst::Xor:
+      case AtomicRMWInst::Max:
+      case AtomicRMWInst::Min:
+      case AtomicRMWInst::UMax:
+      case AtomicRMWInst::UMin:
+        break;
+      default:
+        continue;
+      }
+      Value *Ptr = RMW->getPointerOperand();
+      Instruction *PtrDef = dyn_cast<Instruction>(Ptr);
+      if ((PtrDef != nullptr && RegionBlocks.count(PtrDef->getParent())) ||
+          !VUA.isUniform(F, Ptr))
+        continue;
+      Candidates.insert(RMW);
+    }
+  }
+
+  // Private variables, including the context arrays, and the module's
+  // globals can't be the buffers the kernel arguments point to.
+  auto MayConflict = [&](Instruction &I, AtomicRMWInst *RMW) -> bool {
+    if (!I.mayReadOrWriteMemory())
+      return false;
+    if (AtomicRMWInst *Other = dyn_cast<AtomicRMWInst>(&I))
+      if (Candidates.count(Other) &&
+          Other->getOperation() == RMW->getOperation() &&
+          Other->getType() == RMW->getType() &&
+          Other->getOrdering() == RMW->getOrdering() &&
+          Other->getSyncScopeID() == RMW->getSyncScopeID() &&
+          Other->isVolatile() == RMW->isVolatile())
+        return false;
+    if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(&I))
+      if (II->isLifetimeStartOrEnd())
+        return false;
+    Value *Ptr = getLoadStorePointerOperand(&I);
+    if (Ptr == nullptr)
+      return true;
+    const Value *Obj = getUnderlyingObject(Ptr);
+    return Obj == getUnderlyingObject(RMW->getPointerOperand()) ||
+           !(isa<AllocaInst>(Obj) || isa<GlobalVariable>(Obj));
+  };
+
+  AtomicRMWVec Atomics;
+  for (BasicBlock *BB : Region) {
+    for (Instruction &I : *BB) {
+      AtomicRMWInst *RMW = dyn_cast<AtomicRMWInst>(&I);
+      if (RMW == nullptr || !Candidates.count(RMW))
+        continue;
+
+      bool Conflict = false;
+      for (Instruction *Next = RMW->getNextNode(); Next != nullptr && !Conflict;
+           Next = Next->getNextNode())
+        Conflict = MayConflict(*Next, RMW);
+
+      std::set<BasicBlock *> Visited;
+      std::vector<BasicBlock *> Worklist(succ_begin(BB), succ_end(BB));
+      while (!Worklist.empty() && !Conflict) {
+        BasicBlock *Succ = Worklist.back();
+        Worklist.pop_back();
+        if (!RegionBlocks.count(Succ) || !Visited.insert(Succ).second)
+          continue;
+        for (Instruction &Next : *Succ) {
+          Conflict = MayConflict(Next, RMW);
+          if (Conflict)
+            break;
+        }
+        Worklist.insert(Worklist.end(), succ_begin(Succ), succ_end(Succ));
+      }
+
+      if (!Conflict)
+        Atomics.push_back(RMW);
+    }
+  }
+  return Atomics;
+}
+
+// Replaces the atomic updates found by findUniformAtomics() in the work-item
+// loop starting at LoopInitBB with updates of a private accumulator for each
+// address, operation, type, ordering, scope and volatility, so that no update
+// takes the ordering of another or shares an accumulator of another width.
+// LoopEndBB then applies each accumulated value with a single atomic update.
+// A relaxed update that leaves the accumulator at the identity is skipped;
+// an update with a stronger ordering or a volatile one is always applied, as
+// it still synchronizes (or is observable) even when it changes nothing. The
+// accumulators are added after the loop has been marked
+// parallel, so they are not in its access group; once promoted to registers,
+// they are reductions the loop vectorizer handles.
+void WorkitemLoopsImpl::aggregateUniformAtomics(const AtomicRMWVec &Atomics,
+                                                llvm::BasicBlock *LoopInitBB,
+                                                llvm::BasicBlock *LoopEndBB) {
+
+  Function *F = LoopInitBB->getParent();
+  Instruction *ApplyBefore = LoopEndBB->getTerminator();
+  std::map<std::tuple<Value *, unsigned, llvm::Type *, unsigned,
+                      SyncScope::ID, bool>,
+           AllocaInst *>
+      Accumulators;
+  IRBuilder<> Builder(F->getContext());
+
+  for (AtomicRMWInst *RMW : Atomics) {
+    Value *Ptr = RMW->getPointerOperand();
+    AtomicRMWInst::BinOp Op = RMW->getOperation();
+    llvm::Type *Ty = RMW->getType();
+
+    AllocaInst *&Acc = Accumulators[std::make_tuple(
+        Ptr, (unsigned)Op, Ty, (unsigned)RMW->getOrdering(),
+        RMW->getSyncScopeID(), RMW->isVolatile())];
+    if (Acc == nullptr) {
+      Constant *Identity = atomicIdentity(Op, Ty);
+      Builder.SetInsertPoint(&*F->getEntryBlock().getFirstInsertionPt());
+      Acc = Builder.CreateAlloca(Ty, nullptr, "wg_atomic_acc");
+
+      Builder.SetInsertPoint(LoopInitBB->getTerminator());
+      Builder.CreateStore(Identity, Acc);
+
+      Builder.SetInsertPoint(ApplyBefore);
+      Value *Combined = Builder.CreateLoad(Ty, Acc);
+      if (RMW->getOrdering() == AtomicOrdering::Monotonic &&
+          !RMW->isVolatile()) {
+        Instruction *ThenTerm = SplitBlockAndInsertIfThen(
+            Builder.CreateICmpNE(Combined, Identity), ApplyBefore, false);
+        Builder.SetInsertPoint(ThenTerm);
+      }
+      AtomicRMWInst *Applied =
+          Builder.CreateAtomicRMW(Op, Ptr, Combined, RMW->getAlign(),
+                                  RMW->getOrdering(), RMW->getSyncScopeID());
+      Applied->setVolatile(RMW->isVolatile());
+      Applied->setDebugLoc(RMW->getDebugLoc());
+    }
+
+    Builder.SetInsertPoint(RMW);
+    Builder.CreateStore(
+        combineAtomicOperands(Builder, Op, Builder.CreateLoad(Ty, Acc),
+                              RMW->getValOperand()),
+        Acc);
+    RMW->eraseFromParent();
+  }
+}
+
 llvm::Value *WorkitemLoopsImpl::getLinearWiIndex(llvm::IRBuilder<> &Builder,
                                                  llvm::Module *M,
                                                  ParallelRegion *Region) {
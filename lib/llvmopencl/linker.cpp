@@ -44,12 +44,14 @@ IGNORE_COMPILER_WARNING("-Wunused-parameter")
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalValue.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/PassInfo.h>
 #include <llvm/PassRegistry.h>
 #include <llvm/Transforms/IPO/AlwaysInliner.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #include <llvm/Transforms/Utils/ValueMapper.h>
 
 #include "pocl_cl.h"
@@ -148,6 +150,41 @@ static void fixCallingConv(llvm::Module *Mod, std::string &Log) {
   }
 }
 
+// The LLVM function attribute listing the vector variants of a function
+// the loop vectorizer may widen its calls to.
+static const char *VectorVariantsAttr = "vector-function-abi-variant";
+
+static inline void
+find_called_functions(llvm::Function *F,
+                      llvm::StringSet<> &FNameSet);
+
+// Find the vector variants F is mapped to (see addVectorVariantMappings),
+// append their names to function name set. Nothing calls them before
+// the work-group function has been vectorized, so they would be left behind.
+static inline void
+find_vector_variants(llvm::Function *F,
+                     llvm::StringSet<> &FNameSet)
+{
+  llvm::Attribute Attr = F->getFnAttribute(VectorVariantsAttr);
+  if (!Attr.isStringAttribute())
+    return;
+
+  SmallVector<StringRef, 4> Mappings;
+  Attr.getValueAsString().split(Mappings, ',');
+  for (StringRef Mapping : Mappings) {
+    size_t Open = Mapping.find('(');
+    if (Open == StringRef::npos || !Mapping.endswith(")"))
+      continue;
+    StringRef VecName = Mapping.slice(Open + 1, Mapping.size() - 1);
+    llvm::Function *VecF = F->getParent()->getFunction(VecName);
+    if (VecF == nullptr || FNameSet.count(VecName) > 0)
+      continue;
+    DB_PRINT("inserting vector variant %s\n", VecName.data());
+    FNameSet.insert(VecName);
+    find_called_functions(VecF, FNameSet);
+  }
+}
+
 // Find all functions in the calltree of F, append their
 // name to function name set.
 static inline void
@@ -216,6 +253,7 @@ find_called_functions(llvm::Function *F,
         FNameSet.insert(Callee->getName());
         DB_PRINT("search: recursing into %s\n", Name);
         find_called_functions(Callee, FNameSet);
+        find_vector_variants(Callee, FNameSet);
       }
     }
   }
@@ -284,6 +322,7 @@ copy_func_callgraph(const llvm::StringRef func_name,
     DB_PRINT("copying function %s with callgraph\n", RootFunc->getName().data());
 
     find_called_functions(RootFunc, callees);
+    find_vector_variants(RootFunc, callees);
 
     // First copy the callees of func, then the function itself.
     // Recurse into callees to handle the case where kernel library
@@ -366,7 +405,7 @@ static void shared_copy(llvm::Module *program, const llvm::Module *lib,
 using namespace pocl;
 
 int link(llvm::Module *Program, const llvm::Module *Lib, std::string &Log,
-         const char **DevAuxFuncs, bool DeviceSidePrintf) {
+         const char **DevAuxFuncs, bool DeviceSidePrintf, bool RelaxedMath) {
 
   assert(Program);
   assert(Lib);
@@ -509,6 +548,20 @@ int link(llvm::Module *Program, const llvm::Module *Lib, std::string &Log,
     }
   }
 
+  /* The kernel library selects between accuracy tiers of some math builtins
+   * with this, leaving it to us to define according to the build options. */
+  Function *RelaxedMathF = Program->getFunction("__pocl_relaxed_math");
+  if (RelaxedMathF && RelaxedMathF->isDeclaration()) {
+    BasicBlock *BB =
+        BasicBlock::Create(Program->getContext(), "entry", RelaxedMathF);
+    ReturnInst::Create(
+        Program->getContext(),
+        ConstantInt::get(RelaxedMathF->getReturnType(), RelaxedMath ? 1 : 0),
+        BB);
+    RelaxedMathF->setLinkage(GlobalValue::InternalLinkage);
+    RelaxedMathF->addFnAttr(Attribute::AlwaysInline);
+  }
+
   return 0;
 }
 
@@ -680,5 +733,112 @@ bool moveProgramScopeVarsOutOfProgramBc(llvm::LLVMContext *Context,
   return true;
 }
 
+// Scalar builtins with a body at most this big and no calls other than
+// to intrinsics are left alone: the vectorizer widens those on its own once
+// they are inlined.
+#define VECTOR_VARIANT_MIN_INSTRUCTIONS 16
+
+void addVectorVariantMappings(llvm::Module *Lib) {
+
+  for (llvm::Function &F : *Lib) {
+    if (F.isDeclaration() || F.arg_empty() ||
+        F.hasFnAttribute(Attribute::AlwaysInline))
+      continue;
+
+    // Only the float and double builtins with all-scalar arguments
+    // of the same type, e.g. _Z7_cl_powff, which maps to _Z7_cl_powDv8_fS_.
+    StringRef Name = F.getName();
+    unsigned BaseLen = 0;
+    if (!Name.consume_front("_Z") || Name.consumeInteger(10, BaseLen) ||
+        BaseLen > Name.size())
+      continue;
+    StringRef Base = Name.take_front(BaseLen);
+    StringRef Params = Name.drop_front(BaseLen);
+    if (!Base.startswith("_cl_"))
+      continue;
+
+    llvm::Type *ElemT = F.getReturnType();
+    char Code = ElemT->isFloatTy() ? 'f' : (ElemT->isDoubleTy() ? 'd' : 0);
+    if (Code == 0 || Params.size() != F.arg_size() ||
+        Params.find_first_not_of(Code) != StringRef::npos)
+      continue;
+
+    bool WorthMapping = false;
+    unsigned NumInstrs = 0;
+    for (llvm::BasicBlock &BB : F) {
+      for (llvm::Instruction &I : BB) {
+        ++NumInstrs;
+        CallInst *CI = dyn_cast<CallInst>(&I);
+        if (CI != nullptr && !isa<IntrinsicInst>(CI))
+          WorthMapping = true;
+      }
+    }
+    if (!WorthMapping && NumInstrs <= VECTOR_VARIANT_MIN_INSTRUCTIONS)
+      continue;
+
+    std::string Mappings;
+    for (unsigned Width = 2; Width <= 16; Width *= 2) {
+      std::string VecName = "_Z" + std::to_string(BaseLen) + Base.str() +
+                            "Dv" + std::to_string(Width) + "_" + Code;
+      for (unsigned i = 1; i < F.arg_size(); ++i)
+        VecName += "S_";
+
+      // The vector overloads wider than the target's registers are passed
+      // in memory, those don't fit the vector function ABI.
+      llvm::Function *VecF = Lib->getFunction(VecName);
+      llvm::Type *VecT = FixedVectorType::get(ElemT, Width);
+      SmallVector<llvm::Type *, 3> VecParams(F.arg_size(), VecT);
+      if (VecF == nullptr || VecF->isDeclaration() ||
+          VecF->getFunctionType() != FunctionType::get(VecT, VecParams, false))
+        continue;
+
+      if (!Mappings.empty())
+        Mappings += ",";
+      Mappings += "_ZGV_LLVM_N" + std::to_string(Width) +
+                  std::string(F.arg_size(), 'v') + "_" + F.getName().str() +
+                  "(" + VecName + ")";
+    }
+    if (Mappings.empty())
+      continue;
+
+    DB_PRINT("vector variants of %s: %s\n", F.getName().data(),
+             Mappings.c_str());
+    F.addFnAttr(VectorVariantsAttr, Mappings);
+    // Keep the calls around until the work-item loops exist. The work-group
+    // pass lifts this and keeps only the calls inside the loops out of line.
+    F.addFnAttr(Attribute::NoInline);
+  }
+}
+
+void inlineUnvectorizedVariantCalls(llvm::Module *M) {
+  SmallVector<CallInst *, 8> Calls;
+  for (llvm::Function &F : *M) {
+    if (F.isDeclaration() || !F.hasFnAttribute(VectorVariantsAttr))
+      continue;
+    for (User *U : F.users()) {
+      CallInst *CI = dyn_cast<CallInst>(U);
+      if (CI != nullptr && CI->getCalledFunction() == &F &&
+          CI->hasFnAttr(VectorVariantsAttr))
+        Calls.push_back(CI);
+    }
+  }
+
+  std::set<llvm::Function *> Callees;
+  for (CallInst *CI : Calls) {
+    Callees.insert(CI->getCalledFunction());
+    CI->setAttributes(
+        CI->getAttributes()
+            .removeFnAttribute(M->getContext(), Attribute::NoInline)
+            .removeFnAttribute(M->getContext(), VectorVariantsAttr));
+    InlineFunctionInfo IFI;
+    InlineFunction(*CI, IFI);
+  }
+
+  for (llvm::Function *F : Callees) {
+    if (F->use_empty() && F->hasLocalLinkage())
+      F->eraseFromParent();
+  }
+}
+
 /* vim: set expandtab ts=4 : */
 
@@ -38,14 +38,31 @@
  * running DCE.
  *
  * log is used to report errors if we run into undefined symbols
+ *
+ * RelaxedMath selects the faster, less accurate variants of the math
+ * builtins that have them (-cl-fast-relaxed-math and the like).
  */
 int link(llvm::Module *Program, const llvm::Module *Lib, std::string &Log,
-         const char **DevAuxFuncs, bool DeviceSidePrintf);
+         const char **DevAuxFuncs, bool DeviceSidePrintf, bool RelaxedMath);
 
 int copyKernelFromBitcode(const char* Name, llvm::Module *ParallelBC,
                           const llvm::Module *Program,
                           const char **DevAuxFuncs);
 
+/**
+ * Map the scalar float and double math builtins of the kernel library to
+ * their vector overloads with the vector function ABI attribute, so the
+ * loop vectorizer can widen their calls in the work-item loops.
+ */
+void addVectorVariantMappings(llvm::Module *Lib);
+
+/**
+ * Inline the calls to the mapped builtins the loop vectorizer left scalar
+ * (the scalar remainders of the work-item loops and loops it gave up on).
+ * To be run once the optimizations after the work-group pass are done.
+ */
+void inlineUnvectorizedVariantCalls(llvm::Module *M);
+
 bool moveProgramScopeVarsOutOfProgramBc(llvm::LLVMContext *Context,
                                         llvm::Module *ProgramBC,
                                         llvm::Module *OutputBC,
@@ -269,15 +269,19 @@ void CommandQueue::ReadBuffer(uint32_t queue_id, Request *req, Reply *rep) {
   */
   rep->extra_size = m.size;
   char *host_ptr = nullptr;
+  if (req->shared_data) {
+    host_ptr = (char *)req->shared_data;
+  } else {
 #ifdef ENABLE_RDMA
-  if (!backend->clientUsesRdma()) {
-    rep->extra_data.resize(rep->extra_size);
-    host_ptr = (char*)rep->extra_data.data();
-  }
+    if (!backend->clientUsesRdma()) {
+      rep->extra_data.resize(rep->extra_size);
+      host_ptr = (char *)rep->extra_data.data();
+    }
 #else
-  rep->extra_data.resize(rep->extra_size);
-  host_ptr = (char*)rep->extra_data.data();
+    rep->extra_data.resize(rep->extra_size);
+    host_ptr = (char *)rep->extra_data.data();
 #endif
+  }
 
   TP_READ_BUFFER(req->req.msg_id, req->req.client_did, queue_id,
                  req->req.obj_id, m.size, CL_RUNNING);
@@ -296,9 +300,9 @@ void CommandQueue::WriteBuffer(uint32_t queue_id, Request *req, Reply *rep) {
   EventTiming_t evt_timing{};
 
 #ifdef ENABLE_RDMA
-  void *data = backend->clientUsesRdma() ? nullptr : req->extra_data.data();
+  void *data = backend->clientUsesRdma() ? nullptr : req->payload();
 #else
-  void *data = req->extra_data.data();
+  void *data = req->payload();
 #endif
 
   TP_WRITE_BUFFER(req->req.msg_id, req->req.client_did, queue_id,
@@ -338,15 +342,19 @@ void CommandQueue::ReadBufferRect(uint32_t queue_id, Request *req, Reply *rep) {
 
   rep->extra_size = m.host_bytes;
   char *host_ptr = nullptr;
+  if (req->shared_data) {
+    host_ptr = (char *)req->shared_data;
+  } else {
 #ifdef ENABLE_RDMA
-  if (!backend->clientUsesRdma()) {
-    rep->extra_data.resize(rep->extra_size);
-    host_ptr = (char*)rep->extra_data.data();
-  }
+    if (!backend->clientUsesRdma()) {
+      rep->extra_data.resize(rep->extra_size);
+      host_ptr = (char *)rep->extra_data.data();
+    }
 #else
-  rep->extra_data.resize(rep->extra_size);
-  host_ptr = (char*)rep->extra_data.data();
+    rep->extra_data.resize(rep->extra_size);
+    host_ptr = (char *)rep->extra_data.data();
 #endif
+  }
 
   TP_READ_BUFFER_RECT(req->req.msg_id, req->req.client_did, queue_id,
                       req->req.obj_id, m.region.x, m.region.y, m.region.z,
@@ -371,9 +379,9 @@ void CommandQueue::WriteBufferRect(uint32_t queue_id, Request *req,
   COPY_VEC3(region, m.region);
 
 #ifdef ENABLE_RDMA
-  void *data = backend->clientUsesRdma() ? nullptr : req->extra_data.data();
+  void *data = backend->clientUsesRdma() ? nullptr : req->payload();
 #else
-  void *data = req->extra_data.data();
+  void *data = req->payload();
 #endif
 
   TP_WRITE_BUFFER_RECT(req->req.msg_id, req->req.client_did, queue_id,
@@ -485,14 +493,18 @@ void CommandQueue::ReadImageRect(uint32_t queue_id, Request *req, Reply *rep) {
   COPY_VEC3(img_region, m.region);
 
   rep->extra_size = m.host_bytes;
-  rep->extra_data.resize(rep->extra_size);
+  uint8_t *host_ptr = req->shared_data;
+  if (host_ptr == nullptr) {
+    rep->extra_data.resize(rep->extra_size);
+    host_ptr = rep->extra_data.data();
+  }
 
   TP_READ_IMAGE_RECT(req->req.msg_id, req->req.client_did, queue_id,
                      req->req.obj_id, m.region.x, m.region.y, m.region.z,
                      CL_RUNNING);
   RETURN_IF_ERR_CODE(backend->readImageRect(
       req->req.event_id, queue_id, req->req.obj_id, img_origin, img_region,
-      rep->extra_data.data(), m.host_bytes, evt_timing, req->req.waitlist_size, req->waitlist.data()));
+      host_ptr, m.host_bytes, evt_timing, req->req.waitlist_size, req->waitlist.data()));
   TP_READ_IMAGE_RECT(req->req.msg_id, req->req.client_did, queue_id,
                      req->req.obj_id, m.region.x, m.region.y, m.region.z,
                      CL_FINISHED);
@@ -513,7 +525,7 @@ void CommandQueue::WriteImageRect(uint32_t queue_id, Request *req, Reply *rep) {
   RETURN_IF_ERR_CODE(backend->writeImageRect(
       req->req.event_id, queue_id, req->req.obj_id, img_origin, img_region,
       // m.IMAGE_row_pitch, m.IMAGE_slice_pitch,
-      req->extra_data.data(), req->extra_size, evt_timing,
+      req->payload(), req->extra_size, evt_timing,
       req->req.waitlist_size, req->waitlist.data()));
   TP_WRITE_IMAGE_RECT(req->req.msg_id, req->req.client_did, queue_id,
                       req->req.obj_id, m.region.x, m.region.y, m.region.z,
@@ -33,6 +33,7 @@
 #include <cassert>
 #include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -305,14 +306,18 @@ struct peer_listener_data_t {
 #endif
 };
 
+class ReplyQueueThread;
+
 class Reply {
 
 public:
   ReplyMsg_t rep;
   std::unique_ptr<Request> req;
-  std::vector<uint8_t> extra_data;
+  PayloadVector extra_data;
   size_t extra_size;
   cl::Event event;
+  /** Writer the reply goes to once the event completes */
+  ReplyQueueThread *writer;
   // server host timestamps for network comm
   uint64_t write_start_timestamp_ns;
 
@@ -320,7 +325,7 @@ public:
    * actually using it is likely to lead to accessing uninitialized fields. */
   Reply() = delete;
   Reply(Request *r)
-      : rep(), req(r), extra_size(0), event(nullptr) {
+      : rep(), req(r), extra_size(0), event(nullptr), writer(nullptr) {
     assert(req.get());
     rep.client_did = req->req.client_did;
     rep.did = req->req.did;
@@ -329,6 +334,13 @@ public:
     rep.server_read_start_timestamp_ns = req->read_start_timestamp_ns;
     rep.server_read_end_timestamp_ns = req->read_end_timestamp_ns;
   }
+
+  static void *operator new(size_t Size) {
+    return ObjectPool<Reply>::allocate(Size);
+  }
+  static void operator delete(void *Ptr, size_t Size) {
+    ObjectPool<Reply>::release(Ptr, Size);
+  }
 };
 
 void replyID(Reply *rep, ReplyMessageType t, uint32_t id);
@@ -356,6 +368,7 @@ class ExitHelper {
   int requested_exit;
   mutable std::mutex exit_mutex;
   std::condition_variable exit_condvar;
+  std::vector<std::function<void()>> exit_hooks;
 
 public:
   ExitHelper() : exit_status(0), requested_exit(0){};
@@ -371,11 +384,27 @@ public:
     POCL_MSG_PRINT_GENERAL("%s : EXIT requested \n", msg);
     requested_exit = 13;
     exit_status = status;
+    std::vector<std::function<void()>> hooks;
+    hooks.swap(exit_hooks);
     lock.unlock();
     exit_condvar.notify_one();
+    for (auto &hook : hooks)
+      hook();
     return 0;
   }
 
+  /** Run hook once exit is requested, e.g. to wake up a thread sleeping on a
+   * queue. Runs it right away if exit was already requested. */
+  void onExit(std::function<void()> hook) {
+    std::unique_lock<std::mutex> lock(exit_mutex);
+    if (requested_exit > 0) {
+      lock.unlock();
+      hook();
+      return;
+    }
+    exit_hooks.push_back(std::move(hook));
+  }
+
   void waitUntilExit() {
     std::unique_lock<std::mutex> lock(exit_mutex);
 
@@ -79,12 +79,16 @@ typedef struct clKernelStruct {
 } clKernelStruct;
 typedef std::unique_ptr<clKernelStruct> clKernelStructPtr;
 
+struct CachedProgram;
+
 typedef std::unique_ptr<cl::Program> clProgramPtr;
 typedef struct clProgramStruct {
   clProgramPtr uptr;
   std::vector<cl::Device> devices;
   std::vector<cl::Kernel> prebuilt_kernels;
   std::vector<clKernelMetadata> kernel_meta;
+  /* the program cache entry of the build, holds the serialized kernel_meta */
+  std::shared_ptr<const CachedProgram> cached;
   unsigned numKernels = 0;
   bool isFakeBuiltin = false;
 } clProgramStruct;
@@ -30,6 +30,7 @@
 #include <optional>
 #include <random>
 #include <set>
+#include <sys/mman.h>
 #include <sys/poll.h>
 #include <unistd.h>
 
@@ -48,6 +49,9 @@
 #endif
 
 #include "daemon.hh"
+#ifdef HAVE_IO_URING
+#include "io_uring.hh"
+#endif
 
 #ifndef POLLRDHUP
 #define POLLRDHUP 0
@@ -213,6 +217,13 @@ int listen_rdmacm_events(rdmacm::EventChannelPtr cm_channel,
 PoclDaemon::~PoclDaemon() {
   if (ClientPoller.joinable())
     ClientPoller.join();
+  if (SharedMemoryListenFd >= 0) {
+    /* wakes up the accept() */
+    shutdown(SharedMemoryListenFd, SHUT_RDWR);
+    if (SharedMemoryListener.joinable())
+      SharedMemoryListener.join();
+    close(SharedMemoryListenFd);
+  }
   if (peer_listener_th.joinable())
     peer_listener_th.join();
 #ifdef ENABLE_RDMA
@@ -452,12 +463,69 @@ int PoclDaemon::launch(std::string ListenAddress, struct ServerPorts &Ports,
       std::move(std::thread(listen_peers, (void *)&peer_listener_data));
   }
 
+  if (!UseVsock && pocl_get_bool_option("POCLD_SHARED_MEMORY", 1)) {
+    SharedMemoryListenFd = pocl_remote_shm_listen(ListenPorts.command);
+    if (SharedMemoryListenFd < 0)
+      POCL_MSG_WARN("Could not open the local socket, shared memory is not "
+                    "available to same-host clients: %s\n",
+                    strerror(errno));
+    else
+      SharedMemoryListener = std::move(std::thread(
+          std::bind(&PoclDaemon::acceptSharedMemoryThread, this)));
+  }
+
   ClientPoller = std::move(
       std::thread(std::bind(&PoclDaemon::readAllClientSocketsThread, this)));
 
   return 0;
 }
 
+void PoclDaemon::acceptSharedMemoryThread() {
+  POCL_MSG_PRINT_GENERAL("Listening for same-host clients on port %d\n",
+                         ListenPorts.command);
+  while (!exit_helper.exit_requested()) {
+    int Fd = accept(SharedMemoryListenFd, nullptr, nullptr);
+    if (Fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;
+    }
+    int32_t Status = attachSharedMemory(Fd);
+    write_full(Fd, &Status, sizeof(Status), nullptr);
+    close(Fd);
+  }
+}
+
+int32_t PoclDaemon::attachSharedMemory(int Fd) {
+  SharedMemoryAttachMsg_t Msg;
+  int MemFd = -1;
+  if (pocl_remote_recv_fd(Fd, &Msg, sizeof(Msg), &MemFd) != 0)
+    return EPROTO;
+
+  int32_t Status = EACCES;
+  std::unique_lock<std::mutex> L(SessionListMtx);
+  auto It = SessionKeys.find(Msg.session);
+  auto CIt = ClientSessions.find(Msg.session);
+  if (It != SessionKeys.end() && CIt != ClientSessions.end() &&
+      std::memcmp(It->second.data(), Msg.authkey, AUTHKEY_LENGTH) == 0) {
+    void *Base = pocl_remote_shm_map(MemFd, Msg.size);
+    if (Base == nullptr)
+      Status = EINVAL;
+    else if (!CIt->second->attachSharedMemory(Base, Msg.size)) {
+      munmap(Base, Msg.size);
+      Status = EBUSY;
+    } else
+      Status = 0;
+  }
+  L.unlock();
+  close(MemFd);
+
+  if (Status != 0)
+    POCL_MSG_WARN("Rejected shared memory for session %" PRIu64 ": %s\n",
+                  uint64_t(Msg.session), strerror(Status));
+  return Status;
+}
+
 VirtualContextBase *PoclDaemon::performSessionSetup(int fd, Request *R) {
   std::array<uint8_t, AUTHKEY_LENGTH> authkey;
   VirtualContextBase *ctx = nullptr;
@@ -472,7 +540,10 @@ VirtualContextBase *PoclDaemon::performSessionSetup(int fd, Request *R) {
     b = dist(dice);
   }
   session = ++LastSessionId;
-  SessionKeys.insert(std::make_pair(session, authkey));
+  {
+    std::unique_lock<std::mutex> L(SessionListMtx);
+    SessionKeys.insert(std::make_pair(session, authkey));
+  }
   if (R->req.m.get_session.fast_socket) {
     connections.fd_command = fd;
     connections.fd_stream = -1;
@@ -486,6 +557,21 @@ VirtualContextBase *PoclDaemon::performSessionSetup(int fd, Request *R) {
   Reply.m.get_session.session = session;
   Reply.m.get_session.peer_port = ListenPorts.peer;
   Reply.m.get_session.use_rdma = 0;
+  /* Pick the payload codec; the choice is passed on to the virtual context
+   * through the session parameters. */
+  uint8_t Codecs = R->req.m.get_session.payload_codecs &
+                   pocl_remote_supported_codecs();
+  if (!pocl_get_bool_option("POCLD_COMPRESSION", 1))
+    Codecs = POCL_REMOTE_CODEC_NONE;
+  R->req.m.get_session.payload_codecs = (Codecs & POCL_REMOTE_CODEC_DEFLATE)
+                                            ? POCL_REMOTE_CODEC_DEFLATE
+                                            : POCL_REMOTE_CODEC_NONE;
+  Reply.m.get_session.payload_codec = R->req.m.get_session.payload_codecs;
+  Reply.m.get_session.shared_memory = SharedMemoryListenFd >= 0;
+  Reply.m.get_session.server_pid = getpid();
+  R->req.m.get_session.num_stripes = std::min<uint8_t>(
+      R->req.m.get_session.num_stripes, POCL_REMOTE_MAX_STRIPES);
+  Reply.m.get_session.num_stripes = R->req.m.get_session.num_stripes;
   memcpy(Reply.m.get_session.authkey, authkey.data(), AUTHKEY_LENGTH);
   authkey_hex =
       std::accumulate(authkey.begin(), authkey.end(), std::string(), hexdigits);
@@ -503,6 +589,7 @@ VirtualContextBase *PoclDaemon::performSessionSetup(int fd, Request *R) {
 
   if (write_full(fd, &Reply, sizeof(Reply), nullptr) < 0) {
     POCL_MSG_ERR("Error sending session creation reply, destroying session\n");
+    std::unique_lock<std::mutex> L(SessionListMtx);
     auto it = SessionKeys.find(session);
     if (it != SessionKeys.end())
       SessionKeys.erase(it);
@@ -538,20 +625,371 @@ VirtualContextBase *PoclDaemon::performSessionSetup(int fd, Request *R) {
     peer_listener_data.vctx_map.insert({session, ctx});
   }
 #endif
-  ClientSessions.insert({session, ctx});
-  ClientSessionThreads.insert(
-      {session, std::move(std::thread(startVirtualContextMainloop, ctx))});
+  {
+    std::unique_lock<std::mutex> L(SessionListMtx);
+    ClientSessions.insert({session, ctx});
+  }
+  // The session thread owns the context: once run() has returned nothing
+  // else uses it, so it is freed there instead of making the client socket
+  // thread wait for run() to notice the exit request.
+  std::thread T([this, session, ctx] {
+    startVirtualContextMainloop(ctx);
+    {
+      std::unique_lock<std::mutex> L(SessionListMtx);
+      ClientSessions.erase(session);
+      SessionKeys.erase(session);
+    }
+    delete ctx;
+  });
+  ClientSessionThreads.insert({session, std::move(T)});
   return ctx;
 }
 
+void PoclDaemon::handOverDataConnection(int Fd, Request *R) {
+  uint64_t Session = R->req.session;
+  VirtualContextBase *Ctx = nullptr;
+  {
+    std::unique_lock<std::mutex> L(SessionListMtx);
+    auto It = SessionKeys.find(Session);
+    if (It != SessionKeys.end() &&
+        std::memcmp(It->second.data(), R->req.authkey, AUTHKEY_LENGTH) == 0) {
+      auto CIt = ClientSessions.find(Session);
+      if (CIt != ClientSessions.end())
+        Ctx = CIt->second;
+    }
+  }
+
+  ReplyMsg_t Reply = {};
+  Reply.message_type = MessageType_CreateOrAttachSessionReply;
+  Reply.m.get_session.session = Session;
+  memcpy(Reply.m.get_session.authkey, R->req.authkey, AUTHKEY_LENGTH);
+  Reply.failed = Ctx == nullptr;
+  delete R;
+  /* Attached only after the reply: the connection's reader may start right
+   * away, and the reply must not race with its chunks. */
+  if (write_full(Fd, &Reply, sizeof(Reply), nullptr) < 0 || Ctx == nullptr ||
+      !Ctx->attachStripe(Fd)) {
+    POCL_MSG_ERR("Rejected a data connection for session %" PRIu64 "\n",
+                 Session);
+    close(Fd);
+  }
+}
+
+PoclDaemon::SocketAction
+PoclDaemon::dispatchRequest(int Fd, Request *R,
+                            VirtualContextBase *&SocketContext) {
+  if (R->req.message_type == MessageType_CreateOrAttachSession) {
+    int Fast = R->req.m.get_session.fast_socket;
+    uint64_t Session = R->req.session;
+    if (Session != 0 && R->req.m.get_session.stripe > 0)
+      return SocketAction::HandOver;
+    if (Session == 0) {
+      VirtualContextBase *ctx = performSessionSetup(Fd, R);
+      if (ctx == nullptr) {
+        delete R;
+        return SocketAction::Close;
+      }
+      SocketContext = ctx;
+    } else {
+      std::unique_lock<std::mutex> L(SessionListMtx);
+      auto it = SessionKeys.find(Session);
+      if (it != SessionKeys.end()) {
+        if (std::memcmp(it->second.data(), R->req.authkey, AUTHKEY_LENGTH) ==
+            0) {
+          auto cit = ClientSessions.find(Session);
+          std::optional<int> command_fd;
+          std::optional<int> stream_fd;
+          if (Fast)
+            command_fd = Fd;
+          else
+            stream_fd = Fd;
+          assert(cit != ClientSessions.end());
+          cit->second->updateSockets(command_fd, stream_fd);
+          SocketContext = cit->second;
+        }
+      }
+      L.unlock();
+      ReplyMsg_t Reply = {};
+      Reply.message_type = MessageType_CreateOrAttachSessionReply;
+      Reply.m.get_session.session = Session;
+      memcpy(Reply.m.get_session.authkey, R->req.authkey, AUTHKEY_LENGTH);
+      write_full(Fd, &Reply, sizeof(Reply), nullptr);
+    }
+    delete R;
+  } else {
+    std::unique_lock<std::mutex> LSessions(SessionListMtx);
+    auto it = ClientSessions.find(R->req.session);
+    VirtualContextBase *Ctx = it == ClientSessions.end() ? nullptr : it->second;
+    LSessions.unlock();
+    if (Ctx) {
+      switch (R->req.message_type) {
+      case MessageType_ServerInfo:
+      case MessageType_ConnectPeer:
+      case MessageType_DeviceInfo:
+      case MessageType_CreateBuffer:
+      case MessageType_FreeBuffer:
+      case MessageType_CreateCommandQueue:
+      case MessageType_FreeCommandQueue:
+      case MessageType_CreateSampler:
+      case MessageType_FreeSampler:
+      case MessageType_CreateImage:
+      case MessageType_FreeImage:
+      case MessageType_CreateKernel:
+      case MessageType_FreeKernel:
+      case MessageType_BuildProgramFromSource:
+      case MessageType_BuildProgramFromBinary:
+      case MessageType_BuildProgramFromSPIRV:
+      case MessageType_CompileProgramFromSource:
+      case MessageType_CompileProgramFromSPIRV:
+      case MessageType_BuildProgramWithBuiltins:
+      case MessageType_LinkProgram:
+      case MessageType_FreeProgram:
+      case MessageType_MigrateD2D:
+      case MessageType_RdmaBufferRegistration:
+      case MessageType_Shutdown: {
+        Ctx->nonQueuedPush(R);
+        break;
+      }
+      case MessageType_ReadBuffer:
+      case MessageType_WriteBuffer:
+      case MessageType_CopyBuffer:
+      case MessageType_FillBuffer:
+      case MessageType_ReadBufferRect:
+      case MessageType_WriteBufferRect:
+      case MessageType_CopyBufferRect:
+      case MessageType_CopyImage2Buffer:
+      case MessageType_CopyBuffer2Image:
+      case MessageType_CopyImage2Image:
+      case MessageType_ReadImageRect:
+      case MessageType_WriteImageRect:
+      case MessageType_FillImageRect:
+      case MessageType_RunKernel: {
+        Ctx->queuedPush(R);
+        break;
+      }
+      case MessageType_NotifyEvent: {
+        // TODO: this message should probably contain an actual status... (see
+        // also rdma thread)
+        Ctx->notifyEvent(R->req.event_id, CL_COMPLETE);
+        delete R;
+        break;
+      }
+
+      default: {
+        Ctx->unknownRequest(R);
+        break;
+      }
+      }
+
+    } else {
+      POCL_MSG_ERR("Client sent request for nonexistent context %" PRIu64
+                   ", ignoring \n",
+                   R->req.session);
+      delete R;
+    }
+  }
+  return SocketAction::Keep;
+}
+
+#ifdef HAVE_IO_URING
+bool PoclDaemon::readAllClientSocketsUring() {
+  /* Completions are tagged with the id of their Connection; 0 marks the
+   * cancellations whose results don't matter. */
+  struct Connection {
+    int Fd;
+    bool IsListener;
+    SocketParams Params;
+    Request *R = nullptr;
+    ReadAheadBuffer Buf{0};
+    VirtualContextBase *Ctx = nullptr;
+  };
+  constexpr uint16_t BufGroup = 0;
+  constexpr unsigned NumBufs = 256;
+  constexpr unsigned BufSize = 64 * 1024;
+
+  IoUring Ring;
+  int Err = Ring.init(256);
+  if (Err == 0)
+    Err = Ring.setupBufferRing(BufGroup, NumBufs, BufSize);
+  /* Otherwise every client connection would be dropped on its first
+   * receive. */
+  if (Err == 0)
+    Err = Ring.probeRecvMultishot();
+  if (Err != 0) {
+    POCL_MSG_WARN("Could not set up io_uring (%s), falling back to poll()\n",
+                  strerror(Err));
+    return false;
+  }
+
+  std::unordered_map<uint64_t, std::unique_ptr<Connection>> Conns;
+  uint64_t LastId = 0;
+  for (size_t i = 0; i < NumListenFds; ++i) {
+    std::unique_ptr<Connection> C(new Connection);
+    C->Fd = OpenClientFds.at(i);
+    C->IsListener = true;
+    C->Params = ListenFdParams.at(i);
+    Ring.prepAcceptMultishot(C->Fd, ++LastId);
+    Conns.insert({LastId, std::move(C)});
+  }
+  POCL_MSG_PRINT_GENERAL("Serving client sockets with io_uring\n");
+
+  /* Stops receiving on the socket of the connection and closes it, unless
+   * it's being handed over. */
+  auto dropConnection = [&](uint64_t Id, bool Close = true) {
+    auto It = Conns.find(Id);
+    Connection *C = It->second.get();
+    Ring.prepCancelFd(C->Fd, 0);
+    /* the cancellation must reach the kernel before the fd is reused */
+    Ring.submitAndWait(0);
+    if (Close)
+      close(C->Fd);
+    VirtualContextBase *VContext = C->Ctx;
+    delete C->R;
+    Conns.erase(It);
+
+    // See the TODO in readAllClientSocketsThread() about reconnects.
+    if (VContext == nullptr ||
+        pocl_get_bool_option("POCLD_ALLOW_CLIENT_RECONNECT", 0))
+      return;
+    for (auto &Other : Conns)
+      if (Other.second->Ctx == VContext)
+        return;
+    VContext->requestExit(0, "Client disconnected and reconnect not enabled.");
+  };
+
+  while (!exit_helper.exit_requested()) {
+    Err = Ring.submitAndWait(1);
+    if (Err != 0) {
+      exit_helper.requestExit(strerror(Err), Err);
+      break;
+    }
+
+    const io_uring_cqe *Cqe;
+    while ((Cqe = Ring.peekCqe()) != nullptr) {
+      uint64_t Id = Cqe->user_data;
+      int Res = Cqe->res;
+      unsigned Flags = Cqe->flags;
+      Ring.cqeSeen();
+
+      auto It = Conns.find(Id);
+      if (It == Conns.end()) {
+        /* a buffer may still be attached to a completion for a socket that
+         * has been closed in the meantime */
+        if (Flags & IORING_CQE_F_BUFFER)
+          Ring.recycleBuffer(Flags >> IORING_CQE_BUFFER_SHIFT);
+        continue;
+      }
+      Connection *C = It->second.get();
+
+      if (C->IsListener) {
+        if (Res < 0) {
+          POCL_MSG_ERR("accept failed: %s\n", strerror(-Res));
+          exit_helper.requestExit("Client listener socket closed", 0);
+          break;
+        }
+        struct sockaddr_storage ClientAddress;
+        socklen_t ClientAddressLength = sizeof(ClientAddress);
+        getpeername(Res, (struct sockaddr *)&ClientAddress,
+                    &ClientAddressLength);
+        pocl_remote_client_set_socket_options(Res, C->Params.BufSize,
+                                              C->Params.IsFast,
+                                              ClientAddress.ss_family);
+        std::string ClientAddressString = describe_sockaddr(
+            (struct sockaddr *)&ClientAddress, ClientAddressLength);
+        POCL_MSG_PRINT_INFO("Accepted client %s connection from %s\n",
+                            C->Params.IsFast ? "command" : "stream",
+                            ClientAddressString.c_str());
+
+        std::unique_ptr<Connection> NewC(new Connection);
+        NewC->Fd = Res;
+        NewC->IsListener = false;
+        NewC->R = new Request();
+        Ring.prepRecvMultishot(Res, ++LastId);
+        Conns.insert({LastId, std::move(NewC)});
+        if (!(Flags & IORING_CQE_F_MORE))
+          Ring.prepAcceptMultishot(C->Fd, Id);
+        continue;
+      }
+
+      if (Res == -ENOBUFS) {
+        /* All buffers were in use; they're handed back as soon as they've
+         * been parsed, so just try again. */
+        if (!(Flags & IORING_CQE_F_MORE))
+          Ring.prepRecvMultishot(C->Fd, Id);
+        continue;
+      }
+      if (Res <= 0) {
+        if (Res < 0)
+          POCL_MSG_ERR("Receive on fd=%d failed: %s\n", C->Fd,
+                       strerror(-Res));
+        else
+          POCL_MSG_PRINT_GENERAL("fd=%d was closed by the client\n", C->Fd);
+        if (Flags & IORING_CQE_F_BUFFER)
+          Ring.recycleBuffer(Flags >> IORING_CQE_BUFFER_SHIFT);
+        dropConnection(Id);
+        continue;
+      }
+
+      uint16_t Bid = Flags >> IORING_CQE_BUFFER_SHIFT;
+      C->Buf.feed(Ring.buffer(Bid), Res);
+      bool Alive = true;
+      Request *HandOver = nullptr;
+      while (Alive && C->Buf.available() > 0) {
+        if (!C->R->read(C->Fd, &C->Buf)) {
+          POCL_MSG_ERR("Something went wrong while reading request, closing "
+                       "connection\n");
+          Alive = false;
+        } else if (C->R->IsFullyRead) {
+          SocketAction A = dispatchRequest(C->Fd, C->R, C->Ctx);
+          if (A == SocketAction::HandOver && C->Buf.available() == 0)
+            HandOver = C->R;
+          else if (A == SocketAction::HandOver)
+            delete C->R;
+          Alive = A == SocketAction::Keep;
+          /* R is now someone else's responsibility */
+          C->R = new Request();
+        }
+      }
+      Ring.recycleBuffer(Bid);
+
+      if (HandOver) {
+        int Fd = C->Fd;
+        dropConnection(Id, false);
+        handOverDataConnection(Fd, HandOver);
+      } else if (!Alive)
+        dropConnection(Id);
+      else if (!(Flags & IORING_CQE_F_MORE))
+        Ring.prepRecvMultishot(C->Fd, Id);
+    }
+  }
+
+  for (auto &C : Conns) {
+    close(C.second->Fd);
+    delete C.second->R;
+  }
+  return true;
+}
+#endif
+
 void PoclDaemon::readAllClientSocketsThread() {
+#ifdef HAVE_IO_URING
+  const char *Engine = pocl_get_string_option("POCLD_IO_ENGINE", "poll");
+  if (strcmp(Engine, "io_uring") == 0 && readAllClientSocketsUring())
+    return;
+  else if (strcmp(Engine, "io_uring") != 0 && strcmp(Engine, "poll") != 0)
+    POCL_MSG_WARN("Unknown POCLD_IO_ENGINE '%s', using poll()\n", Engine);
+#endif
+
   std::vector<Request *> IncompleteRequests(NumListenFds, nullptr);
+  std::vector<std::unique_ptr<ReadAheadBuffer>> ReadAheadBuffers(NumListenFds);
   // Collect vctxs that were used by connections to free those that are
   // not used by any connection when reconnect is not supported.
   std::set<VirtualContextBase *> DroppedVCtxs;
   // Collect fds of closed sockets and close them in bulk at the end of the
   // loop iteration in order to keep indices in sync
   std::vector<int> DroppedFds;
+  /* Data connections to pass on once they're out of the poll list */
+  std::vector<std::pair<int, Request *>> HandedOver;
   bool FdsChanged = true;
   std::vector<struct pollfd> pfds;
 
@@ -576,7 +1014,8 @@ void PoclDaemon::readAllClientSocketsThread() {
     /* These *really* ought to stay consistent */
     assert(pfds.size() == OpenClientFds.size() &&
            SocketContexts.size() == OpenClientFds.size() &&
-           IncompleteRequests.size() == OpenClientFds.size());
+           IncompleteRequests.size() == OpenClientFds.size() &&
+           ReadAheadBuffers.size() == OpenClientFds.size());
 
     /* Just block forever. If/when a socket is closed - including the client
      * listeners - it triggers a POLLERR/POLLHUP/POLLRDHUP/POLLNVAL. */
@@ -615,6 +1054,7 @@ void PoclDaemon::readAllClientSocketsThread() {
             OpenClientFds.push_back(newfd);
             SocketContexts.push_back(nullptr);
             IncompleteRequests.push_back(new Request());
+            ReadAheadBuffers.emplace_back(new ReadAheadBuffer());
             FdsChanged = true;
             /* XXX: Set these based on CreateOrAttachSession request instead? */
             pocl_remote_client_set_socket_options(
@@ -660,125 +1100,32 @@ void PoclDaemon::readAllClientSocketsThread() {
           continue;
         }
 
-        if (ev & POLLIN) {
+        /* Parse all requests of a batch before going back to poll(); what is
+         * left in the read-ahead buffer would not wake it up again. */
+        ReadAheadBuffer *Buf = ReadAheadBuffers.at(i).get();
+        bool ReadMore = (ev & POLLIN) != 0;
+        while (ReadMore) {
+          ReadMore = false;
           Request *R = IncompleteRequests.at(i);
-          if (R->read(pfds.at(i).fd)) {
+          if (R->read(pfds.at(i).fd, Buf)) {
             if (R->IsFullyRead) {
-              if (R->req.message_type == MessageType_CreateOrAttachSession) {
-                int Fast = R->req.m.get_session.fast_socket;
-                uint64_t Session = R->req.session;
-                if (Session == 0) {
-                  VirtualContextBase *ctx =
-                      performSessionSetup(pfds.at(i).fd, R);
-                  if (ctx == nullptr) {
-                    DroppedFds.push_back(pfds.at(i).fd);
-                  } else {
-                    SocketContexts.at(i) = ctx;
-                  }
-                } else {
-                  std::unique_lock<std::mutex> L(SessionListMtx);
-                  auto it = SessionKeys.find(Session);
-                  if (it != SessionKeys.end()) {
-                    if (std::memcmp(it->second.data(), R->req.authkey,
-                                    AUTHKEY_LENGTH) == 0) {
-                      auto cit = ClientSessions.find(Session);
-                      std::optional<int> command_fd;
-                      std::optional<int> stream_fd;
-                      if (Fast)
-                        command_fd = pfds.at(i).fd;
-                      else
-                        stream_fd = pfds.at(i).fd;
-                      assert(cit != ClientSessions.end());
-                      cit->second->updateSockets(command_fd, stream_fd);
-                      SocketContexts.at(i) = cit->second;
-                    }
-                  }
-                  L.unlock();
-                  ReplyMsg_t Reply = {};
-                  Reply.message_type = MessageType_CreateOrAttachSessionReply;
-                  Reply.m.get_session.session = Session;
-                  memcpy(Reply.m.get_session.authkey, R->req.authkey,
-                         AUTHKEY_LENGTH);
-                  write_full(pfds.at(i).fd, &Reply, sizeof(Reply), nullptr);
-                }
+              SocketAction A =
+                  dispatchRequest(pfds.at(i).fd, R, SocketContexts.at(i));
+              /* The client waits for the handshake reply before using a
+               * data connection; anything already read ahead is lost. */
+              if (A == SocketAction::HandOver && Buf->available() > 0) {
                 delete R;
-              } else {
-                std::unique_lock<std::mutex> LSessions(SessionListMtx);
-                auto it = ClientSessions.find(R->req.session);
-                VirtualContextBase *Ctx =
-                    it == ClientSessions.end() ? nullptr : it->second;
-                LSessions.unlock();
-                if (Ctx) {
-                  switch (R->req.message_type) {
-                  case MessageType_ServerInfo:
-                  case MessageType_ConnectPeer:
-                  case MessageType_DeviceInfo:
-                  case MessageType_CreateBuffer:
-                  case MessageType_FreeBuffer:
-                  case MessageType_CreateCommandQueue:
-                  case MessageType_FreeCommandQueue:
-                  case MessageType_CreateSampler:
-                  case MessageType_FreeSampler:
-                  case MessageType_CreateImage:
-                  case MessageType_FreeImage:
-                  case MessageType_CreateKernel:
-                  case MessageType_FreeKernel:
-                  case MessageType_BuildProgramFromSource:
-                  case MessageType_BuildProgramFromBinary:
-                  case MessageType_BuildProgramFromSPIRV:
-                  case MessageType_CompileProgramFromSource:
-                  case MessageType_CompileProgramFromSPIRV:
-                  case MessageType_BuildProgramWithBuiltins:
-                  case MessageType_LinkProgram:
-                  case MessageType_FreeProgram:
-                  case MessageType_MigrateD2D:
-                  case MessageType_RdmaBufferRegistration:
-                  case MessageType_Shutdown: {
-                    Ctx->nonQueuedPush(R);
-                    break;
-                  }
-                  case MessageType_ReadBuffer:
-                  case MessageType_WriteBuffer:
-                  case MessageType_CopyBuffer:
-                  case MessageType_FillBuffer:
-                  case MessageType_ReadBufferRect:
-                  case MessageType_WriteBufferRect:
-                  case MessageType_CopyBufferRect:
-                  case MessageType_CopyImage2Buffer:
-                  case MessageType_CopyBuffer2Image:
-                  case MessageType_CopyImage2Image:
-                  case MessageType_ReadImageRect:
-                  case MessageType_WriteImageRect:
-                  case MessageType_FillImageRect:
-                  case MessageType_RunKernel: {
-                    Ctx->queuedPush(R);
-                    break;
-                  }
-                  case MessageType_NotifyEvent: {
-                    // TODO: this message should probably contain an actual
-                    // status... (see also rdma thread)
-                    Ctx->notifyEvent(R->req.event_id, CL_COMPLETE);
-                    delete R;
-                    break;
-                  }
-
-                  default: {
-                    Ctx->unknownRequest(R);
-                    break;
-                  }
-                  }
-
-                } else {
-                  POCL_MSG_ERR(
-                      "Client sent request for nonexistent context %" PRIu64
-                      ", ignoring \n",
-                      R->req.session);
-                  delete R;
-                }
+                A = SocketAction::Close;
               }
+              if (A == SocketAction::Close)
+                DroppedFds.push_back(pfds.at(i).fd);
+              else if (A == SocketAction::HandOver)
+                HandedOver.push_back({pfds.at(i).fd, R});
 
               /* R is now someone else's responsibility, simply "leak" it */
               IncompleteRequests.at(i) = new Request();
+              /* the client may have sent more requests in the same batch */
+              ReadMore = Buf->available() > 0 && A == SocketAction::Keep;
             }
           } else {
             POCL_MSG_ERR("Something went wrong while reading request, closing "
@@ -789,14 +1136,21 @@ void PoclDaemon::readAllClientSocketsThread() {
       }
     }
 
-    /* reap dead fds */
+    /* reap dead fds, and forget the handed over ones without closing them */
+    auto isHandedOver = [&](int Fd) {
+      return std::any_of(HandedOver.begin(), HandedOver.end(),
+                         [Fd](const auto &H) { return H.first == Fd; });
+    };
+    for (const auto &H : HandedOver)
+      DroppedFds.push_back(H.first);
     FdsChanged |= !DroppedFds.empty();
     size_t left_to_reap = DroppedFds.size();
     for (size_t i = 0; left_to_reap; ++i) {
       int fd = OpenClientFds.at(i);
       for (int d : DroppedFds) {
         if (d == fd) {
-          close(fd);
+          if (!isHandedOver(fd))
+            close(fd);
 
           // Contexts can outlive their client connection (client may reconnect
           // later) so don't destroy them here, only remove them from the socket
@@ -815,26 +1169,32 @@ void PoclDaemon::readAllClientSocketsThread() {
           std::swap(IncompleteRequests.at(i), IncompleteRequests.back());
           delete IncompleteRequests.back();
           IncompleteRequests.pop_back();
+
+          std::swap(ReadAheadBuffers.at(i), ReadAheadBuffers.back());
+          ReadAheadBuffers.pop_back();
           --i;
           --left_to_reap;
         }
       }
     }
     DroppedFds.clear();
+    for (const auto &H : HandedOver)
+      handOverDataConnection(H.first, H.second);
+    HandedOver.clear();
 
     // TODO: The reconnect should have a time window as it holds resources.
     // Especially with SVM on, it will hold the SVMPool which can be a large
     // chunk of virt mem. Let's not enable reconnect by default until this is
     // sanitized.
     if (!pocl_get_bool_option("POCLD_ALLOW_CLIENT_RECONNECT", 0)) {
-      // Free unusued vctxs if reconnect is not enabled.
+      // Stop unusued vctxs if reconnect is not enabled; their session
+      // threads free them.
       for (auto VContext : DroppedVCtxs) {
         if (std::find(SocketContexts.begin(), SocketContexts.end(), VContext) !=
             SocketContexts.end())
           continue;
         VContext->requestExit(0,
                               "Client disconnected and reconnect not enabled.");
-        delete VContext;
       }
     }
     DroppedVCtxs.clear();
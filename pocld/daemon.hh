@@ -107,6 +107,41 @@ public:
    */
   void readAllClientSocketsThread();
 
+#ifdef HAVE_IO_URING
+  /**
+   * io_uring variant of `readAllClientSocketsThread()`, used when
+   * POCLD_IO_ENGINE=io_uring. Instead of rebuilding a pollfd list and reading
+   * each request in small steps, it keeps a multishot accept armed on the
+   * listener sockets and a multishot receive on each client socket. The
+   * receives land in a ring of provided buffers registered with the kernel,
+   * from which the requests are parsed directly. Returns false without
+   * doing anything if the ring can't be set up, e.g. because io_uring is
+   * disabled on the host.
+   */
+  bool readAllClientSocketsUring();
+#endif
+
+  /** What the reading loop does with a client socket after a request */
+  enum class SocketAction {
+    Keep,
+    Close,
+    /** Stop reading the socket, without closing it, and pass it and the
+     * request to handOverDataConnection() */
+    HandOver
+  };
+
+  /** Hands a fully read request from the client socket Fd over to its
+   * virtual context, or performs the session setup. SocketContext is set to
+   * the context the socket gets associated with. */
+  SocketAction dispatchRequest(int Fd, Request *R,
+                               VirtualContextBase *&SocketContext);
+
+  /** Answers the handshake R of a data connection and gives the connection
+   * to its session. The answer is only sent once the socket has left the
+   * reading loop, so that nothing the client sends after it can end up
+   * there. */
+  void handOverDataConnection(int Fd, Request *R);
+
   /** Block until the main I/O thread exits. */
   void waitForExit() {
     if (ClientPoller.joinable())
@@ -116,6 +151,17 @@ public:
   /* returns nullptr on error */
   VirtualContextBase *performSessionSetup(int fd, Request *R);
 
+  /**
+   * Main function of the local socket thread. Accepts connections from
+   * clients running on the same host, which pass in a memfd to use as the
+   * shared memory window of their session. The fd is mapped and handed to
+   * the session's virtual context if the session key matches.
+   */
+  void acceptSharedMemoryThread();
+
+  /** Maps the window received on Fd. Returns 0 or an errno value. */
+  int32_t attachSharedMemory(int Fd);
+
 private:
   ExitHelper exit_helper;
   /** Port numbers that the server is listening on */
@@ -133,6 +179,9 @@ private:
   std::unordered_map<uint64_t, std::array<uint8_t, AUTHKEY_LENGTH>> SessionKeys;
   std::atomic_uint64_t LastSessionId;
   std::thread ClientPoller;
+  /** Local (unix) socket for same-host clients, -1 if not listening */
+  int SharedMemoryListenFd = -1;
+  std::thread SharedMemoryListener;
   peer_listener_data_t peer_listener_data;
   std::thread peer_listener_th;
 #ifdef ENABLE_RDMA
@@ -24,49 +24,256 @@
 #ifndef POCL_REMOTE_REQUEST_QUEUE_HH
 #define POCL_REMOTE_REQUEST_QUEUE_HH
 
-#include <chrono>
-#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <memory>
 #include <mutex>
-#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#endif
 
 #ifdef __GNUC__
 #pragma GCC visibility push(hidden)
 #endif
 
+/**
+ * A counter that threads can sleep on until it changes. Wakers only enter
+ * the kernel when somebody is actually sleeping.
+ */
+class WaitWord {
+  std::atomic<uint32_t> Value{0};
+  std::atomic<uint32_t> Sleepers{0};
+#ifndef __linux__
+  std::mutex M;
+  std::condition_variable Cond;
+#endif
+
+public:
+  /** Returns the value to pass to wait(); take it before checking whatever
+   * condition is about to be waited for. */
+  uint32_t ticket() const { return Value.load(); }
+
+  /** Sleeps until the value differs from Ticket. */
+  void wait(uint32_t Ticket) {
+    Sleepers.fetch_add(1);
+#ifdef __linux__
+    while (Value.load() == Ticket)
+      syscall(SYS_futex, reinterpret_cast<uint32_t *>(&Value),
+              FUTEX_WAIT_PRIVATE, Ticket, nullptr, nullptr, 0);
+#else
+    {
+      std::unique_lock<std::mutex> Lock(M);
+      while (Value.load() == Ticket)
+        Cond.wait(Lock);
+    }
+#endif
+    Sleepers.fetch_sub(1);
+  }
+
+  /** Changes the value and wakes up everyone sleeping on it. */
+  void bump() {
+    Value.fetch_add(1);
+    if (Sleepers.load() == 0)
+      return;
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&Value), FUTEX_WAKE_PRIVATE,
+            INT_MAX, nullptr, nullptr, 0);
+#else
+    { std::unique_lock<std::mutex> Lock(M); }
+    Cond.notify_all();
+#endif
+  }
+};
+
+/**
+ * Bounded multi-producer, single-consumer queue. Producers claim a slot with
+ * a CAS on the enqueue position and publish it through the slot's sequence
+ * number (D. Vyukov's bounded queue), so neither side takes a lock. An idle
+ * consumer sleeps in wait_cond() until something is pushed, and producers
+ * that find the queue full sleep until the consumer frees up slots; there is
+ * no timed polling on either side. Producers that must not sleep use
+ * pushNoWait(), which spills into a locked overflow list instead. Only one
+ * thread may pop.
+ */
 template <class T> class GuardedQueue {
-  std::deque<T> q;
-  std::mutex m;
-  std::condition_variable cond;
+  struct Slot {
+    std::atomic<size_t> Seq;
+    T Item;
+  };
+  std::unique_ptr<Slot[]> Slots;
+  size_t Mask;
+  alignas(64) std::atomic<size_t> EnqueuePos{0};
+  /** Only touched by the consumer */
+  alignas(64) size_t DequeuePos = 0;
+  alignas(64) WaitWord NotEmpty;
+  WaitWord NotFull;
+  std::atomic<bool> Closed{false};
+  /** Items pushed by pushNoWait() while the ring was full */
+  std::mutex OverflowMtx;
+  std::deque<T> Overflow;
+  std::atomic<size_t> OverflowSize{0};
+
+  bool tryPush(T &Item) {
+    size_t Pos = EnqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &S = Slots[Pos & Mask];
+      size_t Seq = S.Seq.load(std::memory_order_acquire);
+      intptr_t Diff = intptr_t(Seq) - intptr_t(Pos);
+      if (Diff == 0) {
+        if (EnqueuePos.compare_exchange_weak(Pos, Pos + 1,
+                                             std::memory_order_relaxed)) {
+          S.Item = Item;
+          S.Seq.store(Pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (Diff < 0)
+        return false;
+      else
+        Pos = EnqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  bool tryPop(T &Item) {
+    Slot &S = Slots[DequeuePos & Mask];
+    if (S.Seq.load(std::memory_order_acquire) != DequeuePos + 1)
+      return false;
+    Item = S.Item;
+    S.Seq.store(DequeuePos + Mask + 1, std::memory_order_release);
+    ++DequeuePos;
+    return true;
+  }
+
+  bool tryPopOverflow(T &Item) {
+    if (OverflowSize.load() == 0)
+      return false;
+    std::lock_guard<std::mutex> Lock(OverflowMtx);
+    if (Overflow.empty())
+      return false;
+    Item = Overflow.front();
+    Overflow.pop_front();
+    OverflowSize.fetch_sub(1);
+    return true;
+  }
 
 public:
+  /** Capacity is rounded up to a power of two. */
+  explicit GuardedQueue(size_t Capacity = 1024) {
+    size_t Size = 2;
+    while (Size < Capacity)
+      Size *= 2;
+    Slots.reset(new Slot[Size]);
+    for (size_t i = 0; i < Size; ++i)
+      Slots[i].Seq.store(i, std::memory_order_relaxed);
+    Mask = Size - 1;
+  }
+
+  /** Drops everything queued. Consumer only. */
   void reset() {
-    std::unique_lock<std::mutex> lock(m);
-    q = std::deque<T>();
+    T Item;
+    while (tryPop(Item) || tryPopOverflow(Item))
+      ;
+    NotFull.bump();
   }
-  void push(T item) {
-    {
-      std::unique_lock<std::mutex> lock(m);
-      q.push_front(item);
+
+  /** Queues Item, sleeping while the queue is full. Returns false without
+   * queueing Item once close() has been called; the caller still owns it
+   * then. Items pushed concurrently with close() may never be popped. */
+  bool push(T item) {
+    while (true) {
+      if (Closed.load())
+        return false;
+      uint32_t Ticket = NotFull.ticket();
+      if (tryPush(item))
+        break;
+      NotFull.wait(Ticket);
     }
-    cond.notify_one();
+    NotEmpty.bump();
+    return true;
   }
+
+  /** Like push() but never sleeps: if the ring is full, Item goes to the
+   * unbounded overflow list, which the consumer drains after the ring. The
+   * order relative to items pushed into the ring is not kept. */
+  bool pushNoWait(T item) {
+    if (Closed.load())
+      return false;
+    if (!tryPush(item)) {
+      std::lock_guard<std::mutex> Lock(OverflowMtx);
+      Overflow.push_back(item);
+      OverflowSize.fetch_add(1);
+    }
+    NotEmpty.bump();
+    return true;
+  }
+
+  /** Returns the oldest item or nullptr if there is none. */
   T pop() {
-    std::unique_lock<std::mutex> lock(m);
-    if (q.empty())
-      return nullptr;
-    else {
-      T tmp = q.back();
-      q.pop_back();
-      return tmp;
+    T Item;
+    if (tryPop(Item)) {
+      NotFull.bump();
+      return Item;
     }
+    if (tryPopOverflow(Item))
+      return Item;
+    return nullptr;
   }
+
+  /** Appends up to Max of the oldest items to Out and returns their
+   * number. */
+  size_t popBatch(std::vector<T> &Out, size_t Max = SIZE_MAX) {
+    size_t N = 0;
+    T Item;
+    while (N < Max && tryPop(Item)) {
+      Out.push_back(Item);
+      ++N;
+    }
+    if (N > 0)
+      NotFull.bump();
+    while (N < Max && tryPopOverflow(Item)) {
+      Out.push_back(Item);
+      ++N;
+    }
+    return N;
+  }
+
+  /** Returns the ticket for wait_cond(); take it before checking anything
+   * else the consumer is about to wait for. */
+  uint32_t ticket() const { return NotEmpty.ticket(); }
+
+  /** Sleeps until something is pushed, or wake() or close() is called,
+   * after Ticket was taken. Doesn't look at what's already queued. */
+  void wait_cond(uint32_t Ticket) {
+    if (!Closed.load())
+      NotEmpty.wait(Ticket);
+  }
+
+  /** Sleeps until the queue is not empty, or until wake() or close() is
+   * called. */
   void wait_cond() {
-    auto now = std::chrono::system_clock::now();
-    std::chrono::duration<unsigned long> d(3);
-    now += d;
-    std::unique_lock<std::mutex> lock(m);
-    cond.wait_until(lock, now);
+    uint32_t Ticket = ticket();
+    if (Slots[DequeuePos & Mask].Seq.load(std::memory_order_acquire) !=
+            DequeuePos + 1 &&
+        OverflowSize.load() == 0)
+      wait_cond(Ticket);
+  }
+
+  /** Makes the consumer's wait_cond() return. */
+  void wake() { NotEmpty.bump(); }
+
+  /** Wakes up everyone for good, e.g. when the consumer is exiting. */
+  void close() {
+    Closed.store(true);
+    NotEmpty.bump();
+    NotFull.bump();
   }
 };
 
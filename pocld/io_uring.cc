@@ -0,0 +1,279 @@
+/* io_uring.cc - minimal io_uring wrapper for the pocld networking engine
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "io_uring.hh"
+
+static int sysSetup(unsigned Entries, io_uring_params *P) {
+  return (int)syscall(__NR_io_uring_setup, Entries, P);
+}
+
+static int sysEnter(int Fd, unsigned ToSubmit, unsigned MinComplete,
+                    unsigned Flags) {
+  return (int)syscall(__NR_io_uring_enter, Fd, ToSubmit, MinComplete, Flags,
+                      nullptr, 0);
+}
+
+static int sysRegister(int Fd, unsigned Opcode, void *Arg, unsigned NrArgs) {
+  return (int)syscall(__NR_io_uring_register, Fd, Opcode, Arg, NrArgs);
+}
+
+template <typename T> static T *ringPtr(void *Ring, uint32_t Offset) {
+  return reinterpret_cast<T *>(static_cast<char *>(Ring) + Offset);
+}
+
+IoUring::~IoUring() {
+  if (Fd >= 0)
+    close(Fd);
+  if (BufRing)
+    munmap(BufRing, BufRingSize);
+  if (BufMem)
+    munmap(BufMem, BufMemSize);
+  if (Sqes)
+    munmap(Sqes, SqesSize);
+  if (CqRing && CqRing != SqRing)
+    munmap(CqRing, CqRingSize);
+  if (SqRing)
+    munmap(SqRing, SqRingSize);
+}
+
+int IoUring::init(unsigned Entries) {
+  io_uring_params P;
+  std::memset(&P, 0, sizeof(P));
+  /* Only the engine thread submits; let the kernel skip the IPIs for task
+   * work. Older kernels reject the flags, try again without them. */
+  P.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+  Fd = sysSetup(Entries, &P);
+  if (Fd < 0 && errno == EINVAL) {
+    std::memset(&P, 0, sizeof(P));
+    Fd = sysSetup(Entries, &P);
+  }
+  if (Fd < 0)
+    return errno;
+
+  SqRingSize = P.sq_off.array + P.sq_entries * sizeof(unsigned);
+  CqRingSize = P.cq_off.cqes + P.cq_entries * sizeof(io_uring_cqe);
+  if (P.features & IORING_FEAT_SINGLE_MMAP) {
+    if (CqRingSize > SqRingSize)
+      SqRingSize = CqRingSize;
+    CqRingSize = SqRingSize;
+  }
+
+  SqRing = mmap(nullptr, SqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQ_RING);
+  if (SqRing == MAP_FAILED) {
+    SqRing = nullptr;
+    return errno;
+  }
+  if (P.features & IORING_FEAT_SINGLE_MMAP)
+    CqRing = SqRing;
+  else {
+    CqRing = mmap(nullptr, CqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_CQ_RING);
+    if (CqRing == MAP_FAILED) {
+      CqRing = nullptr;
+      return errno;
+    }
+  }
+
+  SqesSize = P.sq_entries * sizeof(io_uring_sqe);
+  void *S = mmap(nullptr, SqesSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQES);
+  if (S == MAP_FAILED)
+    return errno;
+  Sqes = static_cast<io_uring_sqe *>(S);
+
+  SqHead = ringPtr<unsigned>(SqRing, P.sq_off.head);
+  SqTail = ringPtr<unsigned>(SqRing, P.sq_off.tail);
+  SqMask = *ringPtr<unsigned>(SqRing, P.sq_off.ring_mask);
+  SqEntries = *ringPtr<unsigned>(SqRing, P.sq_off.ring_entries);
+  SqArray = ringPtr<unsigned>(SqRing, P.sq_off.array);
+
+  CqHead = ringPtr<unsigned>(CqRing, P.cq_off.head);
+  CqTail = ringPtr<unsigned>(CqRing, P.cq_off.tail);
+  CqMask = *ringPtr<unsigned>(CqRing, P.cq_off.ring_mask);
+  Cqes = ringPtr<io_uring_cqe>(CqRing, P.cq_off.cqes);
+  return 0;
+}
+
+int IoUring::setupBufferRing(uint16_t Group, unsigned NumBufs,
+                             unsigned Size) {
+  if (NumBufs == 0 || (NumBufs & (NumBufs - 1)) != 0 || NumBufs > 32768)
+    return EINVAL;
+
+  BufRingSize = NumBufs * sizeof(io_uring_buf);
+  void *R = mmap(nullptr, BufRingSize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (R == MAP_FAILED)
+    return errno;
+  BufRing = static_cast<io_uring_buf_ring *>(R);
+
+  BufMemSize = size_t(NumBufs) * Size;
+  void *M = mmap(nullptr, BufMemSize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (M == MAP_FAILED)
+    return errno;
+  BufMem = static_cast<uint8_t *>(M);
+  BufSize = Size;
+  BufMask = NumBufs - 1;
+  BufGroup = Group;
+
+  io_uring_buf_reg Reg;
+  std::memset(&Reg, 0, sizeof(Reg));
+  Reg.ring_addr = reinterpret_cast<uint64_t>(BufRing);
+  Reg.ring_entries = NumBufs;
+  Reg.bgid = Group;
+  if (sysRegister(Fd, IORING_REGISTER_PBUF_RING, &Reg, 1) < 0)
+    return errno;
+
+  BufRing->tail = 0;
+  for (unsigned i = 0; i < NumBufs; ++i)
+    recycleBuffer(i);
+  return 0;
+}
+
+void IoUring::recycleBuffer(uint16_t Bid) {
+  /* only this thread writes the tail, the kernel just reads it */
+  uint16_t Tail = BufRing->tail;
+  /* Not BufRing->bufs: in C++ the kernel's flexible array wrapper adds an
+   * empty struct in front of it, which shifts the entries. */
+  io_uring_buf *B =
+      reinterpret_cast<io_uring_buf *>(BufRing) + (Tail & BufMask);
+  B->addr = reinterpret_cast<uint64_t>(buffer(Bid));
+  B->len = BufSize;
+  B->bid = Bid;
+  __atomic_store_n(&BufRing->tail, uint16_t(Tail + 1), __ATOMIC_RELEASE);
+}
+
+io_uring_sqe *IoUring::getSqe() {
+  unsigned Head = __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+  unsigned Tail = *SqTail + SqPending;
+  if (Tail - Head >= SqEntries) {
+    /* full, pass what we have to the kernel to make room */
+    if (submitAndWait(0) != 0)
+      return nullptr;
+    Head = __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+    Tail = *SqTail;
+    if (Tail - Head >= SqEntries)
+      return nullptr;
+  }
+  unsigned Idx = Tail & SqMask;
+  io_uring_sqe *Sqe = &Sqes[Idx];
+  std::memset(Sqe, 0, sizeof(*Sqe));
+  SqArray[Idx] = Idx;
+  ++SqPending;
+  return Sqe;
+}
+
+bool IoUring::prepAcceptMultishot(int ListenFd, uint64_t UserData) {
+  io_uring_sqe *Sqe = getSqe();
+  if (!Sqe)
+    return false;
+  Sqe->opcode = IORING_OP_ACCEPT;
+  Sqe->fd = ListenFd;
+  Sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  Sqe->user_data = UserData;
+  return true;
+}
+
+bool IoUring::prepRecvMultishot(int SockFd, uint64_t UserData) {
+  io_uring_sqe *Sqe = getSqe();
+  if (!Sqe)
+    return false;
+  Sqe->opcode = IORING_OP_RECV;
+  Sqe->fd = SockFd;
+  Sqe->ioprio = IORING_RECV_MULTISHOT;
+  Sqe->flags = IOSQE_BUFFER_SELECT;
+  Sqe->buf_group = BufGroup;
+  Sqe->user_data = UserData;
+  return true;
+}
+
+int IoUring::probeRecvMultishot() {
+  /* A receive on a socket whose peer is gone completes at once, with EOF
+   * where the flag is understood. */
+  int Pair[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, Pair) < 0)
+    return errno;
+  close(Pair[1]);
+  int Err = prepRecvMultishot(Pair[0], 0) ? submitAndWait(1) : EBUSY;
+  if (Err == 0) {
+    const io_uring_cqe *Cqe = peekCqe();
+    if (Cqe == nullptr)
+      Err = EIO;
+    else {
+      if (Cqe->res < 0)
+        Err = -Cqe->res;
+      if (Cqe->flags & IORING_CQE_F_BUFFER)
+        recycleBuffer(Cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      cqeSeen();
+    }
+  }
+  close(Pair[0]);
+  return Err;
+}
+
+bool IoUring::prepCancelFd(int SockFd, uint64_t UserData) {
+  io_uring_sqe *Sqe = getSqe();
+  if (!Sqe)
+    return false;
+  Sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  Sqe->fd = SockFd;
+  Sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  Sqe->user_data = UserData;
+  return true;
+}
+
+int IoUring::submitAndWait(unsigned WaitNr) {
+  unsigned ToSubmit = SqPending;
+  __atomic_store_n(SqTail, *SqTail + SqPending, __ATOMIC_RELEASE);
+  SqPending = 0;
+  while (true) {
+    int Ret = sysEnter(Fd, ToSubmit, WaitNr,
+                       WaitNr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if (Ret >= 0)
+      return 0;
+    /* The kernel only takes what's in the ring, so retrying with the same
+     * count can't submit anything twice. */
+    if (errno != EINTR)
+      return errno;
+  }
+}
+
+const io_uring_cqe *IoUring::peekCqe() {
+  unsigned Head = *CqHead;
+  if (Head == __atomic_load_n(CqTail, __ATOMIC_ACQUIRE))
+    return nullptr;
+  return &Cqes[Head & CqMask];
+}
+
+void IoUring::cqeSeen() {
+  __atomic_store_n(CqHead, *CqHead + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,123 @@
+/* io_uring.hh - minimal io_uring wrapper for the pocld networking engine
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#ifndef POCLD_IO_URING_HH
+#define POCLD_IO_URING_HH
+
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+
+#ifdef __GNUC__
+#pragma GCC visibility push(hidden)
+#endif
+
+/**
+ * A single-threaded io_uring instance with one provided buffer ring, talking
+ * to the kernel directly through the raw syscalls so that pocld doesn't
+ * depend on liburing. Only what the client socket engine needs is here:
+ * multishot accept & receive, cancellation and the buffer ring that the
+ * multishot receives pick their buffers from.
+ */
+class IoUring {
+public:
+  IoUring() = default;
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+  ~IoUring();
+
+  /** Sets up a ring with room for Entries submissions. Returns 0 or an
+   * errno value, e.g. ENOSYS or EPERM where io_uring is unavailable. */
+  int init(unsigned Entries);
+
+  /** Registers NumBufs (a power of two) buffers of BufSize bytes each as
+   * buffer group Group. Returns 0 or an errno value. */
+  int setupBufferRing(uint16_t Group, unsigned NumBufs, unsigned BufSize);
+
+  /** Checks that the kernel supports multishot receives, which came after
+   * the provided buffer rings; older kernels fail each one with EINVAL.
+   * Needs the buffer ring and an empty completion queue. Returns 0 or an
+   * errno value. */
+  int probeRecvMultishot();
+
+  /** Queues a multishot accept on the listening socket Fd. */
+  bool prepAcceptMultishot(int Fd, uint64_t UserData);
+  /** Queues a multishot receive on Fd into the provided buffers. */
+  bool prepRecvMultishot(int Fd, uint64_t UserData);
+  /** Queues cancellation of all requests that operate on Fd. */
+  bool prepCancelFd(int Fd, uint64_t UserData);
+
+  /** Submits the queued requests and waits for at least WaitNr
+   * completions. Returns 0 or an errno value. */
+  int submitAndWait(unsigned WaitNr);
+
+  /** Returns the oldest unseen completion, or nullptr. */
+  const io_uring_cqe *peekCqe();
+  /** Marks the completion returned by peekCqe() as consumed. */
+  void cqeSeen();
+
+  /** Contents of the provided buffer Bid */
+  uint8_t *buffer(uint16_t Bid) { return BufMem + size_t(Bid) * BufSize; }
+  /** Hands buffer Bid back to the kernel for new receives. */
+  void recycleBuffer(uint16_t Bid);
+
+private:
+  io_uring_sqe *getSqe();
+
+  int Fd = -1;
+
+  void *SqRing = nullptr;
+  size_t SqRingSize = 0;
+  void *CqRing = nullptr;
+  size_t CqRingSize = 0;
+  io_uring_sqe *Sqes = nullptr;
+  size_t SqesSize = 0;
+
+  unsigned *SqHead = nullptr;
+  unsigned *SqTail = nullptr;
+  unsigned SqMask = 0;
+  unsigned SqEntries = 0;
+  unsigned *SqArray = nullptr;
+  /** SQEs handed out by getSqe() but not yet passed to the kernel */
+  unsigned SqPending = 0;
+
+  unsigned *CqHead = nullptr;
+  unsigned *CqTail = nullptr;
+  unsigned CqMask = 0;
+  io_uring_cqe *Cqes = nullptr;
+
+  io_uring_buf_ring *BufRing = nullptr;
+  size_t BufRingSize = 0;
+  uint8_t *BufMem = nullptr;
+  size_t BufMemSize = 0;
+  unsigned BufSize = 0;
+  unsigned BufMask = 0;
+  uint16_t BufGroup = 0;
+};
+
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
+#endif
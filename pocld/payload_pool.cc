@@ -0,0 +1,152 @@
+/* payload_pool.cc - recycling of pocld's payload buffers
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+
+#include "payload_pool.hh"
+#include "pocl_debug.h"
+#include "pocl_runtime_config.h"
+
+/* 4 KiB ... 256 MiB, in four steps per power of two so that rounding up
+ * wastes less than a fifth of a block. Smaller blocks come from malloc,
+ * larger ones are mapped and unmapped on every use. */
+static constexpr unsigned MinClassShift = 12;
+static constexpr unsigned MaxClassShift = 28;
+static constexpr unsigned NumClasses = (MaxClassShift - MinClassShift + 1) * 4;
+
+namespace {
+
+struct SizeClass {
+  std::mutex Mutex;
+  std::vector<void *> Free;
+};
+
+struct PoolState {
+  SizeClass Classes[NumClasses];
+  std::atomic<size_t> CachedBytes{0};
+  size_t Limit;
+  bool Pin;
+  std::atomic_flag PinWarned = ATOMIC_FLAG_INIT;
+
+  PoolState() {
+    Limit = size_t(pocl_get_int_option("POCLD_PAYLOAD_POOL_SIZE", 256)) << 20;
+    Pin = pocl_get_bool_option("POCLD_PAYLOAD_POOL_PIN", 0);
+  }
+};
+
+} // namespace
+
+/* Never destroyed: reply threads may still release blocks while the
+ * process exits. */
+static PoolState &state() {
+  static PoolState *S = new PoolState;
+  return *S;
+}
+
+/* Returns the size class of a block of at least 4 KiB, or -1 if it's too
+ * large to be pooled. BlockSize is set to the size of the blocks of the
+ * class. */
+static int sizeClass(size_t Size, size_t &BlockSize) {
+  unsigned Shift = 64 - __builtin_clzll((unsigned long long)(Size - 1));
+  if (Shift > MaxClassShift) {
+    BlockSize = Size;
+    return -1;
+  }
+  /* Size is in (2^(Shift-1), 2^Shift], i.e. 5..8 steps of 2^(Shift-3) */
+  size_t Step = size_t(1) << (Shift - 3);
+  size_t Steps = (Size + Step - 1) / Step;
+  BlockSize = Steps * Step;
+  return int(Shift - MinClassShift) * 4 + int(Steps - 5);
+}
+
+static void *mapBlock(size_t Size) {
+  PoolState &S = state();
+  int Flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (S.Pin)
+    Flags |= MAP_POPULATE;
+  void *Ptr = mmap(nullptr, Size, PROT_READ | PROT_WRITE, Flags, -1, 0);
+  if (Ptr == MAP_FAILED)
+    throw std::bad_alloc();
+  if (S.Pin && mlock(Ptr, Size) != 0 && !S.PinWarned.test_and_set())
+    POCL_MSG_WARN("Could not pin payload buffers (%s), check the "
+                  "RLIMIT_MEMLOCK of pocld\n",
+                  strerror(errno));
+  return Ptr;
+}
+
+void *PayloadPool::allocate(size_t Size) {
+  if (Size < (size_t(1) << MinClassShift)) {
+    void *Ptr = std::malloc(Size ? Size : 1);
+    if (Ptr == nullptr)
+      throw std::bad_alloc();
+    return Ptr;
+  }
+
+  size_t BlockSize;
+  int Class = sizeClass(Size, BlockSize);
+  if (Class < 0)
+    return mapBlock(BlockSize);
+
+  PoolState &S = state();
+  SizeClass &C = S.Classes[Class];
+  {
+    std::unique_lock<std::mutex> Lock(C.Mutex);
+    if (!C.Free.empty()) {
+      void *Ptr = C.Free.back();
+      C.Free.pop_back();
+      S.CachedBytes -= BlockSize;
+      return Ptr;
+    }
+  }
+  return mapBlock(BlockSize);
+}
+
+void PayloadPool::release(void *Ptr, size_t Size) {
+  if (Ptr == nullptr)
+    return;
+  if (Size < (size_t(1) << MinClassShift)) {
+    std::free(Ptr);
+    return;
+  }
+
+  size_t BlockSize;
+  int Class = sizeClass(Size, BlockSize);
+  if (Class < 0) {
+    munmap(Ptr, BlockSize);
+    return;
+  }
+
+  PoolState &S = state();
+  if (S.CachedBytes.fetch_add(BlockSize) + BlockSize <= S.Limit) {
+    SizeClass &C = S.Classes[Class];
+    std::unique_lock<std::mutex> Lock(C.Mutex);
+    C.Free.push_back(Ptr);
+    return;
+  }
+  S.CachedBytes -= BlockSize;
+  munmap(Ptr, BlockSize);
+}
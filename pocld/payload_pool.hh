@@ -0,0 +1,126 @@
+/* payload_pool.hh - recycling of pocld's message objects and payload buffers
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#ifndef POCLD_PAYLOAD_POOL_HH
+#define POCLD_PAYLOAD_POOL_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#ifdef __GNUC__
+#pragma GCC visibility push(hidden)
+#endif
+
+/**
+ * Size-classed cache of the buffers backing request and reply payloads.
+ * Blocks of at least 4 KiB are rounded up to one of four sizes per power of
+ * two and handed back to a per-class free list when released, so a steady
+ * stream of transfers reuses the same, already faulted-in pages instead of
+ * going through
+ * malloc/mmap and page faults for every message. The total size of the
+ * cached blocks is limited by POCLD_PAYLOAD_POOL_SIZE (MiB). With
+ * POCLD_PAYLOAD_POOL_PIN=1 the pooled blocks are also locked into RAM.
+ */
+class PayloadPool {
+public:
+  /** Returns a block of at least Size bytes; throws std::bad_alloc. */
+  static void *allocate(size_t Size);
+  /** Returns a block obtained with allocate(Size) to the pool. */
+  static void release(void *Ptr, size_t Size);
+};
+
+/** std::allocator replacement that takes its memory from PayloadPool */
+template <class T> struct PayloadAllocator {
+  typedef T value_type;
+
+  PayloadAllocator() noexcept = default;
+  template <class U> PayloadAllocator(const PayloadAllocator<U> &) noexcept {}
+
+  T *allocate(size_t N) {
+    return static_cast<T *>(PayloadPool::allocate(N * sizeof(T)));
+  }
+  void deallocate(T *Ptr, size_t N) noexcept {
+    PayloadPool::release(Ptr, N * sizeof(T));
+  }
+
+  template <class U> bool operator==(const PayloadAllocator<U> &) const {
+    return true;
+  }
+  template <class U> bool operator!=(const PayloadAllocator<U> &) const {
+    return false;
+  }
+};
+
+/** Payload of a Request or Reply */
+typedef std::vector<uint8_t, PayloadAllocator<uint8_t>> PayloadVector;
+
+/**
+ * Free list of objects of class T, for classes that route their operator
+ * new/delete here. pocld allocates a Request and a Reply for every message;
+ * keeping a few hundred of them around takes the allocator out of the
+ * per-message path.
+ */
+template <class T> class ObjectPool {
+  static constexpr size_t MaxCached = 256;
+  inline static std::mutex Mutex;
+  inline static std::vector<void *> Free;
+
+public:
+  static void *allocate(size_t Size) {
+    if (Size == sizeof(T)) {
+      std::unique_lock<std::mutex> Lock(Mutex);
+      if (!Free.empty()) {
+        void *Ptr = Free.back();
+        Free.pop_back();
+        return Ptr;
+      }
+    }
+    void *Ptr = std::malloc(Size);
+    if (Ptr == nullptr)
+      throw std::bad_alloc();
+    return Ptr;
+  }
+
+  static void release(void *Ptr, size_t Size) {
+    if (Ptr == nullptr)
+      return;
+    if (Size == sizeof(T)) {
+      std::unique_lock<std::mutex> Lock(Mutex);
+      if (Free.size() < MaxCached) {
+        Free.push_back(Ptr);
+        return;
+      }
+    }
+    std::free(Ptr);
+  }
+};
+
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
+#endif
@@ -58,12 +58,20 @@ Peer::Peer(uint64_t id, uint32_t handler_id, VirtualContextBase *ctx,
                             rdma, &local_memory_regions, &local_regions_mutex));
   rdma_writer = std::thread(&Peer::rdmaWriterThread, this);
 #endif
+  eh->onExit([this] {
+    out_queue.close();
+#ifdef ENABLE_RDMA
+    rdma_out_queue.close();
+#endif
+  });
   reader = RequestQueueThreadUPtr(new RequestQueueThread(
       &this->fd, ctx, eh, netstat, (ss.str() + "_R").c_str()));
   writer = std::thread(&Peer::writerThread, this);
 }
 
 Peer::~Peer() {
+  /* wakes up the reader from poll() */
+  shutdown(fd, SHUT_RDWR);
   reader.reset();
   if (writer.joinable())
     writer.join();
@@ -72,15 +80,21 @@ Peer::~Peer() {
   if (rdma_writer.joinable())
     rdma_writer.join();
 #endif
+  close(fd);
 }
 
 void Peer::pushRequest(Request *r) {
+  /* Called from the session threads and the client socket readers, which
+   * must not wait for the writer. The queues only refuse once closed. */
+  bool queued;
 #ifdef ENABLE_RDMA
   if (pocl_request_is_rdma(&r->req, 1))
-    rdma_out_queue.push(r);
+    queued = rdma_out_queue.pushNoWait(r);
   else
 #endif
-    out_queue.push(r);
+    queued = out_queue.pushNoWait(r);
+  if (!queued)
+    delete r;
 }
 
 void Peer::writerThread() {
@@ -169,7 +169,8 @@ void PeerHandler::handleIncomingPeers() {
   while (!eh->exit_requested()) {
     std::unique_lock<std::mutex> l(*NewConnectionsMutex);
     if (NewConnections->second.empty()) {
-      NewConnections->first.wait_for(l, std::chrono::seconds(1));
+      if (!eh->exit_requested())
+        NewConnections->first.wait_for(l, std::chrono::seconds(1));
       continue;
     }
     PeerConnection Conn = NewConnections->second.back();
@@ -251,9 +252,18 @@ void PeerHandler::rdmaUnregisterBuffer(uint32_t id) {
 }
 #endif
 
+void PeerHandler::stopListening() {
+  {
+    std::unique_lock<std::mutex> l(*NewConnectionsMutex);
+    NewConnections->first.notify_all();
+  }
+  if (IncomingPeerHandler.joinable())
+    IncomingPeerHandler.join();
+}
+
 PeerHandler::~PeerHandler() {
   eh->requestExit("PH Shutdown", 0);
-  listen_thread.join();
+  stopListening();
   for (auto &t : Peers) {
     t.second.reset();
   }
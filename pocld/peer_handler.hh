@@ -64,6 +64,10 @@ public:
       VirtualContextBase *c, ExitHelper *eh, TrafficMonitor *tm);
   ~PeerHandler();
 
+  /** Stops the thread that picks up incoming peer connections. Exit must
+   * have been requested already. */
+  void stopListening();
+
   cl_int connectPeer(uint64_t msg_id, const char *const address, uint16_t port,
                      uint64_t session,
                      const std::array<uint8_t, AUTHKEY_LENGTH> &authkey);
@@ -78,12 +82,7 @@ public:
 #endif
 };
 
-#if 0
-// TOFIX: peers cannot be freed without crashing, let them leak for now.
 typedef std::unique_ptr<PeerHandler> PeerHandlerUPtr;
-#else
-typedef PeerHandler *PeerHandlerUPtr;
-#endif
 
 #ifdef __GNUC__
 #pragma GCC visibility pop
@@ -4,6 +4,10 @@
 
 #cmakedefine FORKING
 
+#cmakedefine HAVE_ZLIB
+
+#cmakedefine HAVE_IO_URING
+
 #cmakedefine ENABLE_RDMA
 #cmakedefine RDMA_USE_SVM
 #if !defined(ENABLE_RDMA) && defined(RDMA_USE_SVM)
@@ -0,0 +1,155 @@
+/* program_cache.cc - daemon-wide cache of built programs
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "pocl_hash.h"
+#include "pocl_runtime_config.h"
+#include "program_cache.hh"
+
+size_t CachedProgram::size() const {
+  size_t S = SerializedMeta.size() +
+             KernelMeta.size() * sizeof(clKernelMetadata);
+  for (const auto &B : Binaries)
+    S += B.size();
+  for (const auto &L : BuildLogs)
+    S += L.size();
+  for (const auto &M : KernelMeta)
+    S += M.arg_meta.size() * sizeof(ArgumentInfo_t);
+  return S;
+}
+
+namespace {
+
+struct CacheState {
+  std::mutex Mutex;
+  /** Most recently used first */
+  std::list<std::string> Order;
+  struct Entry {
+    CachedProgramPtr Program;
+    std::list<std::string>::iterator Pos;
+  };
+  std::unordered_map<std::string, Entry> Entries;
+  size_t Bytes = 0;
+  size_t Limit;
+
+  CacheState() {
+    Limit = size_t(pocl_get_int_option("POCLD_PROGRAM_CACHE_SIZE", 64)) << 20;
+  }
+};
+
+} // namespace
+
+/* Never destroyed, like the payload pool. */
+static CacheState &state() {
+  static CacheState *S = new CacheState;
+  return *S;
+}
+
+static void hashBytes(SHA1_CTX *Ctx, const void *Data, uint64_t Size) {
+  /* the size first, so that adjacent fields can't run into each other */
+  pocl_SHA1_Update(Ctx, (const uint8_t *)&Size, sizeof(Size));
+  if (Size > 0)
+    pocl_SHA1_Update(Ctx, (const uint8_t *)Data, Size);
+}
+
+std::string ProgramCache::key(unsigned PlatformId,
+                              const std::vector<uint32_t> &DeviceList,
+                              const char *Source, size_t SourceSize,
+                              const std::vector<unsigned char> *IL,
+                              const char *Options, uint64_t SVMRegionOffset) {
+  SHA1_CTX Ctx;
+  pocl_SHA1_Init(&Ctx);
+  hashBytes(&Ctx, &PlatformId, sizeof(PlatformId));
+  hashBytes(&Ctx, DeviceList.data(), DeviceList.size() * sizeof(uint32_t));
+  hashBytes(&Ctx, &SVMRegionOffset, sizeof(SVMRegionOffset));
+  hashBytes(&Ctx, Options, Options ? std::strlen(Options) : 0);
+  uint8_t IsIL = IL != nullptr;
+  hashBytes(&Ctx, &IsIL, sizeof(IsIL));
+  if (IL)
+    hashBytes(&Ctx, IL->data(), IL->size());
+  else
+    hashBytes(&Ctx, Source, SourceSize);
+
+  uint8_t Digest[SHA1_DIGEST_SIZE];
+  pocl_SHA1_Final(&Ctx, Digest);
+  return std::string((const char *)Digest, sizeof(Digest));
+}
+
+CachedProgramPtr ProgramCache::find(const std::string &Key) {
+  CacheState &S = state();
+  std::unique_lock<std::mutex> Lock(S.Mutex);
+  auto It = S.Entries.find(Key);
+  if (It == S.Entries.end())
+    return nullptr;
+  S.Order.splice(S.Order.begin(), S.Order, It->second.Pos);
+  return It->second.Program;
+}
+
+void ProgramCache::insert(const std::string &Key, CachedProgramPtr Program) {
+  CacheState &S = state();
+  size_t Size = Program->size();
+  if (Size > S.Limit)
+    return;
+
+  std::unique_lock<std::mutex> Lock(S.Mutex);
+  /* another session may have built the same program meanwhile */
+  if (S.Entries.find(Key) != S.Entries.end())
+    return;
+  while (S.Bytes + Size > S.Limit && !S.Order.empty()) {
+    auto Victim = S.Entries.find(S.Order.back());
+    S.Bytes -= Victim->second.Program->size();
+    S.Entries.erase(Victim);
+    S.Order.pop_back();
+  }
+  S.Order.push_front(Key);
+  S.Entries[Key] = {std::move(Program), S.Order.begin()};
+  S.Bytes += Size;
+}
+
+void serializeKernelMeta(const std::vector<clKernelMetadata> &Meta,
+                         std::vector<char> &Out) {
+  auto Append = [&Out](const void *Data, size_t Size) {
+    const char *P = (const char *)Data;
+    Out.insert(Out.end(), P, P + Size);
+  };
+
+  /* size of the rest, filled in below */
+  uint64_t Size = 0;
+  Out.clear();
+  Append(&Size, sizeof(Size));
+  uint32_t NumKernels = Meta.size();
+  Append(&NumKernels, sizeof(NumKernels));
+  for (const auto &K : Meta) {
+    Append(&K.meta, sizeof(KernelMetaInfo_t));
+    uint32_t NumArgs = K.arg_meta.size();
+    Append(&NumArgs, sizeof(NumArgs));
+    for (const auto &A : K.arg_meta)
+      Append(&A, sizeof(ArgumentInfo_t));
+  }
+  Size = Out.size() - sizeof(Size);
+  std::memcpy(Out.data(), &Size, sizeof(Size));
+}
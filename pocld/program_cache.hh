@@ -0,0 +1,84 @@
+/* program_cache.hh - daemon-wide cache of built programs
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#ifndef POCLD_PROGRAM_CACHE_HH
+#define POCLD_PROGRAM_CACHE_HH
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common.hh"
+
+#ifdef __GNUC__
+#pragma GCC visibility push(hidden)
+#endif
+
+/** The result of building a program for some devices of one platform */
+struct CachedProgram {
+  /** Device binaries, in the order of the device list of the build */
+  std::vector<std::vector<unsigned char>> Binaries;
+  std::vector<std::string> BuildLogs;
+  std::vector<clKernelMetadata> KernelMeta;
+  /** KernelMeta in the format written to BuildProgram replies */
+  std::vector<char> SerializedMeta;
+
+  size_t size() const;
+};
+
+typedef std::shared_ptr<const CachedProgram> CachedProgramPtr;
+
+/**
+ * Programs built by any client session, keyed on a hash of what determines
+ * the build result: the source or SPIR-V, the build options and the target
+ * platform and devices. A client that builds the same program again, e.g.
+ * every time it starts, gets the binaries, build logs and kernel metadata
+ * from memory and pocld only has to load the binaries into the session's
+ * context instead of compiling. Least recently used entries are dropped
+ * once POCLD_PROGRAM_CACHE_SIZE (MiB) is exceeded; 0 disables the cache.
+ */
+class ProgramCache {
+public:
+  /** Returns the key of a source (IL == nullptr) or SPIR-V build */
+  static std::string key(unsigned PlatformId,
+                         const std::vector<uint32_t> &DeviceList,
+                         const char *Source, size_t SourceSize,
+                         const std::vector<unsigned char> *IL,
+                         const char *Options, uint64_t SVMRegionOffset);
+
+  /** Returns the entry for Key, nullptr if there is none */
+  static CachedProgramPtr find(const std::string &Key);
+
+  static void insert(const std::string &Key, CachedProgramPtr Program);
+};
+
+/** Writes the kernel metadata of a program in the format of the
+ * BuildProgram reply into Out. */
+void serializeKernelMeta(const std::vector<clKernelMetadata> &Meta,
+                         std::vector<char> &Out);
+
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
+#endif
@@ -108,194 +108,268 @@ static const char *reply_to_str(ReplyMessageType type) {
 
 ReplyQueueThread::ReplyQueueThread(std::atomic_int *f, VirtualContextBase *c,
                                    ExitHelper *e, TrafficMonitor *tm,
-                                   const char *id_str)
-    : fd(f), virtualContext(c), eh(e), netstat(tm), id_str(id_str) {
+                                   const char *id_str, uint32_t payload_codec,
+                                   uint32_t codec_threshold,
+                                   StripedTransfers *s)
+    : fd(f), virtualContext(c), eh(e), netstat(tm), id_str(id_str),
+      ready(4096), stripes(s) {
+  pocl_remote_codec_init(&codec, payload_codec, codec_threshold);
+  if (codec.codec != POCL_REMOTE_CODEC_NONE)
+    codec_scratch.resize(pocl_remote_codec_scratch_size());
+  eh->onExit([this] { ready.close(); });
   io_thread = std::thread{&ReplyQueueThread::writeThread, this};
 }
 
 ReplyQueueThread::~ReplyQueueThread() {
   eh->requestExit(id_str.c_str(), 0);
   io_thread.join();
+  // replies that were queued while the writer exited
+  while (Reply *reply = ready.pop())
+    delete reply;
+  pocl_remote_codec_free(&codec);
+}
+
+/* Buffer and image contents read by the client; the only payloads large
+ * enough to be worth encoding. */
+static bool isBulkRead(const Reply *reply) {
+  return (reply->rep.message_type == MessageType_ReadBufferReply ||
+          reply->rep.message_type == MessageType_ReadImageRectReply) &&
+         reply->rep.data_size == reply->extra_size;
+}
+
+int ReplyQueueThread::writeEncodedPayload(int fd, Reply *reply) {
+  uint64_t done = 0;
+  uint64_t headers = 0;
+  const uint8_t *src = reply->extra_data.data();
+  while (done < reply->extra_size) {
+    uint32_t n = (uint32_t)std::min<uint64_t>(reply->extra_size - done,
+                                              POCL_REMOTE_CODEC_BLOCK_SIZE);
+    CodecBlockHeader_t hdr;
+    const void *out = pocl_remote_codec_encode_block(
+        &codec, src + done, n, codec_scratch.data(), &hdr);
+    if (write_full(fd, &hdr, sizeof(hdr), netstat) < 0 ||
+        write_full(fd, const_cast<void *>(out), hdr.wire_size, netstat) < 0)
+      return -1;
+    done += n;
+    headers += sizeof(hdr);
+  }
+  pocl_remote_codec_end(&codec);
+
+  POCL_MSG_PRINT_GENERAL("%s: payload %" PRIu64 " -> %" PRIu64 " bytes\n",
+                         id_str.c_str(), codec.raw_bytes,
+                         codec.wire_bytes + headers);
+  if (netstat)
+    netstat->txPayload(codec.raw_bytes, codec.wire_bytes + headers);
+  return 0;
+}
+
+static void CL_CALLBACK replyEventCallback(cl_event, cl_int, void *data) {
+  Reply *reply = static_cast<Reply *>(data);
+  reply->writer->replyReady(reply);
 }
 
 void ReplyQueueThread::pushReply(Reply *reply) {
-  if (eh->exit_requested())
+  if (eh->exit_requested()) {
+    delete reply;
     return;
+  }
 
-  {
-    std::unique_lock<std::mutex> lock(io_mutex);
-    io_inflight.push_back(reply);
+  if (reply->event.get() == nullptr) {
+    if (!ready.push(reply))
+      delete reply;
+    return;
   }
 
-  io_cond.notify_one();
+  // The writer only ever sees replies that are ready to go out. The
+  // CL_COMPLETE callback also fires for commands that fail.
+  reply->writer = this;
+  cl_int err =
+      reply->event.setCallback(CL_COMPLETE, replyEventCallback, reply);
+  if (err != CL_SUCCESS) {
+    POCL_MSG_ERR("%s: can't set event callback (%d), waiting in the writer\n",
+                 id_str.c_str(), err);
+    if (!ready.push(reply))
+      delete reply;
+  }
 }
 
 void ReplyQueueThread::writeThread() {
   // XXX: Change into a ring buffer?
   std::queue<Reply *> backup;
+  std::vector<Reply *> batch;
+  size_t next = 0;
   bool resending = false;
-  size_t i = 0;
+  bool writing = false;
+  uint32_t ticket = ready.ticket();
   int fd = *this->fd;
   int oldfd = fd;
   while (1) {
   RETRY:
+    if (writing) {
+      // The write failed; wait for a new socket or more replies before
+      // trying again instead of hammering the broken one.
+      writing = false;
+      ready.wait_cond(ticket);
+    }
+    ticket = ready.ticket();
     fd = *this->fd;
     if (fd != oldfd) {
-      std::unique_lock<std::mutex> lock(io_mutex);
-      int n = io_inflight.size();
-      lock.unlock();
       resending = true;
       POCL_MSG_PRINT_GENERAL(
           "%s: FD change detected with %d items in queue, %d -> %d\n",
-          id_str.c_str(), n, oldfd, fd);
+          id_str.c_str(), int(batch.size() - next), oldfd, fd);
       // Reader closes the socket
     }
     oldfd = fd;
-    if (eh->exit_requested())
+    if (eh->exit_requested()) {
+      for (size_t j = next; j < batch.size(); ++j)
+        delete batch[j];
+      while (!backup.empty()) {
+        delete backup.front();
+        backup.pop();
+      }
       return;
+    }
 
     if (backup.empty())
       resending = false;
-    std::unique_lock<std::mutex> lock(io_mutex);
-    if ((io_inflight.size() > 0 || resending) && fd >= 0) {
-      Reply *reply = io_inflight[i];
-      lock.unlock();
-
-      // If we need to resend old messages, disregard the inflight queue
-      if (resending) {
-        reply = backup.front();
-        POCL_MSG_PRINT_GENERAL("%s: Resending old replies, %" PRIuS
-                               " remaining\n",
-                               id_str.c_str(), backup.size());
-      }
+    if (next == batch.size()) {
+      batch.clear();
+      next = 0;
+      ready.popBatch(batch);
+    }
+    if (fd < 0 || (!resending && next == batch.size())) {
+      ready.wait_cond(ticket);
+      continue;
+    }
+
+    // If we need to resend old messages, disregard the new replies
+    Reply *reply = resending ? backup.front() : batch[next];
+    if (resending) {
+      POCL_MSG_PRINT_GENERAL("%s: Resending old replies, %" PRIuS
+                             " remaining\n",
+                             id_str.c_str(), backup.size());
+    }
 
-      cl_int status =
-          (reply->event.get() == nullptr)
-              ? CL_COMPLETE
-              : reply->event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>();
-      if (status <= CL_COMPLETE) {
-        // clGetEventInfo is NOT a synchronization mechanism and gives no
-        // guarantees that everything related to the event is done, so
-        // wait explicitly (should be instant since the event is already
-        // signaled as complete)
-
-        EventTiming_t timing;
-
-        if (reply->event()) {
-          timing.queued = 0;
-          timing.submitted = 0;
-          timing.started = 0;
-          timing.completed = 0;
-          cl_int stat = reply->event.wait();
-          // This should never actually happen but can't hurt to check
-          if (status == CL_COMPLETE && stat != CL_SUCCESS)
-            status = stat;
+    cl_int status = CL_COMPLETE;
+    EventTiming_t timing;
+
+    if (reply->event()) {
+      timing.queued = 0;
+      timing.submitted = 0;
+      timing.started = 0;
+      timing.completed = 0;
+      // The event has already completed, but clGetEventInfo is NOT a
+      // synchronization mechanism and gives no guarantees that everything
+      // related to the event is done, so wait explicitly (should be instant)
+      cl_int stat = reply->event.wait();
+      status = reply->event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>();
+      // This should never actually happen but can't hurt to check
+      if (status == CL_COMPLETE && stat != CL_SUCCESS)
+        status = stat;
 #ifdef QUEUE_PROFILING
-          int err = CL_SUCCESS;
-          uint64_t tmp;
-          tmp =
-              reply->event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>(&err);
-          if (err == CL_SUCCESS)
-            timing.queued = tmp;
-          tmp =
-              reply->event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>(&err);
-          if (err == CL_SUCCESS)
-            timing.submitted = tmp;
-          tmp = reply->event.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err);
-          if (err == CL_SUCCESS)
-            timing.started = tmp;
-          tmp = reply->event.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err);
-          if (err == CL_SUCCESS)
-            timing.completed = tmp;
+      int err = CL_SUCCESS;
+      uint64_t tmp;
+      tmp = reply->event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>(&err);
+      if (err == CL_SUCCESS)
+        timing.queued = tmp;
+      tmp = reply->event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>(&err);
+      if (err == CL_SUCCESS)
+        timing.submitted = tmp;
+      tmp = reply->event.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err);
+      if (err == CL_SUCCESS)
+        timing.started = tmp;
+      tmp = reply->event.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err);
+      if (err == CL_SUCCESS)
+        timing.completed = tmp;
 #endif
-        }
-
-        // Change reply to FAILURE if the command has failed after submitting
-        if (status < CL_COMPLETE) {
-          reply->rep.failed = 1;
-          reply->rep.fail_details = status;
-          reply->rep.message_type = MessageType_Failure;
-        }
-
-        ReplyMessageType t =
-            static_cast<ReplyMessageType>(reply->rep.message_type);
-
-        POCL_MSG_PRINT_GENERAL(
-            "%s: SENDING MESSAGE, ID: %" PRIu64 " TYPE: %s SIZE: %" PRIuS
-            " EXTRA: %" PRIuS " FAILED: %" PRIu32 "\n",
-            id_str.c_str(), uint64_t(reply->rep.msg_id), reply_to_str(t),
-            sizeof(ReplyMsg_t), reply->extra_size, uint32_t(reply->rep.failed));
-
-        auto now1 = std::chrono::system_clock::now();
-        reply->write_start_timestamp_ns =
-            std::chrono::duration_cast<std::chrono::nanoseconds>(
-                now1.time_since_epoch())
-                .count();
-
-        reply->rep.timing = timing;
-        reply->rep.server_write_start_timestamp_ns =
-            reply->write_start_timestamp_ns;
-
-        // WRITE REPLY
-        CHECK_WRITE_RETRY(
-            write_full(fd, &reply->rep, sizeof(ReplyMsg_t), netstat),
-            id_str.c_str());
-
-        // TODO: handle reconnecting & resending when RDMA is used
-        if (reply->extra_size > 0 && !reply->extra_data.empty()) {
-          POCL_MSG_PRINT_INFO("%s: WRITING EXTRA: %" PRIuS " \n",
-                              id_str.c_str(), reply->extra_size);
-          CHECK_WRITE_RETRY(
-              write_full(fd, reply->extra_data.data(), reply->extra_size, netstat),
-              id_str.c_str());
-        }
-        POCL_MSG_PRINT_GENERAL("%s: MESSAGE FULLY WRITTEN, ID: %" PRIu64 "\n",
-                               id_str.c_str(), uint64_t(reply->rep.msg_id));
-
-        TP_MSG_SENT(reply->rep.msg_id, reply->rep.did, reply->rep.failed,
-                    reply->rep.message_type);
-
-        if (resending) {
-          delete reply;
-          backup.pop();
-        } else {
-          if (reply->event.get() != nullptr) {
-            virtualContext->notifyEvent(reply->req->req.event_id, status);
-            Request peer_notice{};
-            peer_notice.req.msg_id = reply->rep.msg_id;
-            peer_notice.req.event_id = reply->req->req.event_id;
-            peer_notice.req.message_type = MessageType_NotifyEvent;
-            virtualContext->broadcastToPeers(peer_notice);
-          }
-
-          // swap the current element into last place and pop it off the vector
-          lock.lock();
-          if (i != io_inflight.size() - 1) {
-            std::swap(io_inflight[i], io_inflight[io_inflight.size() - 1]);
-          }
-          io_inflight.pop_back();
-
-          // move to next item (now in the old place of the current item)
-          i = i % std::max(io_inflight.size(), (size_t)1);
-          lock.unlock();
-
-          backup.push(reply);
-          if (backup.size() > 5) {
-            delete backup.front();
-            backup.pop();
-          }
-        }
-      } else {
-        lock.lock();
-        i = (i + 1) % io_inflight.size();
-        // lock is dropped after this
-      }
+    }
+
+    // Change reply to FAILURE if the command has failed after submitting
+    if (status < CL_COMPLETE) {
+      reply->rep.failed = 1;
+      reply->rep.fail_details = status;
+      reply->rep.message_type = MessageType_Failure;
+    }
+
+    ReplyMessageType t = static_cast<ReplyMessageType>(reply->rep.message_type);
+
+    POCL_MSG_PRINT_GENERAL(
+        "%s: SENDING MESSAGE, ID: %" PRIu64 " TYPE: %s SIZE: %" PRIuS
+        " EXTRA: %" PRIuS " FAILED: %" PRIu32 "\n",
+        id_str.c_str(), uint64_t(reply->rep.msg_id), reply_to_str(t),
+        sizeof(ReplyMsg_t), reply->extra_size, uint32_t(reply->rep.failed));
+
+    auto now1 = std::chrono::system_clock::now();
+    reply->write_start_timestamp_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now1.time_since_epoch())
+            .count();
+
+    reply->rep.timing = timing;
+    reply->rep.server_write_start_timestamp_ns =
+        reply->write_start_timestamp_ns;
+
+    reply->rep.payload_codec = POCL_REMOTE_CODEC_NONE;
+    if (reply->req->shared_data != nullptr)
+      /* the data read is already in the client's shared memory */
+      reply->rep.payload_codec = POCL_REMOTE_PAYLOAD_SHM;
+    else if (reply->req->req.payload_codec == POCL_REMOTE_PAYLOAD_STRIPED &&
+             stripes != nullptr && !reply->extra_data.empty() &&
+             isBulkRead(reply) && stripes->size() > 0)
+      reply->rep.payload_codec = POCL_REMOTE_PAYLOAD_STRIPED;
+    else if (codec.codec != POCL_REMOTE_CODEC_NONE &&
+             !reply->extra_data.empty() && isBulkRead(reply))
+      reply->rep.payload_codec =
+          pocl_remote_codec_begin(&codec, reply->extra_size);
+
+    // WRITE REPLY
+    writing = true;
+    CHECK_WRITE_RETRY(write_full(fd, &reply->rep, sizeof(ReplyMsg_t), netstat),
+                      id_str.c_str());
+
+    // TODO: handle reconnecting & resending when RDMA is used
+    if (reply->extra_size > 0 && !reply->extra_data.empty()) {
+      POCL_MSG_PRINT_INFO("%s: WRITING EXTRA: %" PRIuS " \n", id_str.c_str(),
+                          reply->extra_size);
+      if (reply->rep.payload_codec == POCL_REMOTE_PAYLOAD_STRIPED)
+        CHECK_WRITE_RETRY(stripes->send(reply->rep.msg_id,
+                                        reply->extra_data.data(),
+                                        reply->extra_size),
+                          id_str.c_str());
+      else if (reply->rep.payload_codec != POCL_REMOTE_CODEC_NONE)
+        CHECK_WRITE_RETRY(writeEncodedPayload(fd, reply), id_str.c_str());
+      else
+        CHECK_WRITE_RETRY(write_full(fd, reply->extra_data.data(),
+                                     reply->extra_size, netstat),
+                          id_str.c_str());
+    }
+    writing = false;
+    POCL_MSG_PRINT_GENERAL("%s: MESSAGE FULLY WRITTEN, ID: %" PRIu64 "\n",
+                           id_str.c_str(), uint64_t(reply->rep.msg_id));
+
+    TP_MSG_SENT(reply->rep.msg_id, reply->rep.did, reply->rep.failed,
+                reply->rep.message_type);
+
+    if (resending) {
+      delete reply;
+      backup.pop();
     } else {
-      auto now = std::chrono::system_clock::now();
-      std::chrono::duration<unsigned long> d(3);
-      now += d;
-      i = 0;
-      io_cond.wait_until(lock, now);
+      if (reply->event.get() != nullptr) {
+        virtualContext->notifyEvent(reply->req->req.event_id, status);
+        Request peer_notice{};
+        peer_notice.req.msg_id = reply->rep.msg_id;
+        peer_notice.req.event_id = reply->req->req.event_id;
+        peer_notice.req.message_type = MessageType_NotifyEvent;
+        virtualContext->broadcastToPeers(peer_notice);
+      }
+
+      ++next;
+      backup.push(reply);
+      if (backup.size() > 5) {
+        delete backup.front();
+        backup.pop();
+      }
     }
   }
 }
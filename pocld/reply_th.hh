@@ -26,14 +26,15 @@
 #define POCL_REMOTE_REPLY_TH_HH
 
 #include <atomic>
-#include <condition_variable>
 #include <memory>
-#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
 #include "common.hh"
+#include "guarded_queue.hh"
+#include "pocl_networking.h"
+#include "stripes.hh"
 #include "traffic_monitor.hh"
 #include "virtual_cl_context.hh"
 
@@ -45,21 +46,42 @@ class ReplyQueueThread {
   std::atomic_int *fd;
   std::string id_str;
   VirtualContextBase *virtualContext;
-  std::vector<Reply *> io_inflight;
-  std::mutex io_mutex;
-  std::condition_variable io_cond;
+  /** Replies whose commands have completed, in completion order */
+  GuardedQueue<Reply *> ready;
   std::thread io_thread;
   ExitHelper *eh;
   TrafficMonitor *netstat;
+  /** Encoder of the read buffer/image payloads, if negotiated */
+  pocl_remote_codec_t codec;
+  std::vector<uint8_t> codec_scratch;
+  /** Data connections of the session for striped payloads, if any */
+  StripedTransfers *stripes;
+
+  int writeEncodedPayload(int fd, Reply *reply);
 
 public:
   ReplyQueueThread(std::atomic_int *f, VirtualContextBase *c, ExitHelper *eh,
-                   TrafficMonitor *tm, const char *id_str);
+                   TrafficMonitor *tm, const char *id_str,
+                   uint32_t payload_codec = POCL_REMOTE_CODEC_NONE,
+                   uint32_t codec_threshold = 0,
+                   StripedTransfers *stripes = nullptr);
 
   ~ReplyQueueThread();
 
+  /** Queues reply for sending once its event (if any) has completed. */
   void pushReply(Reply *reply);
 
+  /** Called from the event callback once reply's command has completed.
+   * That runs on the driver's completion threads, so it must not wait for
+   * the writer. */
+  void replyReady(Reply *reply) {
+    if (!ready.pushNoWait(reply))
+      delete reply;
+  }
+
+  /** Makes the writer look at the socket fd again after it changed. */
+  void wake() { ready.wake(); }
+
   void writeThread();
 };
 
@@ -21,6 +21,7 @@
    IN THE SOFTWARE.
 */
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <chrono>
@@ -28,6 +29,7 @@
 
 #include "messages.h"
 #include "pocl_debug.h"
+#include "pocl_networking.h"
 #include "request.hh"
 #include "tracing.h"
 
@@ -142,11 +144,38 @@ const char *request_to_str(RequestMessageType type) {
   }
 }
 
-/* Returns 0 on success and no-op, otherwise errno */
-static int reentrant_read(int fd, void *dest, size_t size, size_t *tracker) {
+/* Returns 0 on success and no-op, otherwise errno. With a read-ahead buffer,
+ * EAGAIN is only returned once the buffer has been drained. */
+static int reentrant_read(int fd, void *dest, size_t size, size_t *tracker,
+                          ReadAheadBuffer *Buf) {
   if (*tracker == size)
     return 0;
 
+  size_t Want = size - *tracker;
+  if (Buf) {
+    if (Buf->available() == 0 && Buf->IsFed)
+      return EAGAIN;
+    /* Refill only for reads smaller than the buffer; anything larger is
+     * read straight into place below to avoid the extra copy. */
+    if (Buf->available() == 0 && Want < Buf->Storage.size()) {
+      ssize_t readb = ::read(fd, Buf->Storage.data(), Buf->Storage.size());
+      if (readb < 0)
+        return errno;
+      if (readb == 0)
+        return EPIPE;
+      Buf->Base = Buf->Storage.data();
+      Buf->Begin = 0;
+      Buf->End = readb;
+    }
+    if (Buf->available() > 0) {
+      size_t N = std::min(Want, Buf->available());
+      std::memcpy((char *)dest + *tracker, Buf->Base + Buf->Begin, N);
+      Buf->Begin += N;
+      *tracker += N;
+      return *tracker == size ? 0 : EAGAIN;
+    }
+  }
+
   ssize_t readb;
   readb = ::read(fd, (char *)dest + *tracker, size - *tracker);
   if (readb < 0)
@@ -161,6 +190,60 @@ static int reentrant_read(int fd, void *dest, size_t size, size_t *tracker) {
   return 0;
 }
 
+namespace {
+/* Decoder state of the thread reading the client sockets. */
+struct PayloadDecoder {
+  pocl_remote_codec_t codec;
+  PayloadDecoder() {
+    pocl_remote_codec_init(&codec, pocl_remote_supported_codecs(), 0);
+  }
+  ~PayloadDecoder() { pocl_remote_codec_free(&codec); }
+};
+} // namespace
+
+static thread_local PayloadDecoder Decoder;
+
+/* Incrementally reads and decodes the encoded blocks of the auxiliary data.
+ * Returns like reentrant_read(). */
+static int reentrant_read_encoded(int fd, Request *request,
+                                  ReadAheadBuffer *Buf) {
+  while (request->extra_read < request->extra_size) {
+    int ret = reentrant_read(fd, &request->block_hdr,
+                             sizeof(request->block_hdr),
+                             &request->block_hdr_read, Buf);
+    if (ret)
+      return ret;
+
+    const CodecBlockHeader_t &hdr = request->block_hdr;
+    if (hdr.raw_size == 0 || hdr.wire_size == 0 ||
+        hdr.wire_size > hdr.raw_size ||
+        hdr.raw_size > POCL_REMOTE_CODEC_BLOCK_SIZE ||
+        hdr.raw_size > request->extra_size - request->extra_read)
+      return EPROTO;
+
+    uint8_t *dst = request->extra_data.data() + request->extra_read;
+    /* stored blocks are read in place */
+    bool stored = hdr.wire_size == hdr.raw_size;
+    if (!stored)
+      request->block_data.resize(hdr.wire_size);
+    ret = reentrant_read(fd, stored ? dst : request->block_data.data(),
+                         hdr.wire_size, &request->block_read, Buf);
+    if (ret)
+      return ret;
+
+    if (!stored && pocl_remote_codec_decode_block(
+                       &Decoder.codec, request->req.payload_codec, &hdr,
+                       request->block_data.data(), dst))
+      return EPROTO;
+
+    request->extra_read += hdr.raw_size;
+    request->extra_wire_size += sizeof(hdr) + hdr.wire_size;
+    request->block_hdr_read = 0;
+    request->block_read = 0;
+  }
+  return 0;
+}
+
 #define RETURN_UNLESS_DONE(call)                                               \
   do {                                                                         \
     int ret = (call);                                                          \
@@ -173,7 +256,7 @@ static int reentrant_read(int fd, void *dest, size_t size, size_t *tracker) {
     }                                                                          \
   } while (0);
 
-bool Request::read(int fd) {
+bool Request::read(int fd, ReadAheadBuffer *Buf) {
   ssize_t readb;
   Request *request = this;
   RequestMsg_t *req = &request->req;
@@ -188,10 +271,10 @@ bool Request::read(int fd) {
 
   RETURN_UNLESS_DONE(reentrant_read(fd, &request->req_size,
                                     sizeof(request->req_size),
-                                    &request->req_size_read));
+                                    &request->req_size_read, Buf));
 
   RETURN_UNLESS_DONE(
-      reentrant_read(fd, req, request->req_size, &request->req_read));
+      reentrant_read(fd, req, request->req_size, &request->req_read, Buf));
 
   TP_MSG_RECEIVED(req->msg_id, req->did, req->cq_id, req->message_type);
 
@@ -255,6 +338,27 @@ bool Request::read(int fd) {
     break;
   }
 
+  /* Payloads in the shared memory window or striped over the data
+   * connections are only supported for the bulk transfers, which are
+   * resolved by the virtual context. */
+  bool ExternalPayload = req->payload_codec == POCL_REMOTE_PAYLOAD_SHM ||
+                         req->payload_codec == POCL_REMOTE_PAYLOAD_STRIPED;
+  if (ExternalPayload) {
+    switch (req->message_type) {
+    case MessageType_ReadBuffer:
+    case MessageType_WriteBuffer:
+    case MessageType_ReadBufferRect:
+    case MessageType_WriteBufferRect:
+    case MessageType_ReadImageRect:
+    case MessageType_WriteImageRect:
+      break;
+    default:
+      POCL_MSG_ERR("External payload for a %s request, fd=%d\n",
+                   request_to_str(t), fd);
+      return false;
+    }
+  }
+
   /*****************************/
   if (req->waitlist_size > 0) {
     request->waitlist.resize(req->waitlist_size);
@@ -265,19 +369,24 @@ bool Request::read(int fd) {
     RETURN_UNLESS_DONE(
         reentrant_read(fd, request->waitlist.data(),
                        request->req.waitlist_size * sizeof(uint64_t),
-                       &request->waitlist_read));
+                       &request->waitlist_read, Buf));
   }
   /*****************************/
 
   /*****************************/
-  if (request->extra_size > 0) {
+  if (request->extra_size > 0 && !ExternalPayload) {
     request->extra_data.resize(request->extra_size + 1);
     POCL_MSG_PRINT_GENERAL(
         "READING EXTRA FOR ID: %" PRIu64 " = %" PRIuS "/%" PRIu64 "\n",
         uint64_t(req->msg_id), request->extra_read, request->extra_size);
-    RETURN_UNLESS_DONE(reentrant_read(fd, request->extra_data.data(),
-                                      request->extra_size,
-                                      &request->extra_read));
+    if (req->payload_codec != POCL_REMOTE_CODEC_NONE) {
+      RETURN_UNLESS_DONE(reentrant_read_encoded(fd, request, Buf));
+      /* the data is raw from here on, e.g. when forwarded to peers */
+      req->payload_codec = POCL_REMOTE_CODEC_NONE;
+    } else
+      RETURN_UNLESS_DONE(reentrant_read(fd, request->extra_data.data(),
+                                        request->extra_size,
+                                        &request->extra_read, Buf));
     /* Always add a null byte at the end - it is needed for strings and it does
      * not harm other things */
     request->extra_data[request->extra_size] = 0;
@@ -292,7 +401,7 @@ bool Request::read(int fd) {
         uint64_t(req->msg_id), request->extra_read2, request->extra_size2);
     RETURN_UNLESS_DONE(reentrant_read(fd, request->extra_data2.data(),
                                       request->extra_size2,
-                                      &request->extra_read2));
+                                      &request->extra_read2, Buf));
     /* Always add null byte here too, just in case extra2 is a string */
     request->extra_data2[request->extra_size2] = 0;
   }
@@ -29,11 +29,41 @@
 #include <vector>
 
 #include "messages.h"
+#include "payload_pool.hh"
 
 #ifdef __GNUC__
 #pragma GCC visibility push(hidden)
 #endif
 
+/** Bytes read from a socket ahead of the Request being parsed. Clients batch
+ * small commands into a single write, so reading ahead lets all requests of
+ * such a batch be parsed out of one read() call instead of several small
+ * reads per request. Large payloads bypass the buffer. */
+class ReadAheadBuffer {
+public:
+  explicit ReadAheadBuffer(size_t Capacity = 64 * 1024)
+      : Storage(Capacity), Base(Storage.data()) {}
+
+  /** Number of bytes read from the socket but not yet consumed */
+  size_t available() const { return End - Begin; }
+
+  /** Switches the buffer to be fed with bytes received elsewhere, e.g. by an
+   * io_uring receive. Such a buffer never reads the socket itself, and Data
+   * must stay valid until available() drops to 0. */
+  void feed(uint8_t *Data, size_t Size) {
+    Base = Data;
+    Begin = 0;
+    End = Size;
+    IsFed = true;
+  }
+
+  std::vector<uint8_t> Storage;
+  uint8_t *Base;
+  size_t Begin = 0;
+  size_t End = 0;
+  bool IsFed = false;
+};
+
 class Request {
 
 public:
@@ -56,15 +86,32 @@ public:
 
   /** Auxiliary data required for the Request (buffer contents, program binaries
    * etc) */
-  std::vector<uint8_t> extra_data;
+  PayloadVector extra_data;
   /** Size of the auxiliary data buffer */
   uint64_t extra_size;
   /** Tracker for how many bytes of the auxiliary data buffer have been read
    * from the network socket */
   size_t extra_read;
 
+  /** Header of the encoded block being read, if the auxiliary data comes in
+   * through a payload codec */
+  CodecBlockHeader_t block_hdr;
+  /** Tracker for how many bytes of the block header have been read */
+  size_t block_hdr_read;
+  /** Encoded contents of the block being read */
+  PayloadVector block_data;
+  /** Tracker for how many bytes of the block contents have been read */
+  size_t block_read;
+  /** Size of the encoded auxiliary data on the wire, 0 if it was sent raw */
+  uint64_t extra_wire_size;
+
+  /** Buffer or image contents passed by reference in the shared memory window
+   * of a same-host client instead of extra_data; set by the virtual context
+   * before the request is queued */
+  uint8_t *shared_data = nullptr;
+
   /** Second auxiliary data required for the Request */
-  std::vector<uint8_t> extra_data2;
+  PayloadVector extra_data2;
   /** Size of the auxiliary data buffer */
   uint64_t extra_size2;
   /** Tracker for how many bytes of the second auxiliary data buffer have been
@@ -84,8 +131,20 @@ public:
 
   /** Incrementally reads the request from given fd. Returns true on success and
    * false if an error occurs while reading. Call repeatedly until `fully_read`
-   * gets set to true. */
-  bool read(int fd);
+   * gets set to true. If Buf is given, reads go through it and it may be left
+   * holding the beginning of the following requests; the caller must then
+   * keep parsing from it before polling the fd again. */
+  bool read(int fd, ReadAheadBuffer *Buf = nullptr);
+
+  /** The buffer or image contents of a write request */
+  uint8_t *payload() { return shared_data ? shared_data : extra_data.data(); }
+
+  static void *operator new(size_t Size) {
+    return ObjectPool<Request>::allocate(Size);
+  }
+  static void operator delete(void *Ptr, size_t Size) {
+    ObjectPool<Request>::release(Ptr, Size);
+  }
 };
 
 #ifdef __GNUC__
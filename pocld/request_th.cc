@@ -56,6 +56,10 @@ void RequestQueueThread::readThread() {
   pfd.events = POLLIN | POLLRDHUP;
   int nevs;
 
+  /* Peers batch their writes like clients do; requests already in the
+   * buffer are parsed without polling the socket again. */
+  ReadAheadBuffer Buf;
+
   int fd = *this->fd;
   int oldfd = fd;
   while (1) {
@@ -63,23 +67,26 @@ void RequestQueueThread::readThread() {
     if (fd != oldfd) {
       POCL_MSG_PRINT_GENERAL("%s: FD change detected: %d -> %d\n",
                              id_str.c_str(), oldfd, fd);
+      Buf.Begin = Buf.End = 0;
     }
     oldfd = fd;
     if (eh->exit_requested())
       return;
 
-    pfd.fd = fd;
-    nevs = poll(&pfd, 1, 3 * MS_PER_S);
-    if (nevs < 1)
-      continue;
-    if (pfd.revents & (POLLERR | POLLNVAL | POLLHUP | POLLRDHUP))
-      continue;
-    if (!(pfd.revents & POLLIN))
-      continue;
+    if (Buf.available() == 0) {
+      pfd.fd = fd;
+      nevs = poll(&pfd, 1, 3 * MS_PER_S);
+      if (nevs < 1)
+        continue;
+      if (pfd.revents & (POLLERR | POLLNVAL | POLLHUP | POLLRDHUP))
+        continue;
+      if (!(pfd.revents & POLLIN))
+        continue;
+    }
 
     Request *request = new Request();
     while (!request->IsFullyRead) {
-      if (!request->read(fd)) {
+      if (!request->read(fd, &Buf)) {
         delete request;
         continue;
       }
@@ -38,6 +38,7 @@
 #include "pocl.h"
 #include "pocl_runtime_config.h"
 #include "pocl_util.h"
+#include "program_cache.hh"
 #include "shared_cl_context.hh"
 #include "spirv_parser.hh"
 #include "virtual_cl_context.hh"
@@ -160,6 +161,13 @@ class SharedCLContext final : public SharedContextBase {
                     uint64_t *args, unsigned char *is_svm_ptr, size_t pod_size,
                     char *pod_buf);
 
+  int buildFromCache(
+      clProgramStruct *program, const CachedProgramPtr &Cached,
+      const std::string &opts, std::vector<uint32_t> &DeviceList,
+      std::unordered_map<uint64_t, std::vector<unsigned char>> &output_binaries,
+      std::unordered_map<uint64_t, std::string> &build_logs,
+      size_t &num_kernels);
+
 public:
   SharedCLContext(cl::Platform *p, unsigned plat_id, VirtualContextBase *v,
                   ReplyQueueThread *s, ReplyQueueThread *f);
@@ -1347,6 +1355,35 @@ int SharedCLContext::buildOrLinkProgram(
      clGetKernelArgInfo.html*/
   opts += " -cl-kernel-arg-info";
 
+  // Builds from source or SPIR-V are shared by all sessions through the
+  // program cache. Compiled objects and links refer to other programs of the
+  // session, and binaries need no compiling anyway.
+  std::string CacheKey;
+  if (!LinkOnly && !CompileOnly && !is_binary && !is_builtin) {
+    CacheKey = ProgramCache::key(
+        plat_id, DeviceList, src, src_size,
+        is_spirv ? &(*InputBinaries.begin()).second : nullptr, options,
+        SVMRegionOffset);
+    if (CachedProgramPtr Cached = ProgramCache::find(CacheKey)) {
+      err = buildFromCache(program, Cached, opts, DeviceList, output_binaries,
+                           build_logs, num_kernels);
+      if (err == CL_SUCCESS) {
+        std::unique_lock<std::mutex> lock(MainMutex);
+        ProgramIDmap[program_id] = std::move(program_uptr);
+        POCL_MSG_PRINT_INFO("Created program %" PRIu32 " from the cache\n",
+                            program_id);
+        return CL_SUCCESS;
+      }
+      POCL_MSG_WARN("Loading cached binaries of program %" PRIu32
+                    " failed, building it\n",
+                    program_id);
+      program->uptr.reset();
+      program->cached.reset();
+      program->kernel_meta.clear();
+      program->numKernels = 0;
+    }
+  }
+
   if (LinkOnly) {
     // Collect the previously built programs from the server-side cache and link
     // them.
@@ -1667,6 +1704,14 @@ int SharedCLContext::buildOrLinkProgram(
       std::strncpy(temp_kernel.attributes, a.c_str(), MAX_PACKED_STRING_LEN);
     }
 
+    // Only PoCL knows this query, the other platforms fail it.
+    cl_bool GroupsIndependent = CL_FALSE;
+    if (clGetKernelInfo(kernels[i](), CL_KERNEL_GROUPS_INDEPENDENT_POCL,
+                        sizeof(GroupsIndependent), &GroupsIndependent,
+                        nullptr) != CL_SUCCESS)
+      GroupsIndependent = CL_FALSE;
+    temp_kernel.groups_independent = GroupsIndependent;
+
     size_t num_args_temp = kernels[i].getInfo<CL_KERNEL_NUM_ARGS>(&ArgErr);
     if (ArgErr == CL_SUCCESS) {
       temp_kernel.num_args = num_args_temp;
@@ -1732,6 +1777,19 @@ int SharedCLContext::buildOrLinkProgram(
   if (err)
     return err;
 
+  if (!CacheKey.empty()) {
+    std::shared_ptr<CachedProgram> Entry(new CachedProgram);
+    for (auto Dev : DeviceList) {
+      uint64_t id = ((uint64_t)plat_id << 32) + Dev;
+      Entry->Binaries.push_back(output_binaries[id]);
+      Entry->BuildLogs.push_back(build_logs[id]);
+    }
+    Entry->KernelMeta = program->kernel_meta;
+    serializeKernelMeta(Entry->KernelMeta, Entry->SerializedMeta);
+    program->cached = Entry;
+    ProgramCache::insert(CacheKey, std::move(Entry));
+  }
+
   // SUCCESS
   {
     std::unique_lock<std::mutex> lock(MainMutex);
@@ -1742,6 +1800,40 @@ int SharedCLContext::buildOrLinkProgram(
   return CL_SUCCESS;
 }
 
+int SharedCLContext::buildFromCache(
+    clProgramStruct *program, const CachedProgramPtr &Cached,
+    const std::string &opts, std::vector<uint32_t> &DeviceList,
+    std::unordered_map<uint64_t, std::vector<unsigned char>> &output_binaries,
+    std::unordered_map<uint64_t, std::string> &build_logs,
+    size_t &num_kernels) {
+  if (num_kernels != 0 && num_kernels != Cached->KernelMeta.size())
+    return CL_INVALID_PROGRAM;
+
+  cl::Program::Binaries Binaries(Cached->Binaries.begin(),
+                                 Cached->Binaries.end());
+  cl_int err = CL_SUCCESS;
+  clProgramPtr pp(new cl::Program(ContextWithAllDevices, program->devices,
+                                  Binaries, nullptr, &err));
+  if (err != CL_SUCCESS)
+    return err;
+  err = pp->build(program->devices, opts.c_str());
+  if (err != CL_SUCCESS)
+    return err;
+
+  for (size_t i = 0; i < DeviceList.size(); ++i) {
+    uint64_t id = ((uint64_t)plat_id << 32) + DeviceList[i];
+    output_binaries[id] = Cached->Binaries[i];
+    if (!Cached->BuildLogs[i].empty())
+      build_logs[id] = Cached->BuildLogs[i];
+  }
+  num_kernels = Cached->KernelMeta.size();
+  program->uptr = std::move(pp);
+  program->kernel_meta = Cached->KernelMeta;
+  program->numKernels = num_kernels;
+  program->cached = Cached;
+  return CL_SUCCESS;
+}
+
 int SharedCLContext::freeProgram(uint32_t program_id) {
   {
     std::unique_lock<std::mutex> lock(MainMutex);
@@ -1770,25 +1862,18 @@ int SharedCLContext::writeKernelMeta(uint32_t program_id, char *buffer,
   assert(p);
   // there could be 0 kernels in a program
   // assert (p->kernel_meta.size() > 0);
-  std::vector<clKernelMetadata> &meta = p->kernel_meta;
-  uint32_t num_kernels = meta.size();
-  uint64_t placeholder = 0;
-
-  WRITE_BYTES(placeholder);
-  WRITE_BYTES(num_kernels);
-  for (size_t i = 0; i < num_kernels; ++i) {
-    WRITE_STRING(&meta[i].meta, sizeof(KernelMetaInfo_t));
-    uint32_t num_args = meta[i].arg_meta.size();
 
-    WRITE_BYTES(num_args);
-    for (size_t j = 0; j < num_args; ++j) {
-      WRITE_STRING(&meta[i].arg_meta[j], sizeof(ArgumentInfo_t));
-    }
-  }
+  // cached programs carry their metadata already serialized
+  std::vector<char> serialized;
+  const std::vector<char> *meta = &serialized;
+  if (p->cached)
+    meta = &p->cached->SerializedMeta;
+  else
+    serializeKernelMeta(p->kernel_meta, serialized);
 
+  WRITE_STRING(meta->data(), meta->size());
   *written = (size_t)(buf - buffer);
   assert(*written > 0);
-  *((uint64_t *)buffer) = (uint64_t)(*written) - sizeof(placeholder);
   return 0;
 }
 
@@ -0,0 +1,326 @@
+/* stripes.cc - large payloads split over several data connections
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "common.hh"
+#include "messages.h"
+#include "pocl_debug.h"
+#include "stripes.hh"
+
+/** A payload being sent; its chunks are taken in order by whichever writer
+ * thread is free, which keeps a slow connection from holding up the rest. */
+struct StripedTransfers::SendJob {
+  uint64_t MsgId;
+  const uint8_t *Data;
+  uint64_t Size;
+  std::atomic<uint64_t> Next{0};
+  /** Offsets of chunks whose connection failed, to be sent again */
+  std::vector<uint64_t> Lost;
+  /** Writer threads still working on the job */
+  unsigned Busy = 0;
+  bool Failed = false;
+};
+
+StripedTransfers::StripedTransfers(ExitHelper *e, TrafficMonitor *tm,
+                                   uint32_t Chunk, CompletionFn D)
+    : eh(e), netstat(tm), ChunkSize(Chunk), Done(std::move(D)) {
+  if (ChunkSize == 0)
+    ChunkSize = 1 << 20;
+  eh->onExit([this] {
+    std::unique_lock<std::mutex> L(Mutex);
+    Exiting = true;
+    /* wakes up the readers blocked in read() */
+    for (auto &C : Connections)
+      shutdown(C->Fd, SHUT_RDWR);
+    Cond.notify_all();
+  });
+}
+
+StripedTransfers::~StripedTransfers() {
+  for (auto *List : {&Connections, &Retired}) {
+    for (auto &C : *List) {
+      C->Reader.join();
+      C->Writer.join();
+      close(C->Fd);
+    }
+  }
+  for (auto &P : Pending)
+    delete P.second.Req;
+}
+
+bool StripedTransfers::attach(int Fd) {
+  std::unique_lock<std::mutex> L(Mutex);
+  if (Exiting || Connections.size() >= POCL_REMOTE_MAX_STRIPES)
+    return false;
+  Connections.emplace_back(new Connection);
+  Connection *C = Connections.back().get();
+  C->Fd = Fd;
+  C->Reader = std::thread(&StripedTransfers::readThread, this, C);
+  C->Writer = std::thread(&StripedTransfers::writeThread, this, C);
+  POCL_MSG_PRINT_INFO("Data connection %" PRIuS " attached, fd=%d\n",
+                      Connections.size(), Fd);
+  return true;
+}
+
+void StripedTransfers::setMaxPayload(uint64_t Size) {
+  std::unique_lock<std::mutex> L(Mutex);
+  MaxPayload = Size;
+}
+
+size_t StripedTransfers::size() {
+  std::unique_lock<std::mutex> L(Mutex);
+  return Connections.size();
+}
+
+/* Returns the request of In and forgets the payload, if both the request
+ * and all of its chunks have arrived. Called with Mutex held. */
+Request *StripedTransfers::takeIfComplete(uint64_t MsgId, Incoming &In) {
+  if (In.Req == nullptr || In.Failed || In.Readers > 0 ||
+      In.Received < In.Data.size())
+    return nullptr;
+  Request *R = In.Req;
+  if (In.Data.size() != R->extra_size) {
+    POCL_MSG_ERR("Message ID %" PRIu64 ": striped payload of %" PRIuS
+                 " bytes for a request of %" PRIu64 "\n",
+                 MsgId, In.Data.size(), R->extra_size);
+    In.Data.resize(R->extra_size);
+  }
+  R->extra_data = std::move(In.Data);
+  Pending.erase(MsgId);
+  return R;
+}
+
+/* Takes C out of service after a read or write on it failed. Any chunk
+ * still buffered on it is gone, so every payload that hasn't been completed
+ * fails; the requests that have already arrived for them are returned for
+ * failRequests(). Called with Mutex held. */
+std::vector<Request *> StripedTransfers::retire(Connection *C) {
+  std::vector<Request *> Failed;
+  if (C->Dead)
+    return Failed;
+  C->Dead = true;
+  /* makes the other thread of the connection notice */
+  shutdown(C->Fd, SHUT_RDWR);
+  for (auto It = Connections.begin(); It != Connections.end(); ++It) {
+    if (It->get() == C) {
+      Retired.push_back(std::move(*It));
+      Connections.erase(It);
+      break;
+    }
+  }
+  if (!Exiting)
+    POCL_MSG_WARN("Data connection fd=%d failed, %" PRIuS " left\n", C->Fd,
+                  Connections.size());
+
+  for (auto &P : Pending) {
+    Incoming &In = P.second;
+    if (In.Failed)
+      continue;
+    In.Failed = true;
+    if (In.Req != nullptr)
+      Failed.push_back(In.Req);
+    In.Req = nullptr;
+    if (In.Readers == 0)
+      PayloadVector().swap(In.Data);
+  }
+  Cond.notify_all();
+  return Failed;
+}
+
+void StripedTransfers::failRequests(const std::vector<Request *> &Reqs) {
+  for (Request *R : Reqs) {
+    POCL_MSG_ERR("Message ID %" PRIu64 ": striped payload lost\n",
+                 uint64_t(R->req.msg_id));
+    Done(R, false);
+  }
+}
+
+bool StripedTransfers::receive(Request *req) {
+  std::unique_lock<std::mutex> L(Mutex);
+  Incoming &In = Pending[req->req.msg_id];
+  if (In.Failed) {
+    L.unlock();
+    failRequests({req});
+    return false;
+  }
+  In.Req = req;
+  if (In.Data.empty())
+    In.Data.resize(req->extra_size);
+  return takeIfComplete(req->req.msg_id, In) != nullptr;
+}
+
+/* Reads and drops Size bytes from Fd. */
+static bool discardBytes(int Fd, uint64_t Size, TrafficMonitor *netstat) {
+  uint8_t Buf[4096];
+  while (Size > 0) {
+    size_t N = std::min<uint64_t>(Size, sizeof(Buf));
+    if (read_full(Fd, Buf, N, netstat) != (ssize_t)N)
+      return false;
+    Size -= N;
+  }
+  return true;
+}
+
+void StripedTransfers::readThread(Connection *C) {
+  StripeChunkHeader_t H;
+  std::unique_lock<std::mutex> L(Mutex, std::defer_lock);
+  while (read_full(C->Fd, &H, sizeof(H), netstat) == sizeof(H)) {
+    L.lock();
+    if (H.size == 0 || H.size > ChunkSize || H.total > MaxPayload ||
+        H.offset > H.total || H.size > H.total - H.offset) {
+      POCL_MSG_ERR("Invalid chunk of message ID %" PRIu64 " on fd=%d\n",
+                   uint64_t(H.msg_id), C->Fd);
+      break;
+    }
+    Incoming &In = Pending[H.msg_id];
+    if (In.Failed) {
+      L.unlock();
+      if (!discardBytes(C->Fd, H.size, netstat)) {
+        L.lock();
+        break;
+      }
+      continue;
+    }
+    if (In.Data.empty())
+      In.Data.resize(H.total);
+    if (H.total != In.Data.size()) {
+      POCL_MSG_ERR("Invalid chunk of message ID %" PRIu64 " on fd=%d\n",
+                   uint64_t(H.msg_id), C->Fd);
+      break;
+    }
+    /* read in place; the payload stays put while Readers > 0 */
+    ++In.Readers;
+    uint8_t *Dst = In.Data.data() + H.offset;
+    L.unlock();
+    bool Ok = read_full(C->Fd, Dst, H.size, netstat) == (ssize_t)H.size;
+    L.lock();
+    --In.Readers;
+    if (In.Failed && In.Readers == 0)
+      PayloadVector().swap(In.Data);
+    if (!Ok)
+      break;
+    In.Received += H.size;
+    Request *R = takeIfComplete(H.msg_id, In);
+    L.unlock();
+    if (R)
+      Done(R, true);
+  }
+  if (!L.owns_lock())
+    L.lock();
+  std::vector<Request *> Failed = retire(C);
+  L.unlock();
+  failRequests(Failed);
+}
+
+/* Picks the next chunk of J to send: first in order, then the ones lost
+ * with other connections. */
+bool StripedTransfers::takeChunk(SendJob *J, uint64_t &Offset) {
+  Offset = J->Next.fetch_add(ChunkSize);
+  if (Offset < J->Size)
+    return true;
+  std::unique_lock<std::mutex> L(Mutex);
+  if (J->Lost.empty())
+    return false;
+  Offset = J->Lost.back();
+  J->Lost.pop_back();
+  return true;
+}
+
+void StripedTransfers::writeThread(Connection *C) {
+  std::unique_lock<std::mutex> L(Mutex);
+  while (true) {
+    Cond.wait(L, [&] { return Exiting || C->Dead || C->Job != nullptr; });
+    SendJob *J = C->Job;
+    if (Exiting || C->Dead) {
+      /* the sender waits for every writer it gave the job to; the chunks
+       * this one didn't take are left to the others */
+      if (J != nullptr) {
+        if (Exiting)
+          J->Failed = true;
+        C->Job = nullptr;
+        if (--J->Busy == 0)
+          Cond.notify_all();
+      }
+      return;
+    }
+    L.unlock();
+
+    bool Ok = true;
+    uint64_t Offset;
+    while (Ok && takeChunk(J, Offset)) {
+      StripeChunkHeader_t H;
+      H.msg_id = J->MsgId;
+      H.offset = Offset;
+      H.size = std::min<uint64_t>(ChunkSize, J->Size - Offset);
+      H.total = J->Size;
+      Ok = write_full(C->Fd, &H, sizeof(H), netstat) == 0 &&
+           write_full(C->Fd, const_cast<uint8_t *>(J->Data + Offset), H.size,
+                      netstat) == 0;
+    }
+
+    L.lock();
+    std::vector<Request *> Failed;
+    if (!Ok) {
+      /* a partial chunk is dropped by the client's reader */
+      J->Lost.push_back(Offset);
+      Failed = retire(C);
+    }
+    C->Job = nullptr;
+    if (--J->Busy == 0)
+      Cond.notify_all();
+    if (!Ok) {
+      L.unlock();
+      failRequests(Failed);
+      return;
+    }
+  }
+}
+
+int StripedTransfers::send(uint64_t MsgId, const uint8_t *Data,
+                           uint64_t Size) {
+  std::unique_lock<std::mutex> S(SendMutex);
+  SendJob J;
+  J.MsgId = MsgId;
+  J.Data = Data;
+  J.Size = Size;
+
+  std::unique_lock<std::mutex> L(Mutex);
+  /* Until every chunk is out: connections that fail on the way leave their
+   * chunks to the ones still working. */
+  while (J.Next.load() < J.Size || !J.Lost.empty()) {
+    /* the writers may be gone already */
+    if (Exiting || J.Failed || Connections.empty())
+      return -1;
+    for (auto &C : Connections) {
+      C->Job = &J;
+      ++J.Busy;
+    }
+    Cond.notify_all();
+    Cond.wait(L, [&] { return J.Busy == 0; });
+  }
+  return J.Failed ? -1 : 0;
+}
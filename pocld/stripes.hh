@@ -0,0 +1,141 @@
+/* stripes.hh - large payloads split over several data connections
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to
+   deal in the Software without restriction, including without limitation the
+   rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+   sell copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+   IN THE SOFTWARE.
+*/
+
+#ifndef POCLD_STRIPES_HH
+#define POCLD_STRIPES_HH
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hh"
+#include "traffic_monitor.hh"
+
+#ifdef __GNUC__
+#pragma GCC visibility push(hidden)
+#endif
+
+/**
+ * The extra data connections of a client session. Buffer and image contents
+ * larger than a chunk are split into chunks that are spread over all of the
+ * connections, so that a single large transfer is carried by several TCP
+ * streams and copied by several threads instead of queueing up behind one
+ * socket. Every connection has a thread reading incoming chunks and one
+ * writing outgoing ones.
+ */
+class StripedTransfers {
+public:
+  /** Called from a reader thread with a request whose striped payload has
+   * been completed after the request itself arrived. Ok is false if the
+   * payload was lost with a data connection; the request then has to be
+   * failed. */
+  typedef std::function<void(Request *, bool Ok)> CompletionFn;
+
+  StripedTransfers(ExitHelper *eh, TrafficMonitor *tm, uint32_t ChunkSize,
+                   CompletionFn Done);
+  ~StripedTransfers();
+
+  /** Takes over Fd as a data connection of the session. Returns false if
+   * the session already has the maximum number of them. */
+  bool attach(int Fd);
+
+  /** Sets the largest payload the client may announce in a chunk header;
+   * nothing larger can fit in the devices anyway. */
+  void setMaxPayload(uint64_t Size);
+
+  /** Number of working data connections. A connection is dropped as soon as
+   * reading from or writing to it fails; with none left, the payloads go
+   * through the command sockets again. */
+  size_t size();
+
+  /** Claims the striped payload of a write request. Returns true if all of
+   * its chunks are already in; the payload is then in req->extra_data.
+   * Otherwise req is passed to the completion function once the last chunk
+   * has arrived, or once the payload has been lost. */
+  bool receive(Request *req);
+
+  /** Sends Size bytes of Data as the striped payload of the reply to message
+   * MsgId. Chunks lost with a connection are resent over the remaining ones.
+   * Returns 0 once everything has been written, -1 if no connection is
+   * left. */
+  int send(uint64_t MsgId, const uint8_t *Data, uint64_t Size);
+
+private:
+  struct SendJob;
+  struct Connection {
+    int Fd;
+    std::thread Reader;
+    std::thread Writer;
+    /** The payload being sent, if any */
+    SendJob *Job = nullptr;
+    /** Set once reading or writing has failed */
+    bool Dead = false;
+  };
+  /** A payload being received */
+  struct Incoming {
+    PayloadVector Data;
+    uint64_t Received = 0;
+    /** Chunks being read into Data by the reader threads */
+    unsigned Readers = 0;
+    Request *Req = nullptr;
+    /** Some of the chunks were lost with a connection. The entry stays
+     * around so that the rest of them are dropped. */
+    bool Failed = false;
+  };
+
+  void readThread(Connection *C);
+  void writeThread(Connection *C);
+  Request *takeIfComplete(uint64_t MsgId, Incoming &In);
+  bool takeChunk(SendJob *J, uint64_t &Offset);
+  std::vector<Request *> retire(Connection *C);
+  void failRequests(const std::vector<Request *> &Reqs);
+
+  ExitHelper *eh;
+  TrafficMonitor *netstat;
+  uint32_t ChunkSize;
+  CompletionFn Done;
+
+  std::mutex Mutex;
+  std::condition_variable Cond;
+  bool Exiting = false;
+  uint64_t MaxPayload = UINT64_MAX;
+  std::vector<std::unique_ptr<Connection>> Connections;
+  /** Connections that failed; their threads are joined in the destructor */
+  std::vector<std::unique_ptr<Connection>> Retired;
+  std::unordered_map<uint64_t, Incoming> Pending;
+  /** Payloads are sent one at a time, each over all of the connections */
+  std::mutex SendMutex;
+};
+
+typedef std::unique_ptr<StripedTransfers> StripedTransfersUPtr;
+
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
+#endif
@@ -31,7 +31,8 @@
 
 TrafficMonitor::TrafficMonitor(ExitHelper *e, std::string &client_id)
     : tx_bytes_submitted(0), tx_bytes_confirmed(0), rx_bytes_requested(0),
-      rx_bytes_confirmed(0), eh(e), client_id(client_id) {
+      rx_bytes_confirmed(0), tx_payload_raw(0), tx_payload_wire(0),
+      rx_payload_raw(0), rx_payload_wire(0), eh(e), client_id(client_id) {
   const char *env_p = std::getenv("POCL_TRAFFIC_LOG_DIR");
   if (env_p == nullptr || env_p[0] == '\0') {
     POCL_MSG_PRINT_INFO(
@@ -58,7 +59,8 @@ void TrafficMonitor::fileWriterThread() {
 
   std::ofstream f(base_path / filename.str(), std::ios::out | std::ios::trunc);
   f << "timestamp,tx_bytes_submitted,tx_bytes_confirmed,rx_bytes_requested,rx_"
-       "bytes_confirmed"
+       "bytes_confirmed,tx_payload_raw,tx_payload_wire,rx_payload_raw,rx_"
+       "payload_wire"
     << std::endl;
   std::string fieldsep = ",";
   std::string linesep = "\n";
@@ -67,7 +69,8 @@ void TrafficMonitor::fileWriterThread() {
     f << std::chrono::steady_clock::now().time_since_epoch().count() << fieldsep
       << tx_bytes_submitted << fieldsep << tx_bytes_confirmed << fieldsep
       << rx_bytes_requested << fieldsep << rx_bytes_confirmed << fieldsep
-      << linesep;
+      << tx_payload_raw << fieldsep << tx_payload_wire << fieldsep
+      << rx_payload_raw << fieldsep << rx_payload_wire << linesep;
 
     using std::chrono::operator""ms;
     std::this_thread::sleep_for(10ms);
@@ -40,6 +40,11 @@ class TrafficMonitor {
   std::atomic_uint64_t tx_bytes_confirmed;
   std::atomic_uint64_t rx_bytes_requested;
   std::atomic_uint64_t rx_bytes_confirmed;
+  /* buffer payload bytes before and after the payload codec */
+  std::atomic_uint64_t tx_payload_raw;
+  std::atomic_uint64_t tx_payload_wire;
+  std::atomic_uint64_t rx_payload_raw;
+  std::atomic_uint64_t rx_payload_wire;
   ExitHelper *eh;
   std::thread file_thread;
   std::string client_id;
@@ -55,6 +60,14 @@ public:
   inline void txConfirmed(uint64_t bytes) { tx_bytes_confirmed += bytes; }
   inline void rxRequested(uint64_t bytes) { rx_bytes_requested += bytes; }
   inline void rxConfirmed(uint64_t bytes) { rx_bytes_confirmed += bytes; }
+  inline void txPayload(uint64_t raw, uint64_t wire) {
+    tx_payload_raw += raw;
+    tx_payload_wire += wire;
+  }
+  inline void rxPayload(uint64_t raw, uint64_t wire) {
+    rx_payload_raw += raw;
+    rx_payload_wire += wire;
+  }
 };
 
 #ifdef __GNUC__
@@ -24,6 +24,7 @@
 
 #include <cassert>
 #include <memory>
+#include <sys/mman.h>
 #include <unordered_set>
 
 #include "common.hh"
@@ -37,8 +38,10 @@
 #include "virtual_cl_context.hh"
 
 #include "daemon.hh"
+#include "guarded_queue.hh"
 #include "peer_handler.hh"
 #include "reply_th.hh"
+#include "stripes.hh"
 #include "tracing.h"
 #include "traffic_monitor.hh"
 
@@ -90,6 +93,11 @@ public:
 
 class VirtualCLContext : public VirtualContextBase {
   PoclDaemon *Daemon;
+  /** Declared before the threads that use it so that it outlives them */
+  ExitHelper exit_helper;
+  /** Data connections for striped payloads, null if the client has none.
+   * Used by the reply writers, so it has to outlive them. */
+  StripedTransfersUPtr stripes;
   ReplyQueueThreadUPtr write_slow;
   ReplyQueueThreadUPtr write_fast;
 #ifdef ENABLE_RDMA
@@ -101,8 +109,6 @@ class VirtualCLContext : public VirtualContextBase {
   std::atomic_int command_fd;
   std::atomic_int stream_fd;
 
-  ExitHelper exit_helper;
-
   std::vector<cl::Platform> PlatformList;
   std::vector<SharedContextBase *> SharedContextList;
   size_t TotalDevices;
@@ -110,9 +116,9 @@ class VirtualCLContext : public VirtualContextBase {
   size_t current_printf_position;
   std::mutex printf_lock;
 
-  std::condition_variable main_cond;
   std::mutex main_mutex;
-  std::deque<Request *> main_que;
+  /** Non-queued requests from the reader, consumed by run() */
+  GuardedQueue<Request *> main_que;
 
 #ifdef ENABLE_RDMA
   std::shared_ptr<RdmaConnection> client_rdma;
@@ -128,6 +134,11 @@ class VirtualCLContext : public VirtualContextBase {
 #endif
   TrafficMonitor *netstat;
 
+  /** Shared memory window of a same-host client, null if there's none. Set
+   * once from the daemon's local socket thread. */
+  std::atomic<uint8_t *> SharedWindow{nullptr};
+  size_t SharedWindowSize = 0;
+
   std::unordered_set<uint32_t> BufferIDset;
   std::unordered_set<uint32_t> SamplerIDset;
   std::unordered_set<uint32_t> ImageIDset;
@@ -142,19 +153,24 @@ public:
   VirtualCLContext() = default;
 
   ~VirtualCLContext() {
-    // stop threads
+    // stop threads; run() has returned, the session thread deletes the
+    // context after it
     assert(exit_helper.exit_requested());
     POCL_MSG_PRINT_GENERAL("VCTX: DEST\n");
+    // The peer threads use exit_helper and push to the shared contexts, so
+    // they go first. Not under main_mutex, their readers may need it.
+    peers.reset();
 
     // make sure no shared context tries to broadcast stuff
     std::unique_lock<std::mutex> lock(main_mutex);
-    // TOFIX: peers cannot be freed without crashing, let them leak for now.
-    // peers.reset();
     for (auto i : SharedContextList) {
       delete i;
     }
     SharedContextList.clear();
     PlatformList.clear();
+
+    if (SharedWindow.load())
+      munmap(SharedWindow.load(), SharedWindowSize);
   }
 
   /****************************************************************************************************************/
@@ -168,6 +184,10 @@ public:
 
   virtual void queuedPush(Request *req) override;
 
+  virtual bool attachSharedMemory(void *base, size_t size) override;
+
+  virtual bool attachStripe(int fd) override;
+
 #ifdef ENABLE_RDMA
   virtual bool clientUsesRdma() override { return (client_uses_rdma != 0); };
 
@@ -193,6 +213,8 @@ public:
 private:
   int checkPlatformDeviceValidity(Request *req);
 
+  bool resolveSharedPayload(Request *req);
+
   size_t initPlatforms();
 
   void ServerInfo(Request *req, Reply *rep);
@@ -251,6 +273,8 @@ size_t VirtualCLContext::init(PoclDaemon *d, ClientConnections_t conns,
   }
 #endif
 
+  exit_helper.onExit([this] { main_que.close(); });
+
   std::string id_string = std::to_string(session);
   netstat = new TrafficMonitor(&exit_helper, id_string);
 
@@ -264,8 +288,32 @@ size_t VirtualCLContext::init(PoclDaemon *d, ClientConnections_t conns,
                             &client_mem_regions, &client_regions_mutex));
   }
 #endif
-  write_slow = ReplyQueueThreadUPtr(
-      new ReplyQueueThread(&stream_fd, this, &exit_helper, netstat, "WT_S"));
+  if (params.payload_codecs != POCL_REMOTE_CODEC_NONE)
+    POCL_MSG_PRINT_INFO("Compressing payloads of %" PRIu32 " bytes and more\n",
+                        uint32_t(params.codec_threshold));
+  if (params.num_stripes > 0) {
+    stripes = StripedTransfersUPtr(new StripedTransfers(
+        &exit_helper, netstat, params.stripe_chunk,
+        [this](Request *req, bool ok) {
+          /* the destructor deletes the shared contexts under main_mutex */
+          std::unique_lock<std::mutex> lock(main_mutex);
+          if (exit_helper.exit_requested())
+            delete req;
+          else if (!ok) {
+            Reply *reply = new Reply(req);
+            replyFail(&reply->rep, &req->req, CL_OUT_OF_RESOURCES);
+            write_fast->pushReply(reply);
+          } else
+            SharedContextList[req->req.pid]->queuedPush(req);
+        }));
+    POCL_MSG_PRINT_INFO("Striping payloads of more than %" PRIu32
+                        " bytes over %u data connections\n",
+                        uint32_t(params.stripe_chunk),
+                        unsigned(params.num_stripes));
+  }
+  write_slow = ReplyQueueThreadUPtr(new ReplyQueueThread(
+      &stream_fd, this, &exit_helper, netstat, "WT_S", params.payload_codecs,
+      params.codec_threshold, stripes.get()));
   write_fast = ReplyQueueThreadUPtr(
       new ReplyQueueThread(&command_fd, this, &exit_helper, netstat, "WT_F"));
 
@@ -274,6 +322,19 @@ size_t VirtualCLContext::init(PoclDaemon *d, ClientConnections_t conns,
                                           &exit_helper, netstat));
   initPlatforms();
 
+  if (stripes) {
+    /* no striped payload can be larger than the largest device memory */
+    uint64_t MaxPayload = 0;
+    for (cl::Platform &P : PlatformList) {
+      std::vector<cl::Device> Devices;
+      P.getDevices(CL_DEVICE_TYPE_ALL, &Devices);
+      for (cl::Device &D : Devices)
+        MaxPayload =
+            std::max(MaxPayload, D.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>());
+    }
+    stripes->setMaxPayload(MaxPayload);
+  }
+
   POCL_MSG_PRINT_INFO("Created shared contexts for %" PRIuS
                       " platforms / %" PRIuS " devices\n",
                       PlatformList.size(), TotalDevices);
@@ -287,6 +348,8 @@ void VirtualCLContext::updateSockets(std::optional<int> fd_command,
     command_fd = fd_command.value();
   if (fd_stream.has_value())
     stream_fd = fd_stream.value();
+  write_fast->wake();
+  write_slow->wake();
 }
 
 size_t VirtualCLContext::initPlatforms() {
@@ -323,9 +386,10 @@ void VirtualCLContext::nonQueuedPush(Request *req) {
   POCL_MSG_PRINT_GENERAL("VCTX NON-QUEUED PUSH (msg: %" PRIu64 ")\n",
                          uint64_t(req->req.msg_id));
 
-  std::unique_lock<std::mutex> lock(main_mutex);
-  main_que.push_back(req);
-  main_cond.notify_one();
+  /* This runs on the reader thread that serves every session, so it must
+   * not wait for this session's queue to drain. */
+  if (!main_que.pushNoWait(req))
+    delete req;
 }
 
 void VirtualCLContext::queuedPush(Request *req) {
@@ -336,9 +400,85 @@ void VirtualCLContext::queuedPush(Request *req) {
   POCL_MSG_PRINT_GENERAL(
       "VCTX QUEUED PUSH (msg: %" PRIu64 ", event: %" PRIu64 ")\n",
       uint64_t(req->req.msg_id), uint64_t(req->req.event_id));
+  if (req->extra_wire_size > 0)
+    netstat->rxPayload(req->extra_size, req->extra_wire_size);
+  if (req->req.payload_codec == POCL_REMOTE_PAYLOAD_SHM &&
+      !resolveSharedPayload(req)) {
+    Reply *reply = new Reply(req);
+    replyFail(&reply->rep, &req->req, CL_INVALID_VALUE);
+    write_fast->pushReply(reply);
+    return;
+  }
+  /* A striped write waits for the rest of its chunks; the reader of the last
+   * one passes it on. Reads only ask for a striped reply. */
+  if (req->req.payload_codec == POCL_REMOTE_PAYLOAD_STRIPED &&
+      req->extra_size > 0) {
+    if (!stripes) {
+      Reply *reply = new Reply(req);
+      replyFail(&reply->rep, &req->req, CL_INVALID_VALUE);
+      write_fast->pushReply(reply);
+      return;
+    }
+    if (!stripes->receive(req))
+      return;
+  }
   SharedContextList[req->req.pid]->queuedPush(req);
 }
 
+bool VirtualCLContext::attachSharedMemory(void *base, size_t size) {
+  if (SharedWindow.load() != nullptr)
+    return false;
+  SharedWindowSize = size;
+  SharedWindow.store((uint8_t *)base);
+  POCL_MSG_PRINT_INFO("Attached %" PRIuS " bytes of client shared memory\n",
+                      size);
+  return true;
+}
+
+bool VirtualCLContext::attachStripe(int fd) {
+  return stripes && stripes->attach(fd);
+}
+
+/* Points the request at its payload in the shared memory window, after
+ * checking the client gave a slot that is within it. */
+bool VirtualCLContext::resolveSharedPayload(Request *req) {
+  const RequestMsg_t &m = req->req;
+  uint64_t size = 0;
+  switch (m.message_type) {
+  case MessageType_ReadBuffer:
+    size = m.m.read.size;
+    break;
+  case MessageType_WriteBuffer:
+    size = m.m.write.size;
+    break;
+  case MessageType_ReadBufferRect:
+    size = m.m.read_rect.host_bytes;
+    break;
+  case MessageType_WriteBufferRect:
+    size = m.m.write_rect.host_bytes;
+    break;
+  case MessageType_ReadImageRect:
+    size = m.m.read_image_rect.host_bytes;
+    break;
+  case MessageType_WriteImageRect:
+    size = m.m.write_image_rect.host_bytes;
+    break;
+  default:
+    break;
+  }
+
+  uint8_t *Window = SharedWindow.load();
+  if (Window == nullptr || m.shm_offset > SharedWindowSize ||
+      size > SharedWindowSize - m.shm_offset) {
+    POCL_MSG_ERR("Message ID %" PRIu64 ": payload of %" PRIu64
+                 " bytes at %" PRIu64 " is outside of the shared memory\n",
+                 uint64_t(m.msg_id), size, uint64_t(m.shm_offset));
+    return false;
+  }
+  req->shared_data = Window + m.shm_offset;
+  return true;
+}
+
 void VirtualCLContext::notifyEvent(uint64_t event_id, cl_int status) {
   POCL_MSG_PRINT_EVENTS("Updating event %" PRIu64 " status to %d\n", event_id,
                         status);
@@ -401,6 +541,7 @@ int VirtualCLContext::checkPlatformDeviceValidity(Request *req) {
 
 int VirtualCLContext::run() {
   Reply *reply;
+  std::vector<Request *> batch;
   while (1) {
 
     if (exit_helper.exit_requested()) {
@@ -409,12 +550,13 @@ int VirtualCLContext::run() {
       return e;
     }
 
-    std::unique_lock<std::mutex> lock(main_mutex);
-    if (main_que.size() > 0) {
-      Request *request = main_que.front();
-      main_que.pop_front();
-      lock.unlock();
+    batch.clear();
+    if (main_que.popBatch(batch) == 0) {
+      main_que.wait_cond();
+      continue;
+    }
 
+    for (Request *request : batch) {
       reply = nullptr;
       if (request->req.message_type != MessageType_MigrateD2D &&
           request->req.message_type != MessageType_RdmaBufferRegistration) {
@@ -543,12 +685,6 @@ int VirtualCLContext::run() {
         write_fast->pushReply(reply);
         // Reply frees the request when destroyed
       }
-
-    } else {
-      auto now = std::chrono::system_clock::now();
-      std::chrono::duration<unsigned long> d(3);
-      now += d;
-      main_cond.wait_until(lock, now);
     }
   }
 }
@@ -45,6 +45,14 @@ public:
 
   virtual void queuedPush(Request *req) = 0;
 
+  /** Takes over a mapped shared memory window of a same-host client. Returns
+   * false if the session already has one. */
+  virtual bool attachSharedMemory(void *base, size_t size) = 0;
+
+  /** Takes over fd as a data connection for striped payloads. Returns false
+   * if the session doesn't accept another one. */
+  virtual bool attachStripe(int fd) = 0;
+
 #ifdef ENABLE_RDMA
   virtual bool clientUsesRdma() = 0;
 
@@ -0,0 +1,243 @@
+/* Tests kernels that index their outputs by the group id next to kernels
+   that only use the global id, with and without a global offset. The remote
+   aggregate device may divide launches of the latter among its members, and
+   must not divide the former.
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+// Enable OpenCL C++ exceptions
+#define CL_HPP_ENABLE_EXCEPTIONS
+#include <CL/opencl.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "pocl_opencl.h"
+
+#define NUM_ELEMS 4096
+#define LOCAL_SIZE 64
+#define WIDTH 32
+#define HEIGHT 48
+#define Y_OFFSET 4
+
+/* Only uses the global ids. */
+static const char *GLOBAL_ID_SOURCE = R"RAW(
+
+kernel void scale (global const uint *in, global uint *out, uint k)
+{
+  size_t i = get_global_id (0);
+  out[i] = in[i] * k + (uint)i;
+}
+
+kernel void in_place (global uint *data)
+{
+  size_t i = get_global_id (0);
+  data[i] = data[i] * 2 + 1;
+}
+
+kernel void sparse (global uint *data)
+{
+  size_t i = get_global_id (0);
+  if (i % 3 == 0)
+    data[i] = (uint)i;
+}
+
+kernel void rows (global uint *out, uint width)
+{
+  size_t x = get_global_id (0), y = get_global_id (1);
+  out[y * width + x] = (uint)(y * 1000 + x);
+}
+
+)RAW";
+
+static const char *GROUP_ID_SOURCE = R"RAW(
+
+kernel void group_sums (global const uint *in, global uint *sums,
+                        local uint *scratch)
+{
+  size_t l = get_local_id (0);
+  scratch[l] = in[get_global_id (0)];
+  barrier (CLK_LOCAL_MEM_FENCE);
+  if (l == 0)
+    {
+      uint s = 0;
+      for (size_t j = 0; j < get_local_size (0); ++j)
+        s += scratch[j];
+      sums[get_group_id (0)] = s;
+    }
+}
+
+kernel void group_ids (global uint *out)
+{
+  size_t i = get_global_linear_id ();
+  out[i * 4 + 0] = get_group_id (0);
+  out[i * 4 + 1] = get_group_id (1);
+  out[i * 4 + 2] = get_num_groups (1);
+  out[i * 4 + 3] = get_global_id (1);
+}
+
+)RAW";
+
+static unsigned Errors = 0;
+
+static void compare(const std::vector<cl_uint> &Result,
+                    const std::vector<cl_uint> &Expected, const char *What) {
+  for (size_t I = 0; I < Expected.size(); ++I)
+    if (Result[I] != Expected[I]) {
+      std::cout << What << ": element " << I << " is " << Result[I]
+                << " instead of " << Expected[I] << "\n";
+      ++Errors;
+      return;
+    }
+}
+
+int main(void) {
+  try {
+    cl::Context Context = cl::Context::getDefault();
+    cl::Device Device = cl::Device::getDefault();
+    if (!Device.getInfo<CL_DEVICE_COMPILER_AVAILABLE>()) {
+      std::cout << "Device has no compiler, SKIP\n";
+      return 77;
+    }
+    cl::CommandQueue Queue = cl::CommandQueue::getDefault();
+
+    cl::Program GlobalIdProgram(Context, GLOBAL_ID_SOURCE);
+    GlobalIdProgram.build();
+    cl::Program GroupIdProgram(Context, GROUP_ID_SOURCE);
+    GroupIdProgram.build();
+
+    std::vector<cl_uint> In(NUM_ELEMS), Result(NUM_ELEMS);
+    for (size_t I = 0; I < NUM_ELEMS; ++I)
+      In[I] = (cl_uint)(I * 7 + 3);
+    cl::Buffer InBuffer(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                        NUM_ELEMS * sizeof(cl_uint), In.data());
+    cl::Buffer Data(Context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                    NUM_ELEMS * sizeof(cl_uint), In.data());
+    cl::Buffer Out(Context, CL_MEM_READ_WRITE, NUM_ELEMS * sizeof(cl_uint));
+
+    {
+      cl::Kernel Kernel(GlobalIdProgram, "scale");
+      Kernel.setArg(0, InBuffer);
+      Kernel.setArg(1, Out);
+      Kernel.setArg(2, (cl_uint)5);
+      Queue.enqueueNDRangeKernel(Kernel, cl::NullRange, cl::NDRange(NUM_ELEMS),
+                                 cl::NDRange(LOCAL_SIZE));
+      Queue.enqueueReadBuffer(Out, CL_TRUE, 0, NUM_ELEMS * sizeof(cl_uint),
+                              Result.data());
+      std::vector<cl_uint> Expected(NUM_ELEMS);
+      for (size_t I = 0; I < NUM_ELEMS; ++I)
+        Expected[I] = In[I] * 5 + (cl_uint)I;
+      compare(Result, Expected, "scale");
+    }
+
+    {
+      /* Read-modify-write in place, then writes to every third element
+         only, from a global offset. The rest must keep their contents. */
+      cl::Kernel InPlace(GlobalIdProgram, "in_place");
+      InPlace.setArg(0, Data);
+      Queue.enqueueNDRangeKernel(InPlace, cl::NullRange,
+                                 cl::NDRange(NUM_ELEMS),
+                                 cl::NDRange(LOCAL_SIZE));
+      cl::Kernel Sparse(GlobalIdProgram, "sparse");
+      Sparse.setArg(0, Data);
+      Queue.enqueueNDRangeKernel(Sparse, cl::NDRange(LOCAL_SIZE),
+                                 cl::NDRange(NUM_ELEMS - 2 * LOCAL_SIZE),
+                                 cl::NDRange(LOCAL_SIZE));
+      Queue.enqueueReadBuffer(Data, CL_TRUE, 0, NUM_ELEMS * sizeof(cl_uint),
+                              Result.data());
+      std::vector<cl_uint> Expected(NUM_ELEMS);
+      for (size_t I = 0; I < NUM_ELEMS; ++I) {
+        Expected[I] = In[I] * 2 + 1;
+        if (I >= LOCAL_SIZE && I < NUM_ELEMS - LOCAL_SIZE && I % 3 == 0)
+          Expected[I] = (cl_uint)I;
+      }
+      compare(Result, Expected, "in_place and sparse");
+    }
+
+    {
+      cl::Kernel Kernel(GlobalIdProgram, "rows");
+      Kernel.setArg(0, Out);
+      Kernel.setArg(1, (cl_uint)WIDTH);
+      Queue.enqueueFillBuffer(Out, (cl_uint)0, 0, NUM_ELEMS * sizeof(cl_uint));
+      Queue.enqueueNDRangeKernel(Kernel, cl::NDRange(0, Y_OFFSET),
+                                 cl::NDRange(WIDTH, HEIGHT),
+                                 cl::NDRange(8, 4));
+      Queue.enqueueReadBuffer(Out, CL_TRUE, 0, NUM_ELEMS * sizeof(cl_uint),
+                              Result.data());
+      std::vector<cl_uint> Expected(NUM_ELEMS, 0);
+      for (size_t Y = Y_OFFSET; Y < Y_OFFSET + HEIGHT; ++Y)
+        for (size_t X = 0; X < WIDTH; ++X)
+          Expected[Y * WIDTH + X] = (cl_uint)(Y * 1000 + X);
+      compare(Result, Expected, "rows");
+    }
+
+    {
+      cl::Kernel Kernel(GroupIdProgram, "group_sums");
+      Kernel.setArg(0, InBuffer);
+      Kernel.setArg(1, Out);
+      Kernel.setArg(2, cl::Local(LOCAL_SIZE * sizeof(cl_uint)));
+      Queue.enqueueNDRangeKernel(Kernel, cl::NullRange, cl::NDRange(NUM_ELEMS),
+                                 cl::NDRange(LOCAL_SIZE));
+      const size_t NumGroups = NUM_ELEMS / LOCAL_SIZE;
+      Queue.enqueueReadBuffer(Out, CL_TRUE, 0, NumGroups * sizeof(cl_uint),
+                              Result.data());
+      std::vector<cl_uint> Expected(NumGroups, 0);
+      for (size_t I = 0; I < NUM_ELEMS; ++I)
+        Expected[I / LOCAL_SIZE] += In[I];
+      compare(Result, Expected, "group_sums");
+    }
+
+    {
+      cl::Kernel Kernel(GroupIdProgram, "group_ids");
+      Kernel.setArg(0, Out);
+      const size_t W = 16, H = 32, LW = 8, LH = 4;
+      Queue.enqueueNDRangeKernel(Kernel, cl::NDRange(0, Y_OFFSET),
+                                 cl::NDRange(W, H), cl::NDRange(LW, LH));
+      Queue.enqueueReadBuffer(Out, CL_TRUE, 0, W * H * 4 * sizeof(cl_uint),
+                              Result.data());
+      std::vector<cl_uint> Expected(W * H * 4);
+      for (size_t Y = 0; Y < H; ++Y)
+        for (size_t X = 0; X < W; ++X) {
+          cl_uint *E = &Expected[(Y * W + X) * 4];
+          E[0] = X / LW;
+          E[1] = Y / LH;
+          E[2] = H / LH;
+          E[3] = Y + Y_OFFSET;
+        }
+      compare(Result, Expected, "group_ids");
+    }
+
+    if (Errors) {
+      std::cout << "FAIL: " << Errors << " errors\n";
+      return EXIT_FAILURE;
+    }
+  } catch (cl::Error &Err) {
+    std::cout << "FAIL with OpenCL error = " << Err.err() << " in "
+              << Err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "OK" << std::endl;
+  return EXIT_SUCCESS;
+}
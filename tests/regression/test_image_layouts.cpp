@@ -0,0 +1,380 @@
+/* Tests kernel and host access to images whose device storage may be kept
+   in tiles (POCL_CPU_TILED_IMAGES=1) or in the application's own rows, with
+   row and slice pitches wider than the pixels they hold. This includes 1D
+   image arrays whose slice pitch is larger than the row pitch.
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+// Enable OpenCL C++ exceptions
+#define CL_HPP_ENABLE_EXCEPTIONS
+#include <CL/opencl.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "pocl_opencl.h"
+
+static const char *SOURCE = R"RAW(
+
+#pragma OPENCL EXTENSION cl_khr_3d_image_writes : enable
+
+kernel void copy_2d (read_only image2d_t src, write_only image2d_t dst,
+                     global uint4 *out)
+{
+  int2 c = (int2)(get_global_id (0), get_global_id (1));
+  uint4 p = read_imageui (src, c);
+  out[c.y * get_global_size (0) + c.x] = p;
+  write_imageui (dst, c, p + (uint4)(1));
+}
+
+kernel void copy_3d (read_only image3d_t src, write_only image3d_t dst,
+                     global uint4 *out)
+{
+  int4 c = (int4)(get_global_id (0), get_global_id (1), get_global_id (2), 0);
+  uint4 p = read_imageui (src, c);
+  out[(c.z * get_global_size (1) + c.y) * get_global_size (0) + c.x] = p;
+  write_imageui (dst, c, p + (uint4)(1));
+}
+
+kernel void copy_2d_array (read_only image2d_array_t src,
+                           write_only image2d_array_t dst, global uint4 *out)
+{
+  int4 c = (int4)(get_global_id (0), get_global_id (1), get_global_id (2), 0);
+  uint4 p = read_imageui (src, c);
+  out[(c.z * get_global_size (1) + c.y) * get_global_size (0) + c.x] = p;
+  write_imageui (dst, c, p + (uint4)(1));
+}
+
+kernel void copy_1d_array (read_only image1d_array_t src,
+                           write_only image1d_array_t dst, global uint4 *out)
+{
+  int2 c = (int2)(get_global_id (0), get_global_id (1));
+  uint4 p = read_imageui (src, c);
+  out[c.y * get_global_size (0) + c.x] = p;
+  write_imageui (dst, c, p + (uint4)(1));
+}
+
+/* Samples the middle of each 2x2 block of pixels. */
+kernel void linear_2d (read_only image2d_t src, global float4 *out)
+{
+  const sampler_t s = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE
+                      | CLK_FILTER_LINEAR;
+  float2 c = (float2)(get_global_id (0) + 1.0f, get_global_id (1) + 1.0f);
+  out[get_global_id (1) * get_global_size (0) + get_global_id (0)]
+      = read_imagef (src, s, c);
+}
+
+)RAW";
+
+#define PIXEL_SIZE (4 * sizeof(cl_uint))
+
+struct Layout {
+  const char *Kernel;
+  cl_mem_object_type Type;
+  /* For 1D arrays, H is the number of layers; for 2D arrays, D is. */
+  size_t W, H, D;
+  size_t RowPitch, SlicePitch;
+};
+
+static bool isArray1D(const Layout &L) {
+  return L.Type == CL_MEM_OBJECT_IMAGE1D_ARRAY;
+}
+
+static size_t hostOffset(const Layout &L, size_t RowPitch, size_t SlicePitch,
+                         size_t X, size_t Y, size_t Z) {
+  if (isArray1D(L))
+    return Y * SlicePitch + X * PIXEL_SIZE;
+  return Z * SlicePitch + Y * RowPitch + X * PIXEL_SIZE;
+}
+
+static size_t hostSize(const Layout &L, size_t RowPitch, size_t SlicePitch) {
+  if (isArray1D(L))
+    return L.H * SlicePitch;
+  if (L.Type == CL_MEM_OBJECT_IMAGE2D)
+    return L.H * RowPitch;
+  return L.D * SlicePitch;
+}
+
+template <typename ImageT>
+static ImageT createImage(cl::Context &Context, const Layout &L,
+                          cl_mem_flags Flags, void *HostPtr) {
+  cl_image_format Format = {CL_RGBA, CL_UNSIGNED_INT32};
+  cl_image_desc Desc = {};
+  Desc.image_type = L.Type;
+  Desc.image_width = L.W;
+  if (isArray1D(L)) {
+    Desc.image_array_size = L.H;
+  } else {
+    Desc.image_height = L.H;
+    if (L.Type == CL_MEM_OBJECT_IMAGE3D)
+      Desc.image_depth = L.D;
+    else if (L.Type == CL_MEM_OBJECT_IMAGE2D_ARRAY)
+      Desc.image_array_size = L.D;
+  }
+  if (HostPtr) {
+    Desc.image_row_pitch = L.RowPitch;
+    Desc.image_slice_pitch = L.SlicePitch;
+  }
+  cl_int Err;
+  cl_mem Mem =
+      clCreateImage(Context(), Flags, &Format, &Desc, HostPtr, &Err);
+  if (Err != CL_SUCCESS)
+    throw cl::Error(Err, "clCreateImage");
+  return ImageT(Mem);
+}
+
+/* Compares the pixels of HOST, laid out with the given pitches, with the
+   MODEL of the image, which is in tightly packed rows. */
+static unsigned compare(const Layout &L, const char *What, const char *Host,
+                        size_t RowPitch, size_t SlicePitch,
+                        const std::vector<cl_uint> &Model) {
+  unsigned Errors = 0;
+  for (size_t Z = 0; Z < L.D; ++Z)
+    for (size_t Y = 0; Y < L.H; ++Y)
+      for (size_t X = 0; X < L.W; ++X) {
+        const cl_uint *Expected = &Model[((Z * L.H + Y) * L.W + X) * 4];
+        if (std::memcmp(Host + hostOffset(L, RowPitch, SlicePitch, X, Y, Z),
+                        Expected, PIXEL_SIZE) != 0 &&
+            Errors++ < 5)
+          std::cout << L.Kernel << ": " << What << " has a wrong pixel at ("
+                    << X << ", " << Y << ", " << Z << ")\n";
+      }
+  return Errors;
+}
+
+static unsigned readAndCompare(cl::CommandQueue &Queue,
+                               const cl::Image &Image,
+                               const Layout &L, const char *What,
+                               size_t RowPitch, size_t SlicePitch,
+                               const std::vector<cl_uint> &Model) {
+  std::vector<char> Host(hostSize(L, RowPitch, SlicePitch));
+  cl::array<cl::size_type, 3> Origin = {0, 0, 0};
+  cl::array<cl::size_type, 3> Region = {L.W, L.H, L.D};
+  Queue.enqueueReadImage(Image, CL_TRUE, Origin, Region,
+                         RowPitch, isArray1D(L) || L.D > 1 ? SlicePitch : 0,
+                         Host.data());
+  return compare(L, What, Host.data(), RowPitch, SlicePitch, Model);
+}
+
+template <typename ImageT>
+static unsigned testLayout(cl::Context &Context, cl::CommandQueue &Queue,
+                           cl::Program &Program, const Layout &L,
+                           bool UseHostPtr) {
+  unsigned Errors = 0;
+  size_t NumPixels = L.W * L.H * L.D;
+
+  std::vector<cl_uint> Model(NumPixels * 4);
+  std::vector<char> SrcHost(hostSize(L, L.RowPitch, L.SlicePitch), 0x5a);
+  std::vector<char> DstHost(SrcHost.size(), 0x5a);
+  for (size_t Z = 0; Z < L.D; ++Z)
+    for (size_t Y = 0; Y < L.H; ++Y)
+      for (size_t X = 0; X < L.W; ++X) {
+        cl_uint *P = &Model[((Z * L.H + Y) * L.W + X) * 4];
+        P[0] = X;
+        P[1] = Y;
+        P[2] = Z;
+        P[3] = 7;
+        std::memcpy(&SrcHost[hostOffset(L, L.RowPitch, L.SlicePitch, X, Y, Z)],
+                    P, PIXEL_SIZE);
+      }
+
+  cl_mem_flags HostFlag = UseHostPtr ? CL_MEM_USE_HOST_PTR
+                                     : CL_MEM_COPY_HOST_PTR;
+  ImageT Src = createImage<ImageT>(Context, L, CL_MEM_READ_ONLY | HostFlag,
+                                   SrcHost.data());
+  ImageT Dst = createImage<ImageT>(
+      Context, L, CL_MEM_WRITE_ONLY | (UseHostPtr ? HostFlag : 0),
+      UseHostPtr ? DstHost.data() : nullptr);
+  cl::Buffer Out(Context, CL_MEM_WRITE_ONLY, NumPixels * PIXEL_SIZE);
+
+  cl::Kernel Kernel(Program, L.Kernel);
+  Kernel.setArg(0, Src);
+  Kernel.setArg(1, Dst);
+  Kernel.setArg(2, Out);
+  Queue.enqueueNDRangeKernel(Kernel, cl::NullRange,
+                             cl::NDRange(L.W, L.H, L.D));
+
+  std::vector<cl_uint> Pixels(NumPixels * 4);
+  Queue.enqueueReadBuffer(Out, CL_TRUE, 0, NumPixels * PIXEL_SIZE,
+                          Pixels.data());
+  if (Pixels != Model) {
+    std::cout << L.Kernel << ": the kernel read wrong pixels\n";
+    ++Errors;
+  }
+
+  for (cl_uint &C : Model)
+    ++C;
+  Errors += readAndCompare(Queue, Dst, L, "the kernel's output", L.RowPitch,
+                           L.SlicePitch, Model);
+
+  /* Overwrite all but the border, then read it back with tight pitches. */
+  size_t W = L.W - 2, H = isArray1D(L) ? L.H : L.H - 2;
+  size_t D = L.D > 1 ? L.D - 1 : 1;
+  cl::array<cl::size_type, 3> Origin = {1, isArray1D(L) ? 0u : 1u, 0};
+  cl::array<cl::size_type, 3> Region = {W, H, D};
+  std::vector<cl_uint> Patch(W * H * D * 4);
+  for (size_t Z = 0; Z < D; ++Z)
+    for (size_t Y = 0; Y < H; ++Y)
+      for (size_t X = 0; X < W; ++X)
+        for (size_t C = 0; C < 4; ++C) {
+          cl_uint V = 1000 + ((Z * H + Y) * W + X) * 4 + C;
+          Patch[((Z * H + Y) * W + X) * 4 + C] = V;
+          Model[(((Z + Origin[2]) * L.H + Y + Origin[1]) * L.W + X +
+                 Origin[0]) *
+                    4 +
+                C] = V;
+        }
+  Queue.enqueueWriteImage(Dst, CL_FALSE, Origin, Region, 0, 0, Patch.data());
+  size_t TightRow = L.W * PIXEL_SIZE;
+  size_t TightSlice = isArray1D(L) ? TightRow : TightRow * L.H;
+  Errors += readAndCompare(Queue, Dst, L, "a partial write", TightRow,
+                           TightSlice, Model);
+
+  /* Copy the source to the right by one pixel. */
+  cl::array<cl::size_type, 3> SrcOrigin = {0, 0, 0};
+  cl::array<cl::size_type, 3> DstOrigin = {1, 0, 0};
+  cl::array<cl::size_type, 3> CopyRegion = {L.W - 1, L.H, L.D};
+  Queue.enqueueCopyImage(Src, Dst, SrcOrigin, DstOrigin, CopyRegion);
+  for (size_t Z = 0; Z < L.D; ++Z)
+    for (size_t Y = 0; Y < L.H; ++Y)
+      for (size_t X = 1; X < L.W; ++X) {
+        cl_uint *P = &Model[((Z * L.H + Y) * L.W + X) * 4];
+        P[0] = X - 1;
+        P[1] = Y;
+        P[2] = Z;
+        P[3] = 7;
+      }
+
+  cl::array<cl::size_type, 3> Whole = {L.W, L.H, L.D};
+  cl::size_type MapRowPitch = 0, MapSlicePitch = 0;
+  void *Map = Queue.enqueueMapImage(Dst, CL_TRUE, CL_MAP_READ, SrcOrigin,
+                                    Whole, &MapRowPitch, &MapSlicePitch);
+  Errors += compare(L, "a mapping", (const char *)Map, MapRowPitch,
+                    MapSlicePitch, Model);
+  Queue.enqueueUnmapMemObject(Dst, Map);
+  Queue.finish();
+
+  return Errors;
+}
+
+/* The linear filter reads its corner pixels through the same index parts
+   as the integer reads, but from two rows and columns at a time. */
+static unsigned testLinear(cl::Context &Context, cl::CommandQueue &Queue,
+                           cl::Program &Program) {
+  const size_t W = 19, H = 13, RowPitch = W * 4 * sizeof(cl_float) + 64;
+  std::vector<char> Host(H * RowPitch);
+  for (size_t Y = 0; Y < H; ++Y)
+    for (size_t X = 0; X < W; ++X) {
+      cl_float P[4] = {(cl_float)X, (cl_float)Y, (cl_float)(X * Y), 1.0f};
+      std::memcpy(&Host[Y * RowPitch + X * sizeof(P)], P, sizeof(P));
+    }
+
+  cl::Image2D Image(Context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                    cl::ImageFormat(CL_RGBA, CL_FLOAT), W, H, RowPitch,
+                    Host.data());
+  cl::Buffer Out(Context, CL_MEM_WRITE_ONLY,
+                 (W - 1) * (H - 1) * 4 * sizeof(cl_float));
+  cl::Kernel Kernel(Program, "linear_2d");
+  Kernel.setArg(0, Image);
+  Kernel.setArg(1, Out);
+  Queue.enqueueNDRangeKernel(Kernel, cl::NullRange, cl::NDRange(W - 1, H - 1));
+
+  std::vector<cl_float> Result((W - 1) * (H - 1) * 4);
+  Queue.enqueueReadBuffer(Out, CL_TRUE, 0, Result.size() * sizeof(cl_float),
+                          Result.data());
+  unsigned Errors = 0;
+  for (size_t Y = 0; Y < H - 1; ++Y)
+    for (size_t X = 0; X < W - 1; ++X) {
+      const cl_float *R = &Result[(Y * (W - 1) + X) * 4];
+      cl_float Expected[4] = {X + 0.5f, Y + 0.5f,
+                              (X * Y + (X + 1) * Y + X * (Y + 1) +
+                               (X + 1) * (Y + 1)) /
+                                  4.0f,
+                              1.0f};
+      for (size_t C = 0; C < 4; ++C)
+        if (std::abs(R[C] - Expected[C]) > 0.01f * (1.0f + Expected[C])) {
+          if (Errors++ < 5)
+            std::cout << "linear_2d: wrong value at (" << X << ", " << Y
+                      << ")\n";
+          break;
+        }
+    }
+  return Errors;
+}
+
+int main(void) {
+  const size_t Row2D = 37 * PIXEL_SIZE + 48;
+  const size_t Row3D = 11 * PIXEL_SIZE + 16;
+  const size_t Row2DArray = 13 * PIXEL_SIZE + 32;
+  const size_t Row1D = 29 * PIXEL_SIZE;
+  const Layout Layout2D = {"copy_2d", CL_MEM_OBJECT_IMAGE2D, 37, 19, 1,
+                           Row2D, 0};
+  const Layout Layout3D = {"copy_3d", CL_MEM_OBJECT_IMAGE3D, 11, 9, 6,
+                           Row3D, Row3D * 10};
+  const Layout Layout2DArray = {"copy_2d_array", CL_MEM_OBJECT_IMAGE2D_ARRAY,
+                                13, 10, 3, Row2DArray, Row2DArray * 11};
+  /* Layers twice as far apart as the rows are long. */
+  const Layout Layout1DArray = {"copy_1d_array", CL_MEM_OBJECT_IMAGE1D_ARRAY,
+                                29, 4, 1, Row1D, Row1D * 2};
+
+  try {
+    cl::Context Context = cl::Context::getDefault();
+    cl::Device Device = cl::Device::getDefault();
+    if (!Device.getInfo<CL_DEVICE_IMAGE_SUPPORT>()) {
+      std::cout << "Device doesn't support images, SKIP\n";
+      return 77;
+    }
+
+    cl::CommandQueue Queue = cl::CommandQueue::getDefault();
+    cl::Program Program(SOURCE);
+    Program.build();
+
+    unsigned Errors = 0;
+    for (bool UseHostPtr : {false, true}) {
+      Errors += testLayout<cl::Image2D>(Context, Queue, Program, Layout2D,
+                                        UseHostPtr);
+      Errors += testLayout<cl::Image3D>(Context, Queue, Program, Layout3D,
+                                        UseHostPtr);
+      Errors += testLayout<cl::Image2DArray>(Context, Queue, Program,
+                                             Layout2DArray, UseHostPtr);
+      Errors += testLayout<cl::Image1DArray>(Context, Queue, Program,
+                                             Layout1DArray, UseHostPtr);
+    }
+    Errors += testLinear(Context, Queue, Program);
+
+    if (Errors) {
+      std::cout << "FAIL: " << Errors << " errors\n";
+      return EXIT_FAILURE;
+    }
+  } catch (cl::Error &Err) {
+    std::cout << "FAIL with OpenCL error = " << Err.err() << " in "
+              << Err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "OK" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+/* Tests the host-side formatting of printf records of the pthread device
+   (POCL_CPU_DEFERRED_PRINTF=1 with ENABLE_PRINTF_IMMEDIATE_FLUSH=OFF):
+   strings, vectors, field widths and precisions, flags and literal percent
+   signs must come out as the device-side printf formats them.
+
+   The test reads the output back from the file POCL_PRINTF_SINK names.
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+// Enable OpenCL C++ exceptions
+#define CL_HPP_ENABLE_EXCEPTIONS
+#include <CL/opencl.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "pocl_opencl.h"
+
+static const char *SOURCE = R"RAW(
+
+kernel void formats (int i, uint u, float f)
+{
+  printf ("%s|%8s|%-6s|%.3s|%c\n", "abc", "right", "left", "truncated", 'x');
+  printf ("%d|%6d|%-6d|%06d|%+d|% d\n", i, i, i, i, -i, -i);
+  printf ("%u|%x|%X|%#x|%#o|%.5u\n", u, u, u, u, u, 42u);
+  printf ("%f|%.2f|%10.3f|%-12.1e|%+g|%E\n", f, f, -f, f * 1000.0f, f, f);
+  printf ("%%|100%%|%d%%|%%d\n", i);
+  printf ("%v4hld|%v2hlu\n", (int4)(1, -2, 3, -4), (uint2)(5, 6));
+  printf ("%5v2hld|%-4v2hld|\n", (int2)(7, -8), (int2)(9, 10));
+  printf ("%.1v3hlf|%#v2hlx|%v2hhd\n", (float3)(1.5f, 2.0f, -0.25f),
+          (uint2)(0xab, 0xcd), (char2)(-1, 2));
+}
+
+)RAW";
+
+int main(void) {
+  const char *SinkPath = std::getenv("POCL_PRINTF_SINK");
+  if (SinkPath == nullptr || SinkPath[0] == '\0' ||
+      std::string(SinkPath).find(':') != std::string::npos ||
+      std::string(SinkPath) == "stdout" || std::string(SinkPath) == "stderr") {
+    std::cout << "POCL_PRINTF_SINK doesn't name a file, SKIP\n";
+    return 77;
+  }
+  /* The ring appends to the file. */
+  std::ofstream(SinkPath, std::ios::trunc).close();
+
+  const cl_int I = 42;
+  const cl_uint U = 3054;
+  const cl_float F = 2.375f;
+
+  /* Formatted by the host's printf, which the scalar conversions follow. */
+  std::vector<std::string> Expected;
+  char Line[256];
+  std::snprintf(Line, sizeof(Line), "%s|%8s|%-6s|%.3s|%c", "abc", "right",
+                "left", "truncated", 'x');
+  Expected.push_back(Line);
+  std::snprintf(Line, sizeof(Line), "%d|%6d|%-6d|%06d|%+d|% d", I, I, I, I,
+                -I, -I);
+  Expected.push_back(Line);
+  std::snprintf(Line, sizeof(Line), "%u|%x|%X|%#x|%#o|%.5u", U, U, U, U, U,
+                42u);
+  Expected.push_back(Line);
+  std::snprintf(Line, sizeof(Line), "%f|%.2f|%10.3f|%-12.1e|%+g|%E",
+                (double)F, (double)F, (double)-F, (double)(F * 1000.0f),
+                (double)F, (double)F);
+  Expected.push_back(Line);
+  std::snprintf(Line, sizeof(Line), "%%|100%%|%d%%|%%d", I);
+  Expected.push_back(Line);
+  /* The elements of a vector are separated by commas, each formatted with
+     the conversion's flags, width and precision. */
+  Expected.push_back("1,-2,3,-4|5,6");
+  Expected.push_back("    7,   -8|9   ,10  |");
+  Expected.push_back("1.5,2.0,-0.2|0xab,0xcd|-1,2");
+
+  try {
+    cl::Device Device = cl::Device::getDefault();
+    if (!Device.getInfo<CL_DEVICE_COMPILER_AVAILABLE>()) {
+      std::cout << "Device has no compiler, SKIP\n";
+      return 77;
+    }
+    cl::CommandQueue Queue = cl::CommandQueue::getDefault();
+    cl::Program Program(SOURCE);
+    Program.build();
+    cl::Kernel Kernel(Program, "formats");
+    Kernel.setArg(0, I);
+    Kernel.setArg(1, U);
+    Kernel.setArg(2, F);
+    Queue.enqueueNDRangeKernel(Kernel, cl::NullRange, cl::NDRange(1),
+                               cl::NDRange(1));
+    Queue.finish();
+  } catch (cl::Error &Err) {
+    std::cout << "FAIL with OpenCL error = " << Err.err() << " in "
+              << Err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::ifstream Sink(SinkPath);
+  std::vector<std::string> Lines;
+  std::string Text;
+  while (std::getline(Sink, Text))
+    Lines.push_back(Text);
+
+  unsigned Errors = 0;
+  if (Lines.size() != Expected.size()) {
+    std::cout << "got " << Lines.size() << " lines instead of "
+              << Expected.size() << "\n";
+    ++Errors;
+  }
+  for (size_t I = 0; I < Lines.size() && I < Expected.size(); ++I)
+    if (Lines[I] != Expected[I]) {
+      std::cout << "line " << I << " is '" << Lines[I] << "' instead of '"
+                << Expected[I] << "'\n";
+      ++Errors;
+    }
+
+  if (Errors) {
+    std::cout << "FAIL: " << Errors << " errors\n";
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "OK" << std::endl;
+  return EXIT_SUCCESS;
+}
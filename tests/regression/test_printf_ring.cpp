@@ -0,0 +1,162 @@
+/* Tests the printf ring of the pthread device (ENABLE_PRINTF_IMMEDIATE_FLUSH
+   =OFF) with a ring much smaller than the output, so that the producers wrap
+   around it many times. The output of each work-group must reach the sink in
+   one piece and in work-item order, the output of a launch must reach it
+   before the launch completes, and the output of a work-group that doesn't
+   fit in half of the ring must still come out whole.
+
+   The test reads the output back from the file POCL_PRINTF_SINK names.
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+// Enable OpenCL C++ exceptions
+#define CL_HPP_ENABLE_EXCEPTIONS
+#include <CL/opencl.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "pocl_opencl.h"
+
+#define NUM_GROUPS 256
+#define LOCAL_SIZE 16
+/* One work-group whose output is larger than half of a 4 KiB ring. */
+#define BIG_LOCAL_SIZE 256
+
+static const char *SOURCE = R"RAW(
+
+kernel void lines (uint launch)
+{
+  printf ("L%u G%u I%u\n", launch, (uint)get_group_id (0),
+          (uint)get_local_id (0));
+}
+
+)RAW";
+
+struct Line {
+  unsigned Launch, Group, Item;
+};
+
+/* Reads the lines the sink has received since the last call. */
+static std::vector<Line> readNewLines(std::ifstream &Sink) {
+  std::vector<Line> Lines;
+  Sink.clear();
+  std::string Text;
+  while (std::getline(Sink, Text)) {
+    Line L;
+    if (std::sscanf(Text.c_str(), "L%u G%u I%u", &L.Launch, &L.Group,
+                    &L.Item) != 3)
+      L.Launch = L.Group = L.Item = ~0u;
+    Lines.push_back(L);
+  }
+  return Lines;
+}
+
+/* Checks that LINES hold the output of launch LAUNCH of NUM_GROUPS groups of
+   LOCAL_SIZE work-items, each group in one piece and in work-item order. */
+static unsigned checkLaunch(const std::vector<Line> &Lines, unsigned Launch,
+                            unsigned NumGroups, unsigned LocalSize) {
+  if (Lines.size() != NumGroups * LocalSize) {
+    std::cout << "launch " << Launch << ": got " << Lines.size()
+              << " lines instead of " << NumGroups * LocalSize << "\n";
+    return 1;
+  }
+  std::vector<bool> Seen(NumGroups, false);
+  for (size_t I = 0; I < Lines.size(); I += LocalSize) {
+    unsigned Group = Lines[I].Group;
+    if (Group >= NumGroups || Seen[Group]) {
+      std::cout << "launch " << Launch << ": unexpected group at line " << I
+                << "\n";
+      return 1;
+    }
+    Seen[Group] = true;
+    for (unsigned J = 0; J < LocalSize; ++J) {
+      const Line &L = Lines[I + J];
+      if (L.Launch != Launch || L.Group != Group || L.Item != J) {
+        std::cout << "launch " << Launch << ": line " << I + J
+                  << " isn't item " << J << " of group " << Group << "\n";
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+int main(void) {
+  const char *SinkPath = std::getenv("POCL_PRINTF_SINK");
+  if (SinkPath == nullptr || SinkPath[0] == '\0' ||
+      std::string(SinkPath).find(':') != std::string::npos ||
+      std::string(SinkPath) == "stdout" || std::string(SinkPath) == "stderr") {
+    std::cout << "POCL_PRINTF_SINK doesn't name a file, SKIP\n";
+    return 77;
+  }
+  /* The ring appends to the file. */
+  std::ofstream(SinkPath, std::ios::trunc).close();
+
+  try {
+    cl::Device Device = cl::Device::getDefault();
+    if (!Device.getInfo<CL_DEVICE_COMPILER_AVAILABLE>()) {
+      std::cout << "Device has no compiler, SKIP\n";
+      return 77;
+    }
+    cl::CommandQueue Queue = cl::CommandQueue::getDefault();
+    cl::Program Program(SOURCE);
+    Program.build();
+    cl::Kernel Kernel(Program, "lines");
+
+    std::ifstream Sink(SinkPath);
+    unsigned Errors = 0;
+
+    for (cl_uint Launch = 0; Launch < 2; ++Launch) {
+      Kernel.setArg(0, Launch);
+      Queue.enqueueNDRangeKernel(Kernel, cl::NullRange,
+                                 cl::NDRange(NUM_GROUPS * LOCAL_SIZE),
+                                 cl::NDRange(LOCAL_SIZE));
+      Queue.finish();
+      Errors += checkLaunch(readNewLines(Sink), Launch, NUM_GROUPS,
+                            LOCAL_SIZE);
+    }
+
+    Kernel.setArg(0, (cl_uint)2);
+    Queue.enqueueNDRangeKernel(Kernel, cl::NullRange,
+                               cl::NDRange(BIG_LOCAL_SIZE),
+                               cl::NDRange(BIG_LOCAL_SIZE));
+    Queue.finish();
+    Errors += checkLaunch(readNewLines(Sink), 2, 1, BIG_LOCAL_SIZE);
+
+    if (Errors) {
+      std::cout << "FAIL: " << Errors << " errors\n";
+      return EXIT_FAILURE;
+    }
+  } catch (cl::Error &Err) {
+    std::cout << "FAIL with OpenCL error = " << Err.err() << " in "
+              << Err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "OK" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+/* Tests repeated writes of a buffer that change only a few bytes, or none,
+   in between commands that change the buffer on the device. With the remote
+   driver and POCL_REMOTE_DIRTY_BLOCK_SIZE set, only the changed blocks are
+   sent, so a write must not be skipped after the device copy has changed.
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+// Enable OpenCL C++ exceptions
+#define CL_HPP_ENABLE_EXCEPTIONS
+#include <CL/opencl.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "pocl_opencl.h"
+
+/* Spans many blocks of any reasonable size, and isn't a multiple of one. */
+#define NUM_ELEMS (64 * 1024 + 13)
+
+static const char *SOURCE = R"RAW(
+
+kernel void increment (global uint *data)
+{
+  data[get_global_id (0)] += 1;
+}
+
+)RAW";
+
+static unsigned Errors = 0;
+
+/* Reads back the whole buffer and compares it with EXPECTED. */
+static void check(cl::CommandQueue &Queue, cl::Buffer &Buffer,
+                  const std::vector<cl_uint> &Expected, const char *Step) {
+  std::vector<cl_uint> Data(Expected.size());
+  Queue.enqueueReadBuffer(Buffer, CL_TRUE, 0, Data.size() * sizeof(cl_uint),
+                          Data.data());
+  for (size_t I = 0; I < Data.size(); ++I)
+    if (Data[I] != Expected[I]) {
+      std::cout << Step << ": element " << I << " is " << Data[I]
+                << " instead of " << Expected[I] << "\n";
+      ++Errors;
+      return;
+    }
+}
+
+static void write(cl::CommandQueue &Queue, cl::Buffer &Buffer,
+                  const std::vector<cl_uint> &Data) {
+  Queue.enqueueWriteBuffer(Buffer, CL_TRUE, 0, Data.size() * sizeof(cl_uint),
+                           Data.data());
+}
+
+int main(void) {
+  try {
+    cl::Context Context = cl::Context::getDefault();
+    cl::Device Device = cl::Device::getDefault();
+    cl::CommandQueue Queue = cl::CommandQueue::getDefault();
+
+    const size_t Size = NUM_ELEMS * sizeof(cl_uint);
+    std::vector<cl_uint> Host(NUM_ELEMS);
+    for (size_t I = 0; I < NUM_ELEMS; ++I)
+      Host[I] = (cl_uint)(I * 2654435761u);
+    cl::Buffer Buffer(Context, CL_MEM_READ_WRITE, Size);
+    cl::Buffer Other(Context, CL_MEM_READ_WRITE, Size);
+
+    write(Queue, Buffer, Host);
+    check(Queue, Buffer, Host, "first write");
+
+    /* A few changes far apart, then no changes at all. */
+    Host[0] ^= 1;
+    Host[NUM_ELEMS / 3] ^= 1;
+    Host[NUM_ELEMS - 1] ^= 1;
+    write(Queue, Buffer, Host);
+    check(Queue, Buffer, Host, "sparse changes");
+    write(Queue, Buffer, Host);
+    check(Queue, Buffer, Host, "unchanged write");
+
+    /* A partial write that doesn't start or end at a block boundary. */
+    for (size_t I = 1000; I < 1000 + 5000; I += 700)
+      Host[I] += 3;
+    Queue.enqueueWriteBuffer(Buffer, CL_TRUE, 1000 * sizeof(cl_uint),
+                             5000 * sizeof(cl_uint), &Host[1000]);
+    check(Queue, Buffer, Host, "unaligned partial write");
+
+    /* Commands that change the device copy behind the written contents. The
+       following writes of the same contents must restore them. */
+    cl_uint Pattern = 0xdeadbeef;
+    Queue.enqueueFillBuffer(Buffer, Pattern, 0,
+                            NUM_ELEMS / 2 * sizeof(cl_uint));
+    write(Queue, Buffer, Host);
+    check(Queue, Buffer, Host, "write after a fill");
+
+    std::vector<cl_uint> Zeros(NUM_ELEMS, 0);
+    write(Queue, Other, Zeros);
+    Queue.enqueueCopyBuffer(Other, Buffer, 0, Size / 4, Size / 2);
+    write(Queue, Buffer, Host);
+    check(Queue, Buffer, Host, "write after a copy");
+
+    cl_uint *Map = (cl_uint *)Queue.enqueueMapBuffer(Buffer, CL_TRUE,
+                                                     CL_MAP_WRITE, 0, Size);
+    for (size_t I = 0; I < NUM_ELEMS; I += 4096)
+      Map[I] = 0;
+    Queue.enqueueUnmapMemObject(Buffer, Map);
+    write(Queue, Buffer, Host);
+    check(Queue, Buffer, Host, "write after a mapped write");
+
+    /* Read, change one element and write back. */
+    std::vector<cl_uint> Copy(NUM_ELEMS);
+    Queue.enqueueReadBuffer(Buffer, CL_TRUE, 0, Size, Copy.data());
+    Copy[NUM_ELEMS / 2] += 1;
+    write(Queue, Buffer, Copy);
+    check(Queue, Buffer, Copy, "read-modify-write");
+    write(Queue, Buffer, Host);
+    check(Queue, Buffer, Host, "write of the older contents");
+
+    if (Device.getInfo<CL_DEVICE_COMPILER_AVAILABLE>()) {
+      cl::Program Program(Context, SOURCE);
+      Program.build();
+      cl::Kernel Kernel(Program, "increment");
+      Kernel.setArg(0, Buffer);
+      Queue.enqueueNDRangeKernel(Kernel, cl::NullRange,
+                                 cl::NDRange(NUM_ELEMS));
+      std::vector<cl_uint> Incremented(Host);
+      for (cl_uint &E : Incremented)
+        ++E;
+      check(Queue, Buffer, Incremented, "kernel");
+      write(Queue, Buffer, Host);
+      check(Queue, Buffer, Host, "write after a kernel");
+    }
+
+    if (Errors) {
+      std::cout << "FAIL: " << Errors << " errors\n";
+      return EXIT_FAILURE;
+    }
+  } catch (cl::Error &Err) {
+    std::cout << "FAIL with OpenCL error = " << Err.err() << " in "
+              << Err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "OK" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+/* Tests that the sub-group sizes and counts seen by a kernel match what
+   clGetKernelSubGroupInfo reports, and that the sub-group reductions and
+   scans work on the sub-groups the kernel sees. Run also with
+   POCL_CPU_SIMD_SUB_GROUPS=1.
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+// Enable OpenCL C++ exceptions
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_TARGET_OPENCL_VERSION 300
+#define CL_HPP_MINIMUM_OPENCL_VERSION 300
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "pocl_opencl.h"
+
+static const char *SOURCE = R"RAW(
+
+kernel void sub_groups (global uint *info, global int *res)
+{
+  size_t i = get_global_id (1) * get_global_size (0) + get_global_id (0);
+  int x = (int)(i * 7 % 31) - 15;
+
+  info[i * 4 + 0] = get_sub_group_size ();
+  info[i * 4 + 1] = get_num_sub_groups ();
+  info[i * 4 + 2] = get_sub_group_id ();
+  info[i * 4 + 3] = get_sub_group_local_id ();
+
+  res[i * 4 + 0] = x;
+  res[i * 4 + 1] = sub_group_reduce_add (x);
+  res[i * 4 + 2] = sub_group_scan_inclusive_add (x);
+  res[i * 4 + 3] = sub_group_scan_exclusive_max (x);
+}
+
+)RAW";
+
+struct Config {
+  size_t Global[2];
+  size_t Local[2];
+};
+
+int main(void) {
+  const Config Configs[] = {
+      {{128, 1}, {64, 1}}, {{96, 2}, {24, 2}}, {{14, 3}, {7, 3}},
+      {{32, 8}, {16, 4}},  {{8, 8}, {4, 2}},
+  };
+
+  try {
+    cl::Device Device = cl::Device::getDefault();
+
+    bool HasSubGroups = false;
+    if (Device.getInfo<CL_DEVICE_VERSION>().find("OpenCL 3.0") == 0 &&
+        Device.getInfo<CL_DEVICE_MAX_NUM_SUB_GROUPS>() > 0) {
+      for (auto &Item : Device.getInfo<CL_DEVICE_OPENCL_C_FEATURES>())
+        if (std::string("__opencl_c_subgroups") == Item.name)
+          HasSubGroups = true;
+    }
+    if (!HasSubGroups) {
+      std::cout << "Device doesn't support sub-groups, SKIP\n";
+      return 77;
+    }
+
+    cl::CommandQueue Queue = cl::CommandQueue::getDefault();
+    cl::Program Program(SOURCE);
+    Program.build("-cl-std=CL3.0");
+    cl::Kernel Kernel(Program, "sub_groups");
+
+    unsigned Errors = 0;
+    for (const Config &C : Configs) {
+      size_t N = C.Global[0] * C.Global[1];
+      size_t MaxSize = 0, Count = 0;
+      cl_int Err = clGetKernelSubGroupInfo(
+          Kernel(), Device(), CL_KERNEL_MAX_SUB_GROUP_SIZE_FOR_NDRANGE,
+          sizeof(C.Local), C.Local, sizeof(MaxSize), &MaxSize, nullptr);
+      Err |= clGetKernelSubGroupInfo(
+          Kernel(), Device(), CL_KERNEL_SUB_GROUP_COUNT_FOR_NDRANGE,
+          sizeof(C.Local), C.Local, sizeof(Count), &Count, nullptr);
+      if (Err != CL_SUCCESS) {
+        std::cout << "FAIL: clGetKernelSubGroupInfo failed\n";
+        return EXIT_FAILURE;
+      }
+
+      std::vector<cl_uint> Info(N * 4);
+      std::vector<cl_int> Res(N * 4);
+      cl::Buffer InfoBuffer(CL_MEM_WRITE_ONLY, Info.size() * sizeof(cl_uint));
+      cl::Buffer ResBuffer(CL_MEM_WRITE_ONLY, Res.size() * sizeof(cl_int));
+      Kernel.setArg(0, InfoBuffer);
+      Kernel.setArg(1, ResBuffer);
+      Queue.enqueueNDRangeKernel(Kernel, cl::NullRange,
+                                 cl::NDRange(C.Global[0], C.Global[1]),
+                                 cl::NDRange(C.Local[0], C.Local[1]));
+      Queue.enqueueReadBuffer(InfoBuffer, CL_FALSE, 0,
+                              Info.size() * sizeof(cl_uint), Info.data());
+      Queue.enqueueReadBuffer(ResBuffer, CL_TRUE, 0,
+                              Res.size() * sizeof(cl_int), Res.data());
+
+      /* The members of each sub-group in sub-group local id order, keyed by
+         the work-group and the sub-group id. */
+      std::map<std::pair<size_t, cl_uint>, std::map<cl_uint, size_t>> SubGroups;
+      for (size_t I = 0; I < N; ++I) {
+        size_t X = I % C.Global[0], Y = I / C.Global[0];
+        size_t Group = (Y / C.Local[1]) * (C.Global[0] / C.Local[0]) +
+                       X / C.Local[0];
+        size_t LocalLinearId =
+            (Y % C.Local[1]) * C.Local[0] + X % C.Local[0];
+        cl_uint Size = Info[I * 4 + 0];
+        if (Size != MaxSize || Info[I * 4 + 1] != Count ||
+            Info[I * 4 + 2] != LocalLinearId / Size ||
+            Info[I * 4 + 3] != LocalLinearId % Size) {
+          if (Errors++ < 10)
+            std::cout << "Work-item " << I << " of local size " << C.Local[0]
+                      << "x" << C.Local[1] << " has sub-group size " << Size
+                      << " (reported " << MaxSize << "), count "
+                      << Info[I * 4 + 1] << " (reported " << Count << ")\n";
+          continue;
+        }
+        SubGroups[{Group, Info[I * 4 + 2]}][Info[I * 4 + 3]] = I;
+      }
+
+      for (auto &SG : SubGroups) {
+        int Sum = 0, Prefix = 0, PrefixMax = INT32_MIN;
+        for (auto &Member : SG.second)
+          Sum += Res[Member.second * 4];
+        for (auto &Member : SG.second) {
+          const cl_int *R = &Res[Member.second * 4];
+          int ExclusiveMax = PrefixMax;
+          Prefix += R[0];
+          PrefixMax = std::max(PrefixMax, R[0]);
+          if (R[1] != Sum || R[2] != Prefix || R[3] != ExclusiveMax) {
+            if (Errors++ < 10)
+              std::cout << "Wrong sub-group results for work-item "
+                        << Member.second << " of local size " << C.Local[0]
+                        << "x" << C.Local[1] << "\n";
+          }
+        }
+      }
+    }
+
+    /* A local size asked for a sub-group count must have that many. */
+    for (size_t Wish = 0; Wish <= 4; ++Wish) {
+      size_t Local[3] = {1, 1, 1}, Count = 0;
+      cl_int Err = clGetKernelSubGroupInfo(
+          Kernel(), Device(), CL_KERNEL_LOCAL_SIZE_FOR_SUB_GROUP_COUNT,
+          sizeof(Wish), &Wish, sizeof(Local), Local, nullptr);
+      if (Err != CL_SUCCESS) {
+        std::cout << "FAIL: no local size for " << Wish << " sub-groups\n";
+        return EXIT_FAILURE;
+      }
+      if (Local[0] * Local[1] * Local[2] == 0) {
+        if (Wish != 0 &&
+            Wish <= Device.getInfo<CL_DEVICE_MAX_NUM_SUB_GROUPS>()) {
+          std::cout << "FAIL: zero local size for " << Wish
+                    << " sub-groups\n";
+          return EXIT_FAILURE;
+        }
+        continue;
+      }
+      Err = clGetKernelSubGroupInfo(
+          Kernel(), Device(), CL_KERNEL_SUB_GROUP_COUNT_FOR_NDRANGE,
+          sizeof(Local), Local, sizeof(Count), &Count, nullptr);
+      if (Err != CL_SUCCESS || Count != Wish) {
+        if (Errors++ < 10)
+          std::cout << "Local size " << Local[0] << "x" << Local[1] << "x"
+                    << Local[2] << " has " << Count << " sub-groups instead of "
+                    << Wish << "\n";
+      }
+    }
+
+    if (Errors) {
+      std::cout << "FAIL: " << Errors << " errors\n";
+      return EXIT_FAILURE;
+    }
+  } catch (cl::Error &Err) {
+    std::cout << "FAIL with OpenCL error = " << Err.err() << " in "
+              << Err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "OK" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,246 @@
+/* Tests atomic updates that every work-item applies to the same address,
+   which the work-item loops combine into one update per work-group, next to
+   updates that must not be combined.
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+// Enable OpenCL C++ exceptions
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_TARGET_OPENCL_VERSION 300
+#define CL_HPP_MINIMUM_OPENCL_VERSION 300
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "pocl_opencl.h"
+
+#define GLOBAL_SIZE 1024
+#define LOCAL_SIZE 64
+#define NUM_BINS 16
+
+static const char *SOURCE = R"RAW(
+
+kernel void uniform (global uint *counters, global uint *bins,
+                     global uint *old)
+{
+  size_t gid = get_global_id (0);
+
+  atomic_inc (&counters[0]);
+  atomic_add (&counters[1], 3);
+  atomic_sub (&counters[2], 2);
+  atomic_or (&counters[3], 1u << (get_group_id (0) & 31));
+  atomic_max (&counters[4], (uint)gid);
+  atomic_min (&counters[5], (uint)gid + 5);
+  atomic_xor (&counters[6], 1u << (gid & 31));
+  atomic_and (&counters[7], ~(1u << (gid & 31)));
+
+  /* The address depends on the work-item. */
+  atomic_inc (&bins[gid % 16]);
+
+  /* The result is used. */
+  old[gid] = atomic_inc (&counters[8]);
+}
+
+kernel void visible_after_barrier (global uint *counter, global uint *seen)
+{
+  local uint local_counter;
+  if (get_local_id (0) == 0)
+    local_counter = 0;
+  barrier (CLK_LOCAL_MEM_FENCE);
+
+  atomic_inc (&local_counter);
+  atomic_inc (counter);
+  barrier (CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+
+  seen[get_global_id (0) * 2] = local_counter;
+  seen[get_global_id (0) * 2 + 1] = atomic_add (counter, 0);
+}
+
+)RAW";
+
+static const char *SOURCE_30 = R"RAW(
+
+kernel void mixed_orders (global atomic_uint *counters)
+{
+  atomic_fetch_add_explicit (&counters[0], 1, memory_order_relaxed,
+                             memory_scope_device);
+  atomic_fetch_add_explicit (&counters[0], 2, memory_order_acq_rel,
+                             memory_scope_device);
+  atomic_fetch_add_explicit (&counters[0], 4, memory_order_release,
+                             memory_scope_work_group);
+  atomic_fetch_sub_explicit (&counters[1], 1, memory_order_relaxed,
+                             memory_scope_device);
+  atomic_fetch_add_explicit (&counters[1], 3, memory_order_relaxed,
+                             memory_scope_device);
+  atomic_fetch_or_explicit (&counters[2], 1u << (get_local_id (0) & 31),
+                            memory_order_relaxed, memory_scope_device);
+  atomic_fetch_max_explicit (&counters[2], 1u << 31, memory_order_acq_rel,
+                             memory_scope_device);
+  /* Changes nothing, but still has to be applied for its ordering. */
+  atomic_fetch_add_explicit (&counters[3], 0, memory_order_release,
+                             memory_scope_device);
+}
+
+)RAW";
+
+int main(void) {
+  try {
+    cl::Device Device = cl::Device::getDefault();
+    cl::CommandQueue Queue = cl::CommandQueue::getDefault();
+    cl::Program Program(SOURCE);
+    Program.build();
+
+    unsigned Errors = 0;
+
+    {
+      cl::Kernel Kernel(Program, "uniform");
+      std::vector<cl_uint> Counters = {
+          0, 0, 2 * GLOBAL_SIZE, 0, 0, 0xffffffffu, 0x12345678, 0xffffffffu, 0};
+      std::vector<cl_uint> Bins(NUM_BINS, 0), Old(GLOBAL_SIZE);
+      cl::Buffer CounterBuffer(CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                               Counters.size() * sizeof(cl_uint),
+                               Counters.data());
+      cl::Buffer BinBuffer(CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                           Bins.size() * sizeof(cl_uint), Bins.data());
+      cl::Buffer OldBuffer(CL_MEM_WRITE_ONLY, Old.size() * sizeof(cl_uint));
+      Kernel.setArg(0, CounterBuffer);
+      Kernel.setArg(1, BinBuffer);
+      Kernel.setArg(2, OldBuffer);
+      Queue.enqueueNDRangeKernel(Kernel, cl::NullRange,
+                                 cl::NDRange(GLOBAL_SIZE),
+                                 cl::NDRange(LOCAL_SIZE));
+      Queue.enqueueReadBuffer(CounterBuffer, CL_FALSE, 0,
+                              Counters.size() * sizeof(cl_uint),
+                              Counters.data());
+      Queue.enqueueReadBuffer(BinBuffer, CL_FALSE, 0,
+                              Bins.size() * sizeof(cl_uint), Bins.data());
+      Queue.enqueueReadBuffer(OldBuffer, CL_TRUE, 0,
+                              Old.size() * sizeof(cl_uint), Old.data());
+
+      /* Each bit is flipped GLOBAL_SIZE / 32 times, an even number. */
+      const cl_uint Expected[] = {GLOBAL_SIZE,
+                                  3 * GLOBAL_SIZE,
+                                  0,
+                                  (1u << (GLOBAL_SIZE / LOCAL_SIZE)) - 1,
+                                  GLOBAL_SIZE - 1,
+                                  5,
+                                  0x12345678,
+                                  0,
+                                  GLOBAL_SIZE};
+      for (size_t I = 0; I < Counters.size(); ++I)
+        if (Counters[I] != Expected[I]) {
+          std::cout << "counters[" << I << "] is " << Counters[I]
+                    << " instead of " << Expected[I] << "\n";
+          ++Errors;
+        }
+      for (size_t I = 0; I < NUM_BINS; ++I)
+        if (Bins[I] != GLOBAL_SIZE / NUM_BINS) {
+          std::cout << "bins[" << I << "] is " << Bins[I] << "\n";
+          ++Errors;
+        }
+      std::sort(Old.begin(), Old.end());
+      for (size_t I = 0; I < GLOBAL_SIZE; ++I)
+        if (Old[I] != I) {
+          std::cout << "The old values of counters[8] aren't unique\n";
+          ++Errors;
+          break;
+        }
+    }
+
+    {
+      /* A single work-group, so the barrier orders all updates before the
+         reads. */
+      cl::Kernel Kernel(Program, "visible_after_barrier");
+      cl_uint Zero = 0;
+      std::vector<cl_uint> Seen(LOCAL_SIZE * 2);
+      cl::Buffer CounterBuffer(CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                               sizeof(cl_uint), &Zero);
+      cl::Buffer SeenBuffer(CL_MEM_WRITE_ONLY, Seen.size() * sizeof(cl_uint));
+      Kernel.setArg(0, CounterBuffer);
+      Kernel.setArg(1, SeenBuffer);
+      Queue.enqueueNDRangeKernel(Kernel, cl::NullRange,
+                                 cl::NDRange(LOCAL_SIZE),
+                                 cl::NDRange(LOCAL_SIZE));
+      Queue.enqueueReadBuffer(SeenBuffer, CL_TRUE, 0,
+                              Seen.size() * sizeof(cl_uint), Seen.data());
+      for (size_t I = 0; I < Seen.size(); ++I)
+        if (Seen[I] != LOCAL_SIZE) {
+          std::cout << "Work-item " << I / 2 << " saw "
+                    << (I % 2 ? "global" : "local") << " count " << Seen[I]
+                    << " after the barrier\n";
+          ++Errors;
+          break;
+        }
+    }
+
+    bool HasAcqRel = false, HasDeviceScope = false;
+    if (Device.getInfo<CL_DEVICE_VERSION>().find("OpenCL 3.0") == 0) {
+      for (auto &Item : Device.getInfo<CL_DEVICE_OPENCL_C_FEATURES>()) {
+        if (std::string("__opencl_c_atomic_order_acq_rel") == Item.name)
+          HasAcqRel = true;
+        if (std::string("__opencl_c_atomic_scope_device") == Item.name)
+          HasDeviceScope = true;
+      }
+    }
+    if (HasAcqRel && HasDeviceScope) {
+      cl::Program Program30(SOURCE_30);
+      Program30.build("-cl-std=CL3.0");
+      cl::Kernel Kernel(Program30, "mixed_orders");
+      std::vector<cl_uint> Counters = {0, 0, 0, 0};
+      cl::Buffer CounterBuffer(CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                               Counters.size() * sizeof(cl_uint),
+                               Counters.data());
+      Kernel.setArg(0, CounterBuffer);
+      Queue.enqueueNDRangeKernel(Kernel, cl::NullRange,
+                                 cl::NDRange(GLOBAL_SIZE),
+                                 cl::NDRange(LOCAL_SIZE));
+      Queue.enqueueReadBuffer(CounterBuffer, CL_TRUE, 0,
+                              Counters.size() * sizeof(cl_uint),
+                              Counters.data());
+      const cl_uint Expected[] = {7 * GLOBAL_SIZE, 2 * GLOBAL_SIZE,
+                                  0xffffffffu, 0};
+      for (size_t I = 0; I < Counters.size(); ++I)
+        if (Counters[I] != Expected[I]) {
+          std::cout << "mixed order counters[" << I << "] is " << Counters[I]
+                    << " instead of " << Expected[I] << "\n";
+          ++Errors;
+        }
+    }
+
+    if (Errors) {
+      std::cout << "FAIL: " << Errors << " errors\n";
+      return EXIT_FAILURE;
+    }
+  } catch (cl::Error &Err) {
+    std::cout << "FAIL with OpenCL error = " << Err.err() << " in "
+              << Err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "OK" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+/* Tests work_group_reduce_* and work_group_scan_* with local sizes that are
+   and aren't multiples of the vector width the folds are expanded to.
+
+   Copyright (c) 2024 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+// Enable OpenCL C++ exceptions
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_TARGET_OPENCL_VERSION 300
+#define CL_HPP_MINIMUM_OPENCL_VERSION 300
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "pocl_opencl.h"
+
+#define NUM_INT_RESULTS 8
+#define NUM_LONG_RESULTS 2
+#define NUM_FLOAT_RESULTS 2
+
+static const char *SOURCE = R"RAW(
+
+kernel void collectives (global const int *in, global int *ires,
+                         global long *lres, global float *fres)
+{
+  size_t i = get_global_id (1) * get_global_size (0) + get_global_id (0);
+  int x = in[i];
+
+  ires[i * 8 + 0] = work_group_reduce_add (x);
+  ires[i * 8 + 1] = work_group_reduce_min (x);
+  ires[i * 8 + 2] = work_group_reduce_max (x);
+  ires[i * 8 + 3] = as_int (work_group_reduce_max (as_uint (x)));
+  ires[i * 8 + 4] = work_group_scan_inclusive_add (x);
+  ires[i * 8 + 5] = work_group_scan_exclusive_add (x);
+  ires[i * 8 + 6] = work_group_scan_inclusive_max (x);
+  ires[i * 8 + 7] = work_group_scan_exclusive_min (x);
+
+  lres[i * 2 + 0] = work_group_reduce_add ((long)x * 100000000L);
+  lres[i * 2 + 1] = work_group_scan_inclusive_add ((long)x * 100000000L);
+
+  /* Small integers, so that the sums are exact in any order. */
+  fres[i * 2 + 0] = work_group_reduce_add ((float)x);
+  fres[i * 2 + 1] = work_group_scan_exclusive_add ((float)x);
+}
+
+)RAW";
+
+struct Config {
+  size_t Global[2];
+  size_t Local[2];
+};
+
+/* Computes the expected results of one work-group, whose work-items' global
+   indices are given in local linear id order. */
+static void expected(const std::vector<int> &In,
+                     const std::vector<size_t> &Group, std::vector<int> &IRes,
+                     std::vector<long long> &LRes, std::vector<float> &FRes) {
+  int Sum = 0, Min = INT_MAX, Max = INT_MIN;
+  unsigned UMax = 0;
+  long long LSum = 0;
+  for (size_t G : Group) {
+    Sum += In[G];
+    Min = std::min(Min, In[G]);
+    Max = std::max(Max, In[G]);
+    UMax = std::max(UMax, (unsigned)In[G]);
+    LSum += In[G] * 100000000LL;
+  }
+
+  int Prefix = 0, PrefixMax = INT_MIN, PrefixMin = INT_MAX;
+  long long LPrefix = 0;
+  for (size_t G : Group) {
+    IRes[G * 8 + 0] = Sum;
+    IRes[G * 8 + 1] = Min;
+    IRes[G * 8 + 2] = Max;
+    IRes[G * 8 + 3] = (int)UMax;
+    IRes[G * 8 + 5] = Prefix;
+    IRes[G * 8 + 7] = PrefixMin;
+    FRes[G * 2 + 0] = (float)Sum;
+    FRes[G * 2 + 1] = (float)Prefix;
+
+    Prefix += In[G];
+    PrefixMax = std::max(PrefixMax, In[G]);
+    PrefixMin = std::min(PrefixMin, In[G]);
+    LPrefix += In[G] * 100000000LL;
+
+    IRes[G * 8 + 4] = Prefix;
+    IRes[G * 8 + 6] = PrefixMax;
+    LRes[G * 2 + 0] = LSum;
+    LRes[G * 2 + 1] = LPrefix;
+  }
+}
+
+int main(void) {
+  std::random_device RandomDevice;
+  std::mt19937 Mersenne{RandomDevice()};
+  std::uniform_int_distribution<int> UniDist{-1000, 1000};
+
+  const Config Configs[] = {
+      {{256, 1}, {64, 1}}, {{96, 1}, {24, 1}}, {{21, 1}, {7, 1}},
+      {{65, 1}, {13, 1}},  {{16, 8}, {8, 4}},  {{12, 6}, {3, 3}},
+  };
+
+  try {
+    cl::Device Device = cl::Device::getDefault();
+
+    bool HasCollectives = false;
+    if (Device.getInfo<CL_DEVICE_VERSION>().find("OpenCL 3.0") == 0) {
+      for (auto &Item : Device.getInfo<CL_DEVICE_OPENCL_C_FEATURES>())
+        if (std::string("__opencl_c_work_group_collective_functions") ==
+            Item.name)
+          HasCollectives = true;
+    }
+    if (!HasCollectives) {
+      std::cout << "Device doesn't support work-group collectives, SKIP\n";
+      return 77;
+    }
+
+    cl::CommandQueue Queue = cl::CommandQueue::getDefault();
+    cl::Program Program(SOURCE);
+    Program.build("-cl-std=CL3.0");
+    auto Kernel =
+        cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer>(
+            Program, "collectives");
+
+    unsigned Errors = 0;
+    for (const Config &C : Configs) {
+      size_t N = C.Global[0] * C.Global[1];
+      std::vector<int> In(N);
+      for (int &X : In)
+        X = UniDist(Mersenne);
+
+      std::vector<int> IRes(N * NUM_INT_RESULTS), IExp(IRes.size());
+      std::vector<long long> LRes(N * NUM_LONG_RESULTS), LExp(LRes.size());
+      std::vector<float> FRes(N * NUM_FLOAT_RESULTS), FExp(FRes.size());
+
+      cl::Buffer InBuffer(In.begin(), In.end(), true);
+      cl::Buffer IBuffer(CL_MEM_WRITE_ONLY, IRes.size() * sizeof(int));
+      cl::Buffer LBuffer(CL_MEM_WRITE_ONLY, LRes.size() * sizeof(long long));
+      cl::Buffer FBuffer(CL_MEM_WRITE_ONLY, FRes.size() * sizeof(float));
+
+      Kernel(cl::EnqueueArgs(Queue, cl::NDRange(C.Global[0], C.Global[1]),
+                             cl::NDRange(C.Local[0], C.Local[1])),
+             InBuffer, IBuffer, LBuffer, FBuffer);
+
+      Queue.enqueueReadBuffer(IBuffer, CL_FALSE, 0, IRes.size() * sizeof(int),
+                              IRes.data());
+      Queue.enqueueReadBuffer(LBuffer, CL_FALSE, 0,
+                              LRes.size() * sizeof(long long), LRes.data());
+      Queue.enqueueReadBuffer(FBuffer, CL_TRUE, 0,
+                              FRes.size() * sizeof(float), FRes.data());
+
+      for (size_t GY = 0; GY < C.Global[1]; GY += C.Local[1])
+        for (size_t GX = 0; GX < C.Global[0]; GX += C.Local[0]) {
+          std::vector<size_t> Group;
+          for (size_t LY = 0; LY < C.Local[1]; ++LY)
+            for (size_t LX = 0; LX < C.Local[0]; ++LX)
+              Group.push_back((GY + LY) * C.Global[0] + GX + LX);
+          expected(In, Group, IExp, LExp, FExp);
+        }
+
+      for (size_t I = 0; I < N; ++I) {
+        bool Ok = std::equal(IRes.begin() + I * 8, IRes.begin() + I * 8 + 8,
+                             IExp.begin() + I * 8) &&
+                  LRes[I * 2] == LExp[I * 2] &&
+                  LRes[I * 2 + 1] == LExp[I * 2 + 1] &&
+                  FRes[I * 2] == FExp[I * 2] &&
+                  FRes[I * 2 + 1] == FExp[I * 2 + 1];
+        if (!Ok && Errors++ < 10)
+          std::cout << "Wrong results for work-item " << I << " with local size "
+                    << C.Local[0] << "x" << C.Local[1] << "\n";
+      }
+    }
+
+    if (Errors) {
+      std::cout << "FAIL: " << Errors << " wrong results\n";
+      return EXIT_FAILURE;
+    }
+  } catch (cl::Error &Err) {
+    std::cout << "FAIL with OpenCL error = " << Err.err() << " in "
+              << Err.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "OK" << std::endl;
+  return EXIT_SUCCESS;
+}